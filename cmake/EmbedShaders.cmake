@@ -0,0 +1,74 @@
+# Writes a C++ header that embeds shader blobs as constexpr byte arrays.
+#
+# Run in script mode:
+#   cmake -DOUTPUT=<header> -DINPUTS=<file|file|...> -P EmbedShaders.cmake
+#
+# INPUTS is '|'-separated so it survives being passed through a custom
+# command. Blobs are emitted sorted by file name.
+#
+# Each input becomes `inline constexpr std::array<std::byte, N> k<Name>`,
+# where <Name> is its file name with every character that is not a letter
+# or digit replaced by '_'. The arrays are 16-byte aligned, as D3D12 reads
+# containers a dword at a time. kEmbeddedShaders lists them all with their
+# file names and SHA-256 digests for FindEmbeddedShader().
+
+if(NOT OUTPUT)
+    message(FATAL_ERROR "EmbedShaders.cmake: OUTPUT is required")
+endif()
+
+string(REPLACE "|" ";" INPUTS "${INPUTS}")
+set(SORTED "")
+foreach(INPUT IN LISTS INPUTS)
+    get_filename_component(NAME "${INPUT}" NAME)
+    list(APPEND SORTED "${NAME}|${INPUT}")
+endforeach()
+list(SORT SORTED)
+
+# One line of generated source per 8 bytes (16 hex digits).
+set(LINE_PATTERN "")
+foreach(i RANGE 1 16)
+    string(APPEND LINE_PATTERN "[0-9a-f]")
+endforeach()
+
+set(ARRAYS "")
+set(TABLE "")
+set(COUNT 0)
+foreach(ENTRY IN LISTS SORTED)
+    string(REGEX REPLACE "^[^|]*\\|" "" INPUT "${ENTRY}")
+    get_filename_component(NAME "${INPUT}" NAME)
+    string(MAKE_C_IDENTIFIER "${NAME}" IDENTIFIER)
+    file(SIZE "${INPUT}" SIZE)
+    file(SHA256 "${INPUT}" DIGEST)
+    file(READ "${INPUT}" HEX HEX)
+
+    string(REGEX REPLACE "(${LINE_PATTERN})" "\\1\n" HEX "${HEX}")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "std::byte{0x\\1}, " BYTES
+           "${HEX}")
+    string(REGEX REPLACE ", \n" ",\n    " BYTES "${BYTES}")
+    string(REGEX REPLACE "[, \n]+$" "" BYTES "${BYTES}")
+
+    string(APPEND ARRAYS
+           "// ${NAME}, sha256 ${DIGEST}\n"
+           "alignas(16) inline constexpr std::array<std::byte, ${SIZE}>\n"
+           "    k${IDENTIFIER} = {\n"
+           "    ${BYTES}};\n\n")
+    string(APPEND TABLE
+           "    EmbeddedShader{\"${NAME}\", k${IDENTIFIER}.data(), "
+           "k${IDENTIFIER}.size(),\n"
+           "                   \"${DIGEST}\"},\n")
+    math(EXPR COUNT "${COUNT} + 1")
+endforeach()
+
+string(CONCAT CONTENT
+    "// Generated by cmake/EmbedShaders.cmake. Do not edit.\n"
+    "#pragma once\n\n"
+    "#include \"EmbeddedShaders.h\"\n\n"
+    "#include <array>\n"
+    "#include <cstddef>\n\n"
+    "namespace embedded_shaders {\n\n"
+    "${ARRAYS}"
+    "inline constexpr std::array<EmbeddedShader, ${COUNT}> kEmbeddedShaders = {{\n"
+    "${TABLE}"
+    "}};\n\n"
+    "} // namespace embedded_shaders\n")
+file(WRITE "${OUTPUT}" "${CONTENT}")
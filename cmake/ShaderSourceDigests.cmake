@@ -0,0 +1,29 @@
+# Records the sources a checked-in shader blob was compiled from as
+# "<sha256>  <file name>" lines, so configure can tell when the blob no
+# longer matches them.
+#
+# include() it for shader_source_digests(<var> <file>...), or run it in
+# script mode to write the lines to a file:
+#   cmake -DOUTPUT=<file> -DINPUTS=<file|file|...> -P ShaderSourceDigests.cmake
+#
+# INPUTS is '|'-separated so it survives being passed through a custom
+# command.
+
+function(shader_source_digests VAR)
+    set(LINES "")
+    foreach(INPUT IN LISTS ARGN)
+        file(SHA256 "${INPUT}" DIGEST)
+        get_filename_component(NAME "${INPUT}" NAME)
+        string(APPEND LINES "${DIGEST}  ${NAME}\n")
+    endforeach()
+    set(${VAR} "${LINES}" PARENT_SCOPE)
+endfunction()
+
+if(CMAKE_SCRIPT_MODE_FILE STREQUAL CMAKE_CURRENT_LIST_FILE)
+    if(NOT OUTPUT)
+        message(FATAL_ERROR "ShaderSourceDigests.cmake: OUTPUT is required")
+    endif()
+    string(REPLACE "|" ";" INPUTS "${INPUTS}")
+    shader_source_digests(LINES ${INPUTS})
+    file(WRITE "${OUTPUT}" "${LINES}")
+endif()
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "MeshGenerator.h"
+#include "RtMath.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+// Flat BVH node, 32 bytes. Inner nodes store the index of their left child;
+// the right child always follows it, so sibling pairs share a cache line.
+// Leaves store a range [leftFirst, leftFirst + primCount) into
+// Bvh::PrimIndices().
+struct alignas(32) BvhNode {
+  Float3 boundsMin;
+  uint32_t leftFirst;
+  Float3 boundsMax;
+  uint32_t primCount; // 0 for inner nodes
+
+  bool IsLeaf() const { return primCount != 0; }
+};
+
+static_assert(sizeof(BvhNode) == 32, "BvhNode must stay 32 bytes");
+
+// Cache-line aligned storage so node pairs (2k, 2k + 1) never straddle lines.
+template <typename T, size_t Alignment> struct AlignedAllocator {
+  using value_type = T;
+  template <typename U> struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() = default;
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(
+        ::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+  }
+  void deallocate(T *p, size_t) {
+    ::operator delete(p, std::align_val_t(Alignment));
+  }
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const {
+    return false;
+  }
+};
+
+struct BvhBuildSettings {
+  uint32_t binCount = 16;      // SAH bins per axis (max 64)
+  uint32_t maxLeafSize = 4;    // leaves never hold more than this
+  float traversalCost = 1.0f;  // SAH cost of visiting an inner node
+  float intersectionCost = 1.0f; // SAH cost of one primitive test
+  unsigned threadCount = 0;    // 0 = one per hardware thread
+  // Nodes with at least this many primitives are handed to another worker;
+  // smaller subtrees are finished on the thread that split them.
+  uint32_t taskThreshold = 2048;
+  // Nodes with at least this many primitives bin in parallel.
+  uint32_t parallelBinThreshold = 1u << 17;
+};
+
+struct BvhBuildStats {
+  double buildMs = 0.0;
+  float sahCost = 0.0f; // expected cost per ray relative to the root box
+  uint32_t nodeCount = 0;
+  uint32_t leafCount = 0;
+  uint32_t maxDepth = 0;
+  uint32_t maxLeafPrims = 0;
+  float avgLeafPrims = 0.0f;
+  unsigned threadCount = 0;
+};
+
+// Top-down binned-SAH BVH over an indexed triangle list or a set of boxes.
+class Bvh {
+public:
+  using NodeArray = std::vector<BvhNode, AlignedAllocator<BvhNode, 64>>;
+
+  // positions points at the first vertex's float3 position; vertexStride is
+  // the byte distance between vertices (sizeof(MeshVertex) for the renderer's
+  // interleaved buffer, 12 for a packed position stream).
+  void Build(const void *positions, size_t vertexStride, size_t vertexCount,
+             const uint32_t *indices, size_t indexCount,
+             const BvhBuildSettings &settings = {});
+
+  void Build(const std::vector<MeshVertex> &vertices,
+             const std::vector<uint32_t> &indices,
+             const BvhBuildSettings &settings = {}) {
+    Build(vertices.data(), sizeof(MeshVertex), vertices.size(),
+          indices.data(), indices.size(), settings);
+  }
+
+  // Builds over arbitrary primitive boxes, e.g. instance world bounds;
+  // PrimIndices() then refers to positions in primBounds.
+  void Build(const Aabb *primBounds, size_t primCount,
+             const BvhBuildSettings &settings = {});
+
+  // Recomputes every node box from moved primitives without changing the
+  // topology. primBounds must hold as many boxes as the tree was built over.
+  // Cheap enough to run every frame, but the tree degrades as primitives
+  // drift away from where they were when it was built; the returned SAH cost
+  // (same constants as the build) says by how much.
+  float Refit(const Aabb *primBounds);
+
+  const NodeArray &Nodes() const { return m_nodes; }
+  // Triangle indices in leaf order.
+  const std::vector<uint32_t> &PrimIndices() const { return m_primIndices; }
+  const BvhBuildStats &Stats() const { return m_stats; }
+  bool Empty() const { return m_nodes.empty(); }
+
+  // Recomputes the SAH cost of the current tree with the given constants.
+  float ComputeSahCost(float traversalCost, float intersectionCost) const;
+
+private:
+  void FinishStats(const BvhBuildSettings &settings,
+                   std::chrono::steady_clock::time_point start);
+
+  NodeArray m_nodes;
+  std::vector<uint32_t> m_primIndices;
+  BvhBuildStats m_stats;
+  float m_traversalCost = 1.0f;
+  float m_intersectionCost = 1.0f;
+};
+
+float SurfaceArea(Float3 boundsMin, Float3 boundsMax);
+
+// Node stack for one traversal of a Bvh. A nearest-first traversal defers
+// at most one sibling per level, so the tree's maxDepth bounds it: trees up
+// to kInlineDepth deep use storage on the caller's stack, deeper ones (a
+// degenerate build over clustered or geometrically spaced primitives) get
+// a heap stack sized to the tree.
+class BvhTraversalStack {
+public:
+  static constexpr uint32_t kInlineDepth = 128;
+
+  explicit BvhTraversalStack(const Bvh &bvh) {
+    uint32_t depth = bvh.Stats().maxDepth;
+    if (depth > kInlineDepth) {
+      m_heap.resize(depth);
+      m_data = m_heap.data();
+    }
+  }
+  BvhTraversalStack(const BvhTraversalStack &) = delete;
+  BvhTraversalStack &operator=(const BvhTraversalStack &) = delete;
+
+  uint32_t *Data() { return m_data; }
+
+private:
+  uint32_t m_inline[kInlineDepth];
+  std::vector<uint32_t> m_heap;
+  uint32_t *m_data = m_inline;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+class JobSystem;
+
+// Checkerboard rendering traces half the pixels each frame: those where
+// (x + y + parity) is even, with the parity flipping every frame. RayGen
+// maps launch index (lx, y) of a CheckerboardLaunchWidth() x height
+// dispatch to pixel (CheckerboardPixelX(lx, y, parity), y).
+inline bool CheckerboardTraced(uint32_t x, uint32_t y, uint32_t parity) {
+  return ((x + y + parity) & 1) == 0;
+}
+inline uint32_t CheckerboardPixelX(uint32_t launchX, uint32_t y,
+                                   uint32_t parity) {
+  return launchX * 2 + ((y + parity) & 1);
+}
+inline uint32_t CheckerboardLaunchWidth(uint32_t width) {
+  return (width + 1) / 2;
+}
+
+struct CheckerboardSettings {
+  // Share of a missing pixel taken from the previous frame, where it was
+  // traced; the rest is the average of its four traced neighbours.
+  float historyWeight = 0.5f;
+  // History is clamped to the neighbours' range widened by this much
+  // (in 0-1 colour units), which rejects it where the scene moved.
+  float clampMargin = 0.02f;
+};
+
+// RGBA8 images (R8G8B8A8_UNORM layout, row-major, no padding).
+struct CheckerboardImages {
+  const uint8_t *current; // this frame's trace; untraced pixels are ignored
+  const uint8_t *history; // last resolved frame, or null if there is none
+  uint8_t *out;           // may not alias current or history
+  int width;
+  int height;
+};
+
+// CPU counterpart of shaders/CheckerboardResolve.hlsl: copies the traced
+// pixels and reconstructs the others from their neighbours and the history.
+// Works in 8-bit integer steps, so it can round one step away from the
+// shader. Rows [yBegin, yEnd) only, so callers can split the image.
+void ResolveCheckerboardRows(const CheckerboardImages &images,
+                             uint32_t parity,
+                             const CheckerboardSettings &settings, int yBegin,
+                             int yEnd);
+// The whole image, in row bands over the job system when one is given.
+void ResolveCheckerboard(const CheckerboardImages &images, uint32_t parity,
+                         const CheckerboardSettings &settings,
+                         JobSystem *jobs = nullptr);
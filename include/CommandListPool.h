@@ -0,0 +1,112 @@
+#pragma once
+
+#include "GpuQueue.h"
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Device side of CommandListPool, addressed by index. D3D12CommandBackend
+// implements it with ID3D12CommandAllocators and command lists; the
+// CommandListPoolSimulator tool implements it with a mock that checks the
+// D3D12 reuse rules. Create* calls are serialized by the pool and count up
+// from 0; the others may come from several threads at once, but never for
+// the same allocator or list.
+class CommandListBackend {
+public:
+  virtual ~CommandListBackend() = default;
+
+  virtual void CreateAllocator(uint32_t allocator) = 0;
+  // Lists are created closed.
+  virtual void CreateList(uint32_t list) = 0;
+  // Only called once everything recorded from allocator has retired.
+  virtual void ResetAllocator(uint32_t allocator) = 0;
+  // Opens list for recording into allocator.
+  virtual void ResetList(uint32_t list, uint32_t allocator) = 0;
+  virtual void CloseList(uint32_t list) = 0;
+  // Executes closed lists, in this order, as one batch.
+  virtual void ExecuteLists(const uint32_t *lists, uint32_t count) = 0;
+};
+
+struct CommandListPoolStats {
+  uint32_t allocatorsCreated = 0;
+  uint32_t listsCreated = 0;
+  uint64_t recordings = 0;
+  uint64_t allocatorReuses = 0; // recordings served by a retired allocator
+  uint64_t fenceWaits = 0;      // Begin calls that had to wait for the GPU
+  double fenceWaitMs = 0.0;
+  uint64_t batches = 0;
+  uint32_t maxBatchSize = 0;
+};
+
+// Hands out command lists to recording threads, each paired with an
+// allocator no other recording is using, and submits them in a fixed order.
+//
+// An allocator goes back to the free list only once the fence value of the
+// frame that submitted it has completed, like UploadRing regions; a list is
+// free again as soon as it has been executed. When every allocator is still
+// in flight and the pool is at maxAllocators, Begin() waits on the oldest
+// frame's fence, without holding the pool lock, until an allocator is
+// free; it never creates more than maxAllocators. Begin() and End() are
+// thread-safe; Submit(), FinishFrame() and Retire() belong to the thread that
+// owns the queue.
+//
+//   auto rec = pool.Begin(order);      // any thread
+//   ... record into backend list rec.list ...
+//   pool.End(rec);
+//   ...
+//   pool.Submit();                     // frame thread, lists sorted by order
+//   pool.FinishFrame(queue.Signal());
+//   ...
+//   pool.Retire(queue.CompletedValue());
+class CommandListPool {
+public:
+  struct Recording {
+    uint32_t allocator;
+    uint32_t list;
+    uint32_t order; // position in the next Submit() batch, ascending
+  };
+
+  CommandListPool(GpuQueue &queue, CommandListBackend &backend,
+                  uint32_t maxAllocators, uint32_t maxLists);
+
+  // Checks out an allocator and a list and opens the list for recording.
+  Recording Begin(uint32_t order);
+  // Closes the list; it joins the next Submit() batch.
+  void End(const Recording &recording);
+
+  // Executes every ended recording in one batch, sorted by order (ties keep
+  // End() order). Recordings still open are left for the next batch.
+  // Returns the number of lists executed.
+  uint32_t Submit();
+  // Tags the allocators submitted since the last call with the fence value
+  // signalled after them. Fence values must not decrease.
+  void FinishFrame(uint64_t fenceValue);
+  // Frees allocators whose fence value is <= completedValue.
+  void Retire(uint64_t completedValue);
+
+  uint32_t MaxAllocators() const { return m_maxAllocators; }
+  uint32_t MaxLists() const { return m_maxLists; }
+  CommandListPoolStats Stats() const;
+
+private:
+  struct InFlight {
+    uint64_t fence;
+    uint32_t allocator;
+  };
+
+  void RetireLocked(uint64_t completedValue);
+
+  GpuQueue &m_queue;
+  CommandListBackend &m_backend;
+  uint32_t m_maxAllocators;
+  uint32_t m_maxLists;
+
+  mutable std::mutex m_mutex;
+  std::vector<uint32_t> m_freeAllocators;
+  std::vector<uint32_t> m_freeLists;
+  std::vector<Recording> m_ended;       // waiting for Submit()
+  std::vector<uint32_t> m_submitted;    // waiting for FinishFrame()
+  std::deque<InFlight> m_inFlight;      // fence ascending
+  CommandListPoolStats m_stats;
+};
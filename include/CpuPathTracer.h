@@ -0,0 +1,74 @@
+#pragma once
+
+#include "MeshGenerator.h"
+#include "Ray.h"
+#include "RtMath.h"
+#include "SceneInstances.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class MeshBvh;
+
+// Camera matrices in the form RayGen consumes (see ShaderParams).
+struct CpuCamera {
+  Float4x4 viewInverse;
+  Float4x4 projInverse;
+
+  // Same construction as D3DRenderer::UpdateCamera.
+  static CpuCamera FromYawPitch(Float3 position, float yaw, float pitch,
+                                float aspect);
+
+  // RayGen's primary ray through pixel (px, py) of a width x height target.
+  Ray PixelRay(float px, float py, int width, int height) const;
+};
+
+// CPU reference implementation of shaders/RayTracing.hlsl. Traces the scene
+// produced by BuildSceneInstances with the RayGen/ClosestHit/Miss logic of
+// the GPU path, split into tiles across worker threads. Used as a headless
+// throughput baseline and to produce golden images for the DXR output.
+class CpuPathTracer {
+public:
+  struct Settings {
+    int width = 1280;
+    int height = 720;
+    uint32_t maxBounces = 3;
+    Float3 lightPos = {10.0f, 10.0f, -10.0f};
+    float emissiveIntensity = 2.0f;
+    int tileSize = 32;
+    unsigned threadCount = 0; // 0 = one per hardware thread
+    // 0 or 1: trace only the pixels CheckerboardTraced() picks for that
+    // parity and leave the rest zero, like RayGen in checkerboard mode.
+    int checkerboardParity = -1;
+  };
+
+  struct Stats {
+    uint64_t primaryRays = 0;
+    uint64_t totalRays = 0; // primary + bounce rays
+    double seconds = 0.0;
+    unsigned threadCount = 0;
+
+    double RaysPerSecond() const {
+      return seconds > 0.0 ? (double)totalRays / seconds : 0.0;
+    }
+  };
+
+  CpuPathTracer();
+  ~CpuPathTracer();
+
+  // Registers the bottom-level geometry referenced by SceneInstance::mesh.
+  void SetMesh(SceneMesh mesh, const std::vector<MeshVertex> &vertices,
+               const std::vector<uint32_t> &indices);
+
+  // Renders into RGBA8 (R8G8B8A8_UNORM layout, row-major, no padding).
+  Stats Render(const Settings &settings, const CpuCamera &camera,
+               const std::vector<SceneInstance> &instances,
+               std::vector<uint8_t> &rgba) const;
+
+private:
+  std::unique_ptr<MeshBvh> m_meshes[2];
+};
+
+// Writes an RGBA8 image as binary PPM (alpha is dropped).
+bool WritePpm(const char *path, int width, int height,
+              const std::vector<uint8_t> &rgba);
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define CPU_PROFILER_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CPU_PROFILER_TSC 1
+#endif
+
+// One finished scope as captured. Times are in CpuProfiler::Now() ticks.
+struct CpuProfileEvent {
+  const char *name;
+  uint64_t begin;
+  uint64_t end;
+  uint32_t thread; // index into CpuProfileCapture::threadNames
+  uint32_t depth;  // scopes of the same thread it lies inside
+};
+
+struct CpuProfileCapture {
+  std::vector<CpuProfileEvent> events; // by thread, then begin
+  std::vector<std::string> threadNames;
+  double ticksPerSecond = 0.0;
+  uint64_t dropped = 0; // overwritten in the rings before the capture
+};
+
+// Scoped CPU markers. Each thread records finished scopes into its own ring,
+// which only it writes, so recording takes no lock and no read-modify-write.
+// A capture copies the newest kEventsPerThread - 1 scopes of every ring
+// while the threads keep running, and drops any overwritten during the copy.
+//
+//   void D3DRenderer::Render() {
+//     CPU_PROFILE_SCOPE("Render");
+//     ...
+//   }
+//   CpuProfiler::Get().WriteChromeTrace("cpu_trace.json");
+//
+// Names must outlive the profiler (string literals, __func__). Traces load
+// in chrome://tracing and ui.perfetto.dev, which nest scopes by time.
+class CpuProfiler {
+public:
+  static constexpr uint32_t kEventsPerThread = 1u << 14;
+
+  static CpuProfiler &Get();
+
+  // Recording is on by default; when off, a scope costs one relaxed load.
+  static bool Enabled() { return s_enabled.load(std::memory_order_relaxed); }
+  static void SetEnabled(bool enabled) {
+    s_enabled.store(enabled, std::memory_order_relaxed);
+  }
+
+  // Invariant TSC on x86, steady_clock nanoseconds elsewhere.
+  static uint64_t Now() {
+#if defined(CPU_PROFILER_TSC)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::steady_clock::now()
+        .time_since_epoch()
+        .count();
+#endif
+  }
+
+  // Names the calling thread in captures ("Thread N" otherwise).
+  static void SetThreadName(const std::string &name);
+
+  // Appends a finished scope to the calling thread's ring.
+  static void Record(const char *name, uint64_t begin, uint64_t end);
+
+  // Everything still in the rings and recorded since the last Clear().
+  CpuProfileCapture Capture();
+  void Clear();
+
+  // Chrome trace event JSON ("X" events in microseconds, one track per
+  // thread), as loaded by chrome://tracing and Perfetto.
+  static std::string ChromeTraceJson(const CpuProfileCapture &capture);
+  // Captures and writes the JSON to path; false if the file cannot be
+  // written.
+  bool WriteChromeTrace(const std::string &path);
+
+private:
+  struct Slot {
+    std::atomic<const char *> name;
+    std::atomic<uint64_t> begin;
+    std::atomic<uint64_t> end;
+  };
+  // Aligned so that owners do not share a cache line.
+  struct alignas(64) ThreadRing {
+    std::unique_ptr<Slot[]> slots{new Slot[kEventsPerThread]};
+    std::atomic<uint64_t> head{0}; // events ever recorded; owner writes
+    uint64_t cleared = 0;          // head at the last Clear(), under m_mutex
+    std::string name;              // under m_mutex
+  };
+
+  CpuProfiler();
+  ThreadRing *Register();
+
+  static inline std::atomic<bool> s_enabled{true};
+  static inline thread_local ThreadRing *s_threadRing = nullptr;
+
+  std::mutex m_mutex;
+  std::vector<std::unique_ptr<ThreadRing>> m_rings; // never shrinks
+  // Calibrates Now() against steady_clock between construction and capture.
+  uint64_t m_originTicks;
+  std::chrono::steady_clock::time_point m_originTime;
+};
+
+// Records the enclosing block as a scope named name.
+class CpuProfileScope {
+public:
+  explicit CpuProfileScope(const char *name)
+      : m_name(name), m_begin(CpuProfiler::Enabled() ? CpuProfiler::Now() : 0) {
+  }
+  ~CpuProfileScope() {
+    if (m_begin != 0) {
+      CpuProfiler::Record(m_name, m_begin, CpuProfiler::Now());
+    }
+  }
+  CpuProfileScope(const CpuProfileScope &) = delete;
+  CpuProfileScope &operator=(const CpuProfileScope &) = delete;
+
+private:
+  const char *m_name;
+  uint64_t m_begin; // 0 when recording was off at entry
+};
+
+#define CPU_PROFILE_CONCAT_INNER(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_INNER(a, b)
+#define CPU_PROFILE_SCOPE(name)                                                \
+  CpuProfileScope CPU_PROFILE_CONCAT(cpuProfileScope, __LINE__)(name)
+#define CPU_PROFILE_FUNCTION() CPU_PROFILE_SCOPE(__func__)
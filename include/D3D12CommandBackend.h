@@ -0,0 +1,37 @@
+#pragma once
+
+#include "CommandListPool.h"
+#include <Windows.h>
+#include <d3d12.h>
+#include <vector>
+#include <wrl/client.h>
+
+// CommandListBackend over D3D12 command allocators and DXR-capable command
+// lists, executed on a D3D12 queue. Storage for maxAllocators and maxLists
+// objects is reserved up front, so creating one never moves the others
+// while another thread records.
+class D3D12CommandBackend : public CommandListBackend {
+public:
+  D3D12CommandBackend(ID3D12Device4 *device, ID3D12CommandQueue *queue,
+                      D3D12_COMMAND_LIST_TYPE type, uint32_t maxAllocators,
+                      uint32_t maxLists);
+
+  ID3D12GraphicsCommandList4 *List(uint32_t list) const {
+    return m_lists[list].Get();
+  }
+
+  void CreateAllocator(uint32_t allocator) override;
+  void CreateList(uint32_t list) override;
+  void ResetAllocator(uint32_t allocator) override;
+  void ResetList(uint32_t list, uint32_t allocator) override;
+  void CloseList(uint32_t list) override;
+  void ExecuteLists(const uint32_t *lists, uint32_t count) override;
+
+private:
+  Microsoft::WRL::ComPtr<ID3D12Device4> m_device;
+  Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_queue;
+  D3D12_COMMAND_LIST_TYPE m_type;
+  std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> m_allocators;
+  std::vector<Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList4>> m_lists;
+  std::vector<ID3D12CommandList *> m_batch; // submitting thread only
+};
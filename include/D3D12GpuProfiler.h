@@ -0,0 +1,48 @@
+#pragma once
+
+#include "D3D12HeapAllocator.h"
+#include "GpuProfiler.h"
+#include <Windows.h>
+#include <d3d12.h>
+#include <wrl/client.h>
+
+// GpuProfiler backed by a timestamp query heap and a READBACK buffer with
+// a region per frame slot. Timestamps are read when the slot comes round
+// again, which FramePacer only allows once the GPU has retired it, so the
+// profiler never waits on the GPU itself.
+//
+//   profiler.BeginFrame(slot);            // after FramePacer::BeginFrame
+//   GpuProfilerScope s = profiler.AddScope("DispatchRays");
+//   profiler.Begin(list, s); ... profiler.End(list, s);
+//   profiler.EndFrame(lastList);          // resolves into the readback
+class D3D12GpuProfiler {
+public:
+  // readbackHeaps must be a READBACK buffer allocator that outlives this.
+  D3D12GpuProfiler(ID3D12Device *device, ID3D12CommandQueue *queue,
+                   D3D12HeapAllocator &readbackHeaps, uint32_t framesInFlight,
+                   uint32_t maxScopes);
+
+  D3D12GpuProfiler(const D3D12GpuProfiler &) = delete;
+  D3D12GpuProfiler &operator=(const D3D12GpuProfiler &) = delete;
+
+  // Reads the slot's previous frame, then starts a new one in it.
+  void BeginFrame(uint32_t slot);
+  GpuProfilerScope AddScope(const char *name, uint32_t depth = 0) {
+    return m_profiler.AddScope(name, depth);
+  }
+  // Timestamps around the scope's work; may be recorded into any list of
+  // the frame, from any thread.
+  void Begin(ID3D12GraphicsCommandList *list, const GpuProfilerScope &scope);
+  void End(ID3D12GraphicsCommandList *list, const GpuProfilerScope &scope);
+  // Records the resolve of this frame's queries; list must be submitted
+  // after every list holding one of its scopes.
+  void EndFrame(ID3D12GraphicsCommandList *list);
+
+  const GpuProfiler &Profiler() const { return m_profiler; }
+
+private:
+  GpuProfiler m_profiler;
+  Microsoft::WRL::ComPtr<ID3D12QueryHeap> m_queryHeap;
+  PlacedResource m_readback; // QueryCount() timestamps
+  uint64_t m_frequency = 0;  // ticks per second, 0 if unknown
+};
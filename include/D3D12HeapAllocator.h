@@ -0,0 +1,95 @@
+#pragma once
+
+#include "TlsfAllocator.h"
+#include <Windows.h>
+#include <d3d12.h>
+#include <vector>
+#include <wrl/client.h>
+
+class D3D12HeapAllocator;
+
+// A resource placed in a D3D12HeapAllocator heap. It owns its heap range:
+// destroying or resetting it hands the range back, so it must only be
+// dropped once the GPU is done with it (e.g. through a frame's deferred
+// releases), and before the allocator itself is destroyed.
+class PlacedResource {
+public:
+  PlacedResource() = default;
+  ~PlacedResource();
+  PlacedResource(PlacedResource &&other) noexcept;
+  PlacedResource &operator=(PlacedResource &&other) noexcept;
+  PlacedResource(const PlacedResource &) = delete;
+  PlacedResource &operator=(const PlacedResource &) = delete;
+
+  ID3D12Resource *Get() const { return m_resource.Get(); }
+  ID3D12Resource *operator->() const { return m_resource.Get(); }
+  explicit operator bool() const { return m_resource != nullptr; }
+  // Bytes taken from the heap, alignment included.
+  UINT64 HeapSize() const { return m_heapSize; }
+
+  void Reset();
+
+private:
+  friend class D3D12HeapAllocator;
+
+  Microsoft::WRL::ComPtr<ID3D12Resource> m_resource;
+  D3D12HeapAllocator *m_owner = nullptr;
+  uint32_t m_block = 0;
+  uint32_t m_handle = TlsfAllocator::kInvalidHandle;
+  UINT64 m_heapSize = 0;
+};
+
+struct HeapAllocatorStats {
+  uint32_t heapCount = 0;
+  uint32_t resourceCount = 0;
+  uint64_t reservedBytes = 0; // sum of the ID3D12Heap sizes
+  uint64_t usedBytes = 0;
+  uint64_t largestFreeBlock = 0;
+  float fragmentation = 0.0f; // worst heap, see TlsfStats
+};
+
+// Places resources of one heap type in large ID3D12Heap blocks instead of
+// giving each its own committed allocation. Each block hands out ranges
+// through a TlsfAllocator; a new block is reserved when none has room, and
+// a resource larger than the block size gets a block of its own. Blocks
+// other than the first are released again once they are empty.
+//
+// Resource heap tier 1 hardware cannot mix buffers and textures in one heap,
+// so the heap flags must pick one category (ALLOW_ONLY_BUFFERS,
+// ALLOW_ONLY_NON_RT_DS_TEXTURES or ALLOW_ONLY_RT_DS_TEXTURES).
+class D3D12HeapAllocator {
+public:
+  static const UINT64 DefaultBlockSize = 64ull << 20;
+
+  D3D12HeapAllocator(ID3D12Device *device, D3D12_HEAP_TYPE type,
+                     D3D12_HEAP_FLAGS flags,
+                     UINT64 blockSize = DefaultBlockSize);
+
+  D3D12HeapAllocator(const D3D12HeapAllocator &) = delete;
+  D3D12HeapAllocator &operator=(const D3D12HeapAllocator &) = delete;
+
+  // Placement alignment and size come from GetResourceAllocationInfo, so
+  // buffers and most textures take 64 KB granules (4 KB for small textures).
+  PlacedResource CreateResource(const D3D12_RESOURCE_DESC &desc,
+                                D3D12_RESOURCE_STATES initialState,
+                                const D3D12_CLEAR_VALUE *clearValue = nullptr);
+
+  HeapAllocatorStats Stats() const;
+
+private:
+  friend class PlacedResource;
+
+  struct Block {
+    Microsoft::WRL::ComPtr<ID3D12Heap> heap;
+    TlsfAllocator ranges;
+  };
+
+  uint32_t CreateBlock(UINT64 size);
+  void Free(uint32_t block, uint32_t handle);
+
+  Microsoft::WRL::ComPtr<ID3D12Device> m_device;
+  D3D12_HEAP_TYPE m_type;
+  D3D12_HEAP_FLAGS m_flags;
+  UINT64 m_blockSize;
+  std::vector<Block> m_blocks; // released blocks keep their slot, heap null
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "GpuQueue.h"
+#include <Windows.h>
+#include <d3d12.h>
+#include <wrl/client.h>
+
+// GpuQueue backed by a D3D12 command queue and its fence. Wait may be called
+// from several threads at once; Signal and Execute belong to the thread that
+// owns the queue.
+class D3D12Queue : public GpuQueue {
+public:
+  D3D12Queue(ID3D12Device *device, D3D12_COMMAND_LIST_TYPE type);
+  ~D3D12Queue() override;
+
+  D3D12Queue(const D3D12Queue &) = delete;
+  D3D12Queue &operator=(const D3D12Queue &) = delete;
+
+  ID3D12CommandQueue *Get() const { return m_queue.Get(); }
+  void Execute(ID3D12CommandList *const *lists, UINT count);
+
+  uint64_t Signal() override;
+  uint64_t CompletedValue() override;
+  double Wait(uint64_t value) override;
+
+private:
+  Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_queue;
+  Microsoft::WRL::ComPtr<ID3D12Fence> m_fence;
+  uint64_t m_lastSignaled = 0;
+};
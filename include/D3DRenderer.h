@@ -1,30 +1,58 @@
 #pragma once
 
 #include "../shaders/RayTracingHlslCompat.h"
+#include "CheckerboardResolve.h"
+#include "CommandListPool.h"
+#include "D3D12CommandBackend.h"
+#include "D3D12GpuProfiler.h"
+#include "D3D12HeapAllocator.h"
+#include "D3D12Queue.h"
+#include "DynamicResolution.h"
+#include "FrameLogic.h"
+#include "FramePacer.h"
 #include "ImGuiManager.h"
+#include "InstanceAnimator.h"
+#include "InstanceBvh.h"
+#include "MaterialRegistry.h"
+#include "JobSystem.h"
+#include "MeshBvh.h"
+#include "MeshGenerator.h"
+#include "PipelineCache.h"
+#include "SceneInstances.h"
+#include "ShaderContainer.h"
+#include "ShaderTable.h"
+#include "SphereLod.h"
+#include "TlasUpdatePolicy.h"
+#include "UploadRing.h"
 #include <DirectXMath.h>
 #include <d3d12.h>
 #include <dxgi1_6.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <wrl/client.h>
 
 class D3DRenderer {
 public:
-  struct Vertex {
-    DirectX::XMFLOAT3 position;
-    DirectX::XMFLOAT3 normal;
-    DirectX::XMFLOAT3 color;
-  };
+  using Vertex = MeshVertex;
 
-  D3DRenderer(HWND hwnd);
+  // framesInFlight: how many frames the CPU may queue ahead of the GPU (1-3).
+  explicit D3DRenderer(HWND hwnd, UINT framesInFlight = 2);
   ~D3DRenderer();
 
   void Render();
-  void WaitForPreviousFrame();
+  // Blocks until the GPU has finished everything submitted so far.
+  void WaitForGpu();
 
 private:
   void InitializeD3D12();
   void CreateResources();
+  // Bytecode for one entry point of a mapped HLSL file, from m_pipelineCache
+  // when source, entry point, target and flags match an earlier run.
+  std::vector<uint8_t> CompileShader(const MappedFile &source,
+                                     const char *name, const char *entryPoint,
+                                     const char *target, UINT flags);
   void PopulateCommandList();
   void Present();
 
@@ -35,35 +63,80 @@ private:
   // D3D12
   Microsoft::WRL::ComPtr<IDXGIFactory4> m_factory;
   Microsoft::WRL::ComPtr<ID3D12Device> m_device;
+  // Compiled shaders and driver pipeline blobs from earlier runs, keyed by
+  // everything that goes into them and tied to this adapter and driver.
+  std::unique_ptr<PipelineCache> m_pipelineCache;
+  double m_pipelineStartupMs = 0.0; // compiling and creating pipelines
+  // Every buffer and texture below is placed in one of these instead of
+  // being a committed resource. Declared first so they outlive them.
+  std::unique_ptr<D3D12HeapAllocator> m_bufferHeaps;  // DEFAULT buffers
+  std::unique_ptr<D3D12HeapAllocator> m_textureHeaps; // DEFAULT UAV textures
+  std::unique_ptr<D3D12HeapAllocator> m_uploadHeaps;  // UPLOAD buffers
+  std::unique_ptr<D3D12HeapAllocator> m_readbackHeaps; // READBACK buffers
   Microsoft::WRL::ComPtr<IDXGISwapChain3> m_swapChain;
-  Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_commandQueue;
+  std::unique_ptr<D3D12Queue> m_queue;
   Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_rtvHeap;
-  Microsoft::WRL::ComPtr<ID3D12CommandAllocator> m_commandAllocator;
-  Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_commandList;
-  Microsoft::WRL::ComPtr<ID3D12Fence> m_fence;
-  UINT64 m_fenceValue;
-  HANDLE m_fenceEvent;
 
-  UINT m_frameIndex;
+  // Command lists are checked out per recording from m_commandPool, whose
+  // allocators are recycled once the frame that used them has retired.
+  // Render() records the TLAS update on a job and the rest on the calling
+  // thread, and Present() submits both in one ordered batch.
+  static const uint32_t RecordingsPerFrame = 2; // TLAS, main
+  std::unique_ptr<D3D12CommandBackend> m_commandBackend;
+  std::unique_ptr<CommandListPool> m_commandPool;
+  CommandListPool::Recording m_mainRecording = {};
+  ID3D12GraphicsCommandList4 *m_commandList = nullptr; // while recording
+
+  // Opens m_commandList from the pool; EndCommands closes it for Submit().
+  void BeginCommands(uint32_t order);
+  void EndCommands();
+
+  UINT m_frameIndex; // current back buffer
   UINT m_rtvDescriptorSize;
-  static const UINT FrameCount = 2;
+  static const UINT FrameCount = 3; // swap chain buffers
   Microsoft::WRL::ComPtr<ID3D12Resource> m_renderTargets[FrameCount];
 
+  // Frames in flight. A slot is only reused once the GPU has retired the
+  // frame that last used it; see FramePacer. Per-frame upload data comes
+  // from m_uploadRing and command allocators from m_commandPool instead.
+  struct FrameResources {
+    // Shared resources replaced during this frame, released on slot reuse.
+    std::vector<PlacedResource> deferredReleases;
+  };
+  UINT m_framesInFlight;
+  std::unique_ptr<FramePacer> m_framePacer;
+  FrameResources m_frames[FramePacer::kMaxFramesInFlight];
+  UINT m_frameSlot = 0;
+
+  // GPU timestamps around each pass of the frame, read back when the
+  // frame's slot comes round again.
+  static const uint32_t MaxGpuScopes = 8;
+  std::unique_ptr<D3D12GpuProfiler> m_gpuProfiler;
+  uint64_t m_profiledFrame = 0; // newest frame fed to m_resolution
+
   Microsoft::WRL::ComPtr<ID3D12RootSignature> m_rootSignature;
   Microsoft::WRL::ComPtr<ID3D12PipelineState> m_pipelineState;
-  Microsoft::WRL::ComPtr<ID3D12Resource> m_vertexBuffer;
-  Microsoft::WRL::ComPtr<ID3D12Resource> m_indexBuffer;
-  Microsoft::WRL::ComPtr<ID3D12Resource> m_constantBuffer;
+  PlacedResource m_vertexBuffer;     // positions only (VertexStreams)
+  PlacedResource m_attributeBuffer;  // VertexAttributes, same order
+  PlacedResource m_sphereAabbBuffer; // one D3D12_RAYTRACING_AABB
+  PlacedResource m_indexBuffer;
   D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
   D3D12_INDEX_BUFFER_VIEW m_indexBufferView;
-  void *m_constantBufferData;
+  // R16_UINT when PackIndices could narrow the scene's indices.
+  DXGI_FORMAT m_indexFormat = DXGI_FORMAT_R32_UINT;
+  UINT m_indexSize = sizeof(UINT);
   UINT m_indexCount;
   UINT m_vertexCount;
 
-  // Scene Geometry Offsets
-  UINT m_sphereIndexCount;
-  UINT m_sphereVertexOffset;
-  UINT m_sphereIndexOffset;
+  // Scene Geometry Offsets: the sphere's levels of detail, finest first,
+  // then the plane.
+  struct MeshRange {
+    UINT vertexOffset;
+    UINT vertexCount;
+    UINT indexOffset;
+    UINT indexCount;
+  };
+  MeshRange m_sphereLods[kSphereLodCount];
 
   UINT m_planeIndexCount;
   UINT m_planeVertexOffset;
@@ -73,54 +146,179 @@ private:
   void CreateAccelerationStructures();
   void CreateRayTracingPipeline();
   void CreateRayTracingOutputResource();
+  void CreatePostProcessing();
+  void CreateMaterialBuffer();
   void CreateShaderTables();
 
   // DXR
   Microsoft::WRL::ComPtr<ID3D12Device5> m_dxrDevice;
-  Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList4> m_dxrCommandList;
   Microsoft::WRL::ComPtr<ID3D12StateObject> m_dxrStateObject;
   Microsoft::WRL::ComPtr<ID3D12RootSignature> m_dxrGlobalRootSignature;
+  // Hit group local root signature: one 32-bit constant (b0, space1) that
+  // each instance's hit group record fills in.
+  Microsoft::WRL::ComPtr<ID3D12RootSignature> m_dxrHitGroupRootSignature;
   Microsoft::WRL::ComPtr<ID3D12RootSignature> m_dxrLocalRootSignature;
 
-  // Acceleration Structures
-  Microsoft::WRL::ComPtr<ID3D12Resource> m_sphereBLAS;
-  Microsoft::WRL::ComPtr<ID3D12Resource> m_planeBLAS;
-  Microsoft::WRL::ComPtr<ID3D12Resource> m_topLevelAS;
-  Microsoft::WRL::ComPtr<ID3D12Resource> m_scratchResource;
-  Microsoft::WRL::ComPtr<ID3D12Resource> m_scratchTLAS;
-  Microsoft::WRL::ComPtr<ID3D12Resource> m_instanceDescs;
+  // Acceleration Structures. The BLASes are packed into one pool buffer at
+  // the 256-byte acceleration structure alignment rather than each taking a
+  // 64 KB placement granule.
+  static const UINT64 BlasPoolSize = 4 << 20;
+  PlacedResource m_blasPool;
+  TlsfAllocator m_blasRanges;
+  D3D12_GPU_VIRTUAL_ADDRESS m_sphereBLAS[kSphereLodCount] = {};
+  D3D12_GPU_VIRTUAL_ADDRESS m_planeBLAS = 0;
+  // Single-AABB sphere for the SphereHitGroup path. m_analyticSpheres picks
+  // which sphere BLAS the TLAS references and which hit group the sphere
+  // records use.
+  D3D12_GPU_VIRTUAL_ADDRESS m_sphereAabbBLAS = 0;
+  bool m_analyticSpheres = false;
+  PlacedResource m_topLevelAS;      // built ALLOW_UPDATE
+  PlacedResource m_scratchResource; // BLAS builds only
+  PlacedResource m_scratchTLAS;     // build and update
+  TlasUpdateTracker m_tlasTracker;
+  // CPU copy of the static instance descs (floor, mirror sphere); only
+  // dirty entries are rebuilt. The balls are streamed by m_ballAnimator.
+  std::vector<GpuInstanceDesc> m_instanceDescs;
+  InstanceAnimator m_ballAnimator{kSceneBallCount};
+  // Level of detail per ball, picked in CreateTopLevelAS from the balls'
+  // projected size. The mirror sphere is static and always large on
+  // screen, so it keeps the finest level.
+  SphereLodSelector m_sphereLod;
+  std::vector<uint8_t> m_ballLods;
+  std::vector<uint8_t> m_previousBallLods;
+
+  // Material table (StructuredBuffer t1); m_instanceMaterials[id] is the
+  // entry instance ID id's hit group record selects.
+  MaterialRegistry m_materials;
+  std::vector<uint32_t> m_instanceMaterials;
+  PlacedResource m_materialBuffer;
 
-  // Shader Tables
-  Microsoft::WRL::ComPtr<ID3D12Resource> m_shaderTable;
-  UINT m_shaderTableEntrySize;
+  // Shader Tables: one raygen and one miss record, then a hit group record
+  // per scene instance, indexed by InstanceContributionToHitGroupIndex.
+  PlacedResource m_shaderTable;
+  ShaderTableBuilder::Layout m_shaderTableLayout;
 
   // Output
-  Microsoft::WRL::ComPtr<ID3D12Resource> m_outputResource;
+  PlacedResource m_outputResource;
   Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_srvUavHeap;
 
+  // Compute passes between DispatchRays and the copy to the back buffer.
+  // Each binds root constants (b0) and one descriptor table of SRVs
+  // (t0...) followed by a UAV (u0), and runs 8x8 thread groups.
+  struct ComputePass {
+    Microsoft::WRL::ComPtr<ID3D12RootSignature> rootSignature;
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> pipelineState;
+  };
+  // CSMain of shaders/<name>.hlsl, embedded or compiled and cached.
+  void CreateComputePass(const char *name, UINT constantCount, UINT srvCount,
+                         bool linearSampler, ComputePass &pass);
+  // Records pass over width x height threads with the table at heap slot
+  // table; m_commandList must be open.
+  void DispatchComputePass(const ComputePass &pass, UINT table,
+                           const void *constants, UINT constantCount,
+                           UINT width, UINT height);
+
+  // Checkerboard mode (UIState::checkerboard): DispatchRays traces half of
+  // the render area and m_resolvePass fills in the rest into
+  // m_resolved[m_resolvedIndex], reading the other one as history.
+  static UINT ResolveTable(UINT target) { return 2 + 3 * target; }
+  ComputePass m_resolvePass;
+  PlacedResource m_resolved[2];
+  UINT m_resolvedIndex = 0;
+  uint32_t m_checkerboardParity = 0;
+  bool m_checkerboardHistoryValid = false;
+  DynamicResolutionSize m_checkerboardHistorySize = {};
+  CheckerboardSettings m_checkerboardSettings;
+
+  // Dynamic resolution (UIState::dynamicResolution): rays are dispatched
+  // over the m_renderSize corner of the window-sized output, and
+  // m_upscalePass stretches that corner over m_upscaled. Every
+  // post-processing texture rests in COPY_SOURCE between frames. The
+  // controller is fed the GPU frame time from m_gpuProfiler.
+  // UpscaleTable(0) reads the output, UpscaleTable(1 + i) m_resolved[i].
+  static UINT UpscaleTable(UINT source) { return 8 + 2 * source; }
+  ComputePass m_upscalePass;
+  PlacedResource m_upscaled;
+  DynamicResolutionController m_resolution;
+  DynamicResolutionSize m_renderSize = {};
+
+  // Passes and transitions after the TLAS build, rebuilt every frame
+  // (BuildFramePlan); kept to reuse its storage.
+  FramePlan m_framePlan;
+  ID3D12Resource *FrameResourcePtr(FrameResource resource) const;
+  // Records m_framePlan.barriers[first, first + count) as one batch.
+  void RecordBarriers(uint32_t first, uint32_t count);
+
   // Camera
-  DirectX::XMFLOAT3 m_cameraPos;
-  float m_cameraYaw;
-  float m_cameraPitch;
+  CameraState m_camera;
   POINT m_lastMousePos;
-  Microsoft::WRL::ComPtr<ID3D12Resource> m_cameraBuffer;
-  void *m_cameraMappedData;
+  D3D12_GPU_VIRTUAL_ADDRESS m_cameraConstants = 0; // this frame's ring slice
 
   void UpdateCamera();
-  void CreateConstantBuffer();
+
+  // Upload ring: one persistently mapped UPLOAD buffer shared by every
+  // per-frame upload (constants, instance descs) and by init-time staging.
+  // Regions are freed when the fence of the frame that used them completes.
+  static const UINT64 UploadRingSize = 4 << 20;
+  struct UploadAllocation {
+    void *cpu;
+    D3D12_GPU_VIRTUAL_ADDRESS gpu;
+    UINT64 offset; // within m_uploadBuffer
+  };
+  PlacedResource m_uploadBuffer;
+  uint8_t *m_uploadMapped = nullptr;
+  UploadRing m_uploadRing;
+  // AllocateUpload runs on the TLAS job (instance descs) while the main
+  // thread allocates the frame constants. Retire and FinishFrame stay on
+  // the main thread outside that window and need no lock.
+  std::mutex m_uploadMutex;
+
+  void CreateUploadRing();
+  // Waits for older frames to retire if the ring is full; throws if size
+  // cannot fit even then. Thread-safe.
+  UploadAllocation AllocateUpload(UINT64 size, UINT64 alignment);
+  // DEFAULT-heap buffer filled through the upload ring; the copy is recorded
+  // into m_commandList, which must be open.
+  PlacedResource CreateDefaultBuffer(const void *data, UINT64 size,
+                                     D3D12_RESOURCE_STATES finalState);
 
   // ImGui
   ImGuiManager m_imgui;
 
   // Animation
   float m_animationTime = 0.0f;
+  std::vector<SceneInstance> m_sceneInstances;
+
+  // CPU copy of the acceleration structures for mouse picking
+  MeshBvh m_sphereMeshBvh;
+  MeshBvh m_planeMeshBvh;
+  InstanceBvh m_instanceBvh;
+  bool m_pickButtonDown = false;
+
+  void PickInstance();
+
+  // CPU work fanned out from Render(). Declared after the data its jobs
+  // touch so the workers are joined first.
+  std::unique_ptr<JobSystem> m_jobs;
+  JobCounter m_sceneReady; // AnimateScene for the current frame
+
+  // Builds m_sceneInstances and refits m_instanceBvh; runs as a job.
+  void AnimateScene(float animationSpeed);
 
   // Helpers
-  Microsoft::WRL::ComPtr<ID3D12Resource>
+  // Returns the BLAS address within m_blasPool.
+  D3D12_GPU_VIRTUAL_ADDRESS
   CreateBottomLevelAS(ID3D12GraphicsCommandList4 *commandList,
                       D3D12_GPU_VIRTUAL_ADDRESS vbAddress, UINT vbStride,
                       UINT vertexCount, D3D12_GPU_VIRTUAL_ADDRESS ibAddress,
                       UINT indexCount);
+  D3D12_GPU_VIRTUAL_ADDRESS
+  CreateProceduralBottomLevelAS(ID3D12GraphicsCommandList4 *commandList,
+                                D3D12_GPU_VIRTUAL_ADDRESS aabbAddress,
+                                UINT aabbCount);
+  D3D12_GPU_VIRTUAL_ADDRESS
+  BuildBottomLevelAS(ID3D12GraphicsCommandList4 *commandList,
+                     const D3D12_RAYTRACING_GEOMETRY_DESC &geomDesc);
   void CreateTopLevelAS(ID3D12GraphicsCommandList4 *commandList);
   void UpdateShaderTable();
   void CreatePlane(std::vector<Vertex> &vertices, std::vector<UINT> &indices,
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+struct DynamicResolutionSettings {
+  double targetMs = 1000.0 / 60.0; // frame time budget
+  // Linear scale of the render size relative to the output (at most 1).
+  float minScale = 0.5f;
+  float maxScale = 1.0f;
+  // PI gains on log(target / frame time), acting on log(pixel count),
+  // which ray tracing cost is roughly proportional to.
+  float kp = 0.3f;
+  float ki = 0.15f;
+  // Weight of the newest frame in the smoothed frame time, which is taken
+  // over the median of the last three so a single slow frame is ignored.
+  float smoothing = 0.3f;
+  // Hysteresis: overruns within downBand and headroom within upBand (as
+  // fractions of the budget) leave the scale alone, so the loop settles
+  // anywhere in that band instead of hunting for the exact budget. The
+  // band sits under the budget so the settled frame time does not miss it.
+  float downBand = 0.0f;
+  float upBand = 0.15f;
+  // Largest change of the scale per frame; shrinking reacts faster.
+  float maxStepDown = 0.1f;
+  float maxStepUp = 0.02f;
+};
+
+struct DynamicResolutionSize {
+  uint32_t width;
+  uint32_t height;
+};
+
+// Picks the render resolution each frame from measured frame times. The
+// renderer keeps its output at the window size and dispatches rays over
+// the RenderSize() corner of it, so changing the scale needs no resource
+// reallocation.
+//
+//   float scale = controller.Update(lastFrameMs);
+//   DynamicResolutionSize size = controller.RenderSize(width, height);
+//
+// Frame times arrive a frame or two late with frames in flight; the
+// filtering, the hysteresis band and the step limits keep the loop from
+// oscillating on that delay. Device-free, so it can be driven by recorded
+// or synthetic traces.
+class DynamicResolutionController {
+public:
+  explicit DynamicResolutionController(
+      const DynamicResolutionSettings &settings = {});
+
+  // Feeds one frame time and returns the scale for the next frame.
+  // Non-positive or non-finite times are ignored.
+  float Update(double frameMs);
+
+  // Forgets the frame time history and starts over at scale.
+  void Reset(float scale);
+
+  // Render size for a maxWidth x maxHeight output: the scaled size rounded
+  // to granularity pixels, or exactly the output at full scale.
+  DynamicResolutionSize RenderSize(uint32_t maxWidth, uint32_t maxHeight,
+                                   uint32_t granularity = 8) const;
+
+  float Scale() const { return m_scale; }
+  double SmoothedMs() const { return m_smoothedMs; }
+
+  void SetSettings(const DynamicResolutionSettings &settings);
+  const DynamicResolutionSettings &Settings() const { return m_settings; }
+
+private:
+  DynamicResolutionSettings m_settings;
+  float m_scale;
+  double m_smoothedMs = 0.0;
+  double m_integral; // log(pixel count fraction) the I term holds
+  double m_recentMs[3] = {}; // ring of the last frame times
+  uint32_t m_recentNext = 0;
+  uint32_t m_recentCount = 0; // up to 3
+};
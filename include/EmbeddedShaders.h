@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+// A shader blob from shaders/ compiled into the binary by the ShaderEmbed
+// target (cmake/EmbedShaders.cmake), so pipelines can be created from
+// read-only memory without touching the file system.
+struct EmbeddedShader {
+  const char *name; // file name under shaders/, e.g. "RayTracing.dxil"
+  const std::byte *data;
+  size_t size;
+  const char *sha256; // hex digest of the bytes, taken at build time
+};
+
+// Every embedded blob, sorted by file name.
+std::span<const EmbeddedShader> EmbeddedShaders();
+// Null when no blob of that file name was embedded.
+const EmbeddedShader *FindEmbeddedShader(std::string_view name);
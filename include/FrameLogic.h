@@ -0,0 +1,180 @@
+#pragma once
+
+#include "../shaders/RayTracingHlslCompat.h"
+#include "InstanceAnimator.h"
+#include "RtMath.h"
+#include "SceneInstances.h"
+#include "ShaderTable.h"
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+class ShaderContainer;
+
+// The device-independent half of a D3DRenderer frame: camera movement and
+// the constants built from it, the TLAS instance descs, the shader table
+// records and the order of the passes and barriers after the TLAS build.
+// The renderer turns the results into D3D12 calls; HeadlessFrameBenchmark
+// runs the same code against NullDevice.
+
+// Free-fly camera. Yaw and pitch are in radians, in the order
+// XMMatrixRotationRollPitchYaw(pitch, yaw, 0) takes them.
+struct CameraState {
+  Float3 position = {0.0f, 5.0f, -10.0f};
+  float yaw = 0.0f;
+  float pitch = 0.0f;
+};
+
+// One frame of camera input. forward, right and up are -1, 0 or 1 per held
+// key pair and move along the camera's axes (up is world up) by speed.
+struct CameraInput {
+  float forward = 0.0f;
+  float right = 0.0f;
+  float up = 0.0f;
+  float speed = 0.1f;
+  float yawDelta = 0.0f;
+  float pitchDelta = 0.0f;
+};
+
+// Turns, then moves along the turned axes, as D3DRenderer::UpdateCamera
+// always has.
+void ApplyCameraInput(const CameraInput &input, CameraState &camera);
+
+// Everything in ShaderParams that does not come from the camera.
+struct FrameShading {
+  Float3 lightPos = {10.0f, 10.0f, -10.0f};
+  uint32_t maxBounces = 3;
+  float emissiveIntensity = 2.0f;
+  float animationTime = 0.0f;
+  bool checkerboard = false;
+  uint32_t checkerboardParity = 0;
+  uint32_t renderWidth = 0;
+  uint32_t renderHeight = 0;
+};
+
+// RayGen's constants. aspect is the window's, which the render size keeps.
+ShaderParams BuildShaderParams(const CameraState &camera, float aspect,
+                               const FrameShading &shading);
+
+// Bottom-level structure each SceneMesh is built into.
+struct SceneBlasAddresses {
+  uint64_t plane = 0;
+  uint64_t sphere = 0;
+
+  uint64_t operator[](SceneMesh mesh) const {
+    return mesh == SceneMesh::Plane ? plane : sphere;
+  }
+};
+
+// Desc of one instance. Hit group records are laid out by instance ID (see
+// BuildSceneShaderTable), so the ID doubles as the hit group index.
+GpuInstanceDesc MakeInstanceDesc(const SceneInstance &instance,
+                                 uint64_t blasAddress);
+
+// Re-encodes the dirty entries among the first staticCount instances (the
+// ones no InstanceAnimator streams) into descs, resized to staticCount.
+// dirty is TlasUpdateTracker::DirtyInstances().
+void UpdateStaticInstanceDescs(const std::vector<SceneInstance> &instances,
+                               const std::vector<uint32_t> &dirty,
+                               uint32_t staticCount,
+                               const SceneBlasAddresses &blas,
+                               std::vector<GpuInstanceDesc> &descs);
+
+// Fills the frame's instance descs in dst: staticDescs first, then balls
+// streamed straight behind them with non-temporal stores. Ball i references
+// sphereBlasByLevel[ballLevels[i]], or sphereBlasByLevel[0] for all balls
+// when ballLevels is null. dst is mapped upload memory, 16-byte aligned,
+// with room for both.
+void WriteSceneInstanceDescs(const std::vector<GpuInstanceDesc> &staticDescs,
+                             const InstanceAnimator &balls,
+                             float animationTime, float animationSpeed,
+                             const uint64_t *sphereBlasByLevel,
+                             const uint8_t *ballLevels, GpuInstanceDesc *dst,
+                             JobSystem &jobs);
+
+// What the renderer needs from RayTracing.dxil: the entry points its state
+// object and hit groups name, and a resource on every register its root
+// signatures fill. Matching exports alone are not enough, since a library
+// compiled before the material table still exports them. Throws
+// std::runtime_error listing everything the library lacks.
+void RequireRayTracingLibrary(const ShaderContainer &library);
+
+// The scene's shader table: a RayGen and a Miss record, then a hit group
+// record per instance ID passing hitGroupRecords[id] as its local root
+// constants (see BuildSceneHitGroupRecords). Flat geometry uses hitGroup
+// and sphere geometry sphereHitGroup, which is hitGroup again unless the
+// spheres are procedural. The identifiers are
+// ShaderTableBuilder::kIdentifierSize bytes each, as
+// ID3D12StateObjectProperties returns them.
+ShaderTableBuilder BuildSceneShaderTable(
+    const void *rayGen, const void *miss, const void *hitGroup,
+    const void *sphereHitGroup,
+    const std::vector<HitGroupRecord> &hitGroupRecords);
+
+// Textures the passes after the TLAS build transition. Between frames each
+// rests in FrameResourceRestState(): COPY_SOURCE, or PRESENT for the back
+// buffer.
+enum class FrameResource : uint32_t {
+  Output,    // DispatchRays target
+  Resolved0, // checkerboard resolve targets, alternating as history
+  Resolved1,
+  Upscaled,
+  BackBuffer,
+};
+constexpr uint32_t kFrameResourceCount = 5;
+
+enum class FrameResourceState : uint32_t {
+  CopySource,
+  ShaderRead, // NON_PIXEL_SHADER_RESOURCE
+  UnorderedAccess,
+  CopyDest,
+  RenderTarget,
+  Present,
+};
+
+enum class FramePass : uint32_t {
+  DispatchRays,
+  CheckerboardResolve,
+  Upscale,
+  CopyToBackBuffer,
+  ImGui,
+};
+
+FrameResourceState FrameResourceRestState(FrameResource resource);
+const char *FramePassName(FramePass pass);
+
+struct FrameBarrier {
+  FrameResource resource;
+  FrameResourceState before;
+  FrameResourceState after;
+};
+
+struct FramePlanInputs {
+  bool checkerboard = false;
+  uint32_t resolvedIndex = 0; // m_resolved entry the resolve writes
+  bool upscale = false;       // render size differs from the window
+};
+
+// One pass and the batch of barriers recorded just before it.
+struct FramePlanStep {
+  FramePass pass;
+  uint32_t firstBarrier; // into FramePlan::barriers
+  uint32_t barrierCount;
+};
+
+struct FramePlan {
+  std::vector<FrameBarrier> barriers;
+  std::vector<FramePlanStep> steps;
+  // Batch after the last pass that puts everything back to rest.
+  uint32_t firstFinalBarrier = 0;
+  uint32_t finalBarrierCount = 0;
+  FrameResource resolveTarget = FrameResource::Resolved0;
+  FrameResource upscaleSource = FrameResource::Output;
+  FrameResource copySource = FrameResource::Output; // into the back buffer
+};
+
+// Orders the passes and their transitions. Each transition goes straight
+// from a texture's current state to the one its next pass needs, so a pass
+// output read by the following pass is not sent back to rest in between,
+// and each pass gets one barrier batch. Reuses plan's storage.
+void BuildFramePlan(const FramePlanInputs &inputs, FramePlan &plan);
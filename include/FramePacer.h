@@ -0,0 +1,48 @@
+#pragma once
+
+#include "GpuQueue.h"
+#include <cstdint>
+#include <vector>
+
+struct FramePacerStats {
+  uint64_t frames = 0;
+  uint64_t stalls = 0;   // BeginFrame calls that had to wait for the GPU
+  double stallMs = 0.0;  // time spent in those waits
+  uint32_t maxInFlight = 0; // most frames queued on the GPU at EndFrame
+};
+
+// Keeps up to framesInFlight frames queued on the GPU. Each frame owns a
+// slot (command allocator, constant buffer slice, ...) that is handed out
+// again framesInFlight frames later, so BeginFrame only blocks when the GPU
+// is still working on the frame that last used the slot.
+//
+//   uint32_t slot = pacer.BeginFrame();
+//   ... reset and record into the slot's resources, submit ...
+//   pacer.EndFrame();
+class FramePacer {
+public:
+  static constexpr uint32_t kMaxFramesInFlight = 3;
+
+  FramePacer(GpuQueue &queue, uint32_t framesInFlight);
+
+  // Waits until the next slot is free and returns its index.
+  uint32_t BeginFrame();
+  // Signals the queue after the frame's submissions and tags the slot.
+  void EndFrame();
+  // Waits for every submitted frame, e.g. before resizing or shutdown.
+  void WaitIdle();
+
+  uint32_t FrameSlot() const { return m_slot; }
+  uint32_t FramesInFlight() const { return (uint32_t)m_slotFences.size(); }
+  // Fence value the slot's last frame signalled (0 if never used).
+  uint64_t SlotFence(uint32_t slot) const { return m_slotFences[slot]; }
+  const FramePacerStats &Stats() const { return m_stats; }
+
+private:
+  GpuQueue &m_queue;
+  std::vector<uint64_t> m_slotFences;
+  uint32_t m_slot = 0;
+  uint64_t m_frameNumber = 0;
+  bool m_inFrame = false;
+  FramePacerStats m_stats;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Timestamp query indices of one scope: EndQuery(TIMESTAMP, beginQuery)
+// before the work and EndQuery(TIMESTAMP, endQuery) after it.
+struct GpuProfilerScope {
+  uint32_t beginQuery;
+  uint32_t endQuery;
+};
+
+// The queries a frame wrote, to resolve into the readback buffer.
+struct GpuQueryRange {
+  uint32_t first;
+  uint32_t count;
+};
+
+struct GpuScopeStats {
+  std::string name;
+  uint32_t depth = 0;       // nesting level, for indenting
+  double lastMs = 0.0;      // in the newest resolved frame
+  double averageMs = 0.0;   // over the last averageFrames measurements
+  double maxMs = 0.0;       // over the same window
+  uint64_t lastFrame = 0;   // frame number of the newest measurement
+  // Ring of the window's measurements.
+  std::vector<double> samples;
+  uint32_t sampleCount = 0;
+  uint32_t nextSample = 0;
+};
+
+// Bookkeeping behind the renderer's GPU timestamp profiler, without a
+// device: query allocation per frame slot, timestamp resolution to
+// milliseconds and rolling per-scope averages. D3D12GpuProfiler issues the
+// queries and feeds the readback data back in.
+//
+// Each frame slot (see FramePacer) owns 2 * (maxScopes + 1) consecutive
+// queries, so frames in flight never share one; the last pair absorbs
+// scopes past maxScopes. A frame's timestamps can only be
+// read once the GPU has retired it, framesInFlight frames later, when its
+// slot comes round again:
+//
+//   profiler.Resolve(slot, readback + range.first, frequency); // if Pending
+//   profiler.BeginFrame(slot);
+//   GpuProfilerScope s = profiler.AddScope("DispatchRays");
+//   ... record EndQuery(s.beginQuery), the work, EndQuery(s.endQuery) ...
+//   GpuQueryRange range = profiler.EndFrame(); // ResolveQueryData(range)
+//
+// AddScope is called on one thread, but the indices it returns can be used
+// by any command list recorded for the frame.
+class GpuProfiler {
+public:
+  GpuProfiler(uint32_t framesInFlight, uint32_t maxScopes,
+              uint32_t averageFrames = 60);
+
+  // Size of the query heap and, times 8 bytes, of the readback buffer.
+  uint32_t QueryCount() const { return m_slotCount * SlotQueries(); }
+
+  void BeginFrame(uint32_t slot);
+  // A scope in the current frame; depth only affects display. When the
+  // frame already has maxScopes scopes, returns the slot's spare pair,
+  // which is never resolved (the extra scope is not measured).
+  GpuProfilerScope AddScope(const char *name, uint32_t depth = 0);
+  // Closes the frame and returns the queries it used.
+  GpuQueryRange EndFrame();
+
+  // True if the slot holds an ended frame that has not been resolved yet.
+  bool Pending(uint32_t slot) const;
+  // The range EndFrame returned for the slot's pending frame.
+  GpuQueryRange PendingRange(uint32_t slot) const;
+  // ticks[i] is the timestamp of query PendingRange(slot).first + i.
+  // Scopes whose end is before their begin (e.g. a disjoint or
+  // reset timestamp counter) are dropped, as is everything with a
+  // frequency of 0.
+  void Resolve(uint32_t slot, const uint64_t *ticks, uint64_t frequency);
+  // Forgets the slot's pending frame, e.g. when its queries were never
+  // submitted.
+  void Discard(uint32_t slot);
+
+  // Every scope name seen so far, in order of first appearance.
+  const std::vector<GpuScopeStats> &Scopes() const { return m_stats; }
+  // Frame number of the newest resolved frame (frames count from 1).
+  uint64_t ResolvedFrame() const { return m_resolvedFrame; }
+  // First begin to last end of the newest resolved frame, and its average.
+  double FrameMs() const { return m_frame.lastMs; }
+  double AverageFrameMs() const { return m_frame.averageMs; }
+
+  // (end - begin) ticks of a frequency-Hz counter in milliseconds; the
+  // difference is taken in integers, so large absolute values lose nothing.
+  static double TicksToMs(uint64_t begin, uint64_t end, uint64_t frequency);
+
+private:
+  struct SlotFrame {
+    std::vector<uint32_t> scopeStats; // index into m_stats per scope
+    uint64_t frame = 0;
+    bool pending = false;
+  };
+
+  uint32_t SlotQueries() const { return (m_maxScopes + 1) * 2; }
+  void AddSample(GpuScopeStats &stats, double ms) const;
+
+  uint32_t m_slotCount;
+  uint32_t m_maxScopes;
+  uint32_t m_averageFrames;
+  std::vector<SlotFrame> m_slots;
+  std::vector<GpuScopeStats> m_stats;
+  GpuScopeStats m_frame;
+  uint32_t m_slot = 0;
+  bool m_inFrame = false;
+  uint64_t m_frameNumber = 0;
+  uint64_t m_resolvedFrame = 0;
+};
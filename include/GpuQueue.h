@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+// Fence timeline of one GPU queue. Values are handed out in increasing order
+// starting at 1, and a value completes once the GPU has finished all work
+// submitted before it was signalled. D3D12Queue implements this on an
+// ID3D12CommandQueue + ID3D12Fence; SimulatedGpuQueue runs the same contract
+// against a virtual clock so frame scheduling can be exercised without a GPU.
+class GpuQueue {
+public:
+  virtual ~GpuQueue() = default;
+
+  // Enqueues a signal behind everything submitted so far; returns its value.
+  virtual uint64_t Signal() = 0;
+  // Highest value the GPU has reached.
+  virtual uint64_t CompletedValue() = 0;
+  // Blocks until value has completed; returns the milliseconds spent
+  // waiting (0 when it already had).
+  virtual double Wait(uint64_t value) = 0;
+
+  bool IsComplete(uint64_t value) { return CompletedValue() >= value; }
+  // Waits for all submitted work.
+  double Flush() { return Wait(Signal()); }
+};
+
+// Single-queue GPU model on a virtual millisecond clock. The caller advances
+// CPU time for the work it does and submits GPU work with a duration; the GPU
+// executes submissions in order, each starting once it has been submitted
+// and the previous one has finished. Waiting on an unfinished fence moves
+// the CPU clock forward to the moment the GPU reaches it.
+class SimulatedGpuQueue : public GpuQueue {
+public:
+  void AdvanceCpu(double ms) { m_cpuTime += ms; }
+  void Submit(double gpuMs);
+
+  uint64_t Signal() override;
+  uint64_t CompletedValue() override;
+  double Wait(uint64_t value) override;
+
+  double CpuTime() const { return m_cpuTime; }
+  double GpuBusyMs() const { return m_gpuBusy; }
+  // When the GPU drains the work submitted so far.
+  double GpuIdleAt() const { return m_gpuFreeAt; }
+
+private:
+  double m_cpuTime = 0.0;
+  double m_gpuFreeAt = 0.0;
+  double m_gpuBusy = 0.0;
+  uint64_t m_lastSignaled = 0;
+  uint64_t m_completed = 0;
+  std::deque<double> m_pending; // completion time of m_completed + 1, ...
+};
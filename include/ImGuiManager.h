@@ -22,6 +22,15 @@ public:
   void BeginFrame();
   void EndFrame(ID3D12GraphicsCommandList *commandList);
 
+  // One row of the GPU timing table.
+  struct GpuTiming {
+    const char *name; // owned by the renderer's profiler
+    float averageMs;
+    float lastMs;
+  };
+  static const int MaxGpuTimings = 8;
+  static const int MaxSphereLods = 4;
+
   // UI State - public so D3DRenderer can read these
   struct UIState {
     int bounceCount = 3;
@@ -29,11 +38,62 @@ public:
     float emissiveIntensity = 2.0f;
     float animationSpeed = 1.0f;
     bool animationEnabled = true;
+    // Trace half the pixels each frame and reconstruct the rest.
+    bool checkerboard = false;
+    // Scale the render size to hold the frame time at targetFrameMs.
+    bool dynamicResolution = false;
+    float targetFrameMs = 1000.0f / 60.0f;
+    // Trace the spheres as exact procedural geometry (one AABB each and an
+    // intersection shader) instead of the tessellated mesh.
+    bool analyticSpheres = false;
+    // Give each ball the coarsest sphere mesh its projected size allows.
+    bool sphereLod = true;
+    // Record CPU scopes; saveCpuTrace asks the renderer to write them out.
+    bool cpuProfiling = true;
+    bool saveCpuTrace = false;
     bool showUI = true;
+
+    // Written by D3DRenderer::Render
+    int framesInFlight = 0;
+    unsigned long long gpuWaits = 0; // frames that waited for a free slot
+    int heapCount = 0;               // ID3D12Heap blocks across all types
+    float heapUsedMB = 0.0f;
+    float heapReservedMB = 0.0f;
+    float heapFragmentation = 0.0f; // worst heap
+    int renderWidth = 0;  // pixels rays were dispatched over
+    int renderHeight = 0;
+    float smoothedFrameMs = 0.0f; // dynamic resolution's filtered input
+    float gpuFrameMs = 0.0f;      // average, first pass start to last end
+    GpuTiming gpuTimings[MaxGpuTimings] = {};
+    int gpuTimingCount = 0;
+    const char *cpuTraceStatus = ""; // result of the last saveCpuTrace
+
+    // Written by D3DRenderer::InitRayTracing
+    float pipelineStartupMs = 0.0f; // shader compiles and pipeline creation
+    const char *dxrPipelineCache = ""; // "warm" or "cold"
+    unsigned long long pipelineCacheHits = 0;
+    unsigned long long pipelineCacheMisses = 0;
+    int materialCount = 0;     // entries in the material table
+    int materialInstances = 0; // instances indexing it
+
+    // Written by D3DRenderer::CreateTopLevelAS
+    const char *tlasAction = "";
+    int tlasDirty = 0; // instances changed this frame
+    unsigned long long tlasRebuilds = 0;
+    unsigned long long tlasRefits = 0;
+    int sphereLodBalls[MaxSphereLods] = {}; // balls at each level, finest first
+
+    // Written by D3DRenderer::PickInstance
+    int pickedInstanceID = -1;
+    float pickedDistance = 0.0f;
+    float pickQueryUs = 0.0f;
   };
 
   UIState &GetState() { return m_state; }
 
+  // True while the cursor is over a window, so clicks belong to the UI.
+  bool WantsMouse() const;
+
 private:
   ComPtr<ID3D12DescriptorHeap> m_srvHeap;
   UIState m_state;
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "SceneInstances.h"
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// Layout of D3D12_RAYTRACING_INSTANCE_DESC, for code that cannot include
+// d3d12.h. The renderer static_asserts that the two match.
+struct GpuInstanceDesc {
+  float transform[3][4];
+  uint32_t instanceIdAndMask; // InstanceID:24, InstanceMask:8
+  uint32_t hitGroupAndFlags;  // InstanceContributionToHitGroupIndex:24,
+                              // Flags:8
+  uint64_t accelerationStructure;
+};
+static_assert(sizeof(GpuInstanceDesc) == 64,
+              "GpuInstanceDesc must match D3D12_RAYTRACING_INSTANCE_DESC");
+
+// The scene's orbiting, bouncing balls, stored structure-of-arrays (orbit
+// radius, orbit phase, scale, bounce phase) and evaluated four at a time
+// with a vectorized sincos on x86 (scalar elsewhere, same polynomial).
+//
+// WriteInstanceDescs builds each 64-byte desc in registers and writes it
+// with non-temporal stores, so write-combined upload memory is filled in
+// whole lines and never read back. Evaluate produces the same transforms
+// bit for bit as SceneInstances for the CPU side (picking, TLAS policy).
+class InstanceAnimator {
+public:
+  // Counts at or above this are split across threads.
+  static constexpr uint32_t kParallelThreshold = 16384;
+  // Balls per job when fanned out over a JobSystem (a multiple of four).
+  static constexpr uint32_t kParallelGrain = 4096;
+
+  explicit InstanceAnimator(uint32_t ballCount = 0,
+                            uint32_t firstInstanceID = 2);
+
+  // Lays out ballCount balls the way the scene always has: two turns around
+  // five orbit rings, three sizes.
+  void Reset(uint32_t ballCount, uint32_t firstInstanceID = 2);
+
+  uint32_t Count() const { return m_count; }
+  uint32_t FirstInstanceID() const { return m_firstInstanceID; }
+
+  // Ball transforms into out[0, Count()).
+  void Evaluate(float animationTime, float animationSpeed,
+                SceneInstance *out) const;
+
+  // Ball instance descs into dst[0, Count()), all referencing blasAddress
+  // with mask 0xFF and no flags; each ball's hit group contribution is its
+  // instance ID, matching the renderer's per-instance shader table. dst must
+  // be 16-byte aligned (D3D12_RAYTRACING_INSTANCE_DESCS_BYTE_ALIGNMENT).
+  void WriteInstanceDescs(float animationTime, float animationSpeed,
+                          uint64_t blasAddress, GpuInstanceDesc *dst,
+                          unsigned threadCount = 1) const;
+  // Same, fanned out over the job system in kParallelGrain-ball ranges.
+  void WriteInstanceDescs(float animationTime, float animationSpeed,
+                          uint64_t blasAddress, GpuInstanceDesc *dst,
+                          JobSystem &jobs) const;
+  // Same, with ball i referencing blasByLevel[levels[i]]: one BLAS per
+  // level of detail (see SphereLodSelector).
+  void WriteInstanceDescs(float animationTime, float animationSpeed,
+                          const uint64_t *blasByLevel, const uint8_t *levels,
+                          GpuInstanceDesc *dst, JobSystem &jobs) const;
+
+private:
+  // levels may be null, in which case every ball uses blasByLevel[0].
+  void WriteRange(float animationTime, float animationSpeed,
+                  const uint64_t *blasByLevel, const uint8_t *levels,
+                  GpuInstanceDesc *dst, uint32_t begin, uint32_t end) const;
+
+  uint32_t m_count = 0;
+  uint32_t m_firstInstanceID = 2;
+  // Padded to a multiple of four; phases are pre-reduced to [0, 2pi).
+  std::vector<float> m_orbitRadius;
+  std::vector<float> m_orbitPhase;
+  std::vector<float> m_scale;
+  std::vector<float> m_bouncePhase;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Bvh.h"
+#include "MeshBvh.h"
+#include "Ray.h"
+#include "SceneInstances.h"
+#include <cstdint>
+#include <vector>
+
+struct InstanceHit {
+  float t;
+  uint32_t instance; // index into the instance list last passed in
+};
+
+struct InstanceBvhStats {
+  double buildMs = 0.0;  // last full rebuild
+  double refitMs = 0.0;  // last refit, including the world bounds update
+  float buildSahCost = 0.0f; // SAH cost right after the last rebuild
+  float sahCost = 0.0f;      // SAH cost of the tree as it is now
+  uint32_t refitsSinceBuild = 0;
+  uint32_t rebuildCount = 0;
+};
+
+// CPU mirror of the top-level acceleration structure: a Bvh over instance
+// world bounds whose leaves point at shared MeshBvh bottom levels. Meant for
+// gameplay queries (picking, line of sight) that should not wait on the GPU.
+//
+// Update() refits the existing tree every frame and only rebuilds once
+// refitting has let the SAH cost grow past RebuildThreshold() times its
+// post-build value, or when the instance count changes.
+class InstanceBvh {
+public:
+  // Registers the bottom level used by instances of the given mesh. Not
+  // owned; it must outlive every query.
+  void SetMesh(SceneMesh mesh, const MeshBvh *bvh);
+
+  void Build(const std::vector<SceneInstance> &instances);
+  // Same instances, new transforms; the count must match the last Build.
+  void Refit(const std::vector<SceneInstance> &instances);
+  // Refit or rebuild as described above; returns true when it rebuilt.
+  bool Update(const std::vector<SceneInstance> &instances);
+
+  // Closest hit in [ray.tMin, ray.tMax] with back faces culled, as
+  // TraceRay(RAY_FLAG_CULL_BACK_FACING_TRIANGLES) would report it.
+  bool Intersect(const Ray &ray, InstanceHit &hit) const;
+  // True if anything blocks the ray within [ray.tMin, ray.tMax].
+  bool Occluded(const Ray &ray) const;
+
+  void SetRebuildThreshold(float ratio) { m_rebuildThreshold = ratio; }
+  float RebuildThreshold() const { return m_rebuildThreshold; }
+
+  size_t InstanceCount() const { return m_worldBounds.size(); }
+  const Aabb &WorldBounds(size_t i) const { return m_worldBounds[i]; }
+  const Float3x4 &WorldToObject(size_t i) const { return m_worldToObject[i]; }
+  const Bvh &Tree() const { return m_bvh; }
+  const InstanceBvhStats &Stats() const { return m_stats; }
+
+private:
+  void UpdateInstances(const std::vector<SceneInstance> &instances);
+  template <bool AnyHit> bool Traverse(const Ray &ray, InstanceHit &hit) const;
+
+  const MeshBvh *m_meshes[2] = {};
+  Bvh m_bvh;
+  std::vector<Aabb> m_worldBounds;
+  std::vector<Float3x4> m_worldToObject;
+  std::vector<const MeshBvh *> m_instanceMeshes;
+  float m_rebuildThreshold = 1.5f;
+  InstanceBvhStats m_stats;
+};
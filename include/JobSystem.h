@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+struct Job;
+
+// Counts outstanding jobs. A job submitted with a counter as its signal
+// increments it on submission and decrements it when it finishes; jobs
+// submitted with it as their dependency start once it drops to zero.
+// Waiting on or depending on a counter while it is still being added to
+// from another thread is not meaningful. Destroy a counter only after
+// JobSystem::Wait() on it has returned, not merely once Done() is true.
+class JobCounter {
+public:
+  JobCounter() = default;
+  JobCounter(const JobCounter &) = delete;
+  JobCounter &operator=(const JobCounter &) = delete;
+
+  bool Done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+private:
+  friend class JobSystem;
+  std::atomic<uint32_t> m_pending{0};
+  std::mutex m_mutex;
+  std::vector<Job *> m_continuations;
+};
+
+struct Job {
+  std::function<void()> fn;
+  JobCounter *signal = nullptr;
+};
+
+// Chase-Lev work-stealing deque of Job pointers (Le et al., "Correct and
+// Efficient Work-Stealing for Weak Memory Models", 2013). Only the owning
+// thread may Push and Pop, at the bottom; any thread may Steal from the
+// top. The ring grows on demand; retired rings are kept until destruction
+// because a thief may still be reading one.
+class JobDeque {
+public:
+  explicit JobDeque(uint32_t capacity = 1024);
+  ~JobDeque();
+  JobDeque(const JobDeque &) = delete;
+  JobDeque &operator=(const JobDeque &) = delete;
+
+  void Push(Job *job);
+  Job *Pop();
+  Job *Steal();
+  bool Empty() const;
+
+private:
+  struct Ring {
+    explicit Ring(int64_t capacity)
+        : mask(capacity - 1), slots(new std::atomic<Job *>[capacity]) {}
+    int64_t mask;
+    std::unique_ptr<std::atomic<Job *>[]> slots;
+    Job *Get(int64_t i) const {
+      return slots[i & mask].load(std::memory_order_relaxed);
+    }
+    void Put(int64_t i, Job *job) {
+      slots[i & mask].store(job, std::memory_order_relaxed);
+    }
+  };
+
+  Ring *Grow(Ring *ring, int64_t top, int64_t bottom);
+
+  alignas(64) std::atomic<int64_t> m_top{0};
+  alignas(64) std::atomic<int64_t> m_bottom{0};
+  std::atomic<Ring *> m_ring;
+  std::vector<std::unique_ptr<Ring>> m_rings; // owner only
+};
+
+struct JobSystemSettings {
+  // Threads that run jobs, including the creating thread; 0 = one per
+  // hardware thread.
+  unsigned threadCount = 0;
+  // Pin worker i to logical CPU i + 1 (the creating thread is left alone).
+  // Best effort: ignored where the platform has no affinity API.
+  bool pinThreads = false;
+  // Failed find attempts before an idle worker goes to sleep.
+  unsigned spinCount = 256;
+};
+
+struct JobSystemStats {
+  uint64_t executed = 0; // jobs run, by any thread
+  uint64_t stolen = 0;   // jobs taken from another worker's deque
+  uint64_t sleeps = 0;   // times a worker went idle
+};
+
+// Work-stealing scheduler for the renderer's CPU work. The thread that
+// creates it becomes worker 0 and keeps its own deque, so jobs it submits
+// are popped LIFO by itself and stolen FIFO by the background workers.
+// Other threads submit through a shared injection queue.
+//
+// Wait() never blocks a worker outright: the waiting thread runs queued
+// jobs until the counter drains, so nested fan-out (a job that calls
+// ParallelFor) cannot deadlock. Idle workers spin briefly, then sleep on
+// an epoch counter that every submission bumps.
+class JobSystem {
+public:
+  explicit JobSystem(const JobSystemSettings &settings = {});
+  ~JobSystem();
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  // Threads that execute jobs, including the creating thread.
+  unsigned ThreadCount() const { return (unsigned)m_deques.size(); }
+
+  // Queues fn. signal (optional) tracks its completion; fn is held back
+  // until after (optional) has drained.
+  void Run(std::function<void()> fn, JobCounter *signal = nullptr,
+           JobCounter *after = nullptr);
+
+  // Runs jobs on the calling thread until counter has drained.
+  void Wait(JobCounter &counter);
+
+  // Calls fn(begin, end) over [0, count) in ranges of at most grain
+  // elements and returns when all have run. Ranges are split in half on
+  // demand, so idle workers steal large pieces first.
+  void ParallelFor(uint32_t count, uint32_t grain,
+                   const std::function<void(uint32_t, uint32_t)> &fn);
+
+  JobSystemStats Stats() const;
+
+private:
+  struct alignas(64) WorkerCounters {
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> stolen{0};
+    std::atomic<uint64_t> sleeps{0};
+  };
+
+  void Submit(Job *job);
+  void Execute(Job *job, unsigned self);
+  void Complete(JobCounter *counter);
+  Job *Find(unsigned self, uint32_t &rng);
+  void WorkerLoop(unsigned index);
+  void SplitRange(uint32_t begin, uint32_t end, uint32_t grain,
+                  const std::function<void(uint32_t, uint32_t)> &fn,
+                  JobCounter *counter);
+  int CurrentWorker() const;
+
+  JobSystemSettings m_settings;
+  std::vector<std::unique_ptr<JobDeque>> m_deques;
+  std::unique_ptr<WorkerCounters[]> m_counters;
+  std::vector<std::thread> m_threads;
+
+  std::mutex m_injectMutex;
+  std::deque<Job *> m_inject;
+  std::atomic<uint32_t> m_injectCount{0};
+
+  std::atomic<uint32_t> m_epoch{0};
+  std::atomic<uint32_t> m_sleepers{0};
+  std::atomic<bool> m_stop{false};
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../shaders/RayTracingHlslCompat.h"
+#include "RtMath.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+static_assert(sizeof(MaterialData) == 32 && alignof(MaterialData) == 4,
+              "MaterialData must stay two tightly packed 16-byte rows");
+static_assert(offsetof(MaterialData, reflectivity) == 12 &&
+                  offsetof(MaterialData, emissive) == 16 &&
+                  offsetof(MaterialData, pattern) == 28,
+              "MaterialData layout must match StructuredBuffer<MaterialData>");
+
+// The scene's material table: every distinct MaterialData once, in the
+// order first registered, ready to copy into the structured buffer the hit
+// shaders index. Identical materials (bit for bit, with -0 read as 0) share
+// an index, so a million instances of a dozen looks upload a dozen entries.
+class MaterialRegistry {
+public:
+  // Index of material in Materials(), added if no identical one exists.
+  uint32_t Add(const MaterialData &material);
+  void Clear();
+
+  const std::vector<MaterialData> &Materials() const { return m_materials; }
+  uint32_t Count() const { return (uint32_t)m_materials.size(); }
+  size_t SizeInBytes() const {
+    return m_materials.size() * sizeof(MaterialData);
+  }
+
+private:
+  std::vector<MaterialData> m_materials;
+  // Content hash -> index; colliding entries are told apart by comparing.
+  std::unordered_multimap<uint64_t, uint32_t> m_lookup;
+};
+
+// RayGen's base colour for a hit at hitPos: the albedo, with the checker
+// pattern darkening alternate squares. Mirrors MaterialBaseColor() in
+// RayTracing.hlsl.
+inline Float3 MaterialBaseColor(const MaterialData &material, Float3 hitPos) {
+  Float3 albedo = {material.albedo.x, material.albedo.y, material.albedo.z};
+  if (material.pattern == MATERIAL_PATTERN_CHECKER) {
+    float sum = std::floor(hitPos.x * 0.5f) + std::floor(hitPos.y * 0.5f) +
+                std::floor(hitPos.z * 0.5f);
+    if (std::fmod(sum, 2.0f) != 0.0f) {
+      albedo *= MATERIAL_CHECKER_DARK;
+    }
+  }
+  return albedo;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Bvh.h"
+#include "MeshGenerator.h"
+#include "Ray.h"
+#include <cstdint>
+#include <vector>
+
+// Bottom-level acceleration structure for one mesh: a Bvh plus the triangle
+// vertices in leaf order. Ray queries follow DXR semantics with
+// RAY_FLAG_CULL_BACK_FACING_TRIANGLES and watertight edges, so results match
+// what the GPU reports for the same BLAS.
+class MeshBvh {
+public:
+  void Build(const std::vector<MeshVertex> &vertices,
+             const std::vector<uint32_t> &indices);
+
+  // Closest hit; on success ray.tMax holds the hit distance.
+  bool Intersect(Ray &ray) const;
+  // Any hit in [tMin, tMax]; stops at the first one found.
+  bool Occluded(const Ray &ray) const;
+
+  const Aabb &Bounds() const { return m_bounds; }
+  const Bvh &Tree() const { return m_bvh; }
+
+private:
+  template <bool AnyHit> bool Traverse(Ray &ray) const;
+
+  Bvh m_bvh;
+  std::vector<Float3> m_triangles; // 3 vertices per triangle, in leaf order
+  Aabb m_bounds = {};
+};
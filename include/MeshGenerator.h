@@ -0,0 +1,29 @@
+#pragma once
+
+#include "RtMath.h"
+#include <cstdint>
+#include <vector>
+
+// Vertex layout the generators emit and the CPU-side tools read (same
+// 36-byte layout as the original D3DRenderer::Vertex). The renderer splits
+// it into VertexStreams before uploading.
+struct MeshVertex {
+  Float3 position;
+  Float3 normal;
+  Float3 color;
+};
+
+static_assert(sizeof(MeshVertex) == 36, "MeshVertex must stay tightly packed");
+
+// Both generators append to the given arrays and emit indices relative to the
+// first vertex they append, so each mesh can be bound as its own BLAS input
+// at a vertex buffer offset.
+
+// UV sphere centred on the origin.
+void GenerateSphere(std::vector<MeshVertex> &vertices,
+                    std::vector<uint32_t> &indices, float radius,
+                    int sliceCount, int stackCount);
+
+// Two-triangle floor quad at y = -0.5.
+void GeneratePlane(std::vector<MeshVertex> &vertices,
+                   std::vector<uint32_t> &indices, float width, float depth);
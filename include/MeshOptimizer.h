@@ -0,0 +1,103 @@
+#pragma once
+
+#include "MeshGenerator.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Index and vertex order optimization for indexed triangle lists, run on the
+// generator output before it is uploaded and usable offline on any
+// MeshVertex mesh. Every pass keeps the same triangles with the same
+// winding; only duplicate vertices, degenerate triangles and orderings
+// change.
+//
+// OptimizeMesh runs the passes in order:
+//   1. WeldVertices merges vertices that differ only by float noise, such
+//      as the duplicated seam column of GenerateSphere.
+//   2. RemoveDegenerateTriangles drops triangles that welding collapsed.
+//   3. SortTrianglesSpatially puts triangles in Morton order of their
+//      centroids, so the cache pass restarts somewhere nearby when it runs
+//      into a dead end.
+//   4. OptimizeVertexCache reorders triangles for the post-transform cache
+//      (Tipsify: Sander, Nehab and Barczak 2007), linear in the mesh size.
+//   5. OptimizeVertexFetch renumbers vertices in first-use order, so
+//      vertex fetches walk memory forwards.
+// PackIndices then picks 16-bit indices when every index fits.
+
+struct MeshOptimizeSettings {
+  // Vertices weld when each position component is within this distance, in
+  // mesh units, their normals are within acos(weldNormalCos) and their
+  // colors are equal.
+  float weldPositionEpsilon = 1e-6f;
+  float weldNormalCos = 0.99999f;
+  // Post-transform cache size Tipsify targets and ACMR is measured with.
+  uint32_t cacheSize = 16;
+};
+
+struct MeshOptimizeStats {
+  size_t verticesBefore = 0;
+  size_t verticesAfter = 0;
+  size_t trianglesBefore = 0;
+  size_t trianglesAfter = 0;
+  // Vertex bytes as MeshVertex; index bytes at 32 bits before and at the
+  // width PackIndices picks after.
+  size_t vertexBytesBefore = 0;
+  size_t vertexBytesAfter = 0;
+  size_t indexBytesBefore = 0;
+  size_t indexBytesAfter = 0;
+  // Average cache miss ratio: transformed vertices per triangle with a
+  // FIFO cache of MeshOptimizeSettings::cacheSize entries. 0.5 is the
+  // limit for large regular meshes, 3 means no reuse at all.
+  float acmrBefore = 0.0f;
+  float acmrAfter = 0.0f;
+};
+
+// Returns how many vertices were merged away. Indices are remapped and the
+// surviving vertices keep their relative order.
+size_t WeldVertices(std::vector<MeshVertex> &vertices,
+                    std::vector<uint32_t> &indices, float positionEpsilon,
+                    float normalCos);
+
+// Triangles with a repeated index. Returns how many were removed.
+size_t RemoveDegenerateTriangles(std::vector<uint32_t> &indices);
+
+void SortTrianglesSpatially(const std::vector<MeshVertex> &vertices,
+                            std::vector<uint32_t> &indices);
+
+void OptimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount,
+                         uint32_t cacheSize);
+
+// Unreferenced vertices are dropped.
+void OptimizeVertexFetch(std::vector<MeshVertex> &vertices,
+                         std::vector<uint32_t> &indices);
+
+float ComputeAcmr(const std::vector<uint32_t> &indices, size_t vertexCount,
+                  uint32_t cacheSize);
+
+MeshOptimizeStats OptimizeMesh(std::vector<MeshVertex> &vertices,
+                               std::vector<uint32_t> &indices,
+                               const MeshOptimizeSettings &settings = {});
+
+// Index buffer contents in the narrowest format that holds every index:
+// DXGI_FORMAT_R16_UINT when all are below 65536, R32_UINT otherwise. The
+// D3D12 index buffer view and BLAS geometry both take either.
+struct PackedIndices {
+  bool sixteenBit = false;
+  std::vector<uint16_t> indices16;
+  std::vector<uint32_t> indices32;
+
+  size_t Count() const {
+    return sixteenBit ? indices16.size() : indices32.size();
+  }
+  size_t IndexSize() const { return sixteenBit ? 2 : 4; }
+  size_t ByteSize() const { return Count() * IndexSize(); }
+  const void *Data() const {
+    return sixteenBit ? (const void *)indices16.data()
+                      : (const void *)indices32.data();
+  }
+  uint32_t operator[](size_t i) const {
+    return sixteenBit ? indices16[i] : indices32[i];
+  }
+};
+
+PackedIndices PackIndices(const std::vector<uint32_t> &indices);
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "CommandListPool.h"
+#include "FrameLogic.h"
+#include "GpuQueue.h"
+#include "InstanceAnimator.h"
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct NullDeviceStats {
+  uint64_t listsExecuted = 0;
+  uint64_t barrierBatches = 0;
+  uint64_t barriers = 0;
+  uint64_t passes = 0;
+  uint64_t tlasBuilds = 0;
+  uint64_t tlasRefits = 0;
+  // Barriers whose before state was not the resource's state at execution.
+  uint64_t stateMismatches = 0;
+  // Instance descs whose ID is not their index, whose hit group index is
+  // not their ID or that reference no BLAS.
+  uint64_t badInstanceDescs = 0;
+};
+
+// Queue and command list backend that run no GPU work, so the CPU side of
+// a frame can be driven and timed headless. Work completes as soon as it
+// is signalled. Lists record the FrameLogic-level commands the renderer
+// turns into D3D12 calls, and ExecuteLists replays them the way the debug
+// layer would check them: barriers against the tracked state of each
+// FrameResource, TLAS builds against their instance descs.
+//
+// Recording into a list that is not open, and the pool reuse rules
+// CommandListPool exists for, throw std::logic_error. All entry points
+// lock, since lists are recorded on job threads.
+class NullDevice : public GpuQueue, public CommandListBackend {
+public:
+  NullDevice();
+
+  uint64_t Signal() override;
+  uint64_t CompletedValue() override;
+  double Wait(uint64_t value) override;
+
+  void CreateAllocator(uint32_t allocator) override;
+  void CreateList(uint32_t list) override;
+  void ResetAllocator(uint32_t allocator) override;
+  void ResetList(uint32_t list, uint32_t allocator) override;
+  void CloseList(uint32_t list) override;
+  void ExecuteLists(const uint32_t *lists, uint32_t count) override;
+
+  // ID3D12GraphicsCommandList::ResourceBarrier with transitions.
+  void ResourceBarriers(uint32_t list, const FrameBarrier *barriers,
+                        uint32_t count);
+  void RecordPass(uint32_t list, FramePass pass);
+  // BuildRaytracingAccelerationStructure over count descs, which must stay
+  // valid until the list executes, like upload memory does.
+  void BuildTlas(uint32_t list, const GpuInstanceDesc *descs, uint32_t count,
+                 bool refit);
+
+  // State of resource after everything executed so far.
+  FrameResourceState ResourceState(FrameResource resource) const;
+  NullDeviceStats Stats() const;
+
+private:
+  struct Tlas {
+    const GpuInstanceDesc *descs;
+    uint32_t count;
+    bool refit;
+  };
+  struct List {
+    bool open = false;
+    uint32_t allocator = 0;
+    std::vector<FrameBarrier> barriers;
+    std::vector<Tlas> tlasBuilds;
+    uint64_t barrierBatches = 0;
+    uint64_t passes = 0;
+  };
+  struct Allocator {
+    uint32_t openLists = 0;
+    uint64_t retireFence = 0; // signal after its last execution
+  };
+
+  List &OpenList(uint32_t list);
+
+  mutable std::mutex m_mutex;
+  uint64_t m_fence = 0;
+  std::vector<List> m_lists;
+  std::vector<Allocator> m_allocators;
+  FrameResourceState m_states[kFrameResourceCount];
+  NullDeviceStats m_stats;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 64-bit FNV-1a over named, length-prefixed fields, so moving bytes from one
+// field to the next or reordering fields gives a different key. Every input
+// that changes what the driver would build belongs in the key: bytecode,
+// the serialized root signature, and each piece of fixed-function or
+// subobject state.
+//
+//   uint64_t key = PipelineKey()
+//                      .AddBytes("vs", vs.data(), vs.size())
+//                      .AddBytes("rootsig", rs->GetBufferPointer(), ...)
+//                      .AddU64("payload", sizeof(RayPayload))
+//                      .Value();
+class PipelineKey {
+public:
+  PipelineKey &AddBytes(std::string_view field, const void *data,
+                        size_t size);
+  PipelineKey &AddString(std::string_view field, std::string_view text);
+  PipelineKey &AddU64(std::string_view field, uint64_t value);
+
+  uint64_t Value() const { return m_hash; }
+
+  // Unkeyed FNV-1a, also used to checksum cache files.
+  static uint64_t Hash(const void *data, size_t size,
+                       uint64_t seed = 0xcbf29ce484222325ull);
+
+private:
+  void Mix(const void *data, size_t size);
+
+  uint64_t m_hash = 0xcbf29ce484222325ull;
+};
+
+// What a cached driver blob is only valid for. Any change drops the whole
+// cache, as D3D12 refuses blobs from another adapter or driver anyway.
+struct PipelineCacheDevice {
+  uint32_t vendorId = 0;
+  uint32_t deviceId = 0;
+  uint64_t driverVersion = 0;
+
+  bool operator==(const PipelineCacheDevice &other) const {
+    return vendorId == other.vendorId && deviceId == other.deviceId &&
+           driverVersion == other.driverVersion;
+  }
+};
+
+struct PipelineCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t stores = 0;
+  uint64_t invalidated = 0; // entries dropped by the rules or Invalidate()
+  uint64_t evicted = 0;     // entries dropped to stay under maxBytes
+  bool indexDiscarded = false; // the index on disk could not be used at all
+};
+
+// Key/blob store on disk for compiled shaders and driver pipeline blobs.
+//
+// The directory holds index.bin and one <key>.bin file per entry. The index
+// is little-endian:
+//
+//   header  "PLCI", u32 format version, u32 vendor, u32 device,
+//           u64 driver version, u32 entry count, u32 reserved (0)
+//   entry   u64 key, u64 blob size, u64 blob checksum, u64 last use
+//   trailer u64 checksum of everything before it
+//
+// Invalidation rules, applied when the cache is opened and on Load():
+//   - a missing, short or corrupt index, or one from another format
+//     version, starts the cache empty;
+//   - an index written for another PipelineCacheDevice drops every entry;
+//   - a blob file whose size or checksum no longer matches its entry drops
+//     that entry and Load() misses;
+//   - Invalidate() drops an entry the driver refused;
+//   - Store() evicts the least recently used entries beyond maxBytes.
+// Blob files no index entry refers to are deleted on open. Blobs are written
+// as they are stored; the index only on Flush().
+class PipelineCache {
+public:
+  static constexpr uint32_t kFormatVersion = 1;
+
+  // Opens or creates the cache in directory. Throws std::runtime_error when
+  // the directory cannot be created.
+  PipelineCache(std::string directory, const PipelineCacheDevice &device,
+                uint64_t maxBytes = 64ull << 20);
+
+  // Copies the blob for key into blob and marks it used. False on a miss.
+  bool Load(uint64_t key, std::vector<uint8_t> &blob);
+  // Replaces any blob under key. Zero-sized blobs are allowed and just
+  // record that key has been seen.
+  void Store(uint64_t key, const void *data, size_t size);
+  bool Contains(uint64_t key) const;
+  void Invalidate(uint64_t key);
+
+  // Writes the index if anything changed since it was read or last written.
+  void Flush();
+
+  size_t EntryCount() const { return m_entries.size(); }
+  uint64_t TotalBytes() const { return m_totalBytes; }
+  const PipelineCacheStats &Stats() const { return m_stats; }
+
+private:
+  struct Entry {
+    uint64_t size;
+    uint64_t checksum;
+    uint64_t lastUse;
+  };
+
+  std::string BlobPath(uint64_t key) const;
+  void ReadIndex();
+  void RemoveUnreferencedBlobs();
+  void Drop(uint64_t key);
+
+  std::string m_directory;
+  PipelineCacheDevice m_device;
+  uint64_t m_maxBytes;
+  std::unordered_map<uint64_t, Entry> m_entries;
+  uint64_t m_totalBytes = 0;
+  uint64_t m_useClock = 0;
+  bool m_dirty = false;
+  PipelineCacheStats m_stats;
+};
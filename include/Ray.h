@@ -0,0 +1,47 @@
+#pragma once
+
+#include "RtMath.h"
+#include <algorithm>
+#include <cmath>
+
+// CPU ray shared by the reference tracer and the scene query structures.
+// Mirrors RayDesc: hits are accepted for t in [tMin, tMax].
+struct Ray {
+  Float3 origin;
+  Float3 direction;
+  float tMin;
+  float tMax;
+};
+
+// Axis-parallel rays would produce 0 * inf = NaN in the slab test when the
+// origin lies exactly on a box face (e.g. the centre pixel column against the
+// sphere poles), so zero components are nudged to a tiny signed value.
+inline Float3 SafeInverse(Float3 d) {
+  auto inv = [](float v) {
+    return 1.0f / (v != 0.0f ? v : std::copysign(1e-20f, v));
+  };
+  return {inv(d.x), inv(d.y), inv(d.z)};
+}
+
+// Slab test against [bmin, bmax] limited to [ray.tMin, tMax]; tEntry receives
+// the entry distance for front-to-back ordering.
+inline bool IntersectAabb(const Ray &ray, Float3 invDir, Float3 bmin,
+                          Float3 bmax, float tMax, float &tEntry) {
+  float tx1 = (bmin.x - ray.origin.x) * invDir.x;
+  float tx2 = (bmax.x - ray.origin.x) * invDir.x;
+  float tNear = std::min(tx1, tx2);
+  float tFar = std::max(tx1, tx2);
+  float ty1 = (bmin.y - ray.origin.y) * invDir.y;
+  float ty2 = (bmax.y - ray.origin.y) * invDir.y;
+  tNear = std::max(tNear, std::min(ty1, ty2));
+  tFar = std::min(tFar, std::max(ty1, ty2));
+  float tz1 = (bmin.z - ray.origin.z) * invDir.z;
+  float tz2 = (bmax.z - ray.origin.z) * invDir.z;
+  tNear = std::max(tNear, std::min(tz1, tz2));
+  tFar = std::min(tFar, std::max(tz1, tz2));
+  // Widen the far distance by a few ulps (Ize 2013) so boxes that merely
+  // touch a watertight hit are never rejected.
+  tFar *= 1.0000004f;
+  tEntry = tNear;
+  return tFar >= tNear && tFar >= ray.tMin && tNear <= tMax;
+}
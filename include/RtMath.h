@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cmath>
+
+// Small portable vector/matrix helpers for the CPU-side ray tracing code.
+// Matrices use the DirectXMath row-vector convention (v' = v * M) so values
+// line up one-to-one with what D3DRenderer writes into ShaderParams.
+
+struct Float3 {
+  float x, y, z;
+};
+
+struct Float4 {
+  float x, y, z, w;
+};
+
+inline Float3 operator+(Float3 a, Float3 b) {
+  return {a.x + b.x, a.y + b.y, a.z + b.z};
+}
+inline Float3 operator-(Float3 a, Float3 b) {
+  return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+inline Float3 operator-(Float3 a) { return {-a.x, -a.y, -a.z}; }
+inline Float3 operator*(Float3 a, float s) {
+  return {a.x * s, a.y * s, a.z * s};
+}
+inline Float3 operator*(float s, Float3 a) { return a * s; }
+inline Float3 operator*(Float3 a, Float3 b) {
+  return {a.x * b.x, a.y * b.y, a.z * b.z};
+}
+inline Float3 &operator+=(Float3 &a, Float3 b) { return a = a + b; }
+inline Float3 &operator*=(Float3 &a, Float3 b) { return a = a * b; }
+inline Float3 &operator*=(Float3 &a, float s) { return a = a * s; }
+
+inline float Dot(Float3 a, Float3 b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+inline Float3 Cross(Float3 a, Float3 b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+inline float Length(Float3 a) { return std::sqrt(Dot(a, a)); }
+inline Float3 Normalize(Float3 a) { return a * (1.0f / Length(a)); }
+inline Float3 Min(Float3 a, Float3 b) {
+  return {a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z};
+}
+inline Float3 Max(Float3 a, Float3 b) {
+  return {a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z};
+}
+inline Float3 Lerp(Float3 a, Float3 b, float t) { return a + (b - a) * t; }
+// HLSL reflect(): i - 2 * dot(i, n) * n
+inline Float3 Reflect(Float3 i, Float3 n) { return i - n * (2.0f * Dot(i, n)); }
+
+// Affine transform laid out like D3D12_RAYTRACING_INSTANCE_DESC::Transform
+// (three rows of [linear | translation]).
+struct Float3x4 {
+  float m[3][4];
+};
+
+inline Float3 TransformPoint(const Float3x4 &t, Float3 p) {
+  return {t.m[0][0] * p.x + t.m[0][1] * p.y + t.m[0][2] * p.z + t.m[0][3],
+          t.m[1][0] * p.x + t.m[1][1] * p.y + t.m[1][2] * p.z + t.m[1][3],
+          t.m[2][0] * p.x + t.m[2][1] * p.y + t.m[2][2] * p.z + t.m[2][3]};
+}
+
+inline Float3 TransformVector(const Float3x4 &t, Float3 v) {
+  return {t.m[0][0] * v.x + t.m[0][1] * v.y + t.m[0][2] * v.z,
+          t.m[1][0] * v.x + t.m[1][1] * v.y + t.m[1][2] * v.z,
+          t.m[2][0] * v.x + t.m[2][1] * v.y + t.m[2][2] * v.z};
+}
+
+inline Float3x4 InverseAffine(const Float3x4 &t) {
+  const float(&a)[3][4] = t.m;
+  float c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+  float c01 = a[0][2] * a[2][1] - a[0][1] * a[2][2];
+  float c02 = a[0][1] * a[1][2] - a[0][2] * a[1][1];
+  float c10 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+  float c11 = a[0][0] * a[2][2] - a[0][2] * a[2][0];
+  float c12 = a[0][2] * a[1][0] - a[0][0] * a[1][2];
+  float c20 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+  float c21 = a[0][1] * a[2][0] - a[0][0] * a[2][1];
+  float c22 = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+  float invDet = 1.0f / (a[0][0] * c00 + a[0][1] * c10 + a[0][2] * c20);
+
+  Float3x4 r;
+  r.m[0][0] = c00 * invDet;
+  r.m[0][1] = c01 * invDet;
+  r.m[0][2] = c02 * invDet;
+  r.m[1][0] = c10 * invDet;
+  r.m[1][1] = c11 * invDet;
+  r.m[1][2] = c12 * invDet;
+  r.m[2][0] = c20 * invDet;
+  r.m[2][1] = c21 * invDet;
+  r.m[2][2] = c22 * invDet;
+  Float3 tr = {a[0][3], a[1][3], a[2][3]};
+  for (int i = 0; i < 3; ++i) {
+    r.m[i][3] = -(r.m[i][0] * tr.x + r.m[i][1] * tr.y + r.m[i][2] * tr.z);
+  }
+  return r;
+}
+
+struct Aabb {
+  Float3 min;
+  Float3 max;
+};
+
+// World-space box of a transformed box (Arvo, Graphics Gems 1990): the same
+// result as transforming all eight corners, for a third of the work.
+inline Aabb TransformAabb(const Float3x4 &t, const Aabb &box) {
+  const float *lo = &box.min.x;
+  const float *hi = &box.max.x;
+  Aabb r;
+  float *rmin = &r.min.x;
+  float *rmax = &r.max.x;
+  for (int i = 0; i < 3; ++i) {
+    rmin[i] = rmax[i] = t.m[i][3];
+    for (int j = 0; j < 3; ++j) {
+      float a = t.m[i][j] * lo[j];
+      float b = t.m[i][j] * hi[j];
+      rmin[i] += a < b ? a : b;
+      rmax[i] += a < b ? b : a;
+    }
+  }
+  return r;
+}
+
+struct Float4x4 {
+  float m[4][4];
+};
+
+inline Float4 Transform(Float4 v, const Float4x4 &m) {
+  const float(&a)[4][4] = m.m;
+  return {v.x * a[0][0] + v.y * a[1][0] + v.z * a[2][0] + v.w * a[3][0],
+          v.x * a[0][1] + v.y * a[1][1] + v.z * a[2][1] + v.w * a[3][1],
+          v.x * a[0][2] + v.y * a[1][2] + v.z * a[2][2] + v.w * a[3][2],
+          v.x * a[0][3] + v.y * a[1][3] + v.z * a[2][3] + v.w * a[3][3]};
+}
+
+inline Float4x4 Inverse(const Float4x4 &src) {
+  const float *m = &src.m[0][0];
+  float inv[16];
+  inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] +
+           m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+  inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] -
+           m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+  inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] +
+           m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+  inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] -
+            m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+  inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] -
+           m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+  inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] +
+           m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+  inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] -
+           m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+  inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] +
+            m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+  inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] +
+           m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+  inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] -
+           m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+  inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] +
+            m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+  inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] -
+            m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+  inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] -
+           m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+  inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] +
+           m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+  inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] -
+            m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+  inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] +
+            m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+  float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+  float invDet = 1.0f / det;
+
+  Float4x4 r;
+  for (int i = 0; i < 16; ++i) {
+    (&r.m[0][0])[i] = inv[i] * invDet;
+  }
+  return r;
+}
+
+// Same result as XMMatrixLookAtLH.
+inline Float4x4 LookAtLH(Float3 eye, Float3 focus, Float3 up) {
+  Float3 z = Normalize(focus - eye);
+  Float3 x = Normalize(Cross(up, z));
+  Float3 y = Cross(z, x);
+  return {{{x.x, y.x, z.x, 0.0f},
+           {x.y, y.y, z.y, 0.0f},
+           {x.z, y.z, z.z, 0.0f},
+           {-Dot(x, eye), -Dot(y, eye), -Dot(z, eye), 1.0f}}};
+}
+
+// Same result as XMMatrixPerspectiveFovLH.
+inline Float4x4 PerspectiveFovLH(float fovY, float aspect, float zNear,
+                                 float zFar) {
+  float h = 1.0f / std::tan(fovY * 0.5f);
+  float w = h / aspect;
+  float range = zFar / (zFar - zNear);
+  return {{{w, 0.0f, 0.0f, 0.0f},
+           {0.0f, h, 0.0f, 0.0f},
+           {0.0f, 0.0f, range, 1.0f},
+           {0.0f, 0.0f, -range * zNear, 0.0f}}};
+}
+
+// Vertical field of view of the scene camera's projection.
+constexpr float kCameraFovY = 3.14159265f / 4.0f;
+
+// Forward/right axes of XMMatrixRotationRollPitchYaw(pitch, yaw, 0).
+inline Float3 CameraForward(float yaw, float pitch) {
+  return {std::cos(pitch) * std::sin(yaw), -std::sin(pitch),
+          std::cos(pitch) * std::cos(yaw)};
+}
+inline Float3 CameraRight(float yaw) {
+  return {std::cos(yaw), 0.0f, -std::sin(yaw)};
+}
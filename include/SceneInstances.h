@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../shaders/RayTracingHlslCompat.h"
+#include "RtMath.h"
+#include <cstdint>
+#include <vector>
+
+class MaterialRegistry;
+
+// Which bottom-level mesh an instance references.
+enum class SceneMesh : uint32_t { Plane = 0, Sphere = 1 };
+
+struct SceneInstance {
+  Float3x4 transform;
+  uint32_t instanceID;
+  SceneMesh mesh;
+};
+
+constexpr int kSceneBallCount = 50;
+
+// Generator parameters used for the scene's bottom-level meshes.
+constexpr float kSphereRadius = 0.5f;
+constexpr int kSphereSlices = 32;
+constexpr int kSphereStacks = 32;
+constexpr float kPlaneSize = 20.0f;
+
+// Fills the instance list D3DRenderer::CreateTopLevelAS uploads each frame:
+// the floor (ID 0), the mirror sphere (ID 1) and the orbiting pastel balls
+// (ID 2+). Shared with the CPU tools so both paths see the same scene.
+void BuildSceneInstances(float animationTime, float animationSpeed,
+                         std::vector<SceneInstance> &instances);
+
+// Registers the scene's materials and fills instanceMaterials[id] with the
+// material index of instance ID id, for IDs [0, instanceCount): the
+// checkered floor, the mirror sphere and an emissive pastel per ball.
+void BuildSceneMaterials(uint32_t instanceCount, MaterialRegistry &registry,
+                         std::vector<uint32_t> &instanceMaterials);
+
+// The hit group record for an instance of mesh using material
+// materialIndex: a flat up-facing normal for the plane, the sphere rule for
+// spheres.
+HitGroupRecord MakeHitGroupRecord(SceneMesh mesh, uint32_t materialIndex);
+
+// Fills records[id], one per entry of instanceMaterials, from the mesh of
+// the instance with ID id and instanceMaterials[id]. Throws if an instance
+// ID has no material.
+void BuildSceneHitGroupRecords(const std::vector<SceneInstance> &instances,
+                               const std::vector<uint32_t> &instanceMaterials,
+                               std::vector<HitGroupRecord> &records);
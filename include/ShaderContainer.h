@@ -0,0 +1,202 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only view of a whole file, mapped rather than read into a buffer.
+// The mapping lives as long as the object; an empty file maps to a null
+// Data() with Size() 0.
+class MappedFile {
+public:
+  // Throws std::runtime_error when the file cannot be opened or mapped.
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const uint8_t *Data() const { return m_data; }
+  size_t Size() const { return m_size; }
+
+private:
+  const uint8_t *m_data = nullptr;
+  size_t m_size = 0;
+#if defined(_WIN32)
+  void *m_file = nullptr;
+  void *m_mapping = nullptr;
+#endif
+};
+
+// hlsl::DXIL::ShaderKind, as stored in RDAT function records.
+enum class DxilShaderKind : uint32_t {
+  Pixel = 0,
+  Vertex,
+  Geometry,
+  Hull,
+  Domain,
+  Compute,
+  Library,
+  RayGeneration,
+  Intersection,
+  AnyHit,
+  ClosestHit,
+  Miss,
+  Callable,
+  Mesh,
+  Amplification,
+  Node,
+  Invalid,
+};
+
+const char *DxilShaderKindName(DxilShaderKind kind);
+
+// hlsl::DXIL::ResourceClass, as stored in RDAT resource records.
+enum class DxilResourceClass : uint32_t {
+  SRV = 0,
+  UAV,
+  CBuffer,
+  Sampler,
+  Invalid,
+};
+
+const char *DxilResourceClassName(DxilResourceClass resourceClass);
+
+constexpr uint32_t MakeFourCC(char a, char b, char c, char d) {
+  return (uint32_t)(uint8_t)a | (uint32_t)(uint8_t)b << 8 |
+         (uint32_t)(uint8_t)c << 16 | (uint32_t)(uint8_t)d << 24;
+}
+
+struct ShaderContainerPart {
+  uint32_t fourcc;
+  const uint8_t *data;
+  uint32_t size;
+};
+
+// A function exported from a DXIL library, read from the RDAT part.
+struct ShaderExport {
+  std::string_view name;        // unmangled, e.g. "ClosestHit"
+  std::string_view mangledName; // e.g. "?ClosestHit@@YAXU...@@U...@@@Z"
+  DxilShaderKind kind;
+  uint32_t payloadSize;   // ray payload bytes (hit and miss shaders)
+  uint32_t attributeSize; // hit attribute bytes (hit shaders)
+};
+
+struct ShaderExportRequirement {
+  std::string_view name;
+  DxilShaderKind kind;
+};
+
+// A resource a DXIL library binds, read from the RDAT part. dxc drops
+// resources no function uses, so this is what the shaders actually read.
+struct ShaderResource {
+  std::string_view name; // e.g. "Materials"
+  DxilResourceClass resourceClass;
+  uint32_t space;
+  uint32_t lowerBound; // first register
+  uint32_t upperBound; // last register, ~0u when unbounded
+};
+
+// A register the root signature fills; name is only used in errors.
+struct ShaderResourceRequirement {
+  std::string_view name;
+  DxilResourceClass resourceClass;
+  uint32_t reg;
+  uint32_t space;
+};
+
+// Parsed view of a DXBC container as written by dxc: the header and its
+// part table, the SFI0, VERS, DXIL, HASH and RDAT parts, and the functions a
+// library exports and the resources they bind. Nothing is copied; the bytes
+// must outlive the object.
+//
+// The constructor validates everything it reads and throws
+// std::runtime_error naming the first problem: offsets and sizes that leave
+// the container, the container digest the validator signed it with (an
+// unsigned container is rejected, as the runtime would), the HASH part
+// against the DXIL bitcode, and the DXIL program and bitcode headers.
+class ShaderContainer {
+public:
+  using Digest = std::array<uint8_t, 16>;
+
+  ShaderContainer(const void *data, size_t size);
+
+  const uint8_t *Data() const { return m_data; }
+  size_t Size() const { return m_size; }
+
+  const std::vector<ShaderContainerPart> &Parts() const { return m_parts; }
+  // Null when the container has no such part.
+  const ShaderContainerPart *FindPart(uint32_t fourcc) const;
+
+  // SFI0 shader feature flags; 0 when the part is absent.
+  uint64_t FeatureFlags() const { return m_featureFlags; }
+  // VERS compiler version string, e.g. "1.8.2505.1"; empty when absent.
+  std::string_view CompilerVersion() const { return m_compilerVersion; }
+
+  // From the DXIL program header.
+  DxilShaderKind ProgramKind() const { return m_programKind; }
+  uint32_t ShaderModelMajor() const { return m_shaderModelMajor; }
+  uint32_t ShaderModelMinor() const { return m_shaderModelMinor; }
+  const uint8_t *Bitcode() const { return m_bitcode; }
+  uint32_t BitcodeSize() const { return m_bitcodeSize; }
+
+  const std::vector<ShaderExport> &Exports() const { return m_exports; }
+  // Null when nothing is exported under that (unmangled) name.
+  const ShaderExport *FindExport(std::string_view name) const;
+  // Throws std::runtime_error listing every requirement that is missing or
+  // exported with a different shader kind.
+  void RequireExports(
+      std::initializer_list<ShaderExportRequirement> requirements) const;
+
+  const std::vector<ShaderResource> &Resources() const { return m_resources; }
+  // Null when no resource of that class covers the register.
+  const ShaderResource *FindResource(DxilResourceClass resourceClass,
+                                     uint32_t reg, uint32_t space) const;
+  // Throws std::runtime_error listing every required register no resource
+  // binds.
+  void RequireResources(
+      std::initializer_list<ShaderResourceRequirement> requirements) const;
+
+  // The digest dxc's validator stores in the container header: a variant of
+  // MD5 over everything after the digest field. data must hold a complete
+  // container header.
+  static Digest ComputeDigest(const void *data, size_t size);
+
+private:
+  void ParseDxil(const ShaderContainerPart &part);
+  void ParseRdat(const ShaderContainerPart &part);
+
+  const uint8_t *m_data;
+  size_t m_size;
+  std::vector<ShaderContainerPart> m_parts;
+
+  uint64_t m_featureFlags = 0;
+  std::string_view m_compilerVersion;
+  DxilShaderKind m_programKind = DxilShaderKind::Invalid;
+  uint32_t m_shaderModelMajor = 0;
+  uint32_t m_shaderModelMinor = 0;
+  const uint8_t *m_bitcode = nullptr;
+  uint32_t m_bitcodeSize = 0;
+  std::vector<ShaderExport> m_exports;
+  std::vector<ShaderResource> m_resources;
+};
+
+// A compiled shader library mapped from disk and validated as a container.
+// Data()/Size() point into the mapping and can go straight to
+// D3D12_SHADER_BYTECODE.
+class ShaderBlob {
+public:
+  explicit ShaderBlob(const std::string &path);
+
+  const ShaderContainer &Container() const { return m_container; }
+  const void *Data() const { return m_file.Data(); }
+  size_t Size() const { return m_file.Size(); }
+
+private:
+  MappedFile m_file;
+  ShaderContainer m_container;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The four shader tables DispatchRays reads, in D3D12_DISPATCH_RAYS_DESC
+// order.
+enum class ShaderTableKind : uint32_t { RayGen, Miss, HitGroup, Callable };
+constexpr uint32_t kShaderTableKindCount = 4;
+
+const char *ShaderTableKindName(ShaderTableKind kind);
+
+// Where one table ended up inside the shader binding table buffer. Offsets
+// are relative to the start of the buffer; add the buffer's GPU address to
+// get D3D12_GPU_VIRTUAL_ADDRESS_RANGE(_AND_STRIDE). A table without records
+// has size 0.
+struct ShaderTableRange {
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  uint32_t stride = 0;
+  uint32_t count = 0;
+};
+
+// Lays out a shader binding table and writes it, without any device
+// dependency: the caller copies shader identifiers out of
+// ID3D12StateObjectProperties once and hands in a mapped upload buffer.
+//
+// Records are a 32-byte shader identifier followed by their local root
+// arguments. Each table gets its own stride, the smallest multiple of
+// D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT (32) that fits its largest
+// record, and starts on D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT (64).
+// Tables are ordered so the one that would waste the most tail padding goes
+// last, which gives the smallest buffer those rules allow.
+//
+// Hit group records are added per instance, one per ray type, so an
+// instance's InstanceContributionToHitGroupIndex is the value AddInstance
+// returns and TraceRay's RayContributionToHitGroupIndex picks the ray type
+// (MultiplierForGeometryContributionToHitGroupIndex = RayTypeCount()).
+//
+//   ShaderTableBuilder sbt(1);
+//   uint32_t rayGen = sbt.AddIdentifier(props->GetShaderIdentifier(L"RayGen"));
+//   ...
+//   sbt.AddRecord(ShaderTableKind::RayGen, rayGen);
+//   desc.InstanceContributionToHitGroupIndex =
+//       sbt.AddInstance(&hitGroup, &material, sizeof(material));
+//   ...
+//   buffer = CreateBuffer(sbt.Layout().TotalSize());
+//   sbt.Write(mapped);
+class ShaderTableBuilder {
+public:
+  static constexpr uint32_t kIdentifierSize = 32;
+  static constexpr uint32_t kRecordAlignment = 32;
+  static constexpr uint32_t kTableAlignment = 64;
+  static constexpr uint32_t kMaxRecordStride = 4096;
+  // InstanceContributionToHitGroupIndex is a 24-bit field.
+  static constexpr uint32_t kMaxHitGroupRecords = 1u << 24;
+
+  explicit ShaderTableBuilder(uint32_t rayTypeCount = 1);
+
+  // Forgets every record (identifiers stay registered).
+  void ClearRecords();
+
+  // Copies a kIdentifierSize-byte shader identifier and returns the handle
+  // records refer to it by.
+  uint32_t AddIdentifier(const void *identifier);
+
+  // Appends one record to a table and returns its index in that table.
+  // localArgsSize must be a multiple of 4; root descriptors and descriptor
+  // tables inside the arguments must sit at 8-byte offsets, as D3D12
+  // requires, which is the caller's business.
+  uint32_t AddRecord(ShaderTableKind kind, uint32_t identifier,
+                     const void *localArgs = nullptr,
+                     uint32_t localArgsSize = 0);
+
+  // Appends RayTypeCount() hit group records for one instance, the r-th
+  // using hitGroups[r], all sharing the same local arguments. Returns the
+  // instance's InstanceContributionToHitGroupIndex.
+  uint32_t AddInstance(const uint32_t *hitGroups,
+                       const void *localArgs = nullptr,
+                       uint32_t localArgsSize = 0);
+
+  uint32_t RayTypeCount() const { return m_rayTypeCount; }
+  uint32_t RecordCount(ShaderTableKind kind) const {
+    return (uint32_t)m_tables[(uint32_t)kind].records.size();
+  }
+
+  struct Layout {
+    ShaderTableRange tables[kShaderTableKindCount];
+    uint64_t totalSize = 0;
+    uint64_t paddingBytes = 0; // record and table alignment, not arguments
+
+    const ShaderTableRange &operator[](ShaderTableKind kind) const {
+      return tables[(uint32_t)kind];
+    }
+    uint64_t TotalSize() const { return totalSize; }
+  };
+  // Throws if a record is wider than kMaxRecordStride.
+  Layout ComputeLayout() const;
+
+  // Writes every record at the offsets ComputeLayout() returns, front to
+  // back with padding zeroed, so write-combined upload memory only ever sees
+  // sequential stores. dst must be kTableAlignment-aligned and at least
+  // TotalSize() bytes.
+  void Write(void *dst) const;
+  void Write(void *dst, const Layout &layout) const;
+
+private:
+  struct Record {
+    uint32_t identifier;
+    uint32_t argsOffset; // into m_args
+    uint32_t argsSize;
+  };
+  struct Table {
+    std::vector<Record> records;
+    uint32_t maxArgsSize = 0;
+  };
+
+  uint32_t Append(ShaderTableKind kind, uint32_t identifier,
+                  uint32_t argsOffset, uint32_t argsSize);
+
+  uint32_t m_rayTypeCount;
+  std::vector<uint8_t> m_identifiers;
+  std::vector<uint8_t> m_args;
+  Table m_tables[kShaderTableKindCount];
+};
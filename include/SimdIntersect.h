@@ -0,0 +1,113 @@
+#pragma once
+
+#include "MeshGenerator.h"
+#include "RtMath.h"
+#include "SceneInstances.h"
+#include <cstdint>
+#include <vector>
+
+// 8-wide ray/primitive intersection kernels with scalar, SSE4.1 and AVX2
+// implementations picked at runtime. Triangles use Moller-Trumbore on
+// precomputed edges stored structure-of-arrays so one load fills a register
+// with the same component of eight primitives (or eight rays).
+//
+// Winding matches CpuPathTracer: with cullBackFaces set, only triangles that
+// are clockwise seen from the ray origin (det > 0) are reported, the same as
+// RAY_FLAG_CULL_BACK_FACING_TRIANGLES in RayTracing.hlsl.
+
+constexpr int kSimdWidth = 8;
+
+struct SimdRay {
+  Float3 origin;
+  float tMin;
+  Float3 direction; // need not be normalized; t is in units of direction
+  float tMax;
+};
+
+struct SimdHit {
+  float t;
+  float u;
+  float v;
+  uint32_t lane;
+};
+
+// Eight triangles as v0 and the edges v1 - v0, v2 - v0. Unused lanes have
+// zero edges and never report a hit.
+struct alignas(32) TriangleBlock8 {
+  float v0x[8], v0y[8], v0z[8];
+  float e1x[8], e1y[8], e1z[8];
+  float e2x[8], e2y[8], e2z[8];
+  uint32_t primIndex[8];
+};
+
+// Eight spheres. Unused lanes have a NaN center and never report a hit.
+struct alignas(32) SphereBlock8 {
+  float cx[8], cy[8], cz[8];
+  float radiusSq[8];
+  uint32_t instanceIndex[8];
+};
+
+// A single triangle for the ray-packet kernel.
+struct PackedTriangle {
+  Float3 v0;
+  Float3 e1;
+  Float3 e2;
+};
+
+// Eight rays, one per lane. tMax shrinks as closer hits are found.
+struct alignas(32) RayPacket8 {
+  float ox[8], oy[8], oz[8];
+  float dx[8], dy[8], dz[8];
+  float tMin[8], tMax[8];
+};
+
+struct alignas(32) HitPacket8 {
+  float u[8], v[8];
+  uint32_t primIndex[8];
+};
+
+enum class SimdLevel : uint32_t { Scalar = 0, Sse41 = 1, Avx2 = 2 };
+
+struct IntersectKernels {
+  SimdLevel level;
+
+  // Closest hit of one ray against eight triangles with t in
+  // [ray.tMin, ray.tMax). Returns the lane, or -1 on a miss.
+  int (*rayTriangles8)(const SimdRay &ray, const TriangleBlock8 &tris,
+                       bool cullBackFaces, SimdHit &hit);
+
+  // Eight rays against one triangle. Lanes that hit closer than their tMax
+  // get tMax, u, v and primIndex updated; returns the mask of those lanes.
+  uint32_t (*packetTriangle)(RayPacket8 &rays, const PackedTriangle &tri,
+                             uint32_t primIndex, bool cullBackFaces,
+                             HitPacket8 &hits);
+
+  // Closest hit of one ray against eight spheres (front surface, or the back
+  // surface when the origin is inside). Returns the lane, or -1 on a miss.
+  int (*raySpheres8)(const SimdRay &ray, const SphereBlock8 &spheres,
+                     SimdHit &hit);
+};
+
+// Highest level both the CPU and the OS support.
+SimdLevel DetectSimdLevel();
+const char *SimdLevelName(SimdLevel level);
+
+// Kernels for the detected level.
+const IntersectKernels &GetIntersectKernels();
+// Kernels for a specific level, or nullptr if it was not compiled in or the
+// CPU cannot run it.
+const IntersectKernels *GetIntersectKernels(SimdLevel level);
+
+void BuildTriangleBlocks(const std::vector<MeshVertex> &vertices,
+                         const std::vector<uint32_t> &indices,
+                         std::vector<TriangleBlock8> &blocks);
+
+PackedTriangle PackTriangle(Float3 v0, Float3 v1, Float3 v2);
+
+// World-space spheres for every SceneMesh::Sphere instance. The generator
+// emits spheres of radius kSphereRadius, and CreateTopLevelAS only ever
+// applies uniform scale, so each instance is an exact analytic sphere.
+void BuildSphereBlocks(const std::vector<SceneInstance> &instances,
+                       std::vector<SphereBlock8> &blocks);
+
+void SetRayPacketLane(RayPacket8 &rays, int lane, const SimdRay &ray);
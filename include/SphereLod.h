@@ -0,0 +1,84 @@
+#pragma once
+
+#include "RtMath.h"
+#include "SceneInstances.h"
+#include <cstddef>
+#include <cstdint>
+
+// Levels of detail for the scene's spheres. The renderer builds one BLAS
+// per level and every ball references the level its projected size calls
+// for, so distant balls cost a fraction of the triangles and BLAS memory.
+//
+// A level is allowed while its worst facet, projected, stays within
+// SphereLodSettings::errorPixels of the true silhouette. A ball moves to a
+// finer level as soon as its current one is no longer allowed, but only
+// moves to a coarser one once its projected radius is a hysteresis band
+// below the switch point, so balls near a switch distance do not flip
+// between levels from frame to frame and never exceed the error.
+//
+// Select runs over four instances at a time with SSE2 (scalar elsewhere,
+// same operations in the same order, so both pick the same levels).
+
+constexpr uint32_t kSphereLodCount = 4;
+
+struct SphereLodLevel {
+  int slices;
+  int stacks;
+};
+
+// Finest first; level 0 is the tessellation the scene always had.
+constexpr SphereLodLevel kSphereLodLevels[kSphereLodCount] = {
+    {kSphereSlices, kSphereStacks}, {16, 16}, {8, 8}, {6, 6}};
+
+// How far the level's facets dip below the sphere, as a fraction of the
+// radius. The middle of an equatorial quad sits at
+// cos(pi / slices) * cos(pi / (2 * stacks)) of the radius and no facet
+// point is deeper, so this bounds the error from above.
+float SphereLodError(const SphereLodLevel &level);
+
+struct SphereLodSettings {
+  // Silhouette error a level may show, in pixels.
+  float errorPixels = 0.5f;
+  // Relative band below each switch point a ball's projected radius must
+  // cross before it moves to the coarser level.
+  float hysteresis = 0.15f;
+};
+
+// What projected size is measured against: the camera position and the
+// focal length in pixels, (viewport height / 2) / tan(fovY / 2).
+struct SphereLodView {
+  Float3 cameraPosition = {};
+  float focalPixels = 1.0f;
+};
+
+SphereLodView MakeSphereLodView(Float3 cameraPosition, float fovY,
+                                uint32_t viewportHeight);
+
+class SphereLodSelector {
+public:
+  explicit SphereLodSelector(const SphereLodSettings &settings = {});
+
+  const SphereLodSettings &Settings() const { return m_settings; }
+  void SetSettings(const SphereLodSettings &settings);
+
+  // Projected radius, in pixels, at or below which level (1 or more) is
+  // allowed, before hysteresis.
+  float SwitchPixels(uint32_t level) const;
+
+  // Updates levels[i] for instances[i], each a sphere of kSphereRadius
+  // under a uniformly scaled transform. levels holds each instance's level
+  // from the previous frame (any value the first time).
+  void Select(const SceneInstance *instances, size_t count,
+              const SphereLodView &view, uint8_t *levels) const;
+
+  // One instance; Select gives the same result.
+  uint8_t SelectOne(const SceneInstance &instance, const SphereLodView &view,
+                    uint8_t previous) const;
+
+private:
+  SphereLodSettings m_settings;
+  // Squared switch points for levels 1 to kSphereLodCount - 1, and the
+  // same with the hysteresis band taken off.
+  float m_switchSq[kSphereLodCount - 1] = {};
+  float m_switchBandSq[kSphereLodCount - 1] = {};
+};
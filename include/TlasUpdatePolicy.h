@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Bvh.h"
+#include "RtMath.h"
+#include "SceneInstances.h"
+#include <cstdint>
+#include <vector>
+
+// What the renderer should do with the persistent TLAS this frame.
+enum class TlasBuildAction : uint32_t {
+  None,    // no instance changed; the TLAS from the last frame is still valid
+  Refit,   // PERFORM_UPDATE in place over the same instances
+  Rebuild, // full build, e.g. the instance list changed shape
+};
+
+const char *TlasBuildActionName(TlasBuildAction action);
+
+struct TlasUpdateSettings {
+  // Rebuild once refits have let the estimated SAH cost grow past this many
+  // times its value right after the last rebuild.
+  float rebuildSahRatio = 1.5f;
+  // Rebuild after this many refits in a row regardless of the estimate,
+  // since the driver's update quality is not observable. 0 = no limit.
+  uint32_t maxRefits = 240;
+};
+
+struct TlasUpdateStats {
+  TlasBuildAction lastAction = TlasBuildAction::None;
+  uint32_t dirtyCount = 0;       // instances changed in the last Plan()
+  uint32_t refitsSinceBuild = 0;
+  float sahRatio = 1.0f;         // estimated SAH cost / post-rebuild cost
+  uint64_t rebuildCount = 0;
+  uint64_t refitCount = 0;
+  uint64_t skipCount = 0;
+};
+
+// Decides between refitting and rebuilding the GPU top-level acceleration
+// structure, without touching the device.
+//
+// Plan() diffs the instance list against the one the TLAS was last built
+// or refit from. A different instance count or a changed bottom level
+// requires a rebuild, no changes need no build at all, and anything else is
+// a refit. Refit quality is estimated with a CPU Bvh over the instance
+// world bounds that follows the same rebuild schedule as the GPU structure:
+// a refit that would let its SAH cost drift past
+// TlasUpdateSettings::rebuildSahRatio becomes a rebuild instead.
+// DirtyInstances() lists what changed, so callers only re-encode those
+// instance descs.
+class TlasUpdateTracker {
+public:
+  explicit TlasUpdateTracker(const TlasUpdateSettings &settings = {});
+
+  // worldBounds holds one box per instance, in the same order.
+  TlasBuildAction Plan(const std::vector<SceneInstance> &instances,
+                       const Aabb *worldBounds);
+
+  // Makes the next Plan() rebuild, e.g. after the TLAS buffer was lost.
+  void Invalidate();
+
+  // Makes the next Plan() treat instance index as changed even if its
+  // SceneInstance is not, for desc changes the instance list does not
+  // carry (a ball switching level of detail keeps its mesh and bounds).
+  void MarkDirty(uint32_t index);
+
+  // Indices changed in the last Plan(); every instance after a count change.
+  const std::vector<uint32_t> &DirtyInstances() const { return m_dirty; }
+
+  void SetSettings(const TlasUpdateSettings &settings) {
+    m_settings = settings;
+  }
+  const TlasUpdateSettings &Settings() const { return m_settings; }
+  const TlasUpdateStats &Stats() const { return m_stats; }
+
+private:
+  TlasUpdateSettings m_settings;
+  TlasUpdateStats m_stats;
+  std::vector<SceneInstance> m_instances; // as last handed to the GPU
+  std::vector<uint32_t> m_dirty;
+  std::vector<uint8_t> m_marked; // by instance index, from MarkDirty
+  bool m_valid = false;
+  Bvh m_estimate;
+  float m_buildSahCost = 0.0f;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct TlsfStats {
+  uint64_t capacity = 0;
+  uint64_t usedBytes = 0;     // allocated blocks, rounded to the granularity
+  uint64_t freeBytes = 0;
+  uint64_t largestFreeBlock = 0;
+  uint32_t allocationCount = 0;
+  uint32_t freeBlockCount = 0;
+  // 1 - largestFreeBlock / freeBytes: 0 when all free space is one block,
+  // close to 1 when it is scattered over many small ones.
+  float fragmentation = 0.0f;
+};
+
+// Two-level segregated fit allocator (Masmano et al. 2004) over an abstract
+// range of offsets, e.g. an ID3D12Heap or a large buffer. Block headers live
+// in a side table rather than in the managed memory, which the CPU may not
+// be able to touch.
+//
+// Free blocks are binned by size: the first level is the power of two, the
+// second splits it into 16 linear steps. Two bitmaps locate a large enough
+// bin in O(1); freeing merges with free neighbours in O(1). Every offset and
+// size is a multiple of the granularity, so an alignment above it is met by
+// splitting the leading padding off as a free block.
+class TlsfAllocator {
+public:
+  static constexpr uint32_t kInvalidHandle = UINT32_MAX;
+
+  struct Allocation {
+    uint64_t offset = 0;
+    uint64_t size = 0; // rounded up to the granularity
+    uint32_t handle = kInvalidHandle;
+
+    bool Valid() const { return handle != kInvalidHandle; }
+  };
+
+  // granularity must be a power of two.
+  explicit TlsfAllocator(uint64_t capacity = 0, uint64_t granularity = 256);
+
+  // Forgets every allocation. capacity is rounded down to the granularity.
+  void Reset(uint64_t capacity, uint64_t granularity = 256);
+
+  // alignment must be a power of two. Returns an invalid allocation when no
+  // free block is large enough.
+  Allocation Allocate(uint64_t size, uint64_t alignment);
+  void Free(uint32_t handle);
+
+  uint64_t Capacity() const { return m_capacity; }
+  uint64_t Granularity() const { return m_granularity; }
+  uint64_t UsedBytes() const { return m_usedBytes; }
+  bool Empty() const { return m_allocationCount == 0; }
+  TlsfStats Stats() const;
+
+private:
+  static constexpr uint32_t kSecondLevelLog2 = 4;
+  static constexpr uint32_t kSecondLevelCount = 1u << kSecondLevelLog2;
+  static constexpr uint32_t kFirstLevelCount = 64;
+
+  struct Block {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t prevPhysical; // neighbours in address order
+    uint32_t nextPhysical;
+    uint32_t prevFree;     // bin list links, only while free
+    uint32_t nextFree;
+    bool free;
+  };
+
+  // Bin of a block with the given size in granules, rounded down.
+  static void Mapping(uint64_t units, uint32_t &fl, uint32_t &sl);
+  uint32_t FindFreeBlock(uint64_t size, uint64_t alignment) const;
+  void InsertFree(uint32_t block);
+  void RemoveFree(uint32_t block);
+  uint32_t NewBlock();
+  void ReleaseBlock(uint32_t block);
+  // Cuts the first `size` bytes off `block` into a new block placed before
+  // it in address order; returns the new block.
+  uint32_t SplitFront(uint32_t block, uint64_t size);
+
+  uint64_t m_capacity = 0;
+  uint64_t m_granularity = 256;
+  uint32_t m_granularityLog2 = 8;
+  uint64_t m_usedBytes = 0;
+  uint32_t m_allocationCount = 0;
+  uint32_t m_freeBlockCount = 0;
+
+  uint64_t m_firstLevelMap = 0;
+  uint32_t m_secondLevelMap[kFirstLevelCount] = {};
+  uint32_t m_bins[kFirstLevelCount][kSecondLevelCount];
+
+  std::vector<Block> m_blocks;
+  std::vector<uint32_t> m_unusedBlocks; // recycled m_blocks slots
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+struct UploadRingStats {
+  uint64_t allocations = 0;
+  uint64_t failures = 0;      // Allocate calls that found no room
+  uint64_t bytesAllocated = 0;
+  uint64_t paddingBytes = 0;  // lost to alignment and to skipping the end
+  uint64_t wraps = 0;         // times allocation restarted at offset 0
+  uint64_t peakUsed = 0;      // most bytes live at once, padding included
+};
+
+// Offset bookkeeping for one large persistently mapped upload buffer,
+// without any device dependency: the caller maps the buffer once and turns
+// offsets into CPU and GPU addresses.
+//
+// Allocations are handed out front to back and wrap around to offset 0 when
+// the end of the buffer cannot fit the next one. FinishFrame() tags
+// everything allocated since the previous call with the fence value the
+// frame signalled, and Retire() frees those regions once the fence has
+// completed, oldest first. Allocate() fails instead of blocking; the caller
+// decides whether to wait on OldestPendingFence() and retry.
+//
+//   uint64_t offset = ring.Allocate(sizeof(ShaderParams), 256);
+//   ... write mapped + offset, bind gpuBase + offset ...
+//   ring.FinishFrame(queue.Signal());
+//   ...
+//   ring.Retire(queue.CompletedValue());
+class UploadRing {
+public:
+  static constexpr uint64_t kInvalidOffset = UINT64_MAX;
+
+  explicit UploadRing(uint64_t capacity = 0);
+
+  // Forgets every allocation and starts over with the given size.
+  void Reset(uint64_t capacity);
+
+  // alignment must be a power of two; the buffer itself is assumed to be at
+  // least that aligned. Returns kInvalidOffset when size does not fit until
+  // older frames retire (or at all, if it exceeds Capacity()).
+  uint64_t Allocate(uint64_t size, uint64_t alignment);
+
+  // Closes the current frame: its allocations stay live until Retire() sees
+  // fenceValue complete. Fence values must not decrease.
+  void FinishFrame(uint64_t fenceValue);
+  // Frees every finished frame whose fence value is <= completedValue.
+  void Retire(uint64_t completedValue);
+
+  bool HasPendingFrames() const { return !m_frames.empty(); }
+  // Fence value of the oldest finished frame that still holds memory.
+  uint64_t OldestPendingFence() const { return m_frames.front().fence; }
+
+  uint64_t Capacity() const { return m_capacity; }
+  uint64_t Used() const { return m_head - m_tail; }
+  const UploadRingStats &Stats() const { return m_stats; }
+
+private:
+  struct Frame {
+    uint64_t fence;
+    uint64_t end; // m_head when the frame finished
+  };
+
+  uint64_t m_capacity = 0;
+  // Monotonic byte counts including padding, so m_head - m_tail is the live
+  // size; m_offset is where the next allocation starts in the buffer.
+  uint64_t m_head = 0;
+  uint64_t m_tail = 0;
+  uint64_t m_offset = 0;
+  std::deque<Frame> m_frames;
+  UploadRingStats m_stats;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "MeshGenerator.h"
+#include "RtMath.h"
+#include <cstdint>
+#include <vector>
+
+// Split vertex layout for the GPU. Acceleration structure builds only read
+// positions, so those get a tightly packed stream of their own; everything
+// shading needs sits in a parallel attribute stream. MeshVertex stays the
+// generator and CPU-side format.
+//
+// Positions are either float3 (12 bytes, exact) or four 16-bit SNORMs
+// (8 bytes, DXGI_FORMAT_R16G16B16A16_SNORM, w = 0) relative to a per-mesh
+// scale that the BLAS geometry transform undoes. Normals are octahedral:
+// the unit sphere folded onto the |x| + |y| <= 1 square, stored as two
+// 16-bit SNORMs in one uint32 (x in the low half).
+//
+// The batch encoders and decoders run four vertices at a time with SSE2 on
+// x86 and produce the same bits as the scalar functions everywhere.
+
+struct VertexAttributes {
+  uint32_t normal; // EncodeOctahedral
+};
+static_assert(sizeof(VertexAttributes) == 4,
+              "VertexAttributes must stay tightly packed");
+
+// Largest angle between a unit vector and its decoded octahedral encoding,
+// in radians, with some headroom over the measured worst case of round to
+// nearest (about 6.4e-5 rad, 0.0037 degrees).
+constexpr float kOctahedralMaxError = 7.0e-5f;
+
+uint32_t EncodeOctahedral(Float3 normal);
+// Unit length. A zero vector decodes as +z.
+Float3 DecodeOctahedral(uint32_t packed);
+
+// Quantizing to scale * n / 32767 rounds to nearest, so a position inside
+// [-scale, scale] comes back within half a step per component.
+inline float Snorm16MaxError(float scale) { return 0.5f * scale / 32767.0f; }
+
+// Smallest scale covering every |coordinate| of the positions.
+float Snorm16Scale(const Float3 *positions, size_t stride, size_t count);
+
+// Batch versions. Input is read with a byte stride so MeshVertex arrays
+// can be passed directly (&vertices[0].normal, sizeof(MeshVertex)).
+void EncodeOctahedralNormals(const Float3 *normals, size_t stride,
+                             size_t count, uint32_t *dst);
+void DecodeOctahedralNormals(const uint32_t *src, size_t count, Float3 *dst);
+// dst holds count groups of four int16 (x, y, z, 0).
+void EncodePositionsSnorm16(const Float3 *positions, size_t stride,
+                            size_t count, float scale, int16_t *dst);
+void DecodePositionsSnorm16(const int16_t *src, size_t count, float scale,
+                            Float3 *dst);
+
+// One mesh's GPU streams.
+struct VertexStreams {
+  std::vector<Float3> positions;             // BLAS input, 12-byte stride
+  std::vector<VertexAttributes> attributes; // same order
+};
+
+// Splits vertices into the two streams; MeshVertex::color is dropped, as
+// nothing reads it (it is always white).
+void BuildVertexStreams(const std::vector<MeshVertex> &vertices,
+                        VertexStreams &streams);
@@ -0,0 +1,61 @@
+// Fills in the pixels a checkerboard DispatchRays skipped: traced pixels
+// are copied, the others take the average of their traced neighbours,
+// blended with last frame's resolved value (where that pixel was traced)
+// after clamping it to the neighbours' range so moving edges do not ghost.
+// ResolveCheckerboardRows() in src/CheckerboardResolve.cpp is the CPU
+// counterpart used by the headless tools.
+
+Texture2D<float4> Current : register(t0);   // this frame's trace
+Texture2D<float4> History : register(t1);   // last frame's resolved output
+RWTexture2D<float4> Output : register(u0);
+
+cbuffer ResolveConstants : register(b0)
+{
+    uint width;
+    uint height;
+    uint parity;
+    uint historyValid;
+    float historyWeight;
+    float clampMargin;
+};
+
+[numthreads(8, 8, 1)]
+void CSMain(uint3 id : SV_DispatchThreadID)
+{
+    if (id.x >= width || id.y >= height)
+    {
+        return;
+    }
+    float4 center = Current[id.xy];
+    if (((id.x + id.y + parity) & 1) == 0)
+    {
+        Output[id.xy] = center;
+        return;
+    }
+
+    float3 sum = 0;
+    float3 lo = 1;
+    float3 hi = 0;
+    float count = 0;
+    int2 offsets[4] = { int2(-1, 0), int2(1, 0), int2(0, -1), int2(0, 1) };
+    [unroll]
+    for (int i = 0; i < 4; ++i)
+    {
+        int2 p = int2(id.xy) + offsets[i];
+        if (p.x >= 0 && p.y >= 0 && p.x < (int)width && p.y < (int)height)
+        {
+            float3 c = Current[p].rgb;
+            sum += c;
+            lo = min(lo, c);
+            hi = max(hi, c);
+            count += 1;
+        }
+    }
+    float3 color = count > 0 ? sum / count : 0;
+    if (historyValid)
+    {
+        float3 h = clamp(History[id.xy].rgb, lo - clampMargin, hi + clampMargin);
+        color = count > 0 ? lerp(color, h, historyWeight) : History[id.xy].rgb;
+    }
+    Output[id.xy] = float4(color, 1.0);
+}
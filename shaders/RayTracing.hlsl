@@ -9,12 +9,20 @@ cbuffer CameraParams : register(b0)
     ShaderParams cb;
 }
 
+StructuredBuffer<MaterialData> Materials : register(t1, space0);
+
+// Local root arguments from the instance's hit group record.
+cbuffer HitGroupConstants : register(b0, space1)
+{
+    HitGroupRecord hitGroup;
+}
+
 struct RayPayload
 {
     float4 color;
     float3 hitNormal;
     float3 hitPos;
-    uint   instanceID;
+    uint   materialIndex;
     bool   didHit;
 };
 
@@ -25,27 +33,35 @@ float3 ComputeLighting(float3 hitPos, float3 normal, float3 baseColor, float3 li
     return baseColor * (diff * 0.8 + 0.2); // Diffuse + Ambient
 }
 
-float3 GetPastelColor(uint instanceID)
+float3 MaterialBaseColor(MaterialData material, float3 hitPos)
 {
-    uint h = instanceID * 0x9E3779B9u;
-    h = ((h >> 16) ^ h) * 0x45D9F3B;
-    h = ((h >> 16) ^ h) * 0x45D9F3B;
-    h = (h >> 16) ^ h;
-    
-    float r = float(h & 0xFF) / 255.0;
-    float g = float((h >> 8) & 0xFF) / 255.0;
-    float b = float((h >> 16) & 0xFF) / 255.0;
-    
-    return lerp(float3(r, g, b), float3(1.0, 1.0, 1.0), 0.5);
+    if (material.pattern == MATERIAL_PATTERN_CHECKER)
+    {
+        float3 p = floor(hitPos * 0.5);
+        bool check = fmod(p.x + p.y + p.z, 2.0) == 0.0;
+        return check ? material.albedo : material.albedo * MATERIAL_CHECKER_DARK;
+    }
+    return material.albedo;
 }
 
 [shader("raygeneration")]
 void RayGen()
 {
     uint3 launchIndex = DispatchRaysIndex();
-    uint3 launchDim = DispatchRaysDimensions();
 
-    float2 crd = float2(launchIndex.xy) / float2(launchDim.xy) * 2.0 - 1.0;
+    // In checkerboard mode each launch row covers every other pixel of its
+    // image row, starting one pixel in on alternate rows and frames.
+    uint2 pixel = launchIndex.xy;
+    if (cb.checkerboard)
+    {
+        pixel.x = launchIndex.x * 2 + ((launchIndex.y + cb.checkerboardParity) & 1);
+        if (pixel.x >= cb.renderWidth)
+        {
+            return;
+        }
+    }
+
+    float2 crd = float2(pixel) / float2(cb.renderWidth, cb.renderHeight) * 2.0 - 1.0;
     crd.y = -crd.y;
 
     float4 origin = mul(viewInverse, float4(0,0,0,1));
@@ -79,55 +95,25 @@ void RayGen()
             break;
         }
         
-        float3 baseColor;
-        bool isReflective = false;
-        
-        if (payload.instanceID == 0) // Floor
-        {
-            float scale = 0.5;
-            float3 p = floor(payload.hitPos * scale);
-            bool check = fmod(p.x + p.y + p.z, 2.0) == 0.0;
-            baseColor = check ? float3(0.9, 0.9, 0.9) : float3(0.5, 0.5, 0.5);
-        }
-        else if (payload.instanceID == 1) // Main Metal Sphere
-        {
-            baseColor = float3(0.8, 0.8, 0.9); // Slight tint for the reflective sphere
-            isReflective = true;
-        }
-        else // Pastel Balls
-        {
-            baseColor = GetPastelColor(payload.instanceID);
-        }
-        
+        MaterialData material = Materials[payload.materialIndex];
+        float3 baseColor = MaterialBaseColor(material, payload.hitPos);
         float3 litColor = ComputeLighting(payload.hitPos, payload.hitNormal, baseColor, cb.lightPos.xyz);
-        
-        if (isReflective)
-        {
-            // Add some direct color and continue reflecting
-            finalColor += throughput * litColor * 0.1; // 10% direct
-            throughput *= 0.8; // 80% reflection
-            
-            // Set up next ray
-            ray.Origin = payload.hitPos + payload.hitNormal * 0.01;
-            ray.Direction = reflect(ray.Direction, payload.hitNormal);
-            ray.TMin = 0.001;
-            ray.TMax = 10000.0;
-        }
-        else
+
+        finalColor += throughput * (litColor * (1.0 - material.reflectivity) + material.emissive * cb.emissiveIntensity);
+        if (material.reflectivity <= 0.0)
         {
-            // Non-reflective surface
-            float3 emissive = float3(0, 0, 0);
-            if (payload.instanceID > 1) // Only pastel balls are emissive
-            {
-                emissive = baseColor * cb.emissiveIntensity * 0.5;
-            }
-            
-            finalColor += throughput * (litColor + emissive);
             break;
         }
+
+        // Mirror bounce
+        throughput *= material.reflectivity;
+        ray.Origin = payload.hitPos + payload.hitNormal * 0.01;
+        ray.Direction = reflect(ray.Direction, payload.hitNormal);
+        ray.TMin = 0.001;
+        ray.TMax = 10000.0;
     }
 
-    RenderTarget[launchIndex.xy] = float4(finalColor, 1.0);
+    RenderTarget[pixel] = float4(finalColor, 1.0);
 }
 
 [shader("miss")]
@@ -141,19 +127,52 @@ void ClosestHit(inout RayPayload payload, in BuiltInTriangleIntersectionAttribut
 {
     payload.didHit = true;
     payload.hitPos = WorldRayOrigin() + WorldRayDirection() * RayTCurrent();
-    payload.instanceID = InstanceID();
-    
-    // Compute normal
-    float3 objPos = ObjectRayOrigin() + ObjectRayDirection() * RayTCurrent();
-    
-    if (payload.instanceID > 0) // Spheres
+    payload.materialIndex = hitGroup.materialIndex;
+
+    // The record says which surface this geometry is
+    float3 objNormal = hitGroup.flatNormal;
+    if (hitGroup.geometry == GEOMETRY_SPHERE)
+    {
+        objNormal = ObjectRayOrigin() + ObjectRayDirection() * RayTCurrent();
+    }
+    payload.hitNormal = normalize(mul((float3x3)ObjectToWorld3x4(), objNormal));
+}
+
+// Procedural spheres: the BLAS holds one AABB around the sphere and this
+// shader finds the exact hit with the same IntersectRaySphere the CPU tools
+// test.
+struct SphereAttributes
+{
+    float3 normal; // object space, unit length
+};
+
+[shader("intersection")]
+void SphereIntersection()
+{
+    float3 origin = ObjectRayOrigin();
+    float3 direction = ObjectRayDirection();
+    float t = IntersectRaySphere(origin, direction, float3(0, 0, 0), SCENE_SPHERE_RADIUS,
+                                 RayTMin(), RayTCurrent());
+    if (t == RAY_SPHERE_MISS)
     {
-        float3x4 objToWorld = ObjectToWorld3x4();
-        payload.hitNormal = normalize(objPos);
-        payload.hitNormal = normalize(mul((float3x3)objToWorld, payload.hitNormal));
+        return;
     }
-    else // Plane
+
+    SphereAttributes attr;
+    attr.normal = (origin + direction * t) / SCENE_SPHERE_RADIUS;
+    // Rays leaving the sphere from inside would hit a back face; the
+    // triangle path culls those, so do the same.
+    if (dot(attr.normal, direction) < 0.0)
     {
-        payload.hitNormal = float3(0, 1, 0);
+        ReportHit(t, 0, attr);
     }
 }
+
+[shader("closesthit")]
+void SphereClosestHit(inout RayPayload payload, in SphereAttributes attr)
+{
+    payload.didHit = true;
+    payload.hitPos = WorldRayOrigin() + WorldRayDirection() * RayTCurrent();
+    payload.materialIndex = hitGroup.materialIndex;
+    payload.hitNormal = normalize(mul((float3x3)ObjectToWorld3x4(), attr.normal));
+}
@@ -6,13 +6,24 @@
 typedef float4x4 XMMATRIX;
 typedef float4 XMFLOAT4;
 typedef float3 XMFLOAT3;
-#else
+#elif defined(_WIN32)
 // C++ side
 #include <DirectXMath.h>
 #define float4x4 DirectX::XMMATRIX
 #define float4 DirectX::XMFLOAT4
 #define float3 DirectX::XMFLOAT3
 #define uint unsigned int
+#else
+// C++ side without DirectXMath (the portable core on Linux): same sizes
+#include "../include/RtMath.h"
+#define float4x4 Float4x4
+#define float4 Float4
+#define float3 Float3
+#define uint unsigned int
+#endif
+
+#ifndef HLSL
+#include <math.h>
 #endif
 
 // Shared Constant Buffer Struct
@@ -25,8 +36,90 @@ struct ShaderParams {
   float emissiveIntensity;
   float animationTime;
   float padding;
+  uint checkerboard;       // nonzero: the launch covers half the pixels
+  uint checkerboardParity; // see CheckerboardTraced() in CheckerboardResolve.h
+  uint renderWidth;        // output size in pixels, which the launch
+  uint renderHeight;       // dimensions no longer match in checkerboard mode
+};
+
+// MaterialData::pattern
+#define MATERIAL_PATTERN_SOLID 0
+#define MATERIAL_PATTERN_CHECKER 1 // 2 m squares, dark ones scaled below
+#define MATERIAL_CHECKER_DARK (5.0f / 9.0f)
+
+// One entry of the material table (StructuredBuffer<MaterialData>, t1),
+// two 16-byte rows. Instances pick theirs through the hit group record.
+struct MaterialData {
+  float3 albedo;
+  float reflectivity; // throughput kept by the mirror bounce; 0 ends the path
+  float3 emissive;    // scaled by ShaderParams::emissiveIntensity
+  uint pattern;       // MATERIAL_PATTERN_*
 };
 
+// HitGroupRecord::geometry: how the triangle hit group finds its normal.
+#define GEOMETRY_FLAT 0   // HitGroupRecord::flatNormal (the floor)
+#define GEOMETRY_SPHERE 1 // away from the object-space origin
+
+// Local root arguments of a hit group record (cbuffer HitGroupConstants,
+// b0 space1), five root constants. Hit shaders take the surface from here
+// and the shading from Materials[materialIndex], never from InstanceID().
+// flatNormal leads so the HLSL cbuffer packing matches the C++ layout.
+struct HitGroupRecord {
+  float3 flatNormal;  // object space, GEOMETRY_FLAT only
+  uint materialIndex; // into the material table (t1)
+  uint geometry;      // GEOMETRY_*
+};
+
+// Procedural sphere geometry: the sphere instances' BLAS can be a single
+// AABB around a sphere of this radius at the object-space origin, hit by
+// the SphereIntersection shader (must match kSphereRadius).
+#define SCENE_SPHERE_RADIUS 0.5f
+#define RAY_SPHERE_MISS (-1.0f)
+
+// Nearest t in [tMin, tMax] (tMin >= 0) at which origin + t * direction
+// meets the sphere, or RAY_SPHERE_MISS. direction need not be unit length.
+// Scalar code only, so the same text compiles as HLSL and as C++ and the
+// CPU tools test exactly what the intersection shader runs.
+//
+// The discriminant comes from the ray's closest approach to the center,
+// (r - |l|)(r + |l|) rather than b^2 - ac, and the roots from the stable
+// form c / q and q / a, so grazing rays and spheres thousands of radii
+// away keep their precision (Ray Tracing Gems, chapter 7).
+inline float IntersectRaySphere(float3 origin, float3 direction,
+                                float3 center, float radius, float tMin,
+                                float tMax) {
+  float fx = origin.x - center.x;
+  float fy = origin.y - center.y;
+  float fz = origin.z - center.z;
+  float a = direction.x * direction.x + direction.y * direction.y +
+            direction.z * direction.z;
+  float b = fx * direction.x + fy * direction.y + fz * direction.z;
+  float c = (fx * fx + fy * fy + fz * fz) - radius * radius;
+
+  float s = b / a;
+  float lx = fx - s * direction.x;
+  float ly = fy - s * direction.y;
+  float lz = fz - s * direction.z;
+  float l = sqrt(lx * lx + ly * ly + lz * lz);
+  float discriminant = a * ((radius - l) * (radius + l));
+  if (!(discriminant >= 0.0f)) {
+    return RAY_SPHERE_MISS;
+  }
+
+  float q = -(b + (b >= 0.0f ? sqrt(discriminant) : -sqrt(discriminant)));
+  float t0 = c / q;
+  float t1 = q / a;
+  float tNear = t0 < t1 ? t0 : t1;
+  float tFar = t0 < t1 ? t1 : t0;
+  if (tNear >= tMin && tNear <= tMax) {
+    return tNear;
+  }
+  if (tFar >= tMin && tFar <= tMax) {
+    return tFar;
+  }
+  return RAY_SPHERE_MISS;
+}
+
 #ifdef HLSL
 // Cleanup macros if any
 #else
@@ -0,0 +1,30 @@
+// Stretches the renderWidth x renderHeight corner dynamic resolution traced
+// into over the whole outputWidth x outputHeight target, bilinearly.
+
+Texture2D<float4> Source : register(t0); // outputWidth x outputHeight
+RWTexture2D<float4> Output : register(u0);
+SamplerState LinearClamp : register(s0);
+
+cbuffer UpscaleConstants : register(b0)
+{
+    uint renderWidth;
+    uint renderHeight;
+    uint outputWidth;
+    uint outputHeight;
+};
+
+[numthreads(8, 8, 1)]
+void CSMain(uint3 id : SV_DispatchThreadID)
+{
+    if (id.x >= outputWidth || id.y >= outputHeight)
+    {
+        return;
+    }
+    float2 texel = 1.0 / float2(outputWidth, outputHeight);
+    float2 render = float2(renderWidth, renderHeight);
+    // Pixel centre in render pixels, kept half a texel inside the corner so
+    // the filter never reads the stale pixels around it.
+    float2 p = (float2(id.xy) + 0.5) * render / float2(outputWidth, outputHeight);
+    p = clamp(p, 0.5, render - 0.5);
+    Output[id.xy] = float4(Source.SampleLevel(LinearClamp, p * texel, 0).rgb, 1.0);
+}
@@ -6,7 +6,6 @@ cbuffer ConstantBuffer : register(b0)
 struct VSInput
 {
     float3 position : POSITION;
-    float3 color : COLOR;
 };
 
 struct PSInput
@@ -19,7 +18,7 @@ PSInput VSMain(VSInput input)
 {
     PSInput output;
     output.position = mul(float4(input.position, 1.0f), mvp);
-    output.color = input.color;
+    output.color = float3(1.0f, 1.0f, 1.0f);
     return output;
 }
 
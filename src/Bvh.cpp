@@ -0,0 +1,619 @@
+#include "../include/Bvh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+constexpr uint32_t kMaxBins = 64;
+constexpr float kFloatMax = 3.402823466e+38f;
+
+// Primitive reference used during the build: bounds plus the original
+// triangle index, 32 bytes so partitioning moves whole cache-line halves.
+struct BuildPrim {
+  Float3 boundsMin;
+  uint32_t index;
+  Float3 boundsMax;
+  uint32_t pad;
+};
+
+struct Bounds {
+  Float3 min = {kFloatMax, kFloatMax, kFloatMax};
+  Float3 max = {-kFloatMax, -kFloatMax, -kFloatMax};
+
+  void Grow(Float3 p) {
+    min = Min(min, p);
+    max = Max(max, p);
+  }
+  void Grow(const Bounds &b) {
+    min = Min(min, b.min);
+    max = Max(max, b.max);
+  }
+  float Area() const {
+    return max.x < min.x ? 0.0f : SurfaceArea(min, max);
+  }
+};
+
+// Bins are updated one float at a time: growing them through Float3
+// temporaries makes the compiler mix vector loads with scalar stores, and the
+// resulting store-forwarding stalls made binning about 2x slower.
+struct Bin {
+  float min[3] = {kFloatMax, kFloatMax, kFloatMax};
+  float max[3] = {-kFloatMax, -kFloatMax, -kFloatMax};
+  uint32_t count = 0;
+
+  void Grow(const Float3 &lo, const Float3 &hi) {
+    min[0] = std::min(min[0], lo.x);
+    min[1] = std::min(min[1], lo.y);
+    min[2] = std::min(min[2], lo.z);
+    max[0] = std::max(max[0], hi.x);
+    max[1] = std::max(max[1], hi.y);
+    max[2] = std::max(max[2], hi.z);
+  }
+  Bounds ToBounds() const {
+    Bounds b;
+    b.min = {min[0], min[1], min[2]};
+    b.max = {max[0], max[1], max[2]};
+    return b;
+  }
+};
+
+struct NodeBounds {
+  Bounds bounds;
+  Bounds centroids;
+};
+
+// Child bounds are gathered while partitioning the parent, so only the root
+// needs a separate pass over its primitives.
+struct BuildTask {
+  uint32_t node;
+  uint32_t begin;
+  uint32_t end;
+  uint32_t depth;
+  NodeBounds nb;
+};
+
+struct WorkerStats {
+  uint32_t maxDepth = 0;
+  uint32_t leafCount = 0;
+  uint32_t maxLeafPrims = 0;
+  uint64_t leafPrims = 0;
+};
+
+// Per-thread state, reused across nodes so small subtrees do not pay for
+// allocating and clearing scratch space.
+struct WorkerContext {
+  WorkerStats stats;
+  std::vector<BuildTask> stack;
+  std::vector<Bin> bins; // 3 axes * binCount
+};
+
+inline Float3 Centroid(const BuildPrim &p) {
+  return (p.boundsMin + p.boundsMax) * 0.5f;
+}
+
+inline float Axis(Float3 v, int axis) { return (&v.x)[axis]; }
+
+// Runs fn(begin, end) over [0, count) split into threadCount chunks. The
+// calling thread takes the first chunk.
+template <typename Fn>
+void ParallelChunks(size_t count, unsigned threadCount, Fn &&fn) {
+  if (threadCount <= 1 || count < threadCount) {
+    fn(0, count, 0u);
+    return;
+  }
+  size_t chunk = (count + threadCount - 1) / threadCount;
+  std::vector<std::thread> threads;
+  threads.reserve(threadCount - 1);
+  for (unsigned t = 1; t < threadCount; ++t) {
+    size_t begin = std::min(count, chunk * t);
+    size_t end = std::min(count, begin + chunk);
+    threads.emplace_back([&fn, begin, end, t]() { fn(begin, end, t); });
+  }
+  fn(0, std::min(count, chunk), 0u);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+class BvhBuilder {
+public:
+  BvhBuilder(std::vector<BuildPrim> &prims, Bvh::NodeArray &nodes,
+             const BvhBuildSettings &settings, unsigned threadCount)
+      : m_prims(prims), m_nodes(nodes), m_settings(settings),
+        m_threadCount(threadCount) {
+    m_binCount = std::clamp(settings.binCount, 2u, kMaxBins);
+  }
+
+  void Run() {
+    uint32_t count = (uint32_t)m_prims.size();
+    Push({0, 0, count, 0, ComputeBounds(0, count)});
+
+    std::vector<std::thread> workers;
+    workers.reserve(m_threadCount - 1);
+    for (unsigned i = 1; i < m_threadCount; ++i) {
+      workers.emplace_back([this]() { WorkerLoop(); });
+    }
+    WorkerLoop();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  uint32_t NodeCount() const { return m_nodeCount.load(); }
+  const WorkerStats &Stats() const { return m_stats; }
+
+private:
+  void Push(const BuildTask &task) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_tasks.push_back(task);
+      ++m_pending;
+    }
+    m_cv.notify_one();
+  }
+
+  void WorkerLoop() {
+    WorkerContext ctx;
+    ctx.bins.resize(3 * (size_t)m_binCount);
+    for (;;) {
+      BuildTask task;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return !m_tasks.empty() || m_pending == 0; });
+        if (m_tasks.empty()) {
+          break;
+        }
+        task = m_tasks.front();
+        m_tasks.pop_front();
+      }
+
+      ctx.stack.push_back(task);
+      while (!ctx.stack.empty()) {
+        BuildTask t = ctx.stack.back();
+        ctx.stack.pop_back();
+        Subdivide(t, ctx);
+      }
+
+      bool finished;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        finished = --m_pending == 0;
+      }
+      if (finished) {
+        m_cv.notify_all();
+      }
+    }
+
+    const WorkerStats &local = ctx.stats;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.maxDepth = std::max(m_stats.maxDepth, local.maxDepth);
+    m_stats.leafCount += local.leafCount;
+    m_stats.maxLeafPrims = std::max(m_stats.maxLeafPrims, local.maxLeafPrims);
+    m_stats.leafPrims += local.leafPrims;
+  }
+
+  NodeBounds ComputeBounds(uint32_t begin, uint32_t end) const {
+    auto accumulate = [this](size_t b, size_t e, NodeBounds &out) {
+      for (size_t i = b; i < e; ++i) {
+        const BuildPrim &p = m_prims[i];
+        out.bounds.Grow(p.boundsMin);
+        out.bounds.Grow(p.boundsMax);
+        out.centroids.Grow(Centroid(p));
+      }
+    };
+
+    uint32_t count = end - begin;
+    NodeBounds result;
+    if (count < m_settings.parallelBinThreshold || m_threadCount <= 1) {
+      accumulate(begin, end, result);
+      return result;
+    }
+
+    std::vector<NodeBounds> partial(m_threadCount);
+    ParallelChunks(count, m_threadCount, [&](size_t b, size_t e, unsigned t) {
+      accumulate(begin + b, begin + e, partial[t]);
+    });
+    for (const NodeBounds &p : partial) {
+      result.bounds.Grow(p.bounds);
+      result.centroids.Grow(p.centroids);
+    }
+    return result;
+  }
+
+  // Bins all three axes at once; bins[axis * binCount + i].
+  void BinPrims(uint32_t begin, uint32_t end, const Bounds &centroids,
+                Bin *bins) const {
+    Float3 extent = centroids.max - centroids.min;
+    float scale[3];
+    for (int a = 0; a < 3; ++a) {
+      float e = Axis(extent, a);
+      scale[a] = e > 0.0f ? (float)m_binCount / e : 0.0f;
+    }
+
+    auto binRange = [&](size_t b, size_t e, Bin *out) {
+      for (size_t i = b; i < e; ++i) {
+        const BuildPrim &p = m_prims[i];
+        Float3 c = Centroid(p);
+        for (int a = 0; a < 3; ++a) {
+          uint32_t bin = (uint32_t)((Axis(c, a) - Axis(centroids.min, a)) *
+                                    scale[a]);
+          bin = std::min(bin, m_binCount - 1);
+          Bin &target = out[a * m_binCount + bin];
+          target.Grow(p.boundsMin, p.boundsMax);
+          ++target.count;
+        }
+      }
+    };
+
+    uint32_t count = end - begin;
+    if (count < m_settings.parallelBinThreshold || m_threadCount <= 1) {
+      binRange(begin, end, bins);
+      return;
+    }
+
+    size_t stride = 3 * (size_t)m_binCount;
+    std::vector<Bin> partial(m_threadCount * stride);
+    ParallelChunks(count, m_threadCount, [&](size_t b, size_t e, unsigned t) {
+      binRange(begin + b, begin + e, &partial[t * stride]);
+    });
+    for (unsigned t = 0; t < m_threadCount; ++t) {
+      for (size_t i = 0; i < stride; ++i) {
+        const Bin &src = partial[t * stride + i];
+        bins[i].Grow({src.min[0], src.min[1], src.min[2]},
+                     {src.max[0], src.max[1], src.max[2]});
+        bins[i].count += src.count;
+      }
+    }
+  }
+
+  void MakeLeaf(BvhNode &node, const BuildTask &task, WorkerStats &stats) {
+    uint32_t count = task.end - task.begin;
+    node.leftFirst = task.begin;
+    node.primCount = count;
+    stats.leafCount++;
+    stats.leafPrims += count;
+    stats.maxLeafPrims = std::max(stats.maxLeafPrims, count);
+    stats.maxDepth = std::max(stats.maxDepth, task.depth);
+  }
+
+  void Subdivide(const BuildTask &task, WorkerContext &ctx) {
+    WorkerStats &stats = ctx.stats;
+    BvhNode &node = m_nodes[task.node];
+    uint32_t count = task.end - task.begin;
+
+    const NodeBounds &nb = task.nb;
+    node.boundsMin = nb.bounds.min;
+    node.boundsMax = nb.bounds.max;
+
+    if (count <= 1) {
+      MakeLeaf(node, task, stats);
+      return;
+    }
+
+    // Find the cheapest binned split over all axes.
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+    float bestCost = kFloatMax;
+    Float3 cExtent = nb.centroids.max - nb.centroids.min;
+
+    if (cExtent.x > 0.0f || cExtent.y > 0.0f || cExtent.z > 0.0f) {
+      Bin *bins = ctx.bins.data();
+      std::fill(ctx.bins.begin(), ctx.bins.end(), Bin());
+      BinPrims(task.begin, task.end, nb.centroids, bins);
+
+      for (int a = 0; a < 3; ++a) {
+        if (Axis(cExtent, a) <= 0.0f) {
+          continue;
+        }
+        const Bin *axisBins = &bins[a * m_binCount];
+        float leftArea[kMaxBins];
+        uint32_t leftCount[kMaxBins];
+        Bounds acc;
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < m_binCount - 1; ++i) {
+          acc.Grow(axisBins[i].ToBounds());
+          n += axisBins[i].count;
+          leftArea[i] = acc.Area();
+          leftCount[i] = n;
+        }
+        acc = Bounds();
+        n = 0;
+        for (uint32_t i = m_binCount - 1; i > 0; --i) {
+          acc.Grow(axisBins[i].ToBounds());
+          n += axisBins[i].count;
+          if (leftCount[i - 1] == 0 || n == 0) {
+            continue;
+          }
+          float cost = leftArea[i - 1] * leftCount[i - 1] + acc.Area() * n;
+          if (cost < bestCost) {
+            bestCost = cost;
+            bestAxis = a;
+            bestSplit = i;
+          }
+        }
+      }
+    }
+
+    float nodeArea = nb.bounds.Area();
+    float splitCost =
+        bestAxis >= 0 && nodeArea > 0.0f
+            ? m_settings.traversalCost +
+                  m_settings.intersectionCost * bestCost / nodeArea
+            : kFloatMax;
+    float leafCost = m_settings.intersectionCost * count;
+
+    if (count <= m_settings.maxLeafSize && leafCost <= splitCost) {
+      MakeLeaf(node, task, stats);
+      return;
+    }
+
+    uint32_t left = m_nodeCount.fetch_add(2, std::memory_order_relaxed);
+    node.leftFirst = left;
+    node.primCount = 0;
+
+    BuildTask children[2] = {{left, task.begin, task.end, task.depth + 1, {}},
+                             {left + 1, task.begin, task.end, task.depth + 1,
+                              {}}};
+    if (bestAxis >= 0) {
+      float cmin = Axis(nb.centroids.min, bestAxis);
+      float scale = (float)m_binCount / Axis(cExtent, bestAxis);
+      // Accumulate into locals; growing through a reference picked per
+      // primitive keeps the bounds in memory and serializes the loop.
+      NodeBounds leftBounds, rightBounds;
+      uint32_t i = task.begin;
+      uint32_t j = task.end;
+      while (i < j) {
+        BuildPrim &p = m_prims[i];
+        Float3 c = Centroid(p);
+        uint32_t bin = (uint32_t)((Axis(c, bestAxis) - cmin) * scale);
+        if (std::min(bin, m_binCount - 1) < bestSplit) {
+          leftBounds.bounds.Grow(p.boundsMin);
+          leftBounds.bounds.Grow(p.boundsMax);
+          leftBounds.centroids.Grow(c);
+          ++i;
+        } else {
+          rightBounds.bounds.Grow(p.boundsMin);
+          rightBounds.bounds.Grow(p.boundsMax);
+          rightBounds.centroids.Grow(c);
+          std::swap(p, m_prims[--j]);
+        }
+      }
+      children[0].end = i;
+      children[1].begin = i;
+      children[0].nb = leftBounds;
+      children[1].nb = rightBounds;
+    } else {
+      // All centroids coincide: split the range in half to respect the leaf
+      // size limit.
+      uint32_t mid = task.begin + count / 2;
+      children[0].end = mid;
+      children[1].begin = mid;
+      children[0].nb = ComputeBounds(task.begin, mid);
+      children[1].nb = ComputeBounds(mid, task.end);
+    }
+
+    for (const BuildTask &child : children) {
+      if (m_threadCount > 1 &&
+          child.end - child.begin >= m_settings.taskThreshold) {
+        Push(child);
+      } else {
+        ctx.stack.push_back(child);
+      }
+    }
+  }
+
+  std::vector<BuildPrim> &m_prims;
+  Bvh::NodeArray &m_nodes;
+  const BvhBuildSettings &m_settings;
+  unsigned m_threadCount;
+  uint32_t m_binCount;
+
+  // Root lives at 0, slot 1 is padding so every sibling pair starts on an
+  // even index (and therefore a 64-byte boundary).
+  std::atomic<uint32_t> m_nodeCount{2};
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::deque<BuildTask> m_tasks;
+  uint32_t m_pending = 0;
+  WorkerStats m_stats;
+};
+
+unsigned ResolveThreadCount(const BvhBuildSettings &settings) {
+  if (settings.threadCount != 0) {
+    return settings.threadCount;
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Shared by both Build overloads once the primitive references exist.
+BvhBuildStats BuildTree(std::vector<BuildPrim> &prims,
+                        const BvhBuildSettings &settings,
+                        unsigned threadCount, Bvh::NodeArray &nodes,
+                        std::vector<uint32_t> &primIndices) {
+  uint32_t primCount = (uint32_t)prims.size();
+
+  // A binary tree with N leaves has at most 2N - 1 nodes, plus the padding
+  // slot after the root.
+  nodes.resize((size_t)primCount * 2);
+
+  BvhBuilder builder(prims, nodes, settings, threadCount);
+  builder.Run();
+
+  nodes.resize(builder.NodeCount());
+  nodes.shrink_to_fit();
+  nodes[1] = BvhNode{};
+
+  primIndices.resize(primCount);
+  for (uint32_t i = 0; i < primCount; ++i) {
+    primIndices[i] = prims[i].index;
+  }
+
+  const WorkerStats &ws = builder.Stats();
+  BvhBuildStats stats;
+  stats.nodeCount = builder.NodeCount() - 1; // minus the padding slot
+  stats.leafCount = ws.leafCount;
+  stats.maxDepth = ws.maxDepth;
+  stats.maxLeafPrims = ws.maxLeafPrims;
+  stats.avgLeafPrims =
+      ws.leafCount ? (float)ws.leafPrims / (float)ws.leafCount : 0.0f;
+  stats.threadCount = threadCount;
+  return stats;
+}
+
+} // namespace
+
+float SurfaceArea(Float3 boundsMin, Float3 boundsMax) {
+  Float3 e = boundsMax - boundsMin;
+  return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+void Bvh::Build(const void *positions, size_t vertexStride,
+                size_t vertexCount, const uint32_t *indices, size_t indexCount,
+                const BvhBuildSettings &settings) {
+  auto start = std::chrono::steady_clock::now();
+
+  m_nodes.clear();
+  m_primIndices.clear();
+  m_stats = BvhBuildStats();
+
+  uint32_t triCount = (uint32_t)(indexCount / 3);
+  if (triCount == 0) {
+    return;
+  }
+
+  unsigned threadCount = ResolveThreadCount(settings);
+
+  const uint8_t *base = static_cast<const uint8_t *>(positions);
+  auto vertex = [base, vertexStride, vertexCount](uint32_t i) {
+    Float3 p = {0.0f, 0.0f, 0.0f};
+    if (i < vertexCount) {
+      std::memcpy(&p, base + (size_t)i * vertexStride, sizeof(Float3));
+    }
+    return p;
+  };
+
+  std::vector<BuildPrim> prims(triCount);
+  unsigned setupThreads = triCount >= settings.parallelBinThreshold
+                              ? threadCount
+                              : 1u;
+  ParallelChunks(triCount, setupThreads, [&](size_t b, size_t e, unsigned) {
+    for (size_t t = b; t < e; ++t) {
+      Float3 v0 = vertex(indices[t * 3 + 0]);
+      Float3 v1 = vertex(indices[t * 3 + 1]);
+      Float3 v2 = vertex(indices[t * 3 + 2]);
+      BuildPrim &p = prims[t];
+      p.boundsMin = Min(v0, Min(v1, v2));
+      p.boundsMax = Max(v0, Max(v1, v2));
+      p.index = (uint32_t)t;
+      p.pad = 0;
+    }
+  });
+
+  m_stats = BuildTree(prims, settings, threadCount, m_nodes, m_primIndices);
+  FinishStats(settings, start);
+}
+
+void Bvh::Build(const Aabb *primBounds, size_t primCount,
+                const BvhBuildSettings &settings) {
+  auto start = std::chrono::steady_clock::now();
+
+  m_nodes.clear();
+  m_primIndices.clear();
+  m_stats = BvhBuildStats();
+  if (primCount == 0) {
+    return;
+  }
+
+  unsigned threadCount = ResolveThreadCount(settings);
+  std::vector<BuildPrim> prims(primCount);
+  for (size_t i = 0; i < primCount; ++i) {
+    prims[i] = {primBounds[i].min, (uint32_t)i, primBounds[i].max, 0};
+  }
+  m_stats = BuildTree(prims, settings, threadCount, m_nodes, m_primIndices);
+  FinishStats(settings, start);
+}
+
+void Bvh::FinishStats(const BvhBuildSettings &settings,
+                      std::chrono::steady_clock::time_point start) {
+  m_traversalCost = settings.traversalCost;
+  m_intersectionCost = settings.intersectionCost;
+  m_stats.buildMs = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  m_stats.sahCost =
+      ComputeSahCost(settings.traversalCost, settings.intersectionCost);
+}
+
+float Bvh::Refit(const Aabb *primBounds) {
+  // Children are always allocated after their parent, so one reverse sweep
+  // sees both children of a node before the node itself.
+  double cost = 0.0;
+  for (size_t n = m_nodes.size(); n-- > 0;) {
+    if (n == 1) {
+      continue; // padding slot
+    }
+    BvhNode &node = m_nodes[n];
+    if (node.IsLeaf()) {
+      const Aabb &first = primBounds[m_primIndices[node.leftFirst]];
+      Float3 lo = first.min;
+      Float3 hi = first.max;
+      for (uint32_t i = 1; i < node.primCount; ++i) {
+        const Aabb &b = primBounds[m_primIndices[node.leftFirst + i]];
+        lo = Min(lo, b.min);
+        hi = Max(hi, b.max);
+      }
+      node.boundsMin = lo;
+      node.boundsMax = hi;
+      cost += m_intersectionCost * node.primCount * SurfaceArea(lo, hi);
+    } else {
+      const BvhNode &left = m_nodes[node.leftFirst];
+      const BvhNode &right = m_nodes[node.leftFirst + 1];
+      node.boundsMin = Min(left.boundsMin, right.boundsMin);
+      node.boundsMax = Max(left.boundsMax, right.boundsMax);
+      cost += m_traversalCost * SurfaceArea(node.boundsMin, node.boundsMax);
+    }
+  }
+  if (m_nodes.empty()) {
+    return 0.0f;
+  }
+  float rootArea = SurfaceArea(m_nodes[0].boundsMin, m_nodes[0].boundsMax);
+  if (rootArea <= 0.0f) {
+    return m_intersectionCost * m_nodes[0].primCount;
+  }
+  return (float)(cost / rootArea);
+}
+
+float Bvh::ComputeSahCost(float traversalCost, float intersectionCost) const {
+  if (m_nodes.empty()) {
+    return 0.0f;
+  }
+  float rootArea = SurfaceArea(m_nodes[0].boundsMin, m_nodes[0].boundsMax);
+  if (rootArea <= 0.0f) {
+    return intersectionCost * m_nodes[0].primCount;
+  }
+
+  double cost = 0.0;
+  std::vector<uint32_t> stack;
+  stack.push_back(0);
+  while (!stack.empty()) {
+    const BvhNode &node = m_nodes[stack.back()];
+    stack.pop_back();
+    double area = SurfaceArea(node.boundsMin, node.boundsMax);
+    if (node.IsLeaf()) {
+      cost += intersectionCost * node.primCount * area;
+    } else {
+      cost += traversalCost * area;
+      stack.push_back(node.leftFirst);
+      stack.push_back(node.leftFirst + 1);
+    }
+  }
+  return (float)(cost / rootArea);
+}
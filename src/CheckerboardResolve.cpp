@@ -0,0 +1,111 @@
+#include "../include/CheckerboardResolve.h"
+#include "../include/JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Rows per job when the resolve is split over the job system.
+constexpr uint32_t kRowGrain = 16;
+
+struct Weights {
+  int history; // out of 256
+  int margin;  // out of 255
+};
+
+// One missing pixel from up to four traced neighbours (n[0..count)).
+inline void ResolvePixel(const uint8_t *const *n, int count,
+                         const uint8_t *history, const Weights &w,
+                         uint8_t *out) {
+  for (int c = 0; c < 3; ++c) {
+    int sum = 0, lo = 255, hi = 0;
+    for (int i = 0; i < count; ++i) {
+      int v = n[i][c];
+      sum += v;
+      lo = std::min(lo, v);
+      hi = std::max(hi, v);
+    }
+    int spatial = (sum + count / 2) / count;
+    if (history) {
+      int h = std::clamp((int)history[c], lo - w.margin, hi + w.margin);
+      spatial = (spatial * (256 - w.history) + h * w.history + 128) >> 8;
+    }
+    out[c] = (uint8_t)spatial;
+  }
+  out[3] = 255;
+}
+
+} // namespace
+
+void ResolveCheckerboardRows(const CheckerboardImages &images,
+                             uint32_t parity,
+                             const CheckerboardSettings &settings, int yBegin,
+                             int yEnd) {
+  const int width = images.width;
+  const int height = images.height;
+  const size_t stride = (size_t)width * 4;
+  Weights w;
+  w.history = (int)std::lround(
+      std::clamp(settings.historyWeight, 0.0f, 1.0f) * 256.0f);
+  w.margin =
+      (int)std::lround(std::clamp(settings.clampMargin, 0.0f, 1.0f) * 255.0f);
+
+  for (int y = yBegin; y < yEnd; ++y) {
+    const uint8_t *row = images.current + y * stride;
+    const uint8_t *above = y > 0 ? row - stride : nullptr;
+    const uint8_t *below = y + 1 < height ? row + stride : nullptr;
+    const uint8_t *history =
+        images.history ? images.history + y * stride : nullptr;
+    uint8_t *out = images.out + y * stride;
+
+    for (int x = 0; x < width; ++x) {
+      size_t offset = (size_t)x * 4;
+      if (CheckerboardTraced((uint32_t)x, (uint32_t)y, parity)) {
+        std::memcpy(out + offset, row + offset, 4);
+        continue;
+      }
+      const uint8_t *n[4];
+      int count = 0;
+      if (x > 0) {
+        n[count++] = row + offset - 4;
+      }
+      if (x + 1 < width) {
+        n[count++] = row + offset + 4;
+      }
+      if (above) {
+        n[count++] = above + offset;
+      }
+      if (below) {
+        n[count++] = below + offset;
+      }
+      if (count == 0) {
+        // A 1x1 image whose only pixel was not traced this frame.
+        if (history) {
+          std::memcpy(out + offset, history + offset, 4);
+        } else {
+          std::memset(out + offset, 0, 3);
+          out[offset + 3] = 255;
+        }
+        continue;
+      }
+      ResolvePixel(n, count, history ? history + offset : nullptr, w,
+                   out + offset);
+    }
+  }
+}
+
+void ResolveCheckerboard(const CheckerboardImages &images, uint32_t parity,
+                         const CheckerboardSettings &settings,
+                         JobSystem *jobs) {
+  if (!jobs || (uint32_t)images.height <= kRowGrain) {
+    ResolveCheckerboardRows(images, parity, settings, 0, images.height);
+    return;
+  }
+  jobs->ParallelFor((uint32_t)images.height, kRowGrain,
+                    [&](uint32_t begin, uint32_t end) {
+                      ResolveCheckerboardRows(images, parity, settings,
+                                              (int)begin, (int)end);
+                    });
+}
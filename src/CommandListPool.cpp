@@ -0,0 +1,130 @@
+#include "../include/CommandListPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+CommandListPool::CommandListPool(GpuQueue &queue, CommandListBackend &backend,
+                                 uint32_t maxAllocators, uint32_t maxLists)
+    : m_queue(queue), m_backend(backend), m_maxAllocators(maxAllocators),
+      m_maxLists(maxLists) {
+  if (maxAllocators == 0 || maxLists == 0) {
+    throw std::runtime_error(
+        "CommandListPool: needs at least one allocator and one list");
+  }
+}
+
+CommandListPool::Recording CommandListPool::Begin(uint32_t order) {
+  Recording recording = {0, 0, order};
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // Everything is in flight or checked out; the oldest finished frame is
+    // the first to give allocators back. The fence wait runs unlocked so
+    // other recordings can End() meanwhile, and another Begin() may take
+    // what it frees first, so keep waiting until one is free here.
+    while (m_freeAllocators.empty() &&
+           m_stats.allocatorsCreated == m_maxAllocators) {
+      if (m_inFlight.empty()) {
+        throw std::runtime_error("CommandListPool: every allocator is "
+                                 "recording or awaiting FinishFrame");
+      }
+      uint64_t fence = m_inFlight.front().fence;
+      lock.unlock();
+      double waitMs = m_queue.Wait(fence);
+      lock.lock();
+      m_stats.fenceWaitMs += waitMs;
+      ++m_stats.fenceWaits;
+      RetireLocked(m_queue.CompletedValue());
+    }
+    if (!m_freeAllocators.empty()) {
+      recording.allocator = m_freeAllocators.back();
+      m_freeAllocators.pop_back();
+      ++m_stats.allocatorReuses;
+    } else {
+      recording.allocator = m_stats.allocatorsCreated++;
+      m_backend.CreateAllocator(recording.allocator);
+    }
+
+    if (!m_freeLists.empty()) {
+      recording.list = m_freeLists.back();
+      m_freeLists.pop_back();
+    } else if (m_stats.listsCreated < m_maxLists) {
+      recording.list = m_stats.listsCreated++;
+      m_backend.CreateList(recording.list);
+    } else {
+      m_freeAllocators.push_back(recording.allocator);
+      throw std::runtime_error(
+          "CommandListPool: more lists open or unsubmitted than maxLists");
+    }
+    ++m_stats.recordings;
+  }
+
+  // Both are exclusively ours now, so the device calls run unlocked.
+  m_backend.ResetAllocator(recording.allocator);
+  m_backend.ResetList(recording.list, recording.allocator);
+  return recording;
+}
+
+void CommandListPool::End(const Recording &recording) {
+  m_backend.CloseList(recording.list);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_ended.push_back(recording);
+}
+
+uint32_t CommandListPool::Submit() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_ended.empty()) {
+    return 0;
+  }
+  std::stable_sort(m_ended.begin(), m_ended.end(),
+                   [](const Recording &a, const Recording &b) {
+                     return a.order < b.order;
+                   });
+  std::vector<uint32_t> lists;
+  lists.reserve(m_ended.size());
+  for (const Recording &recording : m_ended) {
+    lists.push_back(recording.list);
+  }
+  m_backend.ExecuteLists(lists.data(), (uint32_t)lists.size());
+
+  // A list may be reset as soon as it has been executed; its allocator
+  // has to wait for the GPU.
+  for (const Recording &recording : m_ended) {
+    m_freeLists.push_back(recording.list);
+    m_submitted.push_back(recording.allocator);
+  }
+  uint32_t count = (uint32_t)m_ended.size();
+  m_ended.clear();
+  ++m_stats.batches;
+  m_stats.maxBatchSize = std::max(m_stats.maxBatchSize, count);
+  return count;
+}
+
+void CommandListPool::FinishFrame(uint64_t fenceValue) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_inFlight.empty() && fenceValue < m_inFlight.back().fence) {
+    throw std::runtime_error(
+        "CommandListPool: fence values must not decrease");
+  }
+  for (uint32_t allocator : m_submitted) {
+    m_inFlight.push_back({fenceValue, allocator});
+  }
+  m_submitted.clear();
+}
+
+void CommandListPool::Retire(uint64_t completedValue) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  RetireLocked(completedValue);
+}
+
+void CommandListPool::RetireLocked(uint64_t completedValue) {
+  while (!m_inFlight.empty() && m_inFlight.front().fence <= completedValue) {
+    m_freeAllocators.push_back(m_inFlight.front().allocator);
+    m_inFlight.pop_front();
+  }
+}
+
+CommandListPoolStats CommandListPool::Stats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
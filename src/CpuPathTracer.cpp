@@ -0,0 +1,238 @@
+#include "../include/CpuPathTracer.h"
+#include "../include/CheckerboardResolve.h"
+#include "../include/InstanceBvh.h"
+#include "../include/MaterialRegistry.h"
+#include "../include/MeshBvh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+constexpr float kTMin = 0.001f;
+constexpr float kTMax = 10000.0f;
+
+Float3 ComputeLighting(Float3 hitPos, Float3 normal, Float3 baseColor,
+                       Float3 lightPos) {
+  Float3 lightDir = Normalize(lightPos - hitPos);
+  float diff = std::fmax(Dot(normal, lightDir), 0.0f);
+  return baseColor * (diff * 0.8f + 0.2f);
+}
+
+uint8_t ToUnorm8(float v) {
+  v = std::fmin(std::fmax(v, 0.0f), 1.0f);
+  return (uint8_t)(v * 255.0f + 0.5f);
+}
+
+} // namespace
+
+CpuCamera CpuCamera::FromYawPitch(Float3 position, float yaw, float pitch,
+                                  float aspect) {
+  Float3 forward = CameraForward(yaw, pitch);
+  Float4x4 view = LookAtLH(position, position + forward, {0.0f, 1.0f, 0.0f});
+  Float4x4 proj =
+      PerspectiveFovLH(kCameraFovY, aspect, 0.1f, 1000.0f);
+  return {Inverse(view), Inverse(proj)};
+}
+
+Ray CpuCamera::PixelRay(float px, float py, int width, int height) const {
+  float crdX = px / (float)width * 2.0f - 1.0f;
+  float crdY = -(py / (float)height * 2.0f - 1.0f);
+
+  Float4 target = Transform({crdX, crdY, 1.0f, 1.0f}, projInverse);
+  Float3 t3 = Normalize({target.x, target.y, target.z});
+  Float4 direction = Transform({t3.x, t3.y, t3.z, 0.0f}, viewInverse);
+
+  Ray ray;
+  ray.origin = {viewInverse.m[3][0], viewInverse.m[3][1], viewInverse.m[3][2]};
+  ray.direction = Normalize({direction.x, direction.y, direction.z});
+  ray.tMin = kTMin;
+  ray.tMax = kTMax;
+  return ray;
+}
+
+CpuPathTracer::CpuPathTracer() = default;
+CpuPathTracer::~CpuPathTracer() = default;
+
+void CpuPathTracer::SetMesh(SceneMesh mesh,
+                            const std::vector<MeshVertex> &vertices,
+                            const std::vector<uint32_t> &indices) {
+  auto data = std::make_unique<MeshBvh>();
+  data->Build(vertices, indices);
+  m_meshes[(uint32_t)mesh] = std::move(data);
+}
+
+CpuPathTracer::Stats
+CpuPathTracer::Render(const Settings &settings, const CpuCamera &camera,
+                      const std::vector<SceneInstance> &instances,
+                      std::vector<uint8_t> &rgba) const {
+  InstanceBvh scene;
+  for (uint32_t mesh = 0; mesh < 2; ++mesh) {
+    scene.SetMesh((SceneMesh)mesh, m_meshes[mesh].get());
+  }
+  scene.Build(instances);
+
+  // The same material table and hit group records the renderer uploads,
+  // indexed by instance ID.
+  uint32_t instanceCount = 0;
+  for (const SceneInstance &inst : instances) {
+    instanceCount = std::max(instanceCount, inst.instanceID + 1);
+  }
+  MaterialRegistry materials;
+  std::vector<uint32_t> instanceMaterials;
+  BuildSceneMaterials(instanceCount, materials, instanceMaterials);
+  std::vector<HitGroupRecord> hitGroupRecords;
+  BuildSceneHitGroupRecords(instances, instanceMaterials, hitGroupRecords);
+
+  const int width = settings.width;
+  const int height = settings.height;
+  const int tileSize = settings.tileSize > 0 ? settings.tileSize : 32;
+  const int tilesX = (width + tileSize - 1) / tileSize;
+  const int tilesY = (height + tileSize - 1) / tileSize;
+  const int tileCount = tilesX * tilesY;
+
+  rgba.assign((size_t)width * height * 4, 0);
+  const bool checkerboard = settings.checkerboardParity >= 0;
+  const uint32_t parity = (uint32_t)settings.checkerboardParity & 1;
+
+  // RayGen for one pixel; returns the number of TraceRay calls made.
+  auto shadePixel = [&](int px, int py, uint8_t *out) -> uint32_t {
+    Ray ray = camera.PixelRay((float)px, (float)py, width, height);
+
+    Float3 finalColor = {0.0f, 0.0f, 0.0f};
+    Float3 throughput = {1.0f, 1.0f, 1.0f};
+    uint32_t raysTraced = 0;
+
+    for (uint32_t bounce = 0; bounce < settings.maxBounces; ++bounce) {
+      // TraceRay(Scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, ...)
+      InstanceHit hit;
+      ++raysTraced;
+      if (!scene.Intersect(ray, hit)) {
+        // Miss: sky gradient
+        Float3 dir = Normalize(ray.direction);
+        float t = 0.5f * (dir.y + 1.0f);
+        Float3 skyColor = Lerp({1.0f, 1.0f, 1.0f}, {0.5f, 0.7f, 1.0f}, t);
+        finalColor += throughput * skyColor;
+        break;
+      }
+
+      // ClosestHit
+      const SceneInstance &instance = instances[hit.instance];
+      const HitGroupRecord &record = hitGroupRecords[instance.instanceID];
+      Float3 hitPos = ray.origin + ray.direction * hit.t;
+      Float3 objNormal = {record.flatNormal.x, record.flatNormal.y,
+                          record.flatNormal.z};
+      if (record.geometry == GEOMETRY_SPHERE) {
+        const Float3x4 &worldToObject = scene.WorldToObject(hit.instance);
+        Float3 objOrigin = TransformPoint(worldToObject, ray.origin);
+        Float3 objDir = TransformVector(worldToObject, ray.direction);
+        objNormal = objOrigin + objDir * hit.t;
+      }
+      Float3 hitNormal =
+          Normalize(TransformVector(instance.transform, objNormal));
+
+      const MaterialData &material =
+          materials.Materials()[record.materialIndex];
+      Float3 baseColor = MaterialBaseColor(material, hitPos);
+      Float3 litColor =
+          ComputeLighting(hitPos, hitNormal, baseColor, settings.lightPos);
+      Float3 emissive = {material.emissive.x, material.emissive.y,
+                         material.emissive.z};
+      finalColor += throughput * (litColor * (1.0f - material.reflectivity) +
+                                  emissive * settings.emissiveIntensity);
+      if (material.reflectivity <= 0.0f) {
+        break;
+      }
+
+      // Mirror bounce
+      throughput *= material.reflectivity;
+      ray.origin = hitPos + hitNormal * 0.01f;
+      ray.direction = Reflect(ray.direction, hitNormal);
+      ray.tMin = kTMin;
+      ray.tMax = kTMax;
+    }
+
+    out[0] = ToUnorm8(finalColor.x);
+    out[1] = ToUnorm8(finalColor.y);
+    out[2] = ToUnorm8(finalColor.z);
+    out[3] = 255;
+    return raysTraced;
+  };
+
+  unsigned threadCount = settings.threadCount;
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threadCount = std::min<unsigned>(threadCount, (unsigned)tileCount);
+
+  std::atomic<int> nextTile{0};
+  std::atomic<uint64_t> totalRays{0};
+
+  auto worker = [&]() {
+    uint64_t rays = 0;
+    for (;;) {
+      int tile = nextTile.fetch_add(1, std::memory_order_relaxed);
+      if (tile >= tileCount) {
+        break;
+      }
+      int x0 = (tile % tilesX) * tileSize;
+      int y0 = (tile / tilesX) * tileSize;
+      int x1 = std::min(x0 + tileSize, width);
+      int y1 = std::min(y0 + tileSize, height);
+      for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+          if (checkerboard && !CheckerboardTraced(x, y, parity)) {
+            continue;
+          }
+          rays += shadePixel(x, y, &rgba[((size_t)y * width + x) * 4]);
+        }
+      }
+    }
+    totalRays.fetch_add(rays, std::memory_order_relaxed);
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  threads.reserve(threadCount - 1);
+  for (unsigned i = 1; i < threadCount; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &t : threads) {
+    t.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  Stats stats;
+  stats.primaryRays =
+      checkerboard ? (uint64_t)CheckerboardLaunchWidth(width) * height -
+                         (width % 2 ? (height + parity) / 2 : 0)
+                   : (uint64_t)width * height;
+  stats.totalRays = totalRays.load();
+  stats.seconds = std::chrono::duration<double>(end - start).count();
+  stats.threadCount = threadCount;
+  return stats;
+}
+
+bool WritePpm(const char *path, int width, int height,
+              const std::vector<uint8_t> &rgba) {
+  FILE *file = std::fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+  std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+  std::vector<uint8_t> row((size_t)width * 3);
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *src = &rgba[(size_t)y * width * 4];
+    for (int x = 0; x < width; ++x) {
+      row[x * 3 + 0] = src[x * 4 + 0];
+      row[x * 3 + 1] = src[x * 4 + 1];
+      row[x * 3 + 2] = src[x * 4 + 2];
+    }
+    std::fwrite(row.data(), 1, row.size(), file);
+  }
+  return std::fclose(file) == 0;
+}
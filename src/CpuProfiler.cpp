@@ -0,0 +1,191 @@
+#include "../include/CpuProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+namespace {
+
+thread_local std::string t_name;
+
+void AppendJsonString(std::string &out, const char *text) {
+  out += '"';
+  for (const char *c = text; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      out += '\\';
+      out += *c;
+    } else if ((unsigned char)*c < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*c);
+      out += escaped;
+    } else {
+      out += *c;
+    }
+  }
+  out += '"';
+}
+
+} // namespace
+
+CpuProfiler &CpuProfiler::Get() {
+  // Never destroyed, so threads still running during static destruction
+  // keep a valid ring.
+  static CpuProfiler *profiler = new CpuProfiler();
+  return *profiler;
+}
+
+CpuProfiler::CpuProfiler()
+    : m_originTicks(Now()), m_originTime(std::chrono::steady_clock::now()) {}
+
+CpuProfiler::ThreadRing *CpuProfiler::Register() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_rings.push_back(std::make_unique<ThreadRing>());
+  ThreadRing *ring = m_rings.back().get();
+  ring->name = t_name.empty() ? "Thread " + std::to_string(m_rings.size() - 1)
+                              : t_name;
+  s_threadRing = ring;
+  return ring;
+}
+
+void CpuProfiler::SetThreadName(const std::string &name) {
+  t_name = name;
+  if (s_threadRing) {
+    CpuProfiler &profiler = Get();
+    std::lock_guard<std::mutex> lock(profiler.m_mutex);
+    s_threadRing->name = name;
+  }
+}
+
+void CpuProfiler::Record(const char *name, uint64_t begin, uint64_t end) {
+  ThreadRing *ring = s_threadRing;
+  if (!ring) {
+    ring = Get().Register();
+  }
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  Slot &slot = ring->slots[head & (kEventsPerThread - 1)];
+  // Orders the previous head store before these, so a capture that sees
+  // any of them also sees that the slot is being reused. Free on x86.
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.begin.store(begin, std::memory_order_relaxed);
+  slot.end.store(end, std::memory_order_relaxed);
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+CpuProfileCapture CpuProfiler::Capture() {
+  CpuProfileCapture capture;
+#if defined(CPU_PROFILER_TSC)
+  // Long enough a baseline for the TSC rate to be accurate to well under
+  // a percent.
+  std::this_thread::sleep_until(m_originTime + std::chrono::milliseconds(20));
+  uint64_t ticks = Now();
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - m_originTime)
+                       .count();
+  capture.ticksPerSecond = (double)(ticks - m_originTicks) / seconds;
+#else
+  capture.ticksPerSecond = (double)std::chrono::steady_clock::period::den /
+                           (double)std::chrono::steady_clock::period::num;
+#endif
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<CpuProfileEvent> ring;
+  for (uint32_t thread = 0; thread < m_rings.size(); ++thread) {
+    const ThreadRing &source = *m_rings[thread];
+    capture.threadNames.push_back(source.name);
+
+    // Event i's slot is rewritten as soon as head reaches i +
+    // kEventsPerThread, possibly while it is being copied, so only the
+    // newest kEventsPerThread - 1 are safe to read.
+    uint64_t head = source.head.load(std::memory_order_acquire);
+    uint64_t first = std::max(source.cleared, head >= kEventsPerThread
+                                                  ? head - kEventsPerThread + 1
+                                                  : 0);
+    ring.clear();
+    for (uint64_t i = first; i < head; ++i) {
+      const Slot &slot = source.slots[i & (kEventsPerThread - 1)];
+      ring.push_back({slot.name.load(std::memory_order_relaxed),
+                      slot.begin.load(std::memory_order_relaxed),
+                      slot.end.load(std::memory_order_relaxed), thread, 0});
+    }
+    // Drop whatever the owner started overwriting during the copy.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t now = source.head.load(std::memory_order_relaxed);
+    uint64_t valid = now >= kEventsPerThread ? now - kEventsPerThread + 1 : 0;
+    size_t skip = (size_t)(std::max(valid, first) - first);
+    skip = std::min(skip, ring.size());
+    capture.dropped += head - source.cleared - (ring.size() - skip);
+
+    // Depth from time nesting: parents start first and end last.
+    std::sort(ring.begin() + skip, ring.end(),
+              [](const CpuProfileEvent &a, const CpuProfileEvent &b) {
+                return a.begin != b.begin ? a.begin < b.begin : a.end > b.end;
+              });
+    std::vector<uint64_t> open;
+    for (size_t i = skip; i < ring.size(); ++i) {
+      CpuProfileEvent &event = ring[i];
+      while (!open.empty() && open.back() <= event.begin) {
+        open.pop_back();
+      }
+      event.depth = (uint32_t)open.size();
+      open.push_back(event.end);
+      capture.events.push_back(event);
+    }
+  }
+  return capture;
+}
+
+void CpuProfiler::Clear() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto &ring : m_rings) {
+    ring->cleared = ring->head.load(std::memory_order_acquire);
+  }
+}
+
+std::string CpuProfiler::ChromeTraceJson(const CpuProfileCapture &capture) {
+  uint64_t origin = UINT64_MAX;
+  for (const CpuProfileEvent &event : capture.events) {
+    origin = std::min(origin, event.begin);
+  }
+  double ticksPerUs =
+      capture.ticksPerSecond > 0.0 ? capture.ticksPerSecond * 1e-6 : 1.0;
+
+  std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool firstEntry = true;
+  char number[96];
+  for (uint32_t thread = 0; thread < capture.threadNames.size(); ++thread) {
+    std::snprintf(number, sizeof(number),
+                  "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                  "\"name\":\"thread_name\",\"args\":{\"name\":",
+                  firstEntry ? "" : ",", thread);
+    out += number;
+    AppendJsonString(out, capture.threadNames[thread].c_str());
+    out += "}}";
+    firstEntry = false;
+  }
+  for (const CpuProfileEvent &event : capture.events) {
+    std::snprintf(number, sizeof(number),
+                  "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                  "\"dur\":%.3f,\"name\":",
+                  firstEntry ? "" : ",", event.thread,
+                  (double)(event.begin - origin) / ticksPerUs,
+                  (double)(event.end - event.begin) / ticksPerUs);
+    out += number;
+    AppendJsonString(out, event.name ? event.name : "");
+    out += '}';
+    firstEntry = false;
+  }
+  out += "]}\n";
+  return out;
+}
+
+bool CpuProfiler::WriteChromeTrace(const std::string &path) {
+  std::string json = ChromeTraceJson(Capture());
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+  file.write(json.data(), (std::streamsize)json.size());
+  return (bool)file;
+}
@@ -0,0 +1,57 @@
+#define NOMINMAX
+#include "../include/D3D12CommandBackend.h"
+
+#include <stdexcept>
+
+D3D12CommandBackend::D3D12CommandBackend(ID3D12Device4 *device,
+                                         ID3D12CommandQueue *queue,
+                                         D3D12_COMMAND_LIST_TYPE type,
+                                         uint32_t maxAllocators,
+                                         uint32_t maxLists)
+    : m_device(device), m_queue(queue), m_type(type),
+      m_allocators(maxAllocators), m_lists(maxLists) {
+  m_batch.reserve(maxLists);
+}
+
+void D3D12CommandBackend::CreateAllocator(uint32_t allocator) {
+  if (FAILED(m_device->CreateCommandAllocator(
+          m_type, IID_PPV_ARGS(&m_allocators[allocator])))) {
+    throw std::runtime_error("Failed to create command allocator");
+  }
+}
+
+void D3D12CommandBackend::CreateList(uint32_t list) {
+  // CreateCommandList1 creates the list closed and without an allocator.
+  if (FAILED(m_device->CreateCommandList1(0, m_type,
+                                          D3D12_COMMAND_LIST_FLAG_NONE,
+                                          IID_PPV_ARGS(&m_lists[list])))) {
+    throw std::runtime_error("Failed to create command list");
+  }
+}
+
+void D3D12CommandBackend::ResetAllocator(uint32_t allocator) {
+  if (FAILED(m_allocators[allocator]->Reset())) {
+    throw std::runtime_error("Failed to reset command allocator");
+  }
+}
+
+void D3D12CommandBackend::ResetList(uint32_t list, uint32_t allocator) {
+  if (FAILED(m_lists[list]->Reset(m_allocators[allocator].Get(), nullptr))) {
+    throw std::runtime_error("Failed to reset command list");
+  }
+}
+
+void D3D12CommandBackend::CloseList(uint32_t list) {
+  if (FAILED(m_lists[list]->Close())) {
+    throw std::runtime_error("Failed to close command list");
+  }
+}
+
+void D3D12CommandBackend::ExecuteLists(const uint32_t *lists,
+                                       uint32_t count) {
+  m_batch.clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    m_batch.push_back(m_lists[lists[i]].Get());
+  }
+  m_queue->ExecuteCommandLists(count, m_batch.data());
+}
@@ -0,0 +1,76 @@
+#define NOMINMAX
+#include "../include/D3D12GpuProfiler.h"
+
+#include <stdexcept>
+
+D3D12GpuProfiler::D3D12GpuProfiler(ID3D12Device *device,
+                                   ID3D12CommandQueue *queue,
+                                   D3D12HeapAllocator &readbackHeaps,
+                                   uint32_t framesInFlight, uint32_t maxScopes)
+    : m_profiler(framesInFlight, maxScopes) {
+  D3D12_QUERY_HEAP_DESC heapDesc = {};
+  heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+  heapDesc.Count = m_profiler.QueryCount();
+  if (FAILED(device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(&m_queryHeap)))) {
+    throw std::runtime_error("Failed to create timestamp query heap");
+  }
+
+  D3D12_RESOURCE_DESC desc = {};
+  desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+  desc.Width = (UINT64)m_profiler.QueryCount() * sizeof(uint64_t);
+  desc.Height = 1;
+  desc.DepthOrArraySize = 1;
+  desc.MipLevels = 1;
+  desc.SampleDesc.Count = 1;
+  desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+  m_readback =
+      readbackHeaps.CreateResource(desc, D3D12_RESOURCE_STATE_COPY_DEST);
+
+  // Without a frequency every frame is discarded rather than misreported.
+  UINT64 frequency = 0;
+  if (SUCCEEDED(queue->GetTimestampFrequency(&frequency))) {
+    m_frequency = frequency;
+  }
+}
+
+void D3D12GpuProfiler::BeginFrame(uint32_t slot) {
+  if (m_profiler.Pending(slot)) {
+    // Mapping with the range to read keeps the CPU view coherent with what
+    // the GPU resolved, which a persistent mapping would not guarantee.
+    GpuQueryRange range = m_profiler.PendingRange(slot);
+    D3D12_RANGE read = {range.first * sizeof(uint64_t),
+                        (range.first + range.count) * sizeof(uint64_t)};
+    void *mapped = nullptr;
+    if (SUCCEEDED(m_readback->Map(0, &read, &mapped))) {
+      m_profiler.Resolve(slot, (const uint64_t *)mapped + range.first,
+                         m_frequency);
+      D3D12_RANGE written = {0, 0};
+      m_readback->Unmap(0, &written);
+    } else {
+      m_profiler.Discard(slot);
+    }
+  }
+  m_profiler.BeginFrame(slot);
+}
+
+void D3D12GpuProfiler::Begin(ID3D12GraphicsCommandList *list,
+                             const GpuProfilerScope &scope) {
+  list->EndQuery(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+                 scope.beginQuery);
+}
+
+void D3D12GpuProfiler::End(ID3D12GraphicsCommandList *list,
+                           const GpuProfilerScope &scope) {
+  list->EndQuery(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+                 scope.endQuery);
+}
+
+void D3D12GpuProfiler::EndFrame(ID3D12GraphicsCommandList *list) {
+  GpuQueryRange range = m_profiler.EndFrame();
+  if (range.count == 0) {
+    return;
+  }
+  list->ResolveQueryData(m_queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+                         range.first, range.count, m_readback.Get(),
+                         range.first * sizeof(uint64_t));
+}
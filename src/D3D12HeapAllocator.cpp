@@ -0,0 +1,161 @@
+#define NOMINMAX
+#include "../include/D3D12HeapAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Placement offsets are multiples of the small-resource alignment; larger
+// alignments are met by the TLSF allocator padding the range.
+const UINT64 kPlacementGranularity = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+
+} // namespace
+
+PlacedResource::~PlacedResource() { Reset(); }
+
+PlacedResource::PlacedResource(PlacedResource &&other) noexcept
+    : m_resource(std::move(other.m_resource)), m_owner(other.m_owner),
+      m_block(other.m_block), m_handle(other.m_handle),
+      m_heapSize(other.m_heapSize) {
+  other.m_owner = nullptr;
+  other.m_handle = TlsfAllocator::kInvalidHandle;
+  other.m_heapSize = 0;
+}
+
+PlacedResource &PlacedResource::operator=(PlacedResource &&other) noexcept {
+  if (this != &other) {
+    Reset();
+    m_resource = std::move(other.m_resource);
+    m_owner = other.m_owner;
+    m_block = other.m_block;
+    m_handle = other.m_handle;
+    m_heapSize = other.m_heapSize;
+    other.m_owner = nullptr;
+    other.m_handle = TlsfAllocator::kInvalidHandle;
+    other.m_heapSize = 0;
+  }
+  return *this;
+}
+
+void PlacedResource::Reset() {
+  // The resource goes first: its range may be handed out again right away.
+  m_resource.Reset();
+  if (m_owner && m_handle != TlsfAllocator::kInvalidHandle) {
+    m_owner->Free(m_block, m_handle);
+  }
+  m_owner = nullptr;
+  m_handle = TlsfAllocator::kInvalidHandle;
+  m_heapSize = 0;
+}
+
+D3D12HeapAllocator::D3D12HeapAllocator(ID3D12Device *device,
+                                       D3D12_HEAP_TYPE type,
+                                       D3D12_HEAP_FLAGS flags,
+                                       UINT64 blockSize)
+    : m_device(device), m_type(type), m_flags(flags),
+      m_blockSize(blockSize) {}
+
+uint32_t D3D12HeapAllocator::CreateBlock(UINT64 size) {
+  D3D12_HEAP_DESC heapDesc = {};
+  heapDesc.SizeInBytes = size;
+  heapDesc.Properties.Type = m_type;
+  heapDesc.Properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+  heapDesc.Properties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+  heapDesc.Properties.CreationNodeMask = 1;
+  heapDesc.Properties.VisibleNodeMask = 1;
+  heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+  heapDesc.Flags = m_flags;
+
+  Microsoft::WRL::ComPtr<ID3D12Heap> heap;
+  if (FAILED(m_device->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap)))) {
+    throw std::runtime_error("Failed to create resource heap");
+  }
+
+  // Reuse the slot of a released block so PlacedResource indices stay put.
+  uint32_t index = (uint32_t)m_blocks.size();
+  for (uint32_t i = 0; i < m_blocks.size(); ++i) {
+    if (!m_blocks[i].heap) {
+      index = i;
+      break;
+    }
+  }
+  if (index == m_blocks.size()) {
+    m_blocks.emplace_back();
+  }
+  m_blocks[index].heap = std::move(heap);
+  m_blocks[index].ranges.Reset(size, kPlacementGranularity);
+  return index;
+}
+
+PlacedResource
+D3D12HeapAllocator::CreateResource(const D3D12_RESOURCE_DESC &desc,
+                                   D3D12_RESOURCE_STATES initialState,
+                                   const D3D12_CLEAR_VALUE *clearValue) {
+  D3D12_RESOURCE_ALLOCATION_INFO info =
+      m_device->GetResourceAllocationInfo(0, 1, &desc);
+  if (info.SizeInBytes == UINT64_MAX) {
+    throw std::runtime_error("Invalid resource description for a heap");
+  }
+
+  TlsfAllocator::Allocation range;
+  uint32_t block = 0;
+  for (; block < m_blocks.size() && !range.Valid(); ++block) {
+    if (m_blocks[block].heap) {
+      range = m_blocks[block].ranges.Allocate(info.SizeInBytes,
+                                              info.Alignment);
+    }
+  }
+  if (range.Valid()) {
+    --block;
+  } else {
+    // Resources larger than a block get a block of their own.
+    const UINT64 heapAlignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+    UINT64 size = (info.SizeInBytes + heapAlignment - 1) & ~(heapAlignment - 1);
+    block = CreateBlock((std::max)(m_blockSize, size));
+    range = m_blocks[block].ranges.Allocate(info.SizeInBytes, info.Alignment);
+  }
+
+  PlacedResource placed;
+  if (FAILED(m_device->CreatePlacedResource(
+          m_blocks[block].heap.Get(), range.offset, &desc, initialState,
+          clearValue, IID_PPV_ARGS(&placed.m_resource)))) {
+    Free(block, range.handle);
+    throw std::runtime_error("Failed to create placed resource");
+  }
+  placed.m_owner = this;
+  placed.m_block = block;
+  placed.m_handle = range.handle;
+  placed.m_heapSize = range.size;
+  return placed;
+}
+
+void D3D12HeapAllocator::Free(uint32_t block, uint32_t handle) {
+  Block &b = m_blocks[block];
+  b.ranges.Free(handle);
+  // Keep the first block around so churn near empty does not keep
+  // creating and destroying heaps.
+  if (block != 0 && b.ranges.Empty()) {
+    b.heap.Reset();
+    b.ranges.Reset(0, kPlacementGranularity);
+  }
+}
+
+HeapAllocatorStats D3D12HeapAllocator::Stats() const {
+  HeapAllocatorStats stats;
+  for (const Block &b : m_blocks) {
+    if (!b.heap) {
+      continue;
+    }
+    TlsfStats ranges = b.ranges.Stats();
+    ++stats.heapCount;
+    stats.resourceCount += ranges.allocationCount;
+    stats.reservedBytes += ranges.capacity;
+    stats.usedBytes += ranges.usedBytes;
+    stats.largestFreeBlock =
+        (std::max)(stats.largestFreeBlock, ranges.largestFreeBlock);
+    stats.fragmentation = (std::max)(stats.fragmentation, ranges.fragmentation);
+  }
+  return stats;
+}
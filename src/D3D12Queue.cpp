@@ -0,0 +1,60 @@
+#define NOMINMAX
+#include "../include/D3D12Queue.h"
+
+#include <chrono>
+#include <stdexcept>
+
+D3D12Queue::D3D12Queue(ID3D12Device *device, D3D12_COMMAND_LIST_TYPE type) {
+  D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+  queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+  queueDesc.Type = type;
+  if (FAILED(device->CreateCommandQueue(&queueDesc,
+                                        IID_PPV_ARGS(&m_queue)))) {
+    throw std::runtime_error("Failed to create command queue");
+  }
+
+  if (FAILED(device->CreateFence(0, D3D12_FENCE_FLAG_NONE,
+                                 IID_PPV_ARGS(&m_fence)))) {
+    throw std::runtime_error("Failed to create fence");
+  }
+}
+
+D3D12Queue::~D3D12Queue() = default;
+
+void D3D12Queue::Execute(ID3D12CommandList *const *lists, UINT count) {
+  m_queue->ExecuteCommandLists(count, lists);
+}
+
+uint64_t D3D12Queue::Signal() {
+  uint64_t value = m_lastSignaled + 1;
+  if (FAILED(m_queue->Signal(m_fence.Get(), value))) {
+    throw std::runtime_error("Failed to signal fence");
+  }
+  m_lastSignaled = value;
+  return value;
+}
+
+uint64_t D3D12Queue::CompletedValue() { return m_fence->GetCompletedValue(); }
+
+double D3D12Queue::Wait(uint64_t value) {
+  if (m_fence->GetCompletedValue() >= value) {
+    return 0.0;
+  }
+  // Wait runs on the TLAS job thread as well as the main thread, so each
+  // call gets its own event: a shared auto-reset event can hand one
+  // thread's wake-up to the other and leave it blocked forever.
+  auto start = std::chrono::steady_clock::now();
+  HANDLE event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+  if (event == nullptr) {
+    throw std::runtime_error("Failed to create fence event");
+  }
+  if (FAILED(m_fence->SetEventOnCompletion(value, event))) {
+    CloseHandle(event);
+    throw std::runtime_error("Failed to set fence completion event");
+  }
+  WaitForSingleObject(event, INFINITE);
+  CloseHandle(event);
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
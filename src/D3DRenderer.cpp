@@ -1,14 +1,24 @@
 #define NOMINMAX
 #include <Windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <d3dcompiler.h>
-#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 #include <wrl/client.h>
 
 #include "../include/D3DRenderer.h"
+#include "../include/CpuPathTracer.h"
+#include "../include/CpuProfiler.h"
+#include "../include/EmbeddedShaders.h"
+#include "../include/MeshOptimizer.h"
+#include "../include/ShaderContainer.h"
+#include "../include/VertexStreams.h"
 #include "../shaders/RayTracingHlslCompat.h"
 
 #pragma comment(lib, "d3dcompiler.lib")
@@ -16,16 +26,91 @@
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
-D3DRenderer::D3DRenderer(HWND hwnd)
-    : m_hwnd(hwnd), m_width(0), m_height(0), m_fenceValue(0),
-      m_fenceEvent(nullptr), m_frameIndex(0), m_rtvDescriptorSize(0),
-      m_constantBufferData(nullptr), m_indexCount(0), m_rotationAngle(0.0f),
-      m_cameraPos({0, 5, -10}), m_cameraYaw(0), m_cameraPitch(0) {
+// InstanceAnimator writes descs without seeing d3d12.h.
+static_assert(sizeof(GpuInstanceDesc) ==
+                  sizeof(D3D12_RAYTRACING_INSTANCE_DESC) &&
+                  offsetof(GpuInstanceDesc, instanceIdAndMask) ==
+                      sizeof(D3D12_RAYTRACING_INSTANCE_DESC::Transform) &&
+                  offsetof(GpuInstanceDesc, accelerationStructure) ==
+                      offsetof(D3D12_RAYTRACING_INSTANCE_DESC,
+                               AccelerationStructure),
+              "GpuInstanceDesc must match D3D12_RAYTRACING_INSTANCE_DESC");
+static_assert(SCENE_SPHERE_RADIUS == kSphereRadius,
+              "SphereIntersection must trace the sphere the meshes model");
+
+namespace {
+
+// Bytecode of a blob the ShaderEmbed target compiled into the binary; empty
+// when the build did not produce it.
+D3D12_SHADER_BYTECODE EmbeddedBytecode(const char *name) {
+  const EmbeddedShader *shader = FindEmbeddedShader(name);
+  if (!shader) {
+    return {};
+  }
+  return {shader->data, shader->size};
+}
+
+D3D12_RESOURCE_BARRIER Transition(ID3D12Resource *resource,
+                                  D3D12_RESOURCE_STATES before,
+                                  D3D12_RESOURCE_STATES after) {
+  D3D12_RESOURCE_BARRIER barrier = {};
+  barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+  barrier.Transition.pResource = resource;
+  barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+  barrier.Transition.StateBefore = before;
+  barrier.Transition.StateAfter = after;
+  return barrier;
+}
+
+D3D12_RESOURCE_STATES ToD3D12State(FrameResourceState state) {
+  switch (state) {
+  case FrameResourceState::CopySource:
+    return D3D12_RESOURCE_STATE_COPY_SOURCE;
+  case FrameResourceState::ShaderRead:
+    return D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+  case FrameResourceState::UnorderedAccess:
+    return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+  case FrameResourceState::CopyDest:
+    return D3D12_RESOURCE_STATE_COPY_DEST;
+  case FrameResourceState::RenderTarget:
+    return D3D12_RESOURCE_STATE_RENDER_TARGET;
+  case FrameResourceState::Present:
+    return D3D12_RESOURCE_STATE_PRESENT;
+  }
+  return D3D12_RESOURCE_STATE_COMMON;
+}
+
+D3D12_RESOURCE_DESC BufferDesc(UINT64 width, D3D12_RESOURCE_FLAGS flags) {
+  D3D12_RESOURCE_DESC desc = {};
+  desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+  desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+  desc.Width = width;
+  desc.Height = 1;
+  desc.DepthOrArraySize = 1;
+  desc.MipLevels = 1;
+  desc.Format = DXGI_FORMAT_UNKNOWN;
+  desc.SampleDesc.Count = 1;
+  desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+  desc.Flags = flags;
+  return desc;
+}
+
+// Written to the working directory by the panel's Save CPU Trace button.
+constexpr const char *kCpuTracePath = "cpu_trace.json";
+
+} // namespace
+
+D3DRenderer::D3DRenderer(HWND hwnd, UINT framesInFlight)
+    : m_hwnd(hwnd), m_width(0), m_height(0), m_frameIndex(0),
+      m_rtvDescriptorSize(0), m_framesInFlight(framesInFlight),
+      m_indexCount(0), m_rotationAngle(0.0f) {
   RECT rect;
   GetClientRect(hwnd, &rect);
   m_width = rect.right - rect.left;
   m_height = rect.bottom - rect.top;
 
+  CpuProfiler::SetThreadName("Main");
+  m_jobs = std::make_unique<JobSystem>();
   InitializeD3D12();
   CreateResources();
   InitRayTracing();
@@ -36,21 +121,18 @@ D3DRenderer::D3DRenderer(HWND hwnd)
 }
 
 D3DRenderer::~D3DRenderer() {
-  WaitForPreviousFrame();
+  m_jobs->Wait(m_sceneReady);
+  WaitForGpu();
 
-  if (m_constantBuffer && m_constantBufferData) {
+  if (m_uploadBuffer && m_uploadMapped) {
     D3D12_RANGE range = {0, 0};
-    m_constantBuffer->Unmap(0, &range);
-    m_constantBufferData = nullptr;
-  }
-
-  if (m_fenceEvent) {
-    CloseHandle(m_fenceEvent);
-    m_fenceEvent = nullptr;
+    m_uploadBuffer->Unmap(0, &range);
+    m_uploadMapped = nullptr;
   }
 }
 
 void D3DRenderer::InitializeD3D12() {
+  CPU_PROFILE_SCOPE("InitializeD3D12");
   UINT dxgiFactoryFlags = 0;
 
 #ifdef _DEBUG
@@ -89,14 +171,46 @@ void D3DRenderer::InitializeD3D12() {
     throw std::runtime_error("Failed to create D3D12 device");
   }
 
-  D3D12_COMMAND_QUEUE_DESC queueDesc = {};
-  queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
-  queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
-
-  if (FAILED(m_device->CreateCommandQueue(&queueDesc,
-                                          IID_PPV_ARGS(&m_commandQueue)))) {
-    throw std::runtime_error("Failed to create command queue");
+  // Cached pipeline blobs only load on the adapter and driver that wrote
+  // them, so both go into the cache's device fingerprint.
+  PipelineCacheDevice cacheDevice;
+  ComPtr<IDXGIAdapter1> deviceAdapter;
+  if (SUCCEEDED(m_factory->EnumAdapterByLuid(m_device->GetAdapterLuid(),
+                                             IID_PPV_ARGS(&deviceAdapter)))) {
+    DXGI_ADAPTER_DESC1 desc;
+    deviceAdapter->GetDesc1(&desc);
+    cacheDevice.vendorId = desc.VendorId;
+    cacheDevice.deviceId = desc.DeviceId;
+    LARGE_INTEGER umdVersion;
+    if (SUCCEEDED(deviceAdapter->CheckInterfaceSupport(__uuidof(IDXGIDevice),
+                                                       &umdVersion))) {
+      cacheDevice.driverVersion = (uint64_t)umdVersion.QuadPart;
+    }
   }
+  m_pipelineCache =
+      std::make_unique<PipelineCache>("pipeline_cache", cacheDevice);
+
+  // Resource heap tier 1 keeps buffers and textures in separate heaps. The
+  // output texture gets its own (small) block size as it is the only one.
+  m_bufferHeaps = std::make_unique<D3D12HeapAllocator>(
+      m_device.Get(), D3D12_HEAP_TYPE_DEFAULT,
+      D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, 32ull << 20);
+  m_textureHeaps = std::make_unique<D3D12HeapAllocator>(
+      m_device.Get(), D3D12_HEAP_TYPE_DEFAULT,
+      D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES, 16ull << 20);
+  m_uploadHeaps = std::make_unique<D3D12HeapAllocator>(
+      m_device.Get(), D3D12_HEAP_TYPE_UPLOAD,
+      D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, 8ull << 20);
+  m_readbackHeaps = std::make_unique<D3D12HeapAllocator>(
+      m_device.Get(), D3D12_HEAP_TYPE_READBACK,
+      D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, 1ull << 20);
+
+  m_queue = std::make_unique<D3D12Queue>(m_device.Get(),
+                                         D3D12_COMMAND_LIST_TYPE_DIRECT);
+  m_framePacer = std::make_unique<FramePacer>(*m_queue, m_framesInFlight);
+  m_gpuProfiler = std::make_unique<D3D12GpuProfiler>(
+      m_device.Get(), m_queue->Get(), *m_readbackHeaps, m_framesInFlight,
+      MaxGpuScopes);
 
   DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
   swapChainDesc.BufferCount = FrameCount;
@@ -108,7 +222,7 @@ void D3DRenderer::InitializeD3D12() {
   swapChainDesc.SampleDesc.Count = 1;
 
   ComPtr<IDXGISwapChain1> swapChain1;
-  if (FAILED(m_factory->CreateSwapChainForHwnd(m_commandQueue.Get(), m_hwnd,
+  if (FAILED(m_factory->CreateSwapChainForHwnd(m_queue->Get(), m_hwnd,
                                                &swapChainDesc, nullptr, nullptr,
                                                &swapChain1))) {
     throw std::runtime_error("Failed to create swap chain");
@@ -144,137 +258,127 @@ void D3DRenderer::InitializeD3D12() {
     rtvHandle.ptr += m_rtvDescriptorSize;
   }
 
-  if (FAILED(m_device->CreateCommandAllocator(
-          D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator)))) {
-    throw std::runtime_error("Failed to create command allocator");
+  // Enough allocators for every slot in flight plus the frame being
+  // recorded; lists can be reused as soon as they are submitted.
+  ComPtr<ID3D12Device4> device4;
+  if (FAILED(m_device.As(&device4))) {
+    throw std::runtime_error("Failed to query ID3D12Device4");
   }
+  const uint32_t maxAllocators =
+      (FramePacer::kMaxFramesInFlight + 1) * RecordingsPerFrame;
+  m_commandBackend = std::make_unique<D3D12CommandBackend>(
+      device4.Get(), m_queue->Get(), D3D12_COMMAND_LIST_TYPE_DIRECT,
+      maxAllocators, RecordingsPerFrame);
+  m_commandPool = std::make_unique<CommandListPool>(
+      *m_queue, *m_commandBackend, maxAllocators, RecordingsPerFrame);
+}
 
-  if (FAILED(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
-                                         m_commandAllocator.Get(), nullptr,
-                                         IID_PPV_ARGS(&m_commandList)))) {
-    throw std::runtime_error("Failed to create command list");
-  }
+void D3DRenderer::BeginCommands(uint32_t order) {
+  m_mainRecording = m_commandPool->Begin(order);
+  m_commandList = m_commandBackend->List(m_mainRecording.list);
+}
 
-  m_commandList->Close();
+void D3DRenderer::EndCommands() {
+  m_commandPool->End(m_mainRecording);
+  m_commandList = nullptr;
+}
 
-  if (FAILED(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE,
-                                   IID_PPV_ARGS(&m_fence)))) {
-    throw std::runtime_error("Failed to create fence");
+void D3DRenderer::CreateResources() {
+  CPU_PROFILE_SCOPE("CreateResources");
+  // Scene meshes, welded and reordered for the post-transform cache. The
+  // CPU BVHs used for picking are built from the same optimized meshes as
+  // the BLASes. The sphere is built at every level of detail, each getting
+  // its own BLAS; picking tests the finest.
+  std::vector<Vertex> sphereVertices[kSphereLodCount], planeVertices;
+  std::vector<UINT> sphereIndices[kSphereLodCount], planeIndices;
+  for (uint32_t level = 0; level < kSphereLodCount; ++level) {
+    CreateSphere(sphereVertices[level], sphereIndices[level], kSphereRadius,
+                 kSphereLodLevels[level].slices,
+                 kSphereLodLevels[level].stacks);
+    OptimizeMesh(sphereVertices[level], sphereIndices[level]);
   }
+  CreatePlane(planeVertices, planeIndices, kPlaneSize, kPlaneSize);
+  OptimizeMesh(planeVertices, planeIndices);
 
-  m_fenceValue = 1;
-  m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-  if (m_fenceEvent == nullptr) {
-    throw std::runtime_error("Failed to create fence event");
-  }
-}
+  m_sphereMeshBvh.Build(sphereVertices[0], sphereIndices[0]);
+  m_planeMeshBvh.Build(planeVertices, planeIndices);
+  m_instanceBvh.SetMesh(SceneMesh::Sphere, &m_sphereMeshBvh);
+  m_instanceBvh.SetMesh(SceneMesh::Plane, &m_planeMeshBvh);
 
-void D3DRenderer::CreateResources() {
-  // Define geometry
+  // All meshes share one vertex and one index buffer. Indices stay
+  // relative to their mesh's first vertex, since each BLAS reads its mesh
+  // at an offset.
   std::vector<Vertex> vertices;
   std::vector<UINT> indices;
-
-  // Sphere
-  m_sphereVertexOffset = 0;
-  m_sphereIndexOffset = 0;
-  CreateSphere(vertices, indices, 0.5f, 32, 32);
-  m_sphereIndexCount = (UINT)indices.size();
-
-  // Plane
+  for (uint32_t level = 0; level < kSphereLodCount; ++level) {
+    m_sphereLods[level] = {(UINT)vertices.size(),
+                           (UINT)sphereVertices[level].size(),
+                           (UINT)indices.size(),
+                           (UINT)sphereIndices[level].size()};
+    vertices.insert(vertices.end(), sphereVertices[level].begin(),
+                    sphereVertices[level].end());
+    indices.insert(indices.end(), sphereIndices[level].begin(),
+                   sphereIndices[level].end());
+  }
   m_planeVertexOffset = (UINT)vertices.size();
   m_planeIndexOffset = (UINT)indices.size();
-  CreatePlane(vertices, indices, 20.0f, 20.0f);
-  m_planeIndexCount = (UINT)indices.size() - m_planeIndexOffset;
-
-  // Update totals
+  m_planeIndexCount = (UINT)planeIndices.size();
+  vertices.insert(vertices.end(), planeVertices.begin(), planeVertices.end());
+  indices.insert(indices.end(), planeIndices.begin(), planeIndices.end());
   m_vertexCount = (UINT)vertices.size();
   m_indexCount = (UINT)indices.size();
 
-  m_sphereIndexCount =
-      m_planeIndexOffset; // Correction: indices.size() includes sphere indices
-  // Actually simpler:
-  // sphereIndices = current indices size (before plane)
-  // planeIndices = total - sphere
-  // Let's rewrite carefully.
-
-  // Re-clearing for safety from earlier thought
-  vertices.clear();
-  indices.clear();
+  // Geometry lives in DEFAULT heap memory and is staged through the upload
+  // ring once; the BLAS builds and the shaders only ever read it.
+  CreateUploadRing();
+  BeginCommands(0);
 
-  // 1. Sphere
-  m_sphereVertexOffset = 0;
-  m_sphereIndexOffset = 0;
-  CreateSphere(vertices, indices, 0.5f, 32, 32);
-  m_sphereIndexCount = (UINT)indices.size();
+  // Split streams: the BLAS builds and the raster pass only fetch the
+  // 12-byte positions, shading attributes sit in a buffer of their own.
+  VertexStreams streams;
+  BuildVertexStreams(vertices, streams);
 
-  // 2. Plane
-  m_planeVertexOffset = (UINT)vertices.size();
-  m_planeIndexOffset = (UINT)indices.size();
-  CreatePlane(vertices, indices, 20.0f, 20.0f); // Adds to end
-  m_planeIndexCount = (UINT)indices.size() - m_planeIndexOffset;
-
-  UINT vertexBufferSize = (UINT)(vertices.size() * sizeof(Vertex));
-  D3D12_HEAP_PROPERTIES heapProps = {};
-  heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
-
-  D3D12_RESOURCE_DESC vertexBufferDesc = {};
-  vertexBufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-  vertexBufferDesc.Width = vertexBufferSize;
-  vertexBufferDesc.Height = 1;
-  vertexBufferDesc.DepthOrArraySize = 1;
-  vertexBufferDesc.MipLevels = 1;
-  vertexBufferDesc.Format = DXGI_FORMAT_UNKNOWN;
-  vertexBufferDesc.SampleDesc.Count = 1;
-  vertexBufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-
-  if (FAILED(m_device->CreateCommittedResource(
-          &heapProps, D3D12_HEAP_FLAG_NONE, &vertexBufferDesc,
-          D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-          IID_PPV_ARGS(&m_vertexBuffer)))) {
-    throw std::runtime_error("Failed to create vertex buffer");
-  }
-
-  void *pVertexDataBegin;
-  m_vertexBuffer->Map(0, nullptr, &pVertexDataBegin);
-  memcpy(pVertexDataBegin, vertices.data(), vertexBufferSize);
-  m_vertexBuffer->Unmap(0, nullptr);
+  UINT vertexBufferSize = (UINT)(streams.positions.size() * sizeof(Float3));
+  m_vertexBuffer = CreateDefaultBuffer(
+      streams.positions.data(), vertexBufferSize,
+      D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER |
+          D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
   m_vertexBufferView.BufferLocation = m_vertexBuffer->GetGPUVirtualAddress();
   m_vertexBufferView.SizeInBytes = vertexBufferSize;
-  m_vertexBufferView.StrideInBytes = sizeof(Vertex);
-
-  UINT indexBufferSize = (UINT)(indices.size() * sizeof(UINT));
-  D3D12_RESOURCE_DESC indexBufferDesc = vertexBufferDesc;
-  indexBufferDesc.Width = indexBufferSize;
-
-  if (FAILED(m_device->CreateCommittedResource(
-          &heapProps, D3D12_HEAP_FLAG_NONE, &indexBufferDesc,
-          D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-          IID_PPV_ARGS(&m_indexBuffer)))) {
-    throw std::runtime_error("Failed to create index buffer");
-  }
-
-  void *pIndexDataBegin;
-  m_indexBuffer->Map(0, nullptr, &pIndexDataBegin);
-  memcpy(pIndexDataBegin, indices.data(), indexBufferSize);
-  m_indexBuffer->Unmap(0, nullptr);
+  m_vertexBufferView.StrideInBytes = sizeof(Float3);
+
+  m_attributeBuffer = CreateDefaultBuffer(
+      streams.attributes.data(),
+      streams.attributes.size() * sizeof(VertexAttributes),
+      D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+  // 16-bit indices whenever the meshes allow.
+  PackedIndices packedIndices = PackIndices(indices);
+  m_indexFormat =
+      packedIndices.sixteenBit ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+  m_indexSize = (UINT)packedIndices.IndexSize();
+  UINT indexBufferSize = (UINT)packedIndices.ByteSize();
+  m_indexBuffer = CreateDefaultBuffer(
+      packedIndices.Data(), indexBufferSize,
+      D3D12_RESOURCE_STATE_INDEX_BUFFER |
+          D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
   m_indexBufferView.BufferLocation = m_indexBuffer->GetGPUVirtualAddress();
   m_indexBufferView.SizeInBytes = indexBufferSize;
-  m_indexBufferView.Format = DXGI_FORMAT_R32_UINT;
+  m_indexBufferView.Format = m_indexFormat;
 
-  UINT constantBufferSize = (sizeof(ShaderParams) + 255) & ~255;
-  D3D12_RESOURCE_DESC constantBufferDesc = vertexBufferDesc;
-  constantBufferDesc.Width = constantBufferSize;
+  // Bounds of the procedural sphere BLAS, in the sphere's object space.
+  D3D12_RAYTRACING_AABB sphereAabb = {-kSphereRadius, -kSphereRadius,
+                                      -kSphereRadius, kSphereRadius,
+                                      kSphereRadius,  kSphereRadius};
+  m_sphereAabbBuffer = CreateDefaultBuffer(
+      &sphereAabb, sizeof(sphereAabb),
+      D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
-  if (FAILED(m_device->CreateCommittedResource(
-          &heapProps, D3D12_HEAP_FLAG_NONE, &constantBufferDesc,
-          D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-          IID_PPV_ARGS(&m_constantBuffer)))) {
-    throw std::runtime_error("Failed to create constant buffer");
-  }
-
-  m_constantBuffer->Map(0, nullptr, &m_constantBufferData);
+  EndCommands();
+  m_commandPool->Submit();
+  WaitForGpu(); // retires the allocator for the acceleration structures
 
   D3D12_ROOT_PARAMETER rootParameter = {};
   rootParameter.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
@@ -307,8 +411,7 @@ void D3DRenderer::CreateResources() {
     throw std::runtime_error("Failed to create root signature");
   }
 
-  ComPtr<ID3DBlob> vertexShader;
-  ComPtr<ID3DBlob> pixelShader;
+  auto pipelineStart = std::chrono::steady_clock::now();
 
 #ifdef _DEBUG
   UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
@@ -316,37 +419,31 @@ void D3DRenderer::CreateResources() {
   UINT compileFlags = 0;
 #endif
 
-  if (FAILED(D3DCompileFromFile(
-          L"shaders/shader.hlsl", nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE,
-          "VSMain", "vs_5_0", compileFlags, 0, &vertexShader, &errorBlob))) {
-    if (errorBlob) {
-      std::cerr << "Vertex shader compilation failed: "
-                << (char *)errorBlob->GetBufferPointer() << std::endl;
-    }
-    throw std::runtime_error("Failed to compile vertex shader");
-  }
-  if (FAILED(D3DCompileFromFile(
-          L"shaders/shader.hlsl", nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE,
-          "PSMain", "ps_5_0", compileFlags, 0, &pixelShader, &errorBlob))) {
-    if (errorBlob) {
-      std::cerr << "Pixel shader compilation failed: "
-                << (char *)errorBlob->GetBufferPointer() << std::endl;
-    }
-    throw std::runtime_error("Failed to compile pixel shader");
+  // Built into the binary when the build found fxc (always optimized);
+  // otherwise compiled here, or taken from the pipeline cache.
+  D3D12_SHADER_BYTECODE vertexShader = EmbeddedBytecode("shader_VSMain.cso");
+  D3D12_SHADER_BYTECODE pixelShader = EmbeddedBytecode("shader_PSMain.cso");
+  std::vector<uint8_t> compiledVertexShader;
+  std::vector<uint8_t> compiledPixelShader;
+  if (!vertexShader.pShaderBytecode || !pixelShader.pShaderBytecode) {
+    MappedFile shaderSource("shaders/shader.hlsl");
+    compiledVertexShader = CompileShader(
+        shaderSource, "shaders/shader.hlsl", "VSMain", "vs_5_0", compileFlags);
+    compiledPixelShader = CompileShader(
+        shaderSource, "shaders/shader.hlsl", "PSMain", "ps_5_0", compileFlags);
+    vertexShader = {compiledVertexShader.data(), compiledVertexShader.size()};
+    pixelShader = {compiledPixelShader.data(), compiledPixelShader.size()};
   }
 
   D3D12_INPUT_ELEMENT_DESC inputElementDescs[] = {
       {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0,
-       D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-      {"COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12,
        D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}};
 
   D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
   psoDesc.InputLayout = {inputElementDescs, _countof(inputElementDescs)};
   psoDesc.pRootSignature = m_rootSignature.Get();
-  psoDesc.VS = {vertexShader->GetBufferPointer(),
-                vertexShader->GetBufferSize()};
-  psoDesc.PS = {pixelShader->GetBufferPointer(), pixelShader->GetBufferSize()};
+  psoDesc.VS = vertexShader;
+  psoDesc.PS = pixelShader;
   psoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
   psoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
   psoDesc.BlendState.RenderTarget[0].RenderTargetWriteMask =
@@ -359,152 +456,423 @@ void D3DRenderer::CreateResources() {
   psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
   psoDesc.SampleDesc.Count = 1;
 
-  if (FAILED(m_device->CreateGraphicsPipelineState(
-          &psoDesc, IID_PPV_ARGS(&m_pipelineState)))) {
-    throw std::runtime_error("Failed to create graphics pipeline state");
+  // Everything above the driver sees; the state left at zero is covered by
+  // the bytecode and root signature staying the same.
+  PipelineKey psoKey;
+  psoKey.AddString("kind", "graphics")
+      .AddBytes("vs", vertexShader.pShaderBytecode,
+                vertexShader.BytecodeLength)
+      .AddBytes("ps", pixelShader.pShaderBytecode, pixelShader.BytecodeLength)
+      .AddBytes("rootsig", signatureBlob->GetBufferPointer(),
+                signatureBlob->GetBufferSize());
+  for (const D3D12_INPUT_ELEMENT_DESC &element : inputElementDescs) {
+    psoKey.AddString("semantic", element.SemanticName)
+        .AddU64("element", (uint64_t)element.SemanticIndex << 48 |
+                               (uint64_t)element.Format << 32 |
+                               element.AlignedByteOffset);
+  }
+  psoKey.AddU64("raster", psoDesc.RasterizerState.FillMode << 8 |
+                              psoDesc.RasterizerState.CullMode)
+      .AddU64("topology", psoDesc.PrimitiveTopologyType)
+      .AddU64("rtv", psoDesc.RTVFormats[0]);
+
+  std::vector<uint8_t> cachedPso;
+  if (m_pipelineCache->Load(psoKey.Value(), cachedPso)) {
+    psoDesc.CachedPSO = {cachedPso.data(), cachedPso.size()};
+    if (FAILED(m_device->CreateGraphicsPipelineState(
+            &psoDesc, IID_PPV_ARGS(&m_pipelineState)))) {
+      // Refused by the driver (e.g. D3D12_ERROR_DRIVER_VERSION_MISMATCH):
+      // build it from scratch and store a fresh blob.
+      m_pipelineCache->Invalidate(psoKey.Value());
+      psoDesc.CachedPSO = {};
+    }
+  }
+  if (!m_pipelineState) {
+    if (FAILED(m_device->CreateGraphicsPipelineState(
+            &psoDesc, IID_PPV_ARGS(&m_pipelineState)))) {
+      throw std::runtime_error("Failed to create graphics pipeline state");
+    }
+    ComPtr<ID3DBlob> blob;
+    if (SUCCEEDED(m_pipelineState->GetCachedBlob(&blob))) {
+      m_pipelineCache->Store(psoKey.Value(), blob->GetBufferPointer(),
+                             blob->GetBufferSize());
+    }
+  }
+  m_pipelineStartupMs += std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - pipelineStart)
+                             .count();
+}
+
+std::vector<uint8_t> D3DRenderer::CompileShader(const MappedFile &source,
+                                                const char *name,
+                                                const char *entryPoint,
+                                                const char *target,
+                                                UINT flags) {
+  uint64_t key = PipelineKey()
+                     .AddString("kind", "hlsl")
+                     .AddBytes("source", source.Data(), source.Size())
+                     .AddString("entry", entryPoint)
+                     .AddString("target", target)
+                     .AddU64("flags", flags)
+                     .Value();
+  std::vector<uint8_t> bytecode;
+  if (m_pipelineCache->Load(key, bytecode)) {
+    return bytecode;
   }
-  CreateConstantBuffer();
+
+  // Compiled from the mapped bytes, so the key covers exactly what the
+  // compiler saw.
+  ComPtr<ID3DBlob> shader;
+  ComPtr<ID3DBlob> errorBlob;
+  if (FAILED(D3DCompile(source.Data(), source.Size(), name, nullptr,
+                        D3D_COMPILE_STANDARD_FILE_INCLUDE, entryPoint, target,
+                        flags, 0, &shader, &errorBlob))) {
+    if (errorBlob) {
+      std::cerr << entryPoint << " compilation failed: "
+                << (char *)errorBlob->GetBufferPointer() << std::endl;
+    }
+    throw std::runtime_error(std::string("Failed to compile ") + entryPoint);
+  }
+  const uint8_t *begin = (const uint8_t *)shader->GetBufferPointer();
+  bytecode.assign(begin, begin + shader->GetBufferSize());
+  m_pipelineCache->Store(key, bytecode.data(), bytecode.size());
+  return bytecode;
 }
 
 void D3DRenderer::Render() {
+  CPU_PROFILE_SCOPE("Render");
   // Start ImGui frame
   m_imgui.BeginFrame();
 
   // Animation scaling
   auto &ui = m_imgui.GetState();
+
+  // The trace holds the last frames recorded before the click.
+  CpuProfiler::SetEnabled(ui.cpuProfiling);
+  if (ui.saveCpuTrace) {
+    ui.saveCpuTrace = false;
+    ui.cpuTraceStatus = CpuProfiler::Get().WriteChromeTrace(kCpuTracePath)
+                            ? "saved to cpu_trace.json"
+                            : "could not write cpu_trace.json";
+  }
   if (ui.animationEnabled) {
     m_animationTime += 0.016f * ui.animationSpeed; // ~60fps
   }
 
+  // Only blocks when the GPU still owns this slot from m_framesInFlight
+  // frames ago. Its timestamps are ready by then.
+  {
+    CPU_PROFILE_SCOPE("Wait for frame slot");
+    m_frameSlot = m_framePacer->BeginFrame();
+  }
+  m_frames[m_frameSlot].deferredReleases.clear();
+  uint64_t completed = m_queue->CompletedValue();
+  m_uploadRing.Retire(completed);
+  m_commandPool->Retire(completed);
+  m_gpuProfiler->BeginFrame(m_frameSlot);
+  const GpuProfiler &profiler = m_gpuProfiler->Profiler();
+
+  // Dynamic resolution picks this frame's render size from the GPU time of
+  // the newest retired frame, which vsync and CPU stalls do not inflate.
+  if (ui.dynamicResolution) {
+    DynamicResolutionSettings settings = m_resolution.Settings();
+    if (settings.targetMs != ui.targetFrameMs) {
+      settings.targetMs = ui.targetFrameMs;
+      m_resolution.SetSettings(settings);
+    }
+    if (profiler.ResolvedFrame() != m_profiledFrame) {
+      m_resolution.Update(profiler.FrameMs());
+    }
+    m_renderSize = m_resolution.RenderSize(m_width, m_height);
+  } else {
+    m_resolution.Reset(1.0f);
+    m_renderSize = {(uint32_t)m_width, (uint32_t)m_height};
+  }
+  m_profiledFrame = profiler.ResolvedFrame();
+  ui.renderWidth = (int)m_renderSize.width;
+  ui.renderHeight = (int)m_renderSize.height;
+  ui.smoothedFrameMs = (float)m_resolution.SmoothedMs();
+
+  // Checkerboard frames alternate which half is traced. Turning the mode
+  // on starts without history, since m_resolved holds an old frame.
+  if (ui.checkerboard) {
+    m_checkerboardParity ^= 1;
+  } else {
+    m_checkerboardHistoryValid = false;
+  }
+
+  // Switching sphere geometry swaps the hit group in every sphere record
+  // and the BLAS every sphere instance references. The old table stays
+  // alive until the frames reading it have retired.
+  if (ui.analyticSpheres != m_analyticSpheres) {
+    m_analyticSpheres = ui.analyticSpheres;
+    m_frames[m_frameSlot].deferredReleases.push_back(std::move(m_shaderTable));
+    CreateShaderTables();
+    m_tlasTracker.Invalidate();
+  }
+
+  // Scene animation overlaps the camera update and the start of command
+  // recording; CreateTopLevelAS waits for it.
+  float animationSpeed = ui.animationSpeed;
+  m_jobs->Run([this, animationSpeed]() { AnimateScene(animationSpeed); },
+              &m_sceneReady);
+
   UpdateCamera();
   PopulateCommandList();
+  PickInstance();
   Present();
-  WaitForPreviousFrame();
+  m_framePacer->EndFrame();
+  m_uploadRing.FinishFrame(m_framePacer->SlotFence(m_frameSlot));
+  m_commandPool->FinishFrame(m_framePacer->SlotFence(m_frameSlot));
+
+  ui.framesInFlight = (int)m_framesInFlight;
+  ui.gpuWaits = m_framePacer->Stats().stalls;
+
+  // Scopes not recorded lately (e.g. Upscale at full resolution) drop out.
+  ui.gpuFrameMs = (float)profiler.AverageFrameMs();
+  ui.gpuTimingCount = 0;
+  for (const GpuScopeStats &scope : profiler.Scopes()) {
+    if (scope.lastFrame + 60 < profiler.ResolvedFrame() ||
+        ui.gpuTimingCount == ImGuiManager::MaxGpuTimings) {
+      continue;
+    }
+    ImGuiManager::GpuTiming &timing = ui.gpuTimings[ui.gpuTimingCount++];
+    timing.name = scope.name.c_str();
+    timing.averageMs = (float)scope.averageMs;
+    timing.lastMs = (float)scope.lastMs;
+  }
+
+  const D3D12HeapAllocator *heaps[] = {
+      m_bufferHeaps.get(), m_textureHeaps.get(), m_uploadHeaps.get(),
+      m_readbackHeaps.get()};
+  ui.heapCount = 0;
+  ui.heapUsedMB = ui.heapReservedMB = ui.heapFragmentation = 0.0f;
+  for (const D3D12HeapAllocator *heap : heaps) {
+    HeapAllocatorStats stats = heap->Stats();
+    ui.heapCount += (int)stats.heapCount;
+    ui.heapUsedMB += stats.usedBytes / (1024.0f * 1024.0f);
+    ui.heapReservedMB += stats.reservedBytes / (1024.0f * 1024.0f);
+    ui.heapFragmentation = (std::max)(ui.heapFragmentation,
+                                      stats.fragmentation);
+  }
 }
 
 void D3DRenderer::PopulateCommandList() {
-  m_commandAllocator->Reset();
+  CPU_PROFILE_SCOPE("PopulateCommandList");
+  m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 
-  // 1. Rebuild TLAS for animation
-  m_dxrCommandList->Reset(m_commandAllocator.Get(), nullptr);
-  CreateTopLevelAS(m_dxrCommandList.Get());
-  m_dxrCommandList->Close();
-  ID3D12CommandList *ppCommandLists[] = {m_dxrCommandList.Get()};
-  m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
-  WaitForPreviousFrame();
+  // 1. Rebuild TLAS for animation, recorded on a job into its own list that
+  // is submitted ahead of the main one. Its closing UAV barrier orders the
+  // build before DispatchRays, so no mid-frame wait is needed.
+  // Profiler scopes are allocated here, on the calling thread.
+  JobCounter tlasRecorded;
+  GpuProfilerScope tlasScope = m_gpuProfiler->AddScope("TLAS build");
+  m_jobs->Run(
+      [this, tlasScope]() {
+        CommandListPool::Recording recording = m_commandPool->Begin(0);
+        ID3D12GraphicsCommandList4 *list =
+            m_commandBackend->List(recording.list);
+        m_gpuProfiler->Begin(list, tlasScope);
+        CreateTopLevelAS(list);
+        m_gpuProfiler->End(list, tlasScope);
+        m_commandPool->End(recording);
+      },
+      &tlasRecorded);
 
   // 2. Main Ray Tracing Pass
-  m_commandList->Reset(m_commandAllocator.Get(), nullptr);
+  BeginCommands(1);
 
   // Set Descriptor Heaps
   ID3D12DescriptorHeap *heaps[] = {m_srvUavHeap.Get()};
   m_commandList->SetDescriptorHeaps(1, heaps);
 
-  // Transition Output to UAV
-  D3D12_RESOURCE_BARRIER barrier = {};
-  barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-  barrier.Transition.pResource = m_outputResource.Get();
-  barrier.Transition.StateBefore =
-      D3D12_RESOURCE_STATE_COPY_SOURCE; // Assumed state from previous frame
-  barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
-  m_commandList->ResourceBarrier(1, &barrier);
-
   // Dispatch Rays
+  D3D12_GPU_VIRTUAL_ADDRESS shaderTable = m_shaderTable->GetGPUVirtualAddress();
+  const ShaderTableRange &rayGenTable =
+      m_shaderTableLayout[ShaderTableKind::RayGen];
+  const ShaderTableRange &missTable =
+      m_shaderTableLayout[ShaderTableKind::Miss];
+  const ShaderTableRange &hitGroupTable =
+      m_shaderTableLayout[ShaderTableKind::HitGroup];
+
   D3D12_DISPATCH_RAYS_DESC dispatchDesc = {};
   dispatchDesc.RayGenerationShaderRecord.StartAddress =
-      m_shaderTable->GetGPUVirtualAddress();
-  dispatchDesc.RayGenerationShaderRecord.SizeInBytes = m_shaderTableEntrySize;
-
-  dispatchDesc.MissShaderTable.StartAddress =
-      m_shaderTable->GetGPUVirtualAddress() + m_shaderTableEntrySize;
-  dispatchDesc.MissShaderTable.SizeInBytes = m_shaderTableEntrySize;
-  dispatchDesc.MissShaderTable.StrideInBytes = m_shaderTableEntrySize;
-
-  dispatchDesc.HitGroupTable.StartAddress =
-      m_shaderTable->GetGPUVirtualAddress() + m_shaderTableEntrySize * 2;
-  dispatchDesc.HitGroupTable.SizeInBytes = m_shaderTableEntrySize;
-  dispatchDesc.HitGroupTable.StrideInBytes = m_shaderTableEntrySize;
-
-  dispatchDesc.Width = m_width;
-  dispatchDesc.Height = m_height;
+      shaderTable + rayGenTable.offset;
+  dispatchDesc.RayGenerationShaderRecord.SizeInBytes = rayGenTable.stride;
+
+  dispatchDesc.MissShaderTable.StartAddress = shaderTable + missTable.offset;
+  dispatchDesc.MissShaderTable.SizeInBytes = missTable.size;
+  dispatchDesc.MissShaderTable.StrideInBytes = missTable.stride;
+
+  dispatchDesc.HitGroupTable.StartAddress = shaderTable + hitGroupTable.offset;
+  dispatchDesc.HitGroupTable.SizeInBytes = hitGroupTable.size;
+  dispatchDesc.HitGroupTable.StrideInBytes = hitGroupTable.stride;
+
+  const bool checkerboard = m_imgui.GetState().checkerboard;
+  const DynamicResolutionSize render = m_renderSize;
+  dispatchDesc.Width =
+      checkerboard ? CheckerboardLaunchWidth(render.width) : render.width;
+  dispatchDesc.Height = render.height;
   dispatchDesc.Depth = 1;
 
-  m_dxrCommandList->SetPipelineState1(m_dxrStateObject.Get());
-  m_dxrCommandList->SetComputeRootSignature(m_dxrGlobalRootSignature.Get());
-
-  // Bind Acceleration Structure (t0 - Root Parameter 0)
-  m_dxrCommandList->SetComputeRootShaderResourceView(
-      0, m_topLevelAS->GetGPUVirtualAddress());
+  m_commandList->SetPipelineState1(m_dxrStateObject.Get());
+  m_commandList->SetComputeRootSignature(m_dxrGlobalRootSignature.Get());
 
   // Bind Output UAV (u0 - Root Parameter 1 - Descriptor Table)
   D3D12_GPU_DESCRIPTOR_HANDLE uavHandle =
       m_srvUavHeap->GetGPUDescriptorHandleForHeapStart();
   uavHandle.ptr += m_device->GetDescriptorHandleIncrementSize(
       D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV); // Index 1
-  m_dxrCommandList->SetComputeRootDescriptorTable(1, uavHandle);
+  m_commandList->SetComputeRootDescriptorTable(1, uavHandle);
 
   // Bind Constants
-  if (m_cameraBuffer) {
-    m_dxrCommandList->SetComputeRootConstantBufferView(
-        2, m_cameraBuffer->GetGPUVirtualAddress());
+  if (m_cameraConstants) {
+    m_commandList->SetComputeRootConstantBufferView(2, m_cameraConstants);
   }
 
-  m_dxrCommandList->DispatchRays(&dispatchDesc);
-
-  // Transition Output to Copy Source
-  barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
-  barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
-  m_commandList->ResourceBarrier(1, &barrier);
-
-  // Transition Backbuffer to Copy Dest
-  barrier.Transition.pResource = m_renderTargets[m_frameIndex].Get();
-  barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-  barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;
-  m_commandList->ResourceBarrier(1, &barrier);
+  // Bind Materials (t1 - Root Parameter 3)
+  m_commandList->SetComputeRootShaderResourceView(
+      3, m_materialBuffer->GetGPUVirtualAddress());
+
+  // Resolve the traced half into m_resolved[m_resolvedIndex]. History from
+  // a different render size does not line up.
+  bool historyValid = m_checkerboardHistoryValid &&
+                      m_checkerboardHistorySize.width == render.width &&
+                      m_checkerboardHistorySize.height == render.height;
+  struct {
+    uint32_t width, height, parity, historyValid;
+    float historyWeight, clampMargin;
+  } resolveConstants = {render.width,
+                        render.height,
+                        m_checkerboardParity,
+                        historyValid ? 1u : 0u,
+                        m_checkerboardSettings.historyWeight,
+                        m_checkerboardSettings.clampMargin};
+  // Stretch the rendered corner over the whole window
+  uint32_t upscaleConstants[4] = {render.width, render.height,
+                                  (uint32_t)m_width, (uint32_t)m_height};
+
+  FramePlanInputs planInputs;
+  planInputs.checkerboard = checkerboard;
+  planInputs.resolvedIndex = m_resolvedIndex;
+  planInputs.upscale =
+      render.width != (UINT)m_width || render.height != (UINT)m_height;
+  BuildFramePlan(planInputs, m_framePlan);
+
+  for (const FramePlanStep &step : m_framePlan.steps) {
+    RecordBarriers(step.firstBarrier, step.barrierCount);
+    if (step.pass == FramePass::DispatchRays) {
+      // Bind Acceleration Structure (t0 - Root Parameter 0). The job may
+      // have replaced the TLAS buffer, so its address is only read once it
+      // is done.
+      m_jobs->Wait(tlasRecorded);
+      m_commandList->SetComputeRootShaderResourceView(
+          0, m_topLevelAS->GetGPUVirtualAddress());
+    } else if (step.pass == FramePass::ImGui) {
+      D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle =
+          m_rtvHeap->GetCPUDescriptorHandleForHeapStart();
+      rtvHandle.ptr += (m_frameIndex * m_rtvDescriptorSize);
+      m_commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
+    }
 
-  // Copy
-  m_commandList->CopyResource(m_renderTargets[m_frameIndex].Get(),
-                              m_outputResource.Get());
+    GpuProfilerScope scope =
+        m_gpuProfiler->AddScope(FramePassName(step.pass));
+    m_gpuProfiler->Begin(m_commandList, scope);
+    switch (step.pass) {
+    case FramePass::DispatchRays:
+      m_commandList->DispatchRays(&dispatchDesc);
+      break;
+    case FramePass::CheckerboardResolve:
+      DispatchComputePass(m_resolvePass, ResolveTable(m_resolvedIndex),
+                          &resolveConstants, sizeof(resolveConstants) / 4,
+                          render.width, render.height);
+      break;
+    case FramePass::Upscale:
+      // FrameResource::Output, Resolved0 and Resolved1 are 0, 1 and 2,
+      // the order UpscaleTable() takes its sources in.
+      DispatchComputePass(m_upscalePass,
+                          UpscaleTable((UINT)m_framePlan.upscaleSource),
+                          upscaleConstants, _countof(upscaleConstants),
+                          m_width, m_height);
+      break;
+    case FramePass::CopyToBackBuffer:
+      m_commandList->CopyResource(FrameResourcePtr(FrameResource::BackBuffer),
+                                  FrameResourcePtr(m_framePlan.copySource));
+      break;
+    case FramePass::ImGui:
+      m_imgui.EndFrame(m_commandList);
+      break;
+    }
+    m_gpuProfiler->End(m_commandList, scope);
+  }
+  RecordBarriers(m_framePlan.firstFinalBarrier, m_framePlan.finalBarrierCount);
 
-  // Transition Backbuffer to Render Target for ImGui
-  barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-  barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-  m_commandList->ResourceBarrier(1, &barrier);
+  if (checkerboard) {
+    m_resolvedIndex ^= 1;
+    m_checkerboardHistoryValid = true;
+    m_checkerboardHistorySize = render;
+  }
 
-  // Render ImGui
-  D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle =
-      m_rtvHeap->GetCPUDescriptorHandleForHeapStart();
-  rtvHandle.ptr += (m_frameIndex * m_rtvDescriptorSize);
-  m_commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
+  // The main list is submitted after the TLAS list, so every timestamp of
+  // the frame has been written when this resolve runs.
+  m_gpuProfiler->EndFrame(m_commandList);
 
-  m_imgui.EndFrame(m_commandList.Get());
+  EndCommands();
+}
 
-  // Transition Backbuffer to Present
-  barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-  barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
-  m_commandList->ResourceBarrier(1, &barrier);
+ID3D12Resource *D3DRenderer::FrameResourcePtr(FrameResource resource) const {
+  switch (resource) {
+  case FrameResource::Output:
+    return m_outputResource.Get();
+  case FrameResource::Resolved0:
+    return m_resolved[0].Get();
+  case FrameResource::Resolved1:
+    return m_resolved[1].Get();
+  case FrameResource::Upscaled:
+    return m_upscaled.Get();
+  case FrameResource::BackBuffer:
+    return m_renderTargets[m_frameIndex].Get();
+  }
+  return nullptr;
+}
 
-  m_commandList->Close();
+void D3DRenderer::RecordBarriers(uint32_t first, uint32_t count) {
+  if (count == 0) {
+    return;
+  }
+  D3D12_RESOURCE_BARRIER barriers[2 * kFrameResourceCount];
+  for (uint32_t i = 0; i < count; ++i) {
+    const FrameBarrier &barrier = m_framePlan.barriers[first + i];
+    barriers[i] = Transition(FrameResourcePtr(barrier.resource),
+                             ToD3D12State(barrier.before),
+                             ToD3D12State(barrier.after));
+  }
+  m_commandList->ResourceBarrier(count, barriers);
 }
 
 void D3DRenderer::Present() {
-  ID3D12CommandList *ppCommandLists[] = {m_commandList.Get()};
-  m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
-
+  CPU_PROFILE_SCOPE("Present");
+  m_commandPool->Submit();
   m_swapChain->Present(1, 0);
 }
 
-void D3DRenderer::WaitForPreviousFrame() {
-  const UINT64 fence = m_fenceValue;
-  m_commandQueue->Signal(m_fence.Get(), fence);
-  m_fenceValue++;
-
-  if (m_fence->GetCompletedValue() < fence) {
-    m_fence->SetEventOnCompletion(fence, m_fenceEvent);
-    WaitForSingleObject(m_fenceEvent, INFINITE);
+void D3DRenderer::WaitForGpu() {
+  CPU_PROFILE_SCOPE("WaitForGpu");
+  if (m_queue) {
+    // Everything submitted so far is complete afterwards, so whatever was
+    // allocated from the upload ring and the command pool since the last
+    // frame can be reused.
+    uint64_t fence = m_queue->Signal();
+    m_uploadRing.FinishFrame(fence);
+    if (m_commandPool) {
+      m_commandPool->FinishFrame(fence);
+    }
+    m_queue->Wait(fence);
+    m_uploadRing.Retire(fence);
+    if (m_commandPool) {
+      m_commandPool->Retire(fence);
+    }
   }
-
-  m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -512,19 +880,15 @@ void D3DRenderer::WaitForPreviousFrame() {
 // ------------------------------------------------------------------------------------------------
 
 void D3DRenderer::InitRayTracing() {
+  CPU_PROFILE_SCOPE("InitRayTracing");
   // 1. Query DXR Device
   if (FAILED(m_device->QueryInterface(IID_PPV_ARGS(&m_dxrDevice)))) {
     throw std::runtime_error("DXR is not supported on this device/system "
                              "(failed to query ID3D12Device5).");
   }
 
-  // 2. Query DXR Command List
-  // We can cast the existing command list if it was created on a compute/direct
-  // queue that supports it. Our m_commandList is DIRECT, so it should support
-  // DXR.
-  if (FAILED(m_commandList->QueryInterface(IID_PPV_ARGS(&m_dxrCommandList)))) {
-    throw std::runtime_error("Failed to query ID3D12GraphicsCommandList4.");
-  }
+  // 2. The pool's lists are created as ID3D12GraphicsCommandList4 on the
+  // DIRECT queue, so they can record DXR work directly.
 
   D3D12_FEATURE_DATA_D3D12_OPTIONS5 options5 = {};
   if (SUCCEEDED(m_device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS5,
@@ -538,7 +902,8 @@ void D3DRenderer::InitRayTracing() {
 
   // Create SRV/UAV/CBV Descriptor Heap
   D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
-  heapDesc.NumDescriptors = 10; // TLAS, Output, TopLevelAS, etc.
+  // 1: output UAV, 2-13: post-processing tables (see CreatePostProcessing).
+  heapDesc.NumDescriptors = 16;
   heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
   heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
   if (FAILED(m_device->CreateDescriptorHeap(&heapDesc,
@@ -548,55 +913,81 @@ void D3DRenderer::InitRayTracing() {
 
   CreateAccelerationStructures();
   CreateRayTracingOutputResource();
+  CreatePostProcessing();
   CreateRayTracingPipeline();
+  CreateMaterialBuffer();
   CreateShaderTables();
+
+  // A cache that cannot be written only costs the next startup.
+  try {
+    m_pipelineCache->Flush();
+  } catch (const std::runtime_error &e) {
+    std::cerr << e.what() << std::endl;
+  }
+  auto &ui = m_imgui.GetState();
+  ui.pipelineStartupMs = (float)m_pipelineStartupMs;
+  ui.pipelineCacheHits = m_pipelineCache->Stats().hits;
+  ui.pipelineCacheMisses = m_pipelineCache->Stats().misses;
+  ui.materialCount = (int)m_materials.Count();
+  ui.materialInstances = (int)m_instanceMaterials.size();
 }
 
 void D3DRenderer::CreateAccelerationStructures() {
-  // Reset command list for initialization work
-  m_commandAllocator->Reset();
-  m_commandList->Reset(m_commandAllocator.Get(), nullptr);
+  // Command list for initialization work
+  BeginCommands(0);
 
-  // 1. Sphere BLAS
+  m_blasPool = m_bufferHeaps->CreateResource(
+      BufferDesc(BlasPoolSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+      D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE);
+  m_blasRanges.Reset(BlasPoolSize,
+                     D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+
+  // 1. Sphere BLASes, one per level of detail
   D3D12_GPU_VIRTUAL_ADDRESS vbBase = m_vertexBuffer->GetGPUVirtualAddress();
   D3D12_GPU_VIRTUAL_ADDRESS ibBase = m_indexBuffer->GetGPUVirtualAddress();
-  UINT stride = sizeof(Vertex);
-
-  UINT sphereVertexCount = m_planeVertexOffset; // Since sphere started at 0
-  D3D12_GPU_VIRTUAL_ADDRESS sphereVB = vbBase;  // Offset 0
-  D3D12_GPU_VIRTUAL_ADDRESS sphereIB = ibBase;  // Offset 0
-
-  m_sphereBLAS =
-      CreateBottomLevelAS(m_dxrCommandList.Get(), sphereVB, stride,
-                          sphereVertexCount, sphereIB, m_sphereIndexCount);
+  UINT stride = sizeof(Float3); // position stream
+
+  for (uint32_t level = 0; level < kSphereLodCount; ++level) {
+    const MeshRange &range = m_sphereLods[level];
+    m_sphereBLAS[level] = CreateBottomLevelAS(
+        m_commandList, vbBase + range.vertexOffset * stride, stride,
+        range.vertexCount, ibBase + range.indexOffset * m_indexSize,
+        range.indexCount);
+  }
 
   // 2. Plane BLAS
   UINT planeVertexCount = m_vertexCount - m_planeVertexOffset;
   D3D12_GPU_VIRTUAL_ADDRESS planeVB = vbBase + m_planeVertexOffset * stride;
   D3D12_GPU_VIRTUAL_ADDRESS planeIB =
-      ibBase + m_planeIndexOffset * sizeof(UINT);
+      ibBase + m_planeIndexOffset * m_indexSize;
 
   m_planeBLAS =
-      CreateBottomLevelAS(m_dxrCommandList.Get(), planeVB, stride,
+      CreateBottomLevelAS(m_commandList, planeVB, stride,
                           planeVertexCount, planeIB, m_planeIndexCount);
 
-  // 3. TLAS
-  CreateTopLevelAS(m_dxrCommandList.Get());
+  // 3. Procedural sphere BLAS: one AABB, hit by SphereIntersection
+  m_sphereAabbBLAS = CreateProceduralBottomLevelAS(
+      m_commandList, m_sphereAabbBuffer->GetGPUVirtualAddress(), 1);
+
+  // 4. TLAS
+  AnimateScene(m_imgui.GetState().animationSpeed);
+  CreateTopLevelAS(m_commandList);
 
   // Close and execute
-  m_commandList->Close();
-  ID3D12CommandList *ppCommandLists[] = {m_commandList.Get()};
-  m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
+  EndCommands();
+  m_commandPool->Submit();
+
+  WaitForGpu(); // Wait for AS build to finish
 
-  WaitForPreviousFrame(); // Wait for AS build to finish
+  // The BLASes are never rebuilt, so their scratch space can go back to the
+  // heap.
+  m_scratchResource.Reset();
 }
 
-ComPtr<ID3D12Resource> D3DRenderer::CreateBottomLevelAS(
+D3D12_GPU_VIRTUAL_ADDRESS D3DRenderer::CreateBottomLevelAS(
     ID3D12GraphicsCommandList4 *commandList,
     D3D12_GPU_VIRTUAL_ADDRESS vbAddress, UINT vbStride, UINT vertexCount,
     D3D12_GPU_VIRTUAL_ADDRESS ibAddress, UINT indexCount) {
-
-  // Geometry definition
   D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = {};
   geomDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
   geomDesc.Triangles.VertexBuffer.StartAddress = vbAddress;
@@ -605,10 +996,27 @@ ComPtr<ID3D12Resource> D3DRenderer::CreateBottomLevelAS(
   geomDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
   geomDesc.Triangles.IndexBuffer = ibAddress;
   geomDesc.Triangles.IndexCount = indexCount;
-  geomDesc.Triangles.IndexFormat = DXGI_FORMAT_R32_UINT;
+  geomDesc.Triangles.IndexFormat = m_indexFormat;
   geomDesc.Triangles.Transform3x4 = 0;
   geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+  return BuildBottomLevelAS(commandList, geomDesc);
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS D3DRenderer::CreateProceduralBottomLevelAS(
+    ID3D12GraphicsCommandList4 *commandList,
+    D3D12_GPU_VIRTUAL_ADDRESS aabbAddress, UINT aabbCount) {
+  D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = {};
+  geomDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS;
+  geomDesc.AABBs.AABBCount = aabbCount;
+  geomDesc.AABBs.AABBs.StartAddress = aabbAddress;
+  geomDesc.AABBs.AABBs.StrideInBytes = sizeof(D3D12_RAYTRACING_AABB);
+  geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+  return BuildBottomLevelAS(commandList, geomDesc);
+}
 
+D3D12_GPU_VIRTUAL_ADDRESS D3DRenderer::BuildBottomLevelAS(
+    ID3D12GraphicsCommandList4 *commandList,
+    const D3D12_RAYTRACING_GEOMETRY_DESC &geomDesc) {
   // Build inputs
   D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
   inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
@@ -621,223 +1029,199 @@ ComPtr<ID3D12Resource> D3DRenderer::CreateBottomLevelAS(
   D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
   m_dxrDevice->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
 
-  // Scratch Buffer
-  D3D12_RESOURCE_DESC scratchDesc = {};
-  scratchDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-  scratchDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
-  scratchDesc.Width = info.ScratchDataSizeInBytes;
-  scratchDesc.Height = 1;
-  scratchDesc.DepthOrArraySize = 1;
-  scratchDesc.MipLevels = 1;
-  scratchDesc.Format = DXGI_FORMAT_UNKNOWN;
-  scratchDesc.SampleDesc.Count = 1;
-  scratchDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-  scratchDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-
-  D3D12_HEAP_PROPERTIES defaultHeapProps = {};
-  defaultHeapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
-  defaultHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-  defaultHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-  defaultHeapProps.CreationNodeMask = 1;
-  defaultHeapProps.VisibleNodeMask = 1;
-
-  // Reuse or create scratch buffer
+  // Scratch buffer, shared by the BLAS builds
   if (!m_scratchResource ||
       m_scratchResource->GetDesc().Width < info.ScratchDataSizeInBytes) {
-    m_scratchResource.Reset();
-    // Add margin to avoid frequent reallocations if sizes slightly differ
-    scratchDesc.Width =
-        (std::max)(scratchDesc.Width,
-                   (UINT64)
-                       D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
-    m_device->CreateCommittedResource(
-        &defaultHeapProps, D3D12_HEAP_FLAG_NONE, &scratchDesc,
-        D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr,
-        IID_PPV_ARGS(&m_scratchResource));
-  }
-
-  // Result (BLAS)
-  D3D12_RESOURCE_DESC asDesc = scratchDesc; // Copy props
-  asDesc.Width = info.ResultDataMaxSizeInBytes;
-  asDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-
-  ComPtr<ID3D12Resource> blas;
-  m_device->CreateCommittedResource(
-      &defaultHeapProps, D3D12_HEAP_FLAG_NONE, &asDesc,
-      D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nullptr,
-      IID_PPV_ARGS(&blas));
+    // An earlier build in this command list may still be using it.
+    if (m_scratchResource) {
+      m_frames[m_frameSlot].deferredReleases.push_back(
+          std::move(m_scratchResource));
+    }
+    UINT64 scratchSize = (std::max)(
+        info.ScratchDataSizeInBytes,
+        (UINT64)D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+    m_scratchResource = m_bufferHeaps->CreateResource(
+        BufferDesc(scratchSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+  }
+
+  // Result (BLAS), sub-allocated from the pool
+  TlsfAllocator::Allocation range = m_blasRanges.Allocate(
+      info.ResultDataMaxSizeInBytes,
+      D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+  if (!range.Valid()) {
+    throw std::runtime_error("BLAS pool is too small for the scene");
+  }
+  D3D12_GPU_VIRTUAL_ADDRESS blas =
+      m_blasPool->GetGPUVirtualAddress() + range.offset;
 
   // Build
   D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
   buildDesc.Inputs = inputs;
-  buildDesc.DestAccelerationStructureData = blas->GetGPUVirtualAddress();
+  buildDesc.DestAccelerationStructureData = blas;
   buildDesc.ScratchAccelerationStructureData =
       m_scratchResource->GetGPUVirtualAddress();
 
   commandList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
 
-  // Barrier
-  D3D12_RESOURCE_BARRIER uavBarrier = {};
-  uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-  uavBarrier.UAV.pResource = blas.Get();
-  commandList->ResourceBarrier(1, &uavBarrier);
+  // Barriers: the TLAS build reads the result, and the next BLAS build
+  // reuses the scratch buffer.
+  D3D12_RESOURCE_BARRIER uavBarriers[2] = {};
+  uavBarriers[0].Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+  uavBarriers[0].UAV.pResource = m_blasPool.Get();
+  uavBarriers[1].Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+  uavBarriers[1].UAV.pResource = m_scratchResource.Get();
+  commandList->ResourceBarrier(2, uavBarriers);
 
   return blas;
 }
 
+void D3DRenderer::AnimateScene(float animationSpeed) {
+  CPU_PROFILE_SCOPE("AnimateScene");
+  BuildSceneInstances(m_animationTime, animationSpeed, m_sceneInstances);
+  m_instanceBvh.Update(m_sceneInstances);
+}
+
 void D3DRenderer::CreateTopLevelAS(ID3D12GraphicsCommandList4 *commandList) {
-  std::vector<D3D12_RAYTRACING_INSTANCE_DESC> instances;
+  CPU_PROFILE_SCOPE("CreateTopLevelAS");
+  auto &ui = m_imgui.GetState();
+  m_jobs->Wait(m_sceneReady);
+
+  // Pick each ball's sphere level of detail from its projected size. A
+  // ball that changes level only changes its desc's BLAS address, so it is
+  // marked for a refit even if it did not move.
+  UINT instanceCount = (UINT)m_sceneInstances.size();
+  UINT ballCount = m_ballAnimator.Count();
+  UINT staticCount = instanceCount - ballCount;
+  m_ballLods.resize(ballCount, 0);
+  m_previousBallLods = m_ballLods;
+  if (ui.sphereLod && !m_analyticSpheres) {
+    SphereLodView view =
+        MakeSphereLodView(m_camera.position, kCameraFovY, m_height);
+    m_sphereLod.Select(m_sceneInstances.data() + staticCount, ballCount, view,
+                       m_ballLods.data());
+  } else {
+    std::fill(m_ballLods.begin(), m_ballLods.end(), (uint8_t)0);
+  }
+  static_assert(kSphereLodCount <= ImGuiManager::MaxSphereLods,
+                "UI reports one ball count per level");
+  std::fill(std::begin(ui.sphereLodBalls), std::end(ui.sphereLodBalls), 0);
+  for (UINT i = 0; i < ballCount; ++i) {
+    if (m_ballLods[i] != m_previousBallLods[i]) {
+      m_tlasTracker.MarkDirty(staticCount + i);
+    }
+    ++ui.sphereLodBalls[m_ballLods[i]];
+  }
 
-  // 1. Plane (ID 0)
-  {
-    D3D12_RAYTRACING_INSTANCE_DESC desc = {};
-    desc.Transform[0][0] = desc.Transform[1][1] = desc.Transform[2][2] = 1;
-    desc.InstanceID = 0;
-    desc.InstanceMask = 0xFF;
-    desc.InstanceContributionToHitGroupIndex = 0;
-    desc.Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-    desc.AccelerationStructure = m_planeBLAS->GetGPUVirtualAddress();
-    instances.push_back(desc);
+  // The TLAS persists across frames; the tracker decides whether this
+  // frame's instances need a full build, an in-place update or nothing.
+  TlasBuildAction action = m_tlasTracker.Plan(
+      m_sceneInstances,
+      m_sceneInstances.empty() ? nullptr : &m_instanceBvh.WorldBounds(0));
+  const TlasUpdateStats &tlasStats = m_tlasTracker.Stats();
+  ui.tlasAction = TlasBuildActionName(action);
+  ui.tlasDirty = (int)tlasStats.dirtyCount;
+  ui.tlasRebuilds = tlasStats.rebuildCount;
+  ui.tlasRefits = tlasStats.refitCount;
+  if (action == TlasBuildAction::None) {
+    return;
   }
 
-  // 2. Main Mirror Sphere (ID 1)
-  {
-    D3D12_RAYTRACING_INSTANCE_DESC desc = {};
-    // Scale 1.5, Pos (0, 1.5, 0)
-    desc.Transform[0][0] = 1.5f;
-    desc.Transform[0][3] = 0.0f;
-    desc.Transform[1][1] = 1.5f;
-    desc.Transform[1][3] = 1.5f;
-    desc.Transform[2][2] = 1.5f;
-    desc.Transform[2][3] = 0.0f;
-
-    desc.InstanceID = 1;
-    desc.InstanceMask = 0xFF;
-    desc.InstanceContributionToHitGroupIndex = 0;
-    desc.Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-    desc.AccelerationStructure = m_sphereBLAS->GetGPUVirtualAddress();
-    instances.push_back(desc);
-  }
-
-  // 3. Pastel Balls (ID 2+)
-  auto &ui = m_imgui.GetState();
-  int numBalls = 50;
-  for (int i = 0; i < numBalls; ++i) {
-    float angle = ((float)i / numBalls * 6.28f * 2.0f) +
-                  (m_animationTime * ui.animationSpeed * 0.5f);
-    float orbitRadius = 4.0f + (i % 5) * 2.0f;
-    float x = cos(angle) * orbitRadius;
-    float z = sin(angle) * orbitRadius;
-    float bounce =
-        abs(sin(m_animationTime * ui.animationSpeed * 2.0f + i)) * 2.0f;
-    float scale = 0.3f + ((i % 3) * 0.1f);
-
-    D3D12_RAYTRACING_INSTANCE_DESC desc = {};
-    desc.Transform[0][0] = scale;
-    desc.Transform[0][3] = x;
-    desc.Transform[1][1] = scale;
-    desc.Transform[1][3] = scale + bounce; // Bouncing
-    desc.Transform[2][2] = scale;
-    desc.Transform[2][3] = z;
-
-    desc.InstanceID = 2 + i;
-    desc.InstanceMask = 0xFF;
-    desc.InstanceContributionToHitGroupIndex = 0;
-    desc.Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-    desc.AccelerationStructure = m_sphereBLAS->GetGPUVirtualAddress();
-    instances.push_back(desc);
-  }
-
-  // Upload Instance Descs
-  UINT instanceDescSize =
-      (UINT)instances.size() * sizeof(D3D12_RAYTRACING_INSTANCE_DESC);
-
-  D3D12_HEAP_PROPERTIES uploadHeapProps = {};
-  uploadHeapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
-  uploadHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-  uploadHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-  uploadHeapProps.CreationNodeMask = 1;
-  uploadHeapProps.VisibleNodeMask = 1;
-
-  D3D12_RESOURCE_DESC bufferDesc = {};
-  bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-  bufferDesc.Alignment = 0;
-  bufferDesc.Width = instanceDescSize;
-  bufferDesc.Height = 1;
-  bufferDesc.DepthOrArraySize = 1;
-  bufferDesc.MipLevels = 1;
-  bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
-  bufferDesc.SampleDesc.Count = 1;
-  bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-  bufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-
-  // Release old resource if exists? Or just create new one directly?
-  // CreateCommittedResource will overwrite pointer but leak if not released?
-  // ComPtr handles this.
-  if (FAILED(m_device->CreateCommittedResource(
-          &uploadHeapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc,
-          D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-          IID_PPV_ARGS(&m_instanceDescs)))) {
-    throw std::runtime_error("Failed to create instance desc buffer");
-  }
-
-  void *pData;
-  m_instanceDescs->Map(0, nullptr, &pData);
-  memcpy(pData, instances.data(), instanceDescSize);
-  m_instanceDescs->Unmap(0, nullptr);
-
-  // TLAS Inputs
+  // Refresh the CPU copy of the static descs that changed and copy them
+  // into the upload ring, then let the animator write the balls straight
+  // into the ring behind them with streaming stores: nothing is staged, and
+  // write-combined memory only ever sees whole sequential lines.
+  UINT64 instanceDescSize =
+      (UINT64)instanceCount * sizeof(D3D12_RAYTRACING_INSTANCE_DESC);
+  uint64_t ballBLAS[kSphereLodCount];
+  for (uint32_t level = 0; level < kSphereLodCount; ++level) {
+    ballBLAS[level] =
+        m_analyticSpheres ? m_sphereAabbBLAS : m_sphereBLAS[level];
+  }
+  UpdateStaticInstanceDescs(m_sceneInstances, m_tlasTracker.DirtyInstances(),
+                            staticCount, {m_planeBLAS, ballBLAS[0]},
+                            m_instanceDescs);
+  UploadAllocation instanceDescs = AllocateUpload(
+      (std::max)(instanceDescSize, (UINT64)1),
+      D3D12_RAYTRACING_INSTANCE_DESCS_BYTE_ALIGNMENT);
+  WriteSceneInstanceDescs(m_instanceDescs, m_ballAnimator, m_animationTime,
+                          ui.animationSpeed, ballBLAS, m_ballLods.data(),
+                          static_cast<GpuInstanceDesc *>(instanceDescs.cpu),
+                          *m_jobs);
+
+  // TLAS Inputs. Build and update must use the same flags apart from
+  // PERFORM_UPDATE. The structure now outlives many refits, so the
+  // rebuild still favours trace speed.
   D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
   inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
   inputs.Flags =
-      D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
-  inputs.NumDescs = (UINT)instances.size();
+      D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE |
+      D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+  inputs.NumDescs = instanceCount;
   inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-  inputs.InstanceDescs = m_instanceDescs->GetGPUVirtualAddress();
+  inputs.InstanceDescs = instanceDescs.gpu;
+
+  bool refit = action == TlasBuildAction::Refit;
+  if (!refit) {
+    // Sizes only depend on the instance count, which cannot change between
+    // rebuilds, so the buffers are only (re)sized here.
+    D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
+    m_dxrDevice->GetRaytracingAccelerationStructurePrebuildInfo(&inputs,
+                                                                &info);
+
+    // The TLAS and its scratch buffer are shared by all frames: the queue
+    // runs frames in order, so only growing them needs care. Earlier frames
+    // may still reference the old buffers, so they are released once this
+    // frame slot comes around again.
+    UINT64 scratchSize = (std::max)(info.ScratchDataSizeInBytes,
+                                    info.UpdateScratchDataSizeInBytes);
+    scratchSize = scratchSize > 0 ? scratchSize : 1024;
+    UINT64 resultSize = info.ResultDataMaxSizeInBytes > 0
+                            ? info.ResultDataMaxSizeInBytes
+                            : 1024;
+
+    // Old buffers keep their heap range until the frame slot is reused,
+    // so nothing new can be placed over memory the GPU may still read.
+    FrameResources &frame = m_frames[m_frameSlot];
+    if (!m_scratchTLAS || m_scratchTLAS->GetDesc().Width < scratchSize) {
+      if (m_scratchTLAS) {
+        frame.deferredReleases.push_back(std::move(m_scratchTLAS));
+      }
+      m_scratchTLAS = m_bufferHeaps->CreateResource(
+          BufferDesc(scratchSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+          D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    }
 
-  D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
-  m_dxrDevice->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
+    // TLAS Resource
+    if (!m_topLevelAS || m_topLevelAS->GetDesc().Width < resultSize) {
+      if (m_topLevelAS) {
+        frame.deferredReleases.push_back(std::move(m_topLevelAS));
+      }
+      m_topLevelAS = m_bufferHeaps->CreateResource(
+          BufferDesc(resultSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+          D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE);
+      refit = false;
+    }
+  }
 
-  // Re-create scratch if needed (simplified: always create new, or check size)
-  D3D12_RESOURCE_DESC scratchDesc = {};
-  scratchDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-  scratchDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
-  scratchDesc.Width =
-      info.ScratchDataSizeInBytes > 0 ? info.ScratchDataSizeInBytes : 1024;
-  scratchDesc.Height = 1;
-  scratchDesc.DepthOrArraySize = 1;
-  scratchDesc.MipLevels = 1;
-  scratchDesc.Format = DXGI_FORMAT_UNKNOWN;
-  scratchDesc.SampleDesc.Count = 1;
-  scratchDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-  scratchDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-
-  D3D12_HEAP_PROPERTIES defaultHeapProps = {};
-  defaultHeapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
-  defaultHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-  defaultHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-  defaultHeapProps.CreationNodeMask = 1;
-  defaultHeapProps.VisibleNodeMask = 1;
-
-  m_device->CreateCommittedResource(&defaultHeapProps, D3D12_HEAP_FLAG_NONE,
-                                    &scratchDesc,
-                                    D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-                                    nullptr, IID_PPV_ARGS(&m_scratchTLAS));
-
-  // TLAS Resource
-  D3D12_RESOURCE_DESC asDesc = scratchDesc;
-  asDesc.Width =
-      info.ResultDataMaxSizeInBytes > 0 ? info.ResultDataMaxSizeInBytes : 1024;
-  asDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-
-  m_device->CreateCommittedResource(
-      &defaultHeapProps, D3D12_HEAP_FLAG_NONE, &asDesc,
-      D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nullptr,
-      IID_PPV_ARGS(&m_topLevelAS));
+  // The previous frame's DispatchRays may still be reading the TLAS, and
+  // its build may still be using the scratch buffer.
+  D3D12_RESOURCE_BARRIER readBarriers[2] = {};
+  readBarriers[0].Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+  readBarriers[0].UAV.pResource = m_topLevelAS.Get();
+  readBarriers[1].Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+  readBarriers[1].UAV.pResource = m_scratchTLAS.Get();
+  commandList->ResourceBarrier(2, readBarriers);
 
-  // Build
+  // Build, or update in place from the previous result
   D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
   buildDesc.Inputs = inputs;
+  if (refit) {
+    buildDesc.Inputs.Flags |=
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+    buildDesc.SourceAccelerationStructureData =
+        m_topLevelAS->GetGPUVirtualAddress();
+  }
   buildDesc.DestAccelerationStructureData =
       m_topLevelAS->GetGPUVirtualAddress();
   buildDesc.ScratchAccelerationStructureData =
@@ -864,19 +1248,8 @@ void D3DRenderer::CreateRayTracingOutputResource() {
   resDesc.MipLevels = 1;
   resDesc.SampleDesc.Count = 1;
 
-  D3D12_HEAP_PROPERTIES heapProps = {};
-  heapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
-  heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-  heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-  heapProps.CreationNodeMask = 1;
-  heapProps.VisibleNodeMask = 1;
-
-  if (FAILED(m_device->CreateCommittedResource(
-          &heapProps, D3D12_HEAP_FLAG_NONE, &resDesc,
-          D3D12_RESOURCE_STATE_COPY_SOURCE, nullptr,
-          IID_PPV_ARGS(&m_outputResource)))) {
-    throw std::runtime_error("Failed to create ray tracing output resource");
-  }
+  m_outputResource = m_textureHeaps->CreateResource(
+      resDesc, D3D12_RESOURCE_STATE_COPY_SOURCE);
 
   // Create UAV
   D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
@@ -895,9 +1268,196 @@ void D3DRenderer::CreateRayTracingOutputResource() {
                                       uavHeapHandle);
 }
 
+void D3DRenderer::CreateComputePass(const char *name, UINT constantCount,
+                                    UINT srvCount, bool linearSampler,
+                                    ComputePass &pass) {
+  D3D12_DESCRIPTOR_RANGE ranges[2] = {};
+  ranges[0].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+  ranges[0].NumDescriptors = srvCount; // t0...
+  ranges[0].OffsetInDescriptorsFromTableStart = 0;
+  ranges[1].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
+  ranges[1].NumDescriptors = 1; // u0
+  ranges[1].OffsetInDescriptorsFromTableStart = srvCount;
+
+  D3D12_ROOT_PARAMETER rootParams[2] = {};
+  rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+  rootParams[0].Constants.ShaderRegister = 0;
+  rootParams[0].Constants.Num32BitValues = constantCount;
+  rootParams[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+  rootParams[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+  rootParams[1].DescriptorTable.NumDescriptorRanges = _countof(ranges);
+  rootParams[1].DescriptorTable.pDescriptorRanges = ranges;
+  rootParams[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+
+  D3D12_STATIC_SAMPLER_DESC sampler = {};
+  sampler.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
+  sampler.AddressU = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+  sampler.AddressV = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+  sampler.AddressW = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+  sampler.MaxLOD = D3D12_FLOAT32_MAX;
+  sampler.ShaderRegister = 0;
+  sampler.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+
+  D3D12_ROOT_SIGNATURE_DESC rootSigDesc = {};
+  rootSigDesc.NumParameters = _countof(rootParams);
+  rootSigDesc.pParameters = rootParams;
+  rootSigDesc.NumStaticSamplers = linearSampler ? 1 : 0;
+  rootSigDesc.pStaticSamplers = linearSampler ? &sampler : nullptr;
+
+  ComPtr<ID3DBlob> signatureBlob;
+  ComPtr<ID3DBlob> errorBlob;
+  if (FAILED(D3D12SerializeRootSignature(&rootSigDesc,
+                                         D3D_ROOT_SIGNATURE_VERSION_1,
+                                         &signatureBlob, &errorBlob))) {
+    throw std::runtime_error(std::string("Failed to serialize ") + name +
+                             " root signature");
+  }
+  if (FAILED(m_device->CreateRootSignature(
+          0, signatureBlob->GetBufferPointer(), signatureBlob->GetBufferSize(),
+          IID_PPV_ARGS(&pass.rootSignature)))) {
+    throw std::runtime_error(std::string("Failed to create ") + name +
+                             " root signature");
+  }
+
+  auto pipelineStart = std::chrono::steady_clock::now();
+
+#ifdef _DEBUG
+  UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#else
+  UINT compileFlags = 0;
+#endif
+
+  std::string path = std::string("shaders/") + name + ".hlsl";
+  D3D12_SHADER_BYTECODE computeShader =
+      EmbeddedBytecode((std::string(name) + "_CSMain.cso").c_str());
+  std::vector<uint8_t> compiledComputeShader;
+  if (!computeShader.pShaderBytecode) {
+    MappedFile shaderSource(path.c_str());
+    compiledComputeShader = CompileShader(shaderSource, path.c_str(),
+                                          "CSMain", "cs_5_0", compileFlags);
+    computeShader = {compiledComputeShader.data(),
+                     compiledComputeShader.size()};
+  }
+
+  D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
+  psoDesc.pRootSignature = pass.rootSignature.Get();
+  psoDesc.CS = computeShader;
+
+  PipelineKey psoKey;
+  psoKey.AddString("kind", "compute")
+      .AddBytes("cs", computeShader.pShaderBytecode,
+                computeShader.BytecodeLength)
+      .AddBytes("rootsig", signatureBlob->GetBufferPointer(),
+                signatureBlob->GetBufferSize());
+
+  std::vector<uint8_t> cachedPso;
+  if (m_pipelineCache->Load(psoKey.Value(), cachedPso)) {
+    psoDesc.CachedPSO = {cachedPso.data(), cachedPso.size()};
+    if (FAILED(m_device->CreateComputePipelineState(
+            &psoDesc, IID_PPV_ARGS(&pass.pipelineState)))) {
+      m_pipelineCache->Invalidate(psoKey.Value());
+      psoDesc.CachedPSO = {};
+    }
+  }
+  if (!pass.pipelineState) {
+    if (FAILED(m_device->CreateComputePipelineState(
+            &psoDesc, IID_PPV_ARGS(&pass.pipelineState)))) {
+      throw std::runtime_error(std::string("Failed to create ") + name +
+                               " pipeline state");
+    }
+    ComPtr<ID3DBlob> blob;
+    if (SUCCEEDED(pass.pipelineState->GetCachedBlob(&blob))) {
+      m_pipelineCache->Store(psoKey.Value(), blob->GetBufferPointer(),
+                             blob->GetBufferSize());
+    }
+  }
+  m_pipelineStartupMs += std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - pipelineStart)
+                             .count();
+}
+
+void D3DRenderer::DispatchComputePass(const ComputePass &pass, UINT table,
+                                      const void *constants,
+                                      UINT constantCount, UINT width,
+                                      UINT height) {
+  D3D12_GPU_DESCRIPTOR_HANDLE handle =
+      m_srvUavHeap->GetGPUDescriptorHandleForHeapStart();
+  handle.ptr += table * m_device->GetDescriptorHandleIncrementSize(
+                            D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+  m_commandList->SetPipelineState(pass.pipelineState.Get());
+  m_commandList->SetComputeRootSignature(pass.rootSignature.Get());
+  m_commandList->SetComputeRoot32BitConstants(0, constantCount, constants, 0);
+  m_commandList->SetComputeRootDescriptorTable(1, handle);
+  m_commandList->Dispatch((width + 7) / 8, (height + 7) / 8, 1);
+}
+
+void D3DRenderer::CreatePostProcessing() {
+  // Two resolve targets and the upscale target, the size of the output.
+  D3D12_RESOURCE_DESC resDesc = m_outputResource->GetDesc();
+  for (PlacedResource &resolved : m_resolved) {
+    resolved = m_textureHeaps->CreateResource(
+        resDesc, D3D12_RESOURCE_STATE_COPY_SOURCE);
+  }
+  m_upscaled = m_textureHeaps->CreateResource(
+      resDesc, D3D12_RESOURCE_STATE_COPY_SOURCE);
+
+  D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+  srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+  srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+  srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+  srvDesc.Texture2D.MipLevels = 1;
+  D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+  uavDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+  uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+
+  UINT increment = m_device->GetDescriptorHandleIncrementSize(
+      D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+  auto slot = [&](UINT index) {
+    D3D12_CPU_DESCRIPTOR_HANDLE handle =
+        m_srvUavHeap->GetCPUDescriptorHandleForHeapStart();
+    handle.ptr += index * increment;
+    return handle;
+  };
+  auto srv = [&](ID3D12Resource *resource, UINT index) {
+    m_device->CreateShaderResourceView(resource, &srvDesc, slot(index));
+  };
+  auto uav = [&](ID3D12Resource *resource, UINT index) {
+    m_device->CreateUnorderedAccessView(resource, nullptr, &uavDesc,
+                                        slot(index));
+  };
+
+  // Resolving into m_resolved[i]: (output t0, m_resolved[1 - i] t1,
+  // m_resolved[i] u0).
+  for (UINT i = 0; i < 2; ++i) {
+    srv(m_outputResource.Get(), ResolveTable(i));
+    srv(m_resolved[i ^ 1].Get(), ResolveTable(i) + 1);
+    uav(m_resolved[i].Get(), ResolveTable(i) + 2);
+  }
+  // Upscaling the output or m_resolved[i]: (source t0, m_upscaled u0).
+  srv(m_outputResource.Get(), UpscaleTable(0));
+  uav(m_upscaled.Get(), UpscaleTable(0) + 1);
+  for (UINT i = 0; i < 2; ++i) {
+    srv(m_resolved[i].Get(), UpscaleTable(1 + i));
+    uav(m_upscaled.Get(), UpscaleTable(1 + i) + 1);
+  }
+
+  CreateComputePass("CheckerboardResolve", 6, 2, false, m_resolvePass);
+  CreateComputePass("Upscale", 4, 1, true, m_upscalePass);
+}
+
 void D3DRenderer::CreateRayTracingPipeline() {
-  // 1. Create Global Root Signature
-  D3D12_ROOT_PARAMETER rootParams[3] = {};
+  // 1. The DXIL library is compiled into the binary (see ShaderEmbed in
+  // CMakeLists.txt); check its exports before creating anything from it.
+  // The state object reads the bytes straight out of read-only memory.
+  const EmbeddedShader *library = FindEmbeddedShader("RayTracing.dxil");
+  if (!library) {
+    throw std::runtime_error("RayTracing.dxil was not embedded at build time");
+  }
+  ShaderContainer libraryContainer(library->data, library->size);
+  RequireRayTracingLibrary(libraryContainer);
+
+  // 2. Create Global Root Signature
+  D3D12_ROOT_PARAMETER rootParams[4] = {};
 
   // Slot 0: Acceleration Structure (SRV t0)
   rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
@@ -930,8 +1490,14 @@ void D3DRenderer::CreateRayTracingPipeline() {
   rootParams[2].Descriptor.RegisterSpace = 0;
   rootParams[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
 
+  // Slot 3: Material table (SRV t1), a structured buffer
+  rootParams[3].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+  rootParams[3].Descriptor.ShaderRegister = 1;
+  rootParams[3].Descriptor.RegisterSpace = 0;
+  rootParams[3].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+
   D3D12_ROOT_SIGNATURE_DESC rootSigDesc = {};
-  rootSigDesc.NumParameters = 3;
+  rootSigDesc.NumParameters = _countof(rootParams);
   rootSigDesc.pParameters = rootParams;
   rootSigDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
 
@@ -948,27 +1514,51 @@ void D3DRenderer::CreateRayTracingPipeline() {
     throw std::runtime_error("Failed to create DXR global root signature");
   }
 
-  // 2. Load DXIL Shader
-  std::string shaderPath = "D:/repos/D3D12-practice/shaders/RayTracing.dxil";
-  std::ifstream shaderFile(shaderPath, std::ios::binary);
-  if (!shaderFile.is_open()) {
-    throw std::runtime_error("Failed to open " + shaderPath);
+  // Local Root Signature for the hit groups: the HitGroupRecord each shader
+  // record carries (b0, space1).
+  D3D12_ROOT_PARAMETER hitGroupParam = {};
+  hitGroupParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+  hitGroupParam.Constants.ShaderRegister = 0;
+  hitGroupParam.Constants.RegisterSpace = 1;
+  hitGroupParam.Constants.Num32BitValues =
+      sizeof(HitGroupRecord) / sizeof(uint32_t);
+  hitGroupParam.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+
+  D3D12_ROOT_SIGNATURE_DESC hitGroupSigDesc = {};
+  hitGroupSigDesc.NumParameters = 1;
+  hitGroupSigDesc.pParameters = &hitGroupParam;
+  hitGroupSigDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
+
+  ComPtr<ID3DBlob> hitGroupSigBlob;
+  if (FAILED(D3D12SerializeRootSignature(&hitGroupSigDesc,
+                                         D3D_ROOT_SIGNATURE_VERSION_1,
+                                         &hitGroupSigBlob, &errorBlob))) {
+    throw std::runtime_error(
+        "Failed to serialize DXR hit group root signature");
+  }
+  if (FAILED(m_device->CreateRootSignature(
+          0, hitGroupSigBlob->GetBufferPointer(),
+          hitGroupSigBlob->GetBufferSize(),
+          IID_PPV_ARGS(&m_dxrHitGroupRootSignature)))) {
+    throw std::runtime_error("Failed to create DXR hit group root signature");
   }
-  std::vector<char> shaderData((std::istreambuf_iterator<char>(shaderFile)),
-                               std::istreambuf_iterator<char>());
 
   // 3. Create State Object
   // We need to construct D3D12_STATE_OBJECT_DESC manually
+  // The export association points into this vector, so it must not grow.
   std::vector<D3D12_STATE_SUBOBJECT> subobjects;
+  subobjects.reserve(9);
 
   // DXIL Library
   D3D12_EXPORT_DESC exports[] = {
       {L"RayGen", nullptr, D3D12_EXPORT_FLAG_NONE},
       {L"Miss", nullptr, D3D12_EXPORT_FLAG_NONE},
-      {L"ClosestHit", nullptr, D3D12_EXPORT_FLAG_NONE}};
+      {L"ClosestHit", nullptr, D3D12_EXPORT_FLAG_NONE},
+      {L"SphereIntersection", nullptr, D3D12_EXPORT_FLAG_NONE},
+      {L"SphereClosestHit", nullptr, D3D12_EXPORT_FLAG_NONE}};
   D3D12_DXIL_LIBRARY_DESC dxilLibDesc = {};
-  dxilLibDesc.DXILLibrary.pShaderBytecode = shaderData.data();
-  dxilLibDesc.DXILLibrary.BytecodeLength = shaderData.size();
+  dxilLibDesc.DXILLibrary.pShaderBytecode = library->data;
+  dxilLibDesc.DXILLibrary.BytecodeLength = library->size;
   dxilLibDesc.NumExports = _countof(exports);
   dxilLibDesc.pExports = exports;
 
@@ -988,11 +1578,45 @@ void D3DRenderer::CreateRayTracingPipeline() {
   hitGroupSubObject.pDesc = &hitGroupDesc;
   subobjects.push_back(hitGroupSubObject);
 
+  // Procedural sphere hit group: exact ray/sphere hits inside the AABB
+  D3D12_HIT_GROUP_DESC sphereHitGroupDesc = {};
+  sphereHitGroupDesc.HitGroupExport = L"SphereHitGroup";
+  sphereHitGroupDesc.Type = D3D12_HIT_GROUP_TYPE_PROCEDURAL_PRIMITIVE;
+  sphereHitGroupDesc.IntersectionShaderImport = L"SphereIntersection";
+  sphereHitGroupDesc.ClosestHitShaderImport = L"SphereClosestHit";
+
+  D3D12_STATE_SUBOBJECT sphereHitGroupSubObject = {};
+  sphereHitGroupSubObject.Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
+  sphereHitGroupSubObject.pDesc = &sphereHitGroupDesc;
+  subobjects.push_back(sphereHitGroupSubObject);
+
+  // Hit Group Local Root Signature
+  D3D12_LOCAL_ROOT_SIGNATURE localRootSigDesc = {};
+  localRootSigDesc.pLocalRootSignature = m_dxrHitGroupRootSignature.Get();
+
+  D3D12_STATE_SUBOBJECT localRootSigSubObject = {};
+  localRootSigSubObject.Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
+  localRootSigSubObject.pDesc = &localRootSigDesc;
+  subobjects.push_back(localRootSigSubObject);
+
+  LPCWSTR localRootSigExports[] = {L"HitGroup", L"SphereHitGroup"};
+  D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION localRootSigAssociation = {};
+  localRootSigAssociation.pSubobjectToAssociate = &subobjects.back();
+  localRootSigAssociation.NumExports = _countof(localRootSigExports);
+  localRootSigAssociation.pExports = localRootSigExports;
+
+  D3D12_STATE_SUBOBJECT localRootSigAssociationSubObject = {};
+  localRootSigAssociationSubObject.Type =
+      D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
+  localRootSigAssociationSubObject.pDesc = &localRootSigAssociation;
+  subobjects.push_back(localRootSigAssociationSubObject);
+
   // Shader Config
   D3D12_RAYTRACING_SHADER_CONFIG shaderConfigDesc = {};
   shaderConfigDesc.MaxPayloadSizeInBytes =
       48; // float4 + float3 + float3 + uint + bool
-  shaderConfigDesc.MaxAttributeSizeInBytes = 8; // float2 barycentrics
+  // float2 barycentrics, or SphereAttributes' float3 normal
+  shaderConfigDesc.MaxAttributeSizeInBytes = 12;
 
   D3D12_STATE_SUBOBJECT shaderConfigSubObject = {};
   shaderConfigSubObject.Type =
@@ -1020,213 +1644,178 @@ void D3DRenderer::CreateRayTracingPipeline() {
   globalRootSigSubObject.pDesc = &globalRootSigDesc;
   subobjects.push_back(globalRootSigSubObject);
 
+  // D3D12 has no blob to hand back for a state object, so the key only
+  // records whether this exact pipeline was built before; the driver's own
+  // shader cache is what makes the warm build fast.
+  uint64_t dxrKey =
+      PipelineKey()
+          .AddString("kind", "dxr")
+          .AddString("library", library->sha256)
+          .AddBytes("rootsig", signatureBlob->GetBufferPointer(),
+                    signatureBlob->GetBufferSize())
+          .AddBytes("hitgroup rootsig", hitGroupSigBlob->GetBufferPointer(),
+                    hitGroupSigBlob->GetBufferSize())
+          .AddU64("payload", shaderConfigDesc.MaxPayloadSizeInBytes)
+          .AddU64("attributes", shaderConfigDesc.MaxAttributeSizeInBytes)
+          .AddU64("recursion", pipelineConfigDesc.MaxTraceRecursionDepth)
+          .Value();
+  bool dxrWarm = m_pipelineCache->Contains(dxrKey);
+  m_imgui.GetState().dxrPipelineCache = dxrWarm ? "warm" : "cold";
+
   // Create
   D3D12_STATE_OBJECT_DESC stateObjectDesc = {};
   stateObjectDesc.Type = D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE;
   stateObjectDesc.NumSubobjects = static_cast<UINT>(subobjects.size());
   stateObjectDesc.pSubobjects = subobjects.data();
 
+  auto stateObjectStart = std::chrono::steady_clock::now();
   if (FAILED(m_dxrDevice->CreateStateObject(&stateObjectDesc,
                                             IID_PPV_ARGS(&m_dxrStateObject)))) {
     throw std::runtime_error("Failed to create DXR State Object");
   }
+  m_pipelineStartupMs +=
+      std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - stateObjectStart)
+          .count();
+  if (!dxrWarm) {
+    m_pipelineCache->Store(dxrKey, nullptr, 0);
+  }
 }
+void D3DRenderer::CreateMaterialBuffer() {
+  // Instance IDs run 0 (floor), 1 (mirror sphere), then the balls.
+  m_materials.Clear();
+  BuildSceneMaterials(2 + m_ballAnimator.Count(), m_materials,
+                      m_instanceMaterials);
+
+  // Written once and read in place, like the shader table.
+  m_materialBuffer = m_uploadHeaps->CreateResource(
+      BufferDesc(m_materials.SizeInBytes(), D3D12_RESOURCE_FLAG_NONE),
+      D3D12_RESOURCE_STATE_GENERIC_READ);
+  void *mapped = nullptr;
+  if (FAILED(m_materialBuffer->Map(0, nullptr, &mapped))) {
+    throw std::runtime_error("Failed to map the material buffer");
+  }
+  memcpy(mapped, m_materials.Materials().data(), m_materials.SizeInBytes());
+  m_materialBuffer->Unmap(0, nullptr);
+}
+
 void D3DRenderer::CreateShaderTables() {
   ComPtr<ID3D12StateObjectProperties> stateObjectProps;
   if (FAILED(m_dxrStateObject.As(&stateObjectProps))) {
     throw std::runtime_error("Failed to query ID3D12StateObjectProperties");
   }
 
-  void *rayGenID = stateObjectProps->GetShaderIdentifier(L"RayGen");
-  void *missID = stateObjectProps->GetShaderIdentifier(L"Miss");
-  void *hitGroupID = stateObjectProps->GetShaderIdentifier(L"HitGroup");
-
-  UINT shaderIdentifierSize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-  m_shaderTableEntrySize =
-      64; // Align to 64 bytes for simplicity and compatibility with
-          // StartAddress alignment requirements
-
-  // Buffer size: 3 records
-  UINT bufferSize = m_shaderTableEntrySize * 3;
-
-  D3D12_HEAP_PROPERTIES uploadHeapProps = {};
-  uploadHeapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
-  uploadHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-  uploadHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-  uploadHeapProps.CreationNodeMask = 1;
-  uploadHeapProps.VisibleNodeMask = 1;
-
-  D3D12_RESOURCE_DESC bufferDesc = {};
-  bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-  bufferDesc.Alignment = 0;
-  bufferDesc.Width = bufferSize;
-  bufferDesc.Height = 1;
-  bufferDesc.DepthOrArraySize = 1;
-  bufferDesc.MipLevels = 1;
-  bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
-  bufferDesc.SampleDesc.Count = 1;
-  bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-  bufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-
-  if (FAILED(m_device->CreateCommittedResource(
-          &uploadHeapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc,
-          D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-          IID_PPV_ARGS(&m_shaderTable)))) {
-    throw std::runtime_error("Failed to create shader table buffer");
+  static_assert(ShaderTableBuilder::kIdentifierSize ==
+                    D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES,
+                "ShaderTableBuilder must match D3D12's identifier size");
+  static_assert(ShaderTableBuilder::kRecordAlignment ==
+                        D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT &&
+                    ShaderTableBuilder::kTableAlignment ==
+                        D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT,
+                "ShaderTableBuilder must match D3D12's alignment rules");
+
+  // Which mesh each instance ID uses does not change with time.
+  std::vector<SceneInstance> instances;
+  BuildSceneInstances(0.0f, 0.0f, instances);
+  std::vector<HitGroupRecord> hitGroupRecords;
+  BuildSceneHitGroupRecords(instances, m_instanceMaterials, hitGroupRecords);
+  ShaderTableBuilder builder = BuildSceneShaderTable(
+      stateObjectProps->GetShaderIdentifier(L"RayGen"),
+      stateObjectProps->GetShaderIdentifier(L"Miss"),
+      stateObjectProps->GetShaderIdentifier(L"HitGroup"),
+      stateObjectProps->GetShaderIdentifier(
+          m_analyticSpheres ? L"SphereHitGroup" : L"HitGroup"),
+      hitGroupRecords);
+  m_shaderTableLayout = builder.ComputeLayout();
+  m_shaderTable = m_uploadHeaps->CreateResource(
+      BufferDesc(m_shaderTableLayout.TotalSize(), D3D12_RESOURCE_FLAG_NONE),
+      D3D12_RESOURCE_STATE_GENERIC_READ);
+
+  void *mapped = nullptr;
+  if (FAILED(m_shaderTable->Map(0, nullptr, &mapped))) {
+    throw std::runtime_error("Failed to map the shader table");
   }
-
-  uint8_t *pData;
-  m_shaderTable->Map(0, nullptr, reinterpret_cast<void **>(&pData));
-
-  // 1. RayGen
-  memcpy(pData, rayGenID, shaderIdentifierSize);
-
-  // 2. Miss
-  memcpy(pData + m_shaderTableEntrySize, missID, shaderIdentifierSize);
-
-  // 3. HitGroup
-  memcpy(pData + m_shaderTableEntrySize * 2, hitGroupID, shaderIdentifierSize);
-
+  builder.Write(mapped, m_shaderTableLayout);
   m_shaderTable->Unmap(0, nullptr);
 }
 
 void D3DRenderer::CreateSphere(std::vector<Vertex> &vertices,
                                std::vector<UINT> &indices, float radius,
                                int sliceCount, int stackCount) {
-  Vertex topVertex = {
-      {0.0f, radius, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f, 1.0f}};
-  Vertex bottomVertex = {
-      {0.0f, -radius, 0.0f}, {0.0f, -1.0f, 0.0f}, {1.0f, 1.0f, 1.0f}};
-
-  vertices.push_back(topVertex);
-
-  float phiStep = XM_PI / stackCount;
-  float thetaStep = 2.0f * XM_PI / sliceCount;
-
-  for (int i = 1; i <= stackCount - 1; ++i) {
-    float phi = i * phiStep;
-
-    for (int j = 0; j <= sliceCount; ++j) {
-      float theta = j * thetaStep;
-
-      Vertex v;
-      v.position.x = radius * sinf(phi) * cosf(theta);
-      v.position.y = radius * cosf(phi);
-      v.position.z = radius * sinf(phi) * sinf(theta);
-
-      XMVECTOR p = XMLoadFloat3(&v.position);
-      XMStoreFloat3(&v.normal, XMVector3Normalize(p));
-
-      v.color = {1.0f, 1.0f, 1.0f};
+  GenerateSphere(vertices, indices, radius, sliceCount, stackCount);
+}
 
-      vertices.push_back(v);
-    }
-  }
+void D3DRenderer::CreatePlane(std::vector<Vertex> &vertices,
+                              std::vector<UINT> &indices, float width,
+                              float depth) {
+  GeneratePlane(vertices, indices, width, depth);
+}
 
-  vertices.push_back(bottomVertex);
+void D3DRenderer::CreateUploadRing() {
+  m_uploadBuffer = m_uploadHeaps->CreateResource(
+      BufferDesc(UploadRingSize, D3D12_RESOURCE_FLAG_NONE),
+      D3D12_RESOURCE_STATE_GENERIC_READ);
 
-  for (int i = 1; i <= sliceCount; ++i) {
-    indices.push_back(0);
-    indices.push_back(i + 1);
-    indices.push_back(i);
+  // Mapped for the renderer's lifetime; the CPU never reads it back.
+  D3D12_RANGE readRange = {0, 0};
+  if (FAILED(m_uploadBuffer->Map(0, &readRange,
+                                 reinterpret_cast<void **>(&m_uploadMapped)))) {
+    throw std::runtime_error("Failed to map upload ring buffer");
   }
+  m_uploadRing.Reset(UploadRingSize);
+}
 
-  int baseIndex = 1;
-  int ringVertexCount = sliceCount + 1;
-  for (int i = 0; i < stackCount - 2; ++i) {
-    for (int j = 0; j < sliceCount; ++j) {
-      indices.push_back(baseIndex + i * ringVertexCount + j);
-      indices.push_back(baseIndex + i * ringVertexCount + j + 1);
-      indices.push_back(baseIndex + (i + 1) * ringVertexCount + j);
-
-      indices.push_back(baseIndex + (i + 1) * ringVertexCount + j);
-      indices.push_back(baseIndex + i * ringVertexCount + j + 1);
-      indices.push_back(baseIndex + (i + 1) * ringVertexCount + j + 1);
+D3DRenderer::UploadAllocation D3DRenderer::AllocateUpload(UINT64 size,
+                                                          UINT64 alignment) {
+  std::lock_guard<std::mutex> lock(m_uploadMutex);
+  uint64_t offset = m_uploadRing.Allocate(size, alignment);
+  while (offset == UploadRing::kInvalidOffset) {
+    if (!m_uploadRing.HasPendingFrames()) {
+      throw std::runtime_error("Upload ring is too small for this frame");
     }
+    m_queue->Wait(m_uploadRing.OldestPendingFence());
+    m_uploadRing.Retire(m_queue->CompletedValue());
+    offset = m_uploadRing.Allocate(size, alignment);
   }
-
-  int southPoleIndex = (int)vertices.size() - 1;
-  baseIndex = southPoleIndex - ringVertexCount;
-
-  for (int i = 0; i < sliceCount; ++i) {
-    indices.push_back(southPoleIndex);
-    indices.push_back(baseIndex + i);
-    indices.push_back(baseIndex + i + 1);
-  }
+  return {m_uploadMapped + offset,
+          m_uploadBuffer->GetGPUVirtualAddress() + offset, offset};
 }
 
-void D3DRenderer::CreatePlane(std::vector<Vertex> &vertices,
-                              std::vector<UINT> &indices, float width,
-                              float depth) {
-  float hw = width * 0.5f;
-  float hd = depth * 0.5f;
-
-  Vertex v[4];
-  v[0] = {{-hw, -0.5f, -hd}, {0.0f, 1.0f, 0.0f}, {0.5f, 0.5f, 0.5f}};
-  v[1] = {{-hw, -0.5f, hd}, {0.0f, 1.0f, 0.0f}, {0.5f, 0.5f, 0.5f}};
-  v[2] = {{hw, -0.5f, hd}, {0.0f, 1.0f, 0.0f}, {0.5f, 0.5f, 0.5f}};
-  v[3] = {{hw, -0.5f, -hd}, {0.0f, 1.0f, 0.0f}, {0.5f, 0.5f, 0.5f}};
-
-  int baseIndex = (int)vertices.size();
-  for (auto &vert : v)
-    vertices.push_back(vert);
-
-  indices.push_back(baseIndex + 0);
-  indices.push_back(baseIndex + 1);
-  indices.push_back(baseIndex + 2);
-  indices.push_back(baseIndex + 0);
-  indices.push_back(baseIndex + 2);
-  indices.push_back(baseIndex + 3);
-}
+PlacedResource
+D3DRenderer::CreateDefaultBuffer(const void *data, UINT64 size,
+                                 D3D12_RESOURCE_STATES finalState) {
+  PlacedResource buffer = m_bufferHeaps->CreateResource(
+      BufferDesc(size, D3D12_RESOURCE_FLAG_NONE),
+      D3D12_RESOURCE_STATE_COPY_DEST);
 
-void D3DRenderer::CreateConstantBuffer() {
-  UINT bufferSize = (sizeof(ShaderParams) + 255) & ~255;
-
-  D3D12_HEAP_PROPERTIES uploadHeapProps = {};
-  uploadHeapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
-  uploadHeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-  uploadHeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-  uploadHeapProps.CreationNodeMask = 1;
-  uploadHeapProps.VisibleNodeMask = 1;
-
-  D3D12_RESOURCE_DESC bufferDesc = {};
-  bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-  bufferDesc.Alignment = 0;
-  bufferDesc.Width = bufferSize;
-  bufferDesc.Height = 1;
-  bufferDesc.DepthOrArraySize = 1;
-  bufferDesc.MipLevels = 1;
-  bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
-  bufferDesc.SampleDesc.Count = 1;
-  bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-  bufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-
-  if (FAILED(m_device->CreateCommittedResource(
-          &uploadHeapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc,
-          D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-          IID_PPV_ARGS(&m_cameraBuffer)))) {
-    throw std::runtime_error("Failed to create camera constant buffer");
-  }
-
-  if (FAILED(m_cameraBuffer->Map(0, nullptr, &m_cameraMappedData))) {
-    throw std::runtime_error("Failed to map camera constant buffer");
-  }
+  UploadAllocation staging = AllocateUpload(size, 16);
+  memcpy(staging.cpu, data, size);
+  m_commandList->CopyBufferRegion(buffer.Get(), 0, m_uploadBuffer.Get(),
+                                  staging.offset, size);
+
+  D3D12_RESOURCE_BARRIER barrier = {};
+  barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+  barrier.Transition.pResource = buffer.Get();
+  barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+  barrier.Transition.StateAfter = finalState;
+  barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+  m_commandList->ResourceBarrier(1, &barrier);
+  return buffer;
 }
 
 void D3DRenderer::UpdateCamera() {
-  float speed = 0.1f;
+  CPU_PROFILE_SCOPE("UpdateCamera");
+  CameraInput input;
   if (GetAsyncKeyState(VK_SHIFT))
-    speed *= 3.0f;
+    input.speed *= 3.0f;
 
   // Rotation (Right Click)
   if (GetAsyncKeyState(VK_RBUTTON) & 0x8000) {
     POINT curPos;
     GetCursorPos(&curPos);
     if (m_lastMousePos.x != 0 || m_lastMousePos.y != 0) {
-      float dx = (float)(curPos.x - m_lastMousePos.x);
-      float dy = (float)(curPos.y - m_lastMousePos.y);
-      m_cameraYaw += dx * 0.005f;
-      m_cameraPitch += dy * 0.005f;
+      input.yawDelta = (float)(curPos.x - m_lastMousePos.x) * 0.005f;
+      input.pitchDelta = (float)(curPos.y - m_lastMousePos.y) * 0.005f;
     }
     m_lastMousePos = curPos;
   } else {
@@ -1234,47 +1823,67 @@ void D3DRenderer::UpdateCamera() {
   }
 
   // Move
-  XMMATRIX rotation =
-      XMMatrixRotationRollPitchYaw(m_cameraPitch, m_cameraYaw, 0);
-  XMVECTOR forward = XMVector3TransformCoord(XMVectorSet(0, 0, 1, 0), rotation);
-  XMVECTOR right = XMVector3TransformCoord(XMVectorSet(1, 0, 0, 0), rotation);
-  XMVECTOR pos = XMLoadFloat3(&m_cameraPos);
-
-  if (GetAsyncKeyState('W') & 0x8000)
-    pos += forward * speed;
-  if (GetAsyncKeyState('S') & 0x8000)
-    pos -= forward * speed;
-  if (GetAsyncKeyState('D') & 0x8000)
-    pos += right * speed;
-  if (GetAsyncKeyState('A') & 0x8000)
-    pos -= right * speed;
-  if (GetAsyncKeyState('E') & 0x8000)
-    pos += XMVectorSet(0, 1, 0, 0) * speed;
-  if (GetAsyncKeyState('Q') & 0x8000)
-    pos -= XMVectorSet(0, 1, 0, 0) * speed;
-
-  XMStoreFloat3(&m_cameraPos, pos);
+  auto axis = [](int positive, int negative) {
+    return ((GetAsyncKeyState(positive) & 0x8000) ? 1.0f : 0.0f) -
+           ((GetAsyncKeyState(negative) & 0x8000) ? 1.0f : 0.0f);
+  };
+  input.forward = axis('W', 'S');
+  input.right = axis('D', 'A');
+  input.up = axis('E', 'Q');
+  ApplyCameraInput(input, m_camera);
 
   // Update Buffer
-  XMVECTOR focus = pos + forward;
-  XMVECTOR up = XMVectorSet(0, 1, 0, 0);
-  XMMATRIX view = XMMatrixLookAtLH(pos, focus, up);
-  XMMATRIX proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, (float)m_width / m_height,
-                                           0.1f, 1000.0f);
-
-  ShaderParams cb;
-  cb.viewInverse = XMMatrixInverse(nullptr, view);
-  cb.projInverse = XMMatrixInverse(nullptr, proj);
-  cb.cameraPos = {m_cameraPos.x, m_cameraPos.y, m_cameraPos.z, 1.0f};
-
-  // UI state
   auto &ui = m_imgui.GetState();
-  cb.lightPos = {ui.lightPos[0], ui.lightPos[1], ui.lightPos[2], 1.0f};
-  cb.maxBounces = ui.bounceCount;
-  cb.emissiveIntensity = ui.emissiveIntensity;
-  cb.animationTime = m_animationTime;
+  FrameShading shading;
+  shading.lightPos = {ui.lightPos[0], ui.lightPos[1], ui.lightPos[2]};
+  shading.maxBounces = ui.bounceCount;
+  shading.emissiveIntensity = ui.emissiveIntensity;
+  shading.animationTime = m_animationTime;
+  shading.checkerboard = ui.checkerboard;
+  shading.checkerboardParity = m_checkerboardParity;
+  shading.renderWidth = m_renderSize.width;
+  shading.renderHeight = m_renderSize.height;
+  ShaderParams cb =
+      BuildShaderParams(m_camera, (float)m_width / m_height, shading);
+
+  UploadAllocation constants = AllocateUpload(
+      sizeof(ShaderParams), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+  memcpy(constants.cpu, &cb, sizeof(ShaderParams));
+  m_cameraConstants = constants.gpu;
+}
+
+// Left click selects the instance under the cursor using the CPU instance
+// BVH, so the result is available this frame without a GPU readback.
+void D3DRenderer::PickInstance() {
+  CPU_PROFILE_SCOPE("PickInstance");
+  bool down = (GetAsyncKeyState(VK_LBUTTON) & 0x8000) != 0;
+  bool clicked = down && !m_pickButtonDown;
+  m_pickButtonDown = down;
+  if (!clicked || m_imgui.WantsMouse()) {
+    return;
+  }
 
-  if (m_cameraMappedData) {
-    memcpy(m_cameraMappedData, &cb, sizeof(ShaderParams));
+  POINT cursor;
+  if (!GetCursorPos(&cursor) || !ScreenToClient(m_hwnd, &cursor) ||
+      cursor.x < 0 || cursor.y < 0 || cursor.x >= (LONG)m_width ||
+      cursor.y >= (LONG)m_height) {
+    return;
   }
+
+  auto start = std::chrono::steady_clock::now();
+  CpuCamera camera = CpuCamera::FromYawPitch(
+      m_camera.position, m_camera.yaw, m_camera.pitch,
+      (float)m_width / m_height);
+  Ray ray = camera.PixelRay((float)cursor.x, (float)cursor.y, m_width,
+                            m_height);
+  InstanceHit hit;
+  bool found = m_instanceBvh.Intersect(ray, hit);
+  auto end = std::chrono::steady_clock::now();
+
+  auto &ui = m_imgui.GetState();
+  ui.pickedInstanceID =
+      found ? (int)m_sceneInstances[hit.instance].instanceID : -1;
+  ui.pickedDistance = found ? hit.t : 0.0f;
+  ui.pickQueryUs =
+      (float)std::chrono::duration<double, std::micro>(end - start).count();
 }
@@ -0,0 +1,87 @@
+#include "../include/DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+uint32_t ScaleDimension(uint32_t size, float scale, uint32_t granularity) {
+  uint32_t scaled = (uint32_t)std::lround(size * (double)scale / granularity) *
+                    granularity;
+  return std::clamp(scaled, std::min(granularity, size), size);
+}
+
+} // namespace
+
+DynamicResolutionController::DynamicResolutionController(
+    const DynamicResolutionSettings &settings)
+    : m_settings(settings) {
+  Reset(settings.maxScale);
+}
+
+void DynamicResolutionController::SetSettings(
+    const DynamicResolutionSettings &settings) {
+  m_settings = settings;
+  Reset(m_scale);
+}
+
+void DynamicResolutionController::Reset(float scale) {
+  m_scale = std::clamp(scale, m_settings.minScale, m_settings.maxScale);
+  m_integral = 2.0 * std::log((double)m_scale);
+  m_recentNext = m_recentCount = 0;
+}
+
+float DynamicResolutionController::Update(double frameMs) {
+  if (!(frameMs > 0.0) || !std::isfinite(frameMs)) {
+    return m_scale;
+  }
+  const DynamicResolutionSettings &s = m_settings;
+  m_recentMs[m_recentNext] = frameMs;
+  m_recentNext = (m_recentNext + 1) % 3;
+  m_recentCount = std::min(m_recentCount + 1, 3u);
+  double median = frameMs;
+  if (m_recentCount >= 3) {
+    double a = m_recentMs[0], b = m_recentMs[1], c = m_recentMs[2];
+    median = std::max(std::min(a, b), std::min(std::max(a, b), c));
+  }
+  m_smoothedMs = m_recentCount > 1 ? m_smoothedMs + (median - m_smoothedMs) *
+                                                        (double)s.smoothing
+                                   : median;
+
+  // Positive when there is headroom. The bands are cut out of the error
+  // rather than just gating it, so the response is continuous at their
+  // edges.
+  double error = std::log(s.targetMs / m_smoothedMs);
+  double up = std::log(1.0 + (double)s.upBand);
+  double down = std::log(1.0 + (double)s.downBand);
+  if (error > up) {
+    error -= up;
+  } else if (error < -down) {
+    error += down;
+  } else {
+    error = 0.0;
+  }
+
+  m_integral += s.ki * error;
+  double logArea = m_integral + s.kp * error;
+  float scale = (float)std::exp(0.5 * logArea);
+  scale = std::clamp(scale, m_scale - s.maxStepDown, m_scale + s.maxStepUp);
+  scale = std::clamp(scale, s.minScale, s.maxScale);
+
+  // Back-calculate the integral from the scale actually applied, so time
+  // spent against a clamp or a step limit does not wind it up.
+  m_integral = 2.0 * std::log((double)scale) - s.kp * error;
+  m_scale = scale;
+  return m_scale;
+}
+
+DynamicResolutionSize
+DynamicResolutionController::RenderSize(uint32_t maxWidth, uint32_t maxHeight,
+                                        uint32_t granularity) const {
+  if (m_scale >= 1.0f) {
+    return {maxWidth, maxHeight};
+  }
+  granularity = std::max(granularity, 1u);
+  return {ScaleDimension(maxWidth, m_scale, granularity),
+          ScaleDimension(maxHeight, m_scale, granularity)};
+}
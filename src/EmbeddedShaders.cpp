@@ -0,0 +1,16 @@
+#include "../include/EmbeddedShaders.h"
+
+#include "EmbeddedShaderData.h"
+
+std::span<const EmbeddedShader> EmbeddedShaders() {
+  return embedded_shaders::kEmbeddedShaders;
+}
+
+const EmbeddedShader *FindEmbeddedShader(std::string_view name) {
+  for (const EmbeddedShader &shader : embedded_shaders::kEmbeddedShaders) {
+    if (name == shader.name) {
+      return &shader;
+    }
+  }
+  return nullptr;
+}
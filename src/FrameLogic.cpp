@@ -0,0 +1,245 @@
+#include "../include/FrameLogic.h"
+#include "../include/CpuPathTracer.h"
+#include "../include/JobSystem.h"
+#include "../include/ShaderContainer.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+constexpr uint32_t kInstanceMask = 0xFFu << 24;
+
+// Appends a transition of resource to state unless it is already there.
+void Require(FrameResource resource, FrameResourceState state,
+             FrameResourceState *states, std::vector<FrameBarrier> &barriers) {
+  FrameResourceState &current = states[(uint32_t)resource];
+  if (current != state) {
+    barriers.push_back({resource, current, state});
+    current = state;
+  }
+}
+
+} // namespace
+
+void ApplyCameraInput(const CameraInput &input, CameraState &camera) {
+  camera.yaw += input.yawDelta;
+  camera.pitch += input.pitchDelta;
+
+  // Rows of XMMatrixRotationRollPitchYaw(pitch, yaw, 0) applied to +Z and
+  // +X.
+  Float3 forward = CameraForward(camera.yaw, camera.pitch);
+  Float3 right = {std::cos(camera.yaw), 0.0f, -std::sin(camera.yaw)};
+  Float3 up = {0.0f, 1.0f, 0.0f};
+  camera.position += forward * (input.forward * input.speed);
+  camera.position += right * (input.right * input.speed);
+  camera.position += up * (input.up * input.speed);
+}
+
+ShaderParams BuildShaderParams(const CameraState &camera, float aspect,
+                               const FrameShading &shading) {
+  CpuCamera matrices =
+      CpuCamera::FromYawPitch(camera.position, camera.yaw, camera.pitch,
+                              aspect);
+  static_assert(sizeof(ShaderParams::viewInverse) == sizeof(Float4x4),
+                "ShaderParams matrices must be 4x4 floats");
+
+  ShaderParams cb = {};
+  std::memcpy(&cb.viewInverse, &matrices.viewInverse, sizeof(Float4x4));
+  std::memcpy(&cb.projInverse, &matrices.projInverse, sizeof(Float4x4));
+  cb.cameraPos = {camera.position.x, camera.position.y, camera.position.z,
+                  1.0f};
+  cb.lightPos = {shading.lightPos.x, shading.lightPos.y, shading.lightPos.z,
+                 1.0f};
+  cb.maxBounces = shading.maxBounces;
+  cb.emissiveIntensity = shading.emissiveIntensity;
+  cb.animationTime = shading.animationTime;
+  cb.checkerboard = shading.checkerboard ? 1 : 0;
+  cb.checkerboardParity = shading.checkerboardParity;
+  cb.renderWidth = shading.renderWidth;
+  cb.renderHeight = shading.renderHeight;
+  return cb;
+}
+
+GpuInstanceDesc MakeInstanceDesc(const SceneInstance &instance,
+                                 uint64_t blasAddress) {
+  GpuInstanceDesc desc = {};
+  std::memcpy(desc.transform, instance.transform.m, sizeof(desc.transform));
+  desc.instanceIdAndMask = instance.instanceID | kInstanceMask;
+  desc.hitGroupAndFlags = instance.instanceID; // no instance flags
+  desc.accelerationStructure = blasAddress;
+  return desc;
+}
+
+void UpdateStaticInstanceDescs(const std::vector<SceneInstance> &instances,
+                               const std::vector<uint32_t> &dirty,
+                               uint32_t staticCount,
+                               const SceneBlasAddresses &blas,
+                               std::vector<GpuInstanceDesc> &descs) {
+  descs.resize(staticCount);
+  for (uint32_t i : dirty) {
+    if (i < staticCount) {
+      const SceneInstance &instance = instances[i];
+      descs[i] = MakeInstanceDesc(instance, blas[instance.mesh]);
+    }
+  }
+}
+
+void WriteSceneInstanceDescs(const std::vector<GpuInstanceDesc> &staticDescs,
+                             const InstanceAnimator &balls,
+                             float animationTime, float animationSpeed,
+                             const uint64_t *sphereBlasByLevel,
+                             const uint8_t *ballLevels, GpuInstanceDesc *dst,
+                             JobSystem &jobs) {
+  std::memcpy(dst, staticDescs.data(),
+              staticDescs.size() * sizeof(GpuInstanceDesc));
+  balls.WriteInstanceDescs(animationTime, animationSpeed, sphereBlasByLevel,
+                           ballLevels, dst + staticDescs.size(), jobs);
+}
+
+void RequireRayTracingLibrary(const ShaderContainer &library) {
+  std::string problems;
+  try {
+    library.RequireExports({{"RayGen", DxilShaderKind::RayGeneration},
+                            {"Miss", DxilShaderKind::Miss},
+                            {"ClosestHit", DxilShaderKind::ClosestHit},
+                            {"SphereIntersection",
+                             DxilShaderKind::Intersection},
+                            {"SphereClosestHit", DxilShaderKind::ClosestHit}});
+  } catch (const std::runtime_error &e) {
+    problems += e.what();
+  }
+  try {
+    library.RequireResources(
+        {{"Scene", DxilResourceClass::SRV, 0, 0},
+         {"RenderTarget", DxilResourceClass::UAV, 0, 0},
+         {"CameraParams", DxilResourceClass::CBuffer, 0, 0},
+         {"Materials", DxilResourceClass::SRV, 1, 0},
+         {"HitGroupConstants", DxilResourceClass::CBuffer, 0, 1}});
+  } catch (const std::runtime_error &e) {
+    problems += (problems.empty() ? "" : "\n") + std::string(e.what());
+  }
+  if (!problems.empty()) {
+    throw std::runtime_error(
+        "RayTracing.dxil does not match RayTracing.hlsl; rebuild it with "
+        "dxc:\n" +
+        problems);
+  }
+}
+
+ShaderTableBuilder BuildSceneShaderTable(
+    const void *rayGen, const void *miss, const void *hitGroup,
+    const void *sphereHitGroup,
+    const std::vector<HitGroupRecord> &hitGroupRecords) {
+  static_assert(sizeof(HitGroupRecord) == 5 * sizeof(uint32_t),
+                "HitGroupRecord is five root constants");
+  // One ray type: TraceRay uses RayContributionToHitGroupIndex 0 and a
+  // geometry multiplier of 1, so instance N's record is simply record N.
+  ShaderTableBuilder builder(1);
+  uint32_t rayGenId = builder.AddIdentifier(rayGen);
+  uint32_t missId = builder.AddIdentifier(miss);
+  uint32_t hitGroupId = builder.AddIdentifier(hitGroup);
+  uint32_t sphereHitGroupId = builder.AddIdentifier(sphereHitGroup);
+  builder.AddRecord(ShaderTableKind::RayGen, rayGenId);
+  builder.AddRecord(ShaderTableKind::Miss, missId);
+
+  // Record N belongs to instance ID N and carries its geometry and
+  // material.
+  for (const HitGroupRecord &record : hitGroupRecords) {
+    builder.AddInstance(record.geometry == GEOMETRY_SPHERE ? &sphereHitGroupId
+                                                           : &hitGroupId,
+                        &record, sizeof(record));
+  }
+  return builder;
+}
+
+FrameResourceState FrameResourceRestState(FrameResource resource) {
+  return resource == FrameResource::BackBuffer ? FrameResourceState::Present
+                                               : FrameResourceState::CopySource;
+}
+
+const char *FramePassName(FramePass pass) {
+  switch (pass) {
+  case FramePass::DispatchRays:
+    return "DispatchRays";
+  case FramePass::CheckerboardResolve:
+    return "Checkerboard resolve";
+  case FramePass::Upscale:
+    return "Upscale";
+  case FramePass::CopyToBackBuffer:
+    return "Copy to back buffer";
+  case FramePass::ImGui:
+    return "ImGui";
+  }
+  return "?";
+}
+
+void BuildFramePlan(const FramePlanInputs &inputs, FramePlan &plan) {
+  plan.barriers.clear();
+  plan.steps.clear();
+
+  FrameResourceState states[kFrameResourceCount];
+  for (uint32_t r = 0; r < kFrameResourceCount; ++r) {
+    states[r] = FrameResourceRestState((FrameResource)r);
+  }
+  auto step = [&](FramePass pass, uint32_t first) {
+    plan.steps.push_back(
+        {pass, first, (uint32_t)plan.barriers.size() - first});
+  };
+  using State = FrameResourceState;
+
+  uint32_t first = (uint32_t)plan.barriers.size();
+  Require(FrameResource::Output, State::UnorderedAccess, states,
+          plan.barriers);
+  step(FramePass::DispatchRays, first);
+  FrameResource presented = FrameResource::Output;
+
+  if (inputs.checkerboard) {
+    // Reads the traced half and the previous resolve, writes the other.
+    FrameResource target = inputs.resolvedIndex == 0
+                               ? FrameResource::Resolved0
+                               : FrameResource::Resolved1;
+    FrameResource history = inputs.resolvedIndex == 0
+                                ? FrameResource::Resolved1
+                                : FrameResource::Resolved0;
+    first = (uint32_t)plan.barriers.size();
+    Require(FrameResource::Output, State::ShaderRead, states, plan.barriers);
+    Require(history, State::ShaderRead, states, plan.barriers);
+    Require(target, State::UnorderedAccess, states, plan.barriers);
+    step(FramePass::CheckerboardResolve, first);
+    plan.resolveTarget = target;
+    presented = target;
+  }
+
+  if (inputs.upscale) {
+    first = (uint32_t)plan.barriers.size();
+    Require(presented, State::ShaderRead, states, plan.barriers);
+    Require(FrameResource::Upscaled, State::UnorderedAccess, states,
+            plan.barriers);
+    step(FramePass::Upscale, first);
+    plan.upscaleSource = presented;
+    presented = FrameResource::Upscaled;
+  }
+
+  first = (uint32_t)plan.barriers.size();
+  Require(presented, State::CopySource, states, plan.barriers);
+  Require(FrameResource::BackBuffer, State::CopyDest, states, plan.barriers);
+  step(FramePass::CopyToBackBuffer, first);
+  plan.copySource = presented;
+
+  first = (uint32_t)plan.barriers.size();
+  Require(FrameResource::BackBuffer, State::RenderTarget, states,
+          plan.barriers);
+  step(FramePass::ImGui, first);
+
+  // Back buffer first: Present() follows right behind this batch.
+  plan.firstFinalBarrier = (uint32_t)plan.barriers.size();
+  Require(FrameResource::BackBuffer, State::Present, states, plan.barriers);
+  for (uint32_t r = 0; r < kFrameResourceCount; ++r) {
+    Require((FrameResource)r, FrameResourceRestState((FrameResource)r),
+            states, plan.barriers);
+  }
+  plan.finalBarrierCount =
+      (uint32_t)plan.barriers.size() - plan.firstFinalBarrier;
+}
@@ -0,0 +1,53 @@
+#include "../include/FramePacer.h"
+
+#include <stdexcept>
+
+FramePacer::FramePacer(GpuQueue &queue, uint32_t framesInFlight)
+    : m_queue(queue) {
+  if (framesInFlight == 0 || framesInFlight > kMaxFramesInFlight) {
+    throw std::runtime_error("FramePacer: frames in flight must be between "
+                             "1 and 3");
+  }
+  m_slotFences.assign(framesInFlight, 0);
+}
+
+uint32_t FramePacer::BeginFrame() {
+  if (m_inFrame) {
+    throw std::runtime_error("FramePacer: BeginFrame called twice");
+  }
+  m_inFrame = true;
+  m_slot = (uint32_t)(m_frameNumber % m_slotFences.size());
+  uint64_t fence = m_slotFences[m_slot];
+  if (fence != 0 && !m_queue.IsComplete(fence)) {
+    ++m_stats.stalls;
+    m_stats.stallMs += m_queue.Wait(fence);
+  }
+  return m_slot;
+}
+
+void FramePacer::EndFrame() {
+  if (!m_inFrame) {
+    throw std::runtime_error("FramePacer: EndFrame without BeginFrame");
+  }
+  m_inFrame = false;
+  m_slotFences[m_slot] = m_queue.Signal();
+  ++m_frameNumber;
+  ++m_stats.frames;
+
+  uint64_t completed = m_queue.CompletedValue();
+  uint32_t inFlight = 0;
+  for (uint64_t fence : m_slotFences) {
+    inFlight += fence > completed;
+  }
+  if (inFlight > m_stats.maxInFlight) {
+    m_stats.maxInFlight = inFlight;
+  }
+}
+
+void FramePacer::WaitIdle() {
+  for (uint64_t fence : m_slotFences) {
+    if (fence != 0) {
+      m_queue.Wait(fence);
+    }
+  }
+}
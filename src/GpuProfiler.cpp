@@ -0,0 +1,136 @@
+#include "../include/GpuProfiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+GpuProfiler::GpuProfiler(uint32_t framesInFlight, uint32_t maxScopes,
+                         uint32_t averageFrames)
+    : m_slotCount(framesInFlight), m_maxScopes(maxScopes),
+      m_averageFrames(std::max(averageFrames, 1u)), m_slots(framesInFlight) {
+  if (framesInFlight == 0 || maxScopes == 0) {
+    throw std::runtime_error("GpuProfiler needs a frame slot and a scope");
+  }
+  m_frame.name = "Frame";
+}
+
+void GpuProfiler::BeginFrame(uint32_t slot) {
+  if (slot >= m_slotCount) {
+    throw std::runtime_error("GpuProfiler frame slot out of range");
+  }
+  // Results the caller never read are lost once the queries are reused.
+  m_slot = slot;
+  m_slots[slot].scopeStats.clear();
+  m_slots[slot].pending = false;
+  m_slots[slot].frame = ++m_frameNumber;
+  m_inFrame = true;
+}
+
+GpuProfilerScope GpuProfiler::AddScope(const char *name, uint32_t depth) {
+  SlotFrame &frame = m_slots[m_slot];
+  uint32_t base = m_slot * SlotQueries();
+  if (!m_inFrame || frame.scopeStats.size() >= m_maxScopes) {
+    uint32_t spare = base + m_maxScopes * 2;
+    return {spare, spare + 1};
+  }
+
+  uint32_t stats = 0;
+  while (stats < m_stats.size() && m_stats[stats].name != name) {
+    ++stats;
+  }
+  if (stats == m_stats.size()) {
+    m_stats.emplace_back();
+    m_stats.back().name = name;
+  }
+  m_stats[stats].depth = depth;
+
+  uint32_t index = (uint32_t)frame.scopeStats.size();
+  frame.scopeStats.push_back(stats);
+  return {base + index * 2, base + index * 2 + 1};
+}
+
+GpuQueryRange GpuProfiler::EndFrame() {
+  if (!m_inFrame) {
+    return {m_slot * SlotQueries(), 0};
+  }
+  m_inFrame = false;
+  SlotFrame &frame = m_slots[m_slot];
+  frame.pending = !frame.scopeStats.empty();
+  return PendingRange(m_slot);
+}
+
+bool GpuProfiler::Pending(uint32_t slot) const {
+  return slot < m_slotCount && m_slots[slot].pending;
+}
+
+GpuQueryRange GpuProfiler::PendingRange(uint32_t slot) const {
+  return {slot * SlotQueries(),
+          (uint32_t)m_slots[slot].scopeStats.size() * 2};
+}
+
+void GpuProfiler::Resolve(uint32_t slot, const uint64_t *ticks,
+                          uint64_t frequency) {
+  if (!Pending(slot)) {
+    return;
+  }
+  SlotFrame &frame = m_slots[slot];
+  frame.pending = false;
+  if (frequency == 0) {
+    return;
+  }
+
+  uint64_t first = UINT64_MAX, last = 0;
+  for (size_t i = 0; i < frame.scopeStats.size(); ++i) {
+    uint64_t begin = ticks[i * 2], end = ticks[i * 2 + 1];
+    if (end < begin) {
+      continue;
+    }
+    GpuScopeStats &stats = m_stats[frame.scopeStats[i]];
+    AddSample(stats, TicksToMs(begin, end, frequency));
+    stats.lastFrame = frame.frame;
+    first = std::min(first, begin);
+    last = std::max(last, end);
+  }
+  if (first <= last) {
+    AddSample(m_frame, TicksToMs(first, last, frequency));
+    m_frame.lastFrame = frame.frame;
+  }
+  m_resolvedFrame = std::max(m_resolvedFrame, frame.frame);
+}
+
+void GpuProfiler::Discard(uint32_t slot) {
+  if (slot < m_slotCount) {
+    m_slots[slot].pending = false;
+  }
+}
+
+double GpuProfiler::TicksToMs(uint64_t begin, uint64_t end,
+                              uint64_t frequency) {
+  if (frequency == 0 || end < begin) {
+    return 0.0;
+  }
+  // Whole seconds and the remainder separately, so neither the tick count
+  // nor its product with 1000 has to fit in a double's mantissa.
+  uint64_t ticks = end - begin;
+  return (double)(ticks / frequency) * 1000.0 +
+         (double)(ticks % frequency) * 1000.0 / (double)frequency;
+}
+
+void GpuProfiler::AddSample(GpuScopeStats &stats, double ms) const {
+  if (stats.samples.size() != m_averageFrames) {
+    stats.samples.assign(m_averageFrames, 0.0);
+    stats.sampleCount = stats.nextSample = 0;
+  }
+  stats.samples[stats.nextSample] = ms;
+  stats.nextSample = (stats.nextSample + 1) % m_averageFrames;
+  stats.sampleCount = std::min(stats.sampleCount + 1, m_averageFrames);
+
+  // Summed afresh rather than kept as a running total, which would drift.
+  double sum = 0.0, peak = 0.0;
+  for (uint32_t i = 0; i < stats.sampleCount; ++i) {
+    sum += stats.samples[i];
+    peak = std::max(peak, stats.samples[i]);
+  }
+  stats.lastMs = ms;
+  stats.averageMs = sum / stats.sampleCount;
+  stats.maxMs = peak;
+}
@@ -0,0 +1,39 @@
+#include "../include/GpuQueue.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void SimulatedGpuQueue::Submit(double gpuMs) {
+  double start = std::max(m_cpuTime, m_gpuFreeAt);
+  m_gpuFreeAt = start + gpuMs;
+  m_gpuBusy += gpuMs;
+}
+
+uint64_t SimulatedGpuQueue::Signal() {
+  // A signal with nothing queued in front of it completes on submission.
+  m_pending.push_back(std::max(m_cpuTime, m_gpuFreeAt));
+  return ++m_lastSignaled;
+}
+
+uint64_t SimulatedGpuQueue::CompletedValue() {
+  while (!m_pending.empty() && m_pending.front() <= m_cpuTime) {
+    m_pending.pop_front();
+    ++m_completed;
+  }
+  return m_completed;
+}
+
+double SimulatedGpuQueue::Wait(uint64_t value) {
+  if (value > m_lastSignaled) {
+    throw std::runtime_error("SimulatedGpuQueue: waiting on a fence value "
+                             "that was never signalled");
+  }
+  if (CompletedValue() >= value) {
+    return 0.0;
+  }
+  double reached = m_pending[value - m_completed - 1];
+  double waited = reached - m_cpuTime;
+  m_cpuTime = reached;
+  CompletedValue();
+  return waited;
+}
@@ -99,6 +99,23 @@ void ImGuiManager::BeginFrame() {
     ImGui::SliderFloat("Light Y", &m_state.lightPos[1], 1.0f, 30.0f);
     ImGui::SliderFloat("Light Z", &m_state.lightPos[2], -20.0f, 20.0f);
 
+    ImGui::Checkbox("Checkerboard Rendering", &m_state.checkerboard);
+    ImGui::SetItemTooltip("Trace half the pixels each frame, alternating, "
+                          "and fill in the rest from neighbours and the "
+                          "previous frame");
+    ImGui::Checkbox("Dynamic Resolution", &m_state.dynamicResolution);
+    if (m_state.dynamicResolution) {
+      ImGui::SliderFloat("Frame Budget (ms)", &m_state.targetFrameMs, 4.0f,
+                         50.0f);
+    }
+    ImGui::Checkbox("Analytic Spheres", &m_state.analyticSpheres);
+    ImGui::SetItemTooltip("Intersect the spheres exactly in an intersection "
+                          "shader instead of tracing their triangles");
+    ImGui::Checkbox("Sphere LOD", &m_state.sphereLod);
+    ImGui::SetItemTooltip("Trace distant balls against coarser sphere "
+                          "meshes, keeping the silhouette within half a "
+                          "pixel");
+
     ImGui::Separator();
 
     // Emissive
@@ -120,11 +137,67 @@ void ImGuiManager::BeginFrame() {
     ImGui::Text("Performance");
     ImGui::Text("FPS: %.1f (%.2f ms)", ImGui::GetIO().Framerate,
                 1000.0f / ImGui::GetIO().Framerate);
+    ImGui::Text("Render size: %dx%d (smoothed frame %.2f ms)",
+                m_state.renderWidth, m_state.renderHeight,
+                m_state.smoothedFrameMs);
+    ImGui::Text("Frames in flight: %d (GPU waits: %llu)",
+                m_state.framesInFlight, m_state.gpuWaits);
+    ImGui::Text("Heaps: %d, %.1f / %.1f MB used (%.0f%% fragmented)",
+                m_state.heapCount, m_state.heapUsedMB, m_state.heapReservedMB,
+                m_state.heapFragmentation * 100.0f);
+    ImGui::Text("TLAS: %s, %d dirty (rebuilds: %llu, refits: %llu)",
+                m_state.tlasAction, m_state.tlasDirty, m_state.tlasRebuilds,
+                m_state.tlasRefits);
+    ImGui::Text("Sphere LOD balls: %d / %d / %d / %d",
+                m_state.sphereLodBalls[0], m_state.sphereLodBalls[1],
+                m_state.sphereLodBalls[2], m_state.sphereLodBalls[3]);
+    ImGui::Text("Pipelines: %.1f ms at startup, DXR %s (cache: %llu hits, "
+                "%llu misses)",
+                m_state.pipelineStartupMs, m_state.dxrPipelineCache,
+                m_state.pipelineCacheHits, m_state.pipelineCacheMisses);
+    ImGui::Text("Materials: %d for %d instances", m_state.materialCount,
+                m_state.materialInstances);
+
+    ImGui::Separator();
+
+    ImGui::Text("GPU timings (avg / last), %.2f ms per frame",
+                m_state.gpuFrameMs);
+    for (int i = 0; i < m_state.gpuTimingCount; ++i) {
+      const GpuTiming &timing = m_state.gpuTimings[i];
+      ImGui::Text("  %-20s %6.3f / %6.3f ms", timing.name, timing.averageMs,
+                  timing.lastMs);
+    }
+
+    ImGui::Checkbox("CPU Profiling", &m_state.cpuProfiling);
+    ImGui::SameLine();
+    if (ImGui::Button("Save CPU Trace")) {
+      m_state.saveCpuTrace = true;
+    }
+    ImGui::SetItemTooltip("Chrome trace JSON of the last frames, for "
+                          "chrome://tracing or ui.perfetto.dev");
+    if (*m_state.cpuTraceStatus) {
+      ImGui::Text("Trace %s", m_state.cpuTraceStatus);
+    }
+
+    ImGui::Separator();
+
+    ImGui::Text("Picking (left click)");
+    if (m_state.pickedInstanceID >= 0) {
+      ImGui::Text("Instance %d at %.2f", m_state.pickedInstanceID,
+                  m_state.pickedDistance);
+    } else {
+      ImGui::Text("Nothing selected");
+    }
+    ImGui::Text("Query: %.1f us", m_state.pickQueryUs);
 
     ImGui::End();
   }
 }
 
+bool ImGuiManager::WantsMouse() const {
+  return m_initialized && ImGui::GetIO().WantCaptureMouse;
+}
+
 void ImGuiManager::EndFrame(ID3D12GraphicsCommandList *commandList) {
   ImGui::Render();
 
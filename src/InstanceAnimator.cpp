@@ -0,0 +1,402 @@
+#include "../include/InstanceAnimator.h"
+#include "../include/JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) ||              \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INSTANCE_ANIMATOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Animation constants, unchanged from the original per-ball loop.
+constexpr float kOrbitSpeed = 0.5f;
+constexpr float kBounceSpeed = 2.0f;
+constexpr float kBounceHeight = 2.0f;
+constexpr double kTwoPi = 6.283185307179586;
+
+// Cephes sinf/cosf: reduce by pi/4 in three parts, then a degree 7 (sin) or
+// 8 (cos) polynomial on [-pi/4, pi/4]. About 1 ulp for |x| < 8192; the
+// phases are pre-reduced so only the time offset grows.
+constexpr float kFourOverPi = 1.27323954473516f;
+constexpr float kDP1 = 0.78515625f;
+constexpr float kDP2 = 2.4187564849853515625e-4f;
+constexpr float kDP3 = 3.77489497744594108e-8f;
+constexpr float kSin0 = -1.9515295891e-4f;
+constexpr float kSin1 = 8.3321608736e-3f;
+constexpr float kSin2 = -1.6666654611e-1f;
+constexpr float kCos0 = 2.443315711809948e-5f;
+constexpr float kCos1 = -1.388731625493765e-3f;
+constexpr float kCos2 = 4.166664568298827e-2f;
+
+constexpr uint32_t kInstanceMask = 0xFFu << 24;
+
+#if defined(INSTANCE_ANIMATOR_SSE2)
+
+inline void SinCos4(__m128 x, __m128 &s, __m128 &c) {
+  const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(INT32_MIN));
+  __m128 signSin = _mm_and_ps(x, signMask);
+  x = _mm_andnot_ps(signMask, x);
+
+  // Octant j, rounded up to even so x - j * pi/4 lands in [-pi/4, pi/4].
+  __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(kFourOverPi)));
+  j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+  __m128 y = _mm_cvtepi32_ps(j);
+
+  __m128i four = _mm_set1_epi32(4);
+  signSin = _mm_xor_ps(
+      signSin, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, four), 29)));
+  __m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(
+      _mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), four), 29));
+  // Octants 2 and 6 swap the sine and cosine polynomials.
+  __m128 usePolySin = _mm_castsi128_ps(_mm_cmpeq_epi32(
+      _mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+
+  x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(kDP1)));
+  x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(kDP2)));
+  x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(kDP3)));
+  __m128 z = _mm_mul_ps(x, x);
+
+  __m128 polyCos = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(kCos0), z),
+                              _mm_set1_ps(kCos1));
+  polyCos = _mm_add_ps(_mm_mul_ps(polyCos, z), _mm_set1_ps(kCos2));
+  polyCos = _mm_mul_ps(_mm_mul_ps(polyCos, z), z);
+  polyCos = _mm_sub_ps(polyCos, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+  polyCos = _mm_add_ps(polyCos, _mm_set1_ps(1.0f));
+
+  __m128 polySin = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(kSin0), z),
+                              _mm_set1_ps(kSin1));
+  polySin = _mm_add_ps(_mm_mul_ps(polySin, z), _mm_set1_ps(kSin2));
+  polySin = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(polySin, z), x), x);
+
+  s = _mm_or_ps(_mm_and_ps(usePolySin, polySin),
+                _mm_andnot_ps(usePolySin, polyCos));
+  c = _mm_or_ps(_mm_and_ps(usePolySin, polyCos),
+                _mm_andnot_ps(usePolySin, polySin));
+  s = _mm_xor_ps(s, signSin);
+  c = _mm_xor_ps(c, signCos);
+}
+
+struct BallGroup {
+  __m128 scale, x, y, z;
+};
+
+inline BallGroup EvaluateGroup(const float *radius, const float *orbitPhase,
+                               const float *scale, const float *bouncePhase,
+                               __m128 orbitOffset, __m128 bounceOffset) {
+  BallGroup g;
+  __m128 s, c, bounce, unused;
+  SinCos4(_mm_add_ps(_mm_loadu_ps(orbitPhase), orbitOffset), s, c);
+  SinCos4(_mm_add_ps(_mm_loadu_ps(bouncePhase), bounceOffset), bounce,
+          unused);
+  bounce = _mm_andnot_ps(_mm_castsi128_ps(_mm_set1_epi32(INT32_MIN)), bounce);
+
+  __m128 r = _mm_loadu_ps(radius);
+  g.scale = _mm_loadu_ps(scale);
+  g.x = _mm_mul_ps(c, r);
+  g.y = _mm_add_ps(g.scale,
+                   _mm_mul_ps(bounce, _mm_set1_ps(kBounceHeight)));
+  g.z = _mm_mul_ps(s, r);
+  return g;
+}
+
+#else
+
+inline void SinCos1(float x, float &s, float &c) {
+  float signSin = x < 0.0f ? -1.0f : 1.0f;
+  x = std::fabs(x);
+  int32_t j = ((int32_t)(x * kFourOverPi) + 1) & ~1;
+  float y = (float)j;
+  if (j & 4) {
+    signSin = -signSin;
+  }
+  float signCos = (~(j - 2) & 4) ? -1.0f : 1.0f;
+  x = ((x - y * kDP1) - y * kDP2) - y * kDP3;
+  float z = x * x;
+  float polyCos =
+      ((kCos0 * z + kCos1) * z + kCos2) * z * z - z * 0.5f + 1.0f;
+  float polySin = ((kSin0 * z + kSin1) * z + kSin2) * z * x + x;
+  bool usePolySin = (j & 2) == 0;
+  s = signSin * (usePolySin ? polySin : polyCos);
+  c = signCos * (usePolySin ? polyCos : polySin);
+}
+
+struct BallGroup {
+  float scale[4], x[4], y[4], z[4];
+};
+
+inline BallGroup EvaluateGroup(const float *radius, const float *orbitPhase,
+                               const float *scale, const float *bouncePhase,
+                               float orbitOffset, float bounceOffset) {
+  BallGroup g;
+  for (int l = 0; l < 4; ++l) {
+    float s, c, bounce, unused;
+    SinCos1(orbitPhase[l] + orbitOffset, s, c);
+    SinCos1(bouncePhase[l] + bounceOffset, bounce, unused);
+    g.scale[l] = scale[l];
+    g.x[l] = c * radius[l];
+    g.y[l] = scale[l] + std::fabs(bounce) * kBounceHeight;
+    g.z[l] = s * radius[l];
+  }
+  return g;
+}
+
+#endif
+
+// Runs fn(begin, end) over [0, count) in chunks of whole SIMD groups, one
+// per thread. The calling thread takes the first chunk.
+template <typename Fn>
+void ParallelGroups(uint32_t count, unsigned threadCount, Fn &&fn) {
+  uint32_t groups = (count + 3) / 4;
+  threadCount = std::max(1u, std::min(threadCount, groups));
+  if (threadCount == 1) {
+    fn(0u, count);
+    return;
+  }
+  uint32_t chunk = (groups + threadCount - 1) / threadCount * 4;
+  std::vector<std::thread> threads;
+  threads.reserve(threadCount - 1);
+  for (unsigned t = 1; t < threadCount; ++t) {
+    uint32_t begin = std::min(count, chunk * t);
+    uint32_t end = std::min(count, begin + chunk);
+    threads.emplace_back([&fn, begin, end]() { fn(begin, end); });
+  }
+  fn(0u, std::min(count, chunk));
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+} // namespace
+
+InstanceAnimator::InstanceAnimator(uint32_t ballCount,
+                                   uint32_t firstInstanceID) {
+  Reset(ballCount, firstInstanceID);
+}
+
+void InstanceAnimator::Reset(uint32_t ballCount, uint32_t firstInstanceID) {
+  m_count = ballCount;
+  m_firstInstanceID = firstInstanceID;
+  size_t padded = (ballCount + 3) & ~3u;
+  m_orbitRadius.assign(padded, 0.0f);
+  m_orbitPhase.assign(padded, 0.0f);
+  m_scale.assign(padded, 0.0f);
+  m_bouncePhase.assign(padded, 0.0f);
+  for (uint32_t i = 0; i < ballCount; ++i) {
+    // Reduced in double: ball indices reach 1e5, where float sincos
+    // arguments would lose most of their fraction.
+    double orbit = (double)((float)i / ballCount * 6.28f * 2.0f);
+    m_orbitPhase[i] = (float)std::fmod(orbit, kTwoPi);
+    m_bouncePhase[i] = (float)std::fmod((double)i, kTwoPi);
+    m_orbitRadius[i] = 4.0f + (i % 5) * 2.0f;
+    m_scale[i] = 0.3f + ((i % 3) * 0.1f);
+  }
+}
+
+void InstanceAnimator::Evaluate(float animationTime, float animationSpeed,
+                                SceneInstance *out) const {
+  float orbitOffset = animationTime * animationSpeed * kOrbitSpeed;
+  float bounceOffset = animationTime * animationSpeed * kBounceSpeed;
+#if defined(INSTANCE_ANIMATOR_SSE2)
+  __m128 orbitOffset4 = _mm_set1_ps(orbitOffset);
+  __m128 bounceOffset4 = _mm_set1_ps(bounceOffset);
+#endif
+
+  for (uint32_t i = 0; i < m_count; i += 4) {
+#if defined(INSTANCE_ANIMATOR_SSE2)
+    BallGroup g = EvaluateGroup(&m_orbitRadius[i], &m_orbitPhase[i],
+                                &m_scale[i], &m_bouncePhase[i], orbitOffset4,
+                                bounceOffset4);
+    float lanes[4][4];
+    _mm_storeu_ps(lanes[0], g.scale);
+    _mm_storeu_ps(lanes[1], g.x);
+    _mm_storeu_ps(lanes[2], g.y);
+    _mm_storeu_ps(lanes[3], g.z);
+#else
+    BallGroup g = EvaluateGroup(&m_orbitRadius[i], &m_orbitPhase[i],
+                                &m_scale[i], &m_bouncePhase[i], orbitOffset,
+                                bounceOffset);
+    float *lanes[] = {g.scale, g.x, g.y, g.z};
+#endif
+    uint32_t n = std::min(4u, m_count - i);
+    for (uint32_t l = 0; l < n; ++l) {
+      SceneInstance &inst = out[i + l];
+      inst = {};
+      inst.transform.m[0][0] = lanes[0][l];
+      inst.transform.m[0][3] = lanes[1][l];
+      inst.transform.m[1][1] = lanes[0][l];
+      inst.transform.m[1][3] = lanes[2][l];
+      inst.transform.m[2][2] = lanes[0][l];
+      inst.transform.m[2][3] = lanes[3][l];
+      inst.instanceID = m_firstInstanceID + i + l;
+      inst.mesh = SceneMesh::Sphere;
+    }
+  }
+}
+
+void InstanceAnimator::WriteInstanceDescs(float animationTime,
+                                          float animationSpeed,
+                                          uint64_t blasAddress,
+                                          GpuInstanceDesc *dst,
+                                          unsigned threadCount) const {
+  if (((uintptr_t)dst & 15) != 0) {
+    throw std::runtime_error(
+        "InstanceAnimator: instance descs must be 16-byte aligned");
+  }
+  if (m_count < kParallelThreshold) {
+    threadCount = 1;
+  }
+  ParallelGroups(m_count, threadCount, [&](uint32_t begin, uint32_t end) {
+    WriteRange(animationTime, animationSpeed, &blasAddress, nullptr, dst,
+               begin, end);
+  });
+}
+
+void InstanceAnimator::WriteInstanceDescs(float animationTime,
+                                          float animationSpeed,
+                                          uint64_t blasAddress,
+                                          GpuInstanceDesc *dst,
+                                          JobSystem &jobs) const {
+  WriteInstanceDescs(animationTime, animationSpeed, &blasAddress, nullptr,
+                     dst, jobs);
+}
+
+void InstanceAnimator::WriteInstanceDescs(float animationTime,
+                                          float animationSpeed,
+                                          const uint64_t *blasByLevel,
+                                          const uint8_t *levels,
+                                          GpuInstanceDesc *dst,
+                                          JobSystem &jobs) const {
+  if (((uintptr_t)dst & 15) != 0) {
+    throw std::runtime_error(
+        "InstanceAnimator: instance descs must be 16-byte aligned");
+  }
+  if (m_count < kParallelThreshold) {
+    WriteRange(animationTime, animationSpeed, blasByLevel, levels, dst, 0,
+               m_count);
+    return;
+  }
+  // Ranges are split in whole SIMD groups so only the last one is partial.
+  uint32_t groups = (m_count + 3) / 4;
+  jobs.ParallelFor(groups, kParallelGrain / 4,
+                   [&](uint32_t begin, uint32_t end) {
+                     WriteRange(animationTime, animationSpeed, blasByLevel,
+                                levels, dst, begin * 4,
+                                std::min(m_count, end * 4));
+                   });
+}
+
+void InstanceAnimator::WriteRange(float animationTime, float animationSpeed,
+                                  const uint64_t *blasByLevel,
+                                  const uint8_t *levels, GpuInstanceDesc *dst,
+                                  uint32_t begin, uint32_t end) const {
+  float orbitOffset = animationTime * animationSpeed * kOrbitSpeed;
+  float bounceOffset = animationTime * animationSpeed * kBounceSpeed;
+
+#if defined(INSTANCE_ANIMATOR_SSE2)
+  __m128 orbitOffset4 = _mm_set1_ps(orbitOffset);
+  __m128 bounceOffset4 = _mm_set1_ps(bounceOffset);
+  const __m128 zero = _mm_setzero_ps();
+  // Fourth row of every desc: ID | mask, hit group | flags, BLAS address.
+  const __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+  const __m128i mask = _mm_set1_epi32((int)kInstanceMask);
+  __m128 blasLo = _mm_castsi128_ps(_mm_set1_epi32((int)blasByLevel[0]));
+  __m128 blasHi =
+      _mm_castsi128_ps(_mm_set1_epi32((int)(blasByLevel[0] >> 32)));
+
+  for (uint32_t i = begin; i < end; i += 4) {
+    BallGroup g = EvaluateGroup(&m_orbitRadius[i], &m_orbitPhase[i],
+                                &m_scale[i], &m_bouncePhase[i], orbitOffset4,
+                                bounceOffset4);
+
+    // Transposing (scale, 0, 0, x) etc. gives each lane's row directly.
+    __m128 r0a = g.scale, r0b = zero, r0c = zero, r0d = g.x;
+    _MM_TRANSPOSE4_PS(r0a, r0b, r0c, r0d);
+    __m128 r1a = zero, r1b = g.scale, r1c = zero, r1d = g.y;
+    _MM_TRANSPOSE4_PS(r1a, r1b, r1c, r1d);
+    __m128 r2a = zero, r2b = zero, r2c = g.scale, r2d = g.z;
+    _MM_TRANSPOSE4_PS(r2a, r2b, r2c, r2d);
+    // Each ball's hit group record is the one at its instance ID.
+    __m128i id = _mm_add_epi32(_mm_set1_epi32((int)(m_firstInstanceID + i)),
+                               laneIndex);
+    __m128 ids = _mm_castsi128_ps(_mm_or_si128(id, mask));
+    __m128 hitGroup = _mm_castsi128_ps(id);
+    if (levels) {
+      // Past the last ball the padding lanes repeat it; they are never
+      // stored.
+      uint64_t blas[4];
+      for (uint32_t l = 0; l < 4; ++l) {
+        blas[l] = blasByLevel[levels[std::min(i + l, end - 1)]];
+      }
+      blasLo = _mm_castsi128_ps(
+          _mm_setr_epi32((int)blas[0], (int)blas[1], (int)blas[2],
+                         (int)blas[3]));
+      blasHi = _mm_castsi128_ps(_mm_setr_epi32(
+          (int)(blas[0] >> 32), (int)(blas[1] >> 32), (int)(blas[2] >> 32),
+          (int)(blas[3] >> 32)));
+    }
+    __m128 r3a = ids, r3b = hitGroup, r3c = blasLo, r3d = blasHi;
+    _MM_TRANSPOSE4_PS(r3a, r3b, r3c, r3d);
+
+    float *row = (float *)&dst[i];
+    if (end - i >= 4) {
+      // Four whole descs, 256 contiguous bytes, in address order.
+      _mm_stream_ps(row + 0, r0a);
+      _mm_stream_ps(row + 4, r1a);
+      _mm_stream_ps(row + 8, r2a);
+      _mm_stream_ps(row + 12, r3a);
+      _mm_stream_ps(row + 16, r0b);
+      _mm_stream_ps(row + 20, r1b);
+      _mm_stream_ps(row + 24, r2b);
+      _mm_stream_ps(row + 28, r3b);
+      _mm_stream_ps(row + 32, r0c);
+      _mm_stream_ps(row + 36, r1c);
+      _mm_stream_ps(row + 40, r2c);
+      _mm_stream_ps(row + 44, r3c);
+      _mm_stream_ps(row + 48, r0d);
+      _mm_stream_ps(row + 52, r1d);
+      _mm_stream_ps(row + 56, r2d);
+      _mm_stream_ps(row + 60, r3d);
+    } else {
+      const __m128 rows[3][4] = {{r0a, r1a, r2a, r3a},
+                                 {r0b, r1b, r2b, r3b},
+                                 {r0c, r1c, r2c, r3c}};
+      for (uint32_t l = 0; l < end - i; ++l) {
+        for (int r = 0; r < 4; ++r) {
+          _mm_stream_ps(row + l * 16 + r * 4, rows[l][r]);
+        }
+      }
+    }
+  }
+  // Streaming stores are weakly ordered; make them visible before the
+  // caller hands the buffer to the GPU (or another thread joins).
+  _mm_sfence();
+#else
+  for (uint32_t i = begin; i < end; i += 4) {
+    BallGroup g = EvaluateGroup(&m_orbitRadius[i], &m_orbitPhase[i],
+                                &m_scale[i], &m_bouncePhase[i], orbitOffset,
+                                bounceOffset);
+    uint32_t n = std::min(4u, end - i);
+    for (uint32_t l = 0; l < n; ++l) {
+      GpuInstanceDesc desc = {};
+      desc.transform[0][0] = g.scale[l];
+      desc.transform[0][3] = g.x[l];
+      desc.transform[1][1] = g.scale[l];
+      desc.transform[1][3] = g.y[l];
+      desc.transform[2][2] = g.scale[l];
+      desc.transform[2][3] = g.z[l];
+      desc.instanceIdAndMask = (m_firstInstanceID + i + l) | kInstanceMask;
+      desc.hitGroupAndFlags = m_firstInstanceID + i + l;
+      desc.accelerationStructure =
+          blasByLevel[levels ? levels[i + l] : 0];
+      std::memcpy(&dst[i + l], &desc, sizeof(desc));
+    }
+  }
+#endif
+}
@@ -0,0 +1,159 @@
+#include "../include/InstanceBvh.h"
+
+#include <chrono>
+#include <stdexcept>
+
+namespace {
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+} // namespace
+
+void InstanceBvh::SetMesh(SceneMesh mesh, const MeshBvh *bvh) {
+  m_meshes[(uint32_t)mesh] = bvh;
+}
+
+void InstanceBvh::UpdateInstances(
+    const std::vector<SceneInstance> &instances) {
+  size_t count = instances.size();
+  m_worldBounds.resize(count);
+  m_worldToObject.resize(count);
+  m_instanceMeshes.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    const SceneInstance &inst = instances[i];
+    const MeshBvh *mesh = m_meshes[(uint32_t)inst.mesh];
+    if (!mesh) {
+      throw std::runtime_error("InstanceBvh: instance references a mesh "
+                               "that was not registered");
+    }
+    m_instanceMeshes[i] = mesh;
+    m_worldBounds[i] = TransformAabb(inst.transform, mesh->Bounds());
+    m_worldToObject[i] = InverseAffine(inst.transform);
+  }
+}
+
+void InstanceBvh::Build(const std::vector<SceneInstance> &instances) {
+  auto start = std::chrono::steady_clock::now();
+  UpdateInstances(instances);
+  m_bvh.Build(m_worldBounds.data(), m_worldBounds.size());
+  m_stats.buildMs = MillisecondsSince(start);
+  m_stats.buildSahCost = m_bvh.Stats().sahCost;
+  m_stats.sahCost = m_stats.buildSahCost;
+  m_stats.refitsSinceBuild = 0;
+  ++m_stats.rebuildCount;
+}
+
+void InstanceBvh::Refit(const std::vector<SceneInstance> &instances) {
+  if (instances.size() != m_worldBounds.size()) {
+    throw std::runtime_error("InstanceBvh: refit with a different instance "
+                             "count than the last build");
+  }
+  auto start = std::chrono::steady_clock::now();
+  UpdateInstances(instances);
+  m_stats.sahCost = m_bvh.Refit(m_worldBounds.data());
+  m_stats.refitMs = MillisecondsSince(start);
+  ++m_stats.refitsSinceBuild;
+}
+
+bool InstanceBvh::Update(const std::vector<SceneInstance> &instances) {
+  if (m_bvh.Empty() || instances.size() != m_worldBounds.size()) {
+    Build(instances);
+    return true;
+  }
+  Refit(instances);
+  if (m_stats.sahCost > m_stats.buildSahCost * m_rebuildThreshold) {
+    Build(instances);
+    return true;
+  }
+  return false;
+}
+
+template <bool AnyHit>
+bool InstanceBvh::Traverse(const Ray &ray, InstanceHit &hit) const {
+  if (m_bvh.Empty()) {
+    return false;
+  }
+  Float3 invDir = SafeInverse(ray.direction);
+  const Bvh::NodeArray &nodes = m_bvh.Nodes();
+  const std::vector<uint32_t> &order = m_bvh.PrimIndices();
+
+  hit.t = ray.tMax;
+  hit.instance = UINT32_MAX;
+
+  float tEntry;
+  if (!IntersectAabb(ray, invDir, nodes[0].boundsMin, nodes[0].boundsMax,
+                     hit.t, tEntry)) {
+    return false;
+  }
+
+  BvhTraversalStack traversalStack(m_bvh);
+  uint32_t *stack = traversalStack.Data();
+  uint32_t stackSize = 0;
+  uint32_t current = 0;
+
+  for (;;) {
+    const BvhNode &node = nodes[current];
+    if (node.IsLeaf()) {
+      for (uint32_t i = 0; i < node.primCount; ++i) {
+        uint32_t index = order[node.leftFirst + i];
+        const Aabb &box = m_worldBounds[index];
+        if (!IntersectAabb(ray, invDir, box.min, box.max, hit.t, tEntry)) {
+          continue;
+        }
+        // Object-space ray keeps the world-space t parameterisation because
+        // the direction is not renormalised.
+        const Float3x4 &worldToObject = m_worldToObject[index];
+        Ray objRay;
+        objRay.origin = TransformPoint(worldToObject, ray.origin);
+        objRay.direction = TransformVector(worldToObject, ray.direction);
+        objRay.tMin = ray.tMin;
+        objRay.tMax = hit.t;
+        if (AnyHit) {
+          if (m_instanceMeshes[index]->Occluded(objRay)) {
+            return true;
+          }
+        } else if (m_instanceMeshes[index]->Intersect(objRay)) {
+          hit.t = objRay.tMax;
+          hit.instance = index;
+        }
+      }
+    } else {
+      uint32_t left = node.leftFirst;
+      float tLeft, tRight;
+      bool hitLeft = IntersectAabb(ray, invDir, nodes[left].boundsMin,
+                                   nodes[left].boundsMax, hit.t, tLeft);
+      bool hitRight =
+          IntersectAabb(ray, invDir, nodes[left + 1].boundsMin,
+                        nodes[left + 1].boundsMax, hit.t, tRight);
+      if (hitLeft && hitRight) {
+        bool leftFirst = tLeft <= tRight;
+        stack[stackSize++] = leftFirst ? left + 1 : left;
+        current = leftFirst ? left : left + 1;
+        continue;
+      }
+      if (hitLeft || hitRight) {
+        current = hitLeft ? left : left + 1;
+        continue;
+      }
+    }
+
+    if (stackSize == 0) {
+      break;
+    }
+    current = stack[--stackSize];
+  }
+  return hit.instance != UINT32_MAX;
+}
+
+bool InstanceBvh::Intersect(const Ray &ray, InstanceHit &hit) const {
+  return Traverse<false>(ray, hit);
+}
+
+bool InstanceBvh::Occluded(const Ray &ray) const {
+  InstanceHit hit;
+  return Traverse<true>(ray, hit);
+}
@@ -0,0 +1,355 @@
+#include "../include/JobSystem.h"
+#include "../include/CpuProfiler.h"
+
+#include <algorithm>
+#include <string>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+thread_local const JobSystem *t_system = nullptr;
+thread_local unsigned t_worker = 0;
+
+uint32_t NextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+void PinCurrentThread(unsigned cpu) {
+#if defined(_WIN32)
+  if (cpu < sizeof(DWORD_PTR) * 8) {
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu);
+  }
+#elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu % CPU_SETSIZE, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void)cpu;
+#endif
+}
+
+} // namespace
+
+JobDeque::JobDeque(uint32_t capacity) {
+  int64_t size = 1;
+  while (size < (int64_t)capacity) {
+    size <<= 1;
+  }
+  m_rings.push_back(std::make_unique<Ring>(size));
+  m_ring.store(m_rings.back().get(), std::memory_order_relaxed);
+}
+
+JobDeque::~JobDeque() = default;
+
+JobDeque::Ring *JobDeque::Grow(Ring *ring, int64_t top, int64_t bottom) {
+  auto grown = std::make_unique<Ring>((ring->mask + 1) * 2);
+  for (int64_t i = top; i < bottom; ++i) {
+    grown->Put(i, ring->Get(i));
+  }
+  Ring *result = grown.get();
+  m_rings.push_back(std::move(grown));
+  m_ring.store(result, std::memory_order_release);
+  return result;
+}
+
+void JobDeque::Push(Job *job) {
+  int64_t b = m_bottom.load(std::memory_order_relaxed);
+  int64_t t = m_top.load(std::memory_order_acquire);
+  Ring *ring = m_ring.load(std::memory_order_relaxed);
+  if (b - t > ring->mask) {
+    ring = Grow(ring, t, b);
+  }
+  ring->Put(b, job);
+  m_bottom.store(b + 1, std::memory_order_release);
+}
+
+Job *JobDeque::Pop() {
+  int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+  Ring *ring = m_ring.load(std::memory_order_relaxed);
+  m_bottom.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = m_top.load(std::memory_order_relaxed);
+
+  if (t > b) {
+    // Already empty.
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  Job *job = ring->Get(b);
+  if (t == b) {
+    // Last element: race the thieves for it.
+    if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+      job = nullptr;
+    }
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+Job *JobDeque::Steal() {
+  int64_t t = m_top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = m_bottom.load(std::memory_order_acquire);
+  if (t >= b) {
+    return nullptr;
+  }
+  Ring *ring = m_ring.load(std::memory_order_acquire);
+  Job *job = ring->Get(t);
+  if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+    return nullptr; // lost to the owner or another thief
+  }
+  return job;
+}
+
+bool JobDeque::Empty() const {
+  int64_t b = m_bottom.load(std::memory_order_relaxed);
+  int64_t t = m_top.load(std::memory_order_relaxed);
+  return b <= t;
+}
+
+JobSystem::JobSystem(const JobSystemSettings &settings)
+    : m_settings(settings) {
+  unsigned threads = settings.threadCount;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  unsigned workers = threads - 1;
+  m_deques.reserve(workers + 1);
+  for (unsigned i = 0; i <= workers; ++i) {
+    m_deques.push_back(std::make_unique<JobDeque>());
+  }
+  // One extra slot for threads that are not workers.
+  m_counters = std::make_unique<WorkerCounters[]>(workers + 2);
+
+  t_system = this;
+  t_worker = 0;
+  m_threads.reserve(workers);
+  for (unsigned i = 1; i <= workers; ++i) {
+    m_threads.emplace_back([this, i]() { WorkerLoop(i); });
+  }
+}
+
+JobSystem::~JobSystem() {
+  m_stop.store(true);
+  m_epoch.fetch_add(1);
+  m_epoch.notify_all();
+  for (auto &thread : m_threads) {
+    thread.join();
+  }
+  if (t_system == this) {
+    t_system = nullptr;
+  }
+
+  // Jobs still queued (or still waiting on a dependency) never run.
+  for (auto &deque : m_deques) {
+    while (Job *job = deque->Steal()) {
+      delete job;
+    }
+  }
+  for (Job *job : m_inject) {
+    delete job;
+  }
+}
+
+int JobSystem::CurrentWorker() const {
+  return t_system == this ? (int)t_worker : -1;
+}
+
+void JobSystem::Run(std::function<void()> fn, JobCounter *signal,
+                    JobCounter *after) {
+  Job *job = new Job{std::move(fn), signal};
+  if (signal) {
+    signal->m_pending.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (after) {
+    std::lock_guard<std::mutex> lock(after->m_mutex);
+    if (after->m_pending.load(std::memory_order_acquire) != 0) {
+      after->m_continuations.push_back(job);
+      return;
+    }
+  }
+  Submit(job);
+}
+
+void JobSystem::Submit(Job *job) {
+  int self = CurrentWorker();
+  if (self >= 0) {
+    m_deques[self]->Push(job);
+  } else {
+    std::lock_guard<std::mutex> lock(m_injectMutex);
+    m_inject.push_back(job);
+    m_injectCount.fetch_add(1, std::memory_order_release);
+  }
+
+  // Pairs with the epoch check in WorkerLoop: either the sleeper sees the
+  // new epoch before it waits, or it is counted here and woken.
+  m_epoch.fetch_add(1);
+  if (m_sleepers.load() != 0) {
+    m_epoch.notify_one();
+  }
+}
+
+void JobSystem::Complete(JobCounter *counter) {
+  if (!counter) {
+    return;
+  }
+  // Not the last job: no lock needed.
+  uint32_t pending = counter->m_pending.load(std::memory_order_relaxed);
+  while (pending > 1) {
+    if (counter->m_pending.compare_exchange_weak(pending, pending - 1,
+                                                 std::memory_order_acq_rel)) {
+      return;
+    }
+  }
+  // Possibly the last one. The final decrement happens under the lock, so
+  // Wait() can lock it once to know nothing here touches the counter again.
+  std::vector<Job *> ready;
+  {
+    std::lock_guard<std::mutex> lock(counter->m_mutex);
+    if (counter->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      ready.swap(counter->m_continuations);
+    }
+  }
+  for (Job *job : ready) {
+    Submit(job);
+  }
+}
+
+void JobSystem::Execute(Job *job, unsigned self) {
+  job->fn();
+  JobCounter *signal = job->signal;
+  delete job;
+  m_counters[self].executed.fetch_add(1, std::memory_order_relaxed);
+  // Last: a waiter may destroy the counter as soon as it drains.
+  Complete(signal);
+}
+
+Job *JobSystem::Find(unsigned self, uint32_t &rng) {
+  unsigned threadCount = ThreadCount();
+  if (self < threadCount) {
+    if (Job *job = m_deques[self]->Pop()) {
+      return job;
+    }
+  }
+  if (m_injectCount.load(std::memory_order_acquire) != 0) {
+    std::lock_guard<std::mutex> lock(m_injectMutex);
+    if (!m_inject.empty()) {
+      Job *job = m_inject.front();
+      m_inject.pop_front();
+      m_injectCount.fetch_sub(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+  unsigned start = NextRandom(rng) % threadCount;
+  for (unsigned i = 0; i < threadCount; ++i) {
+    unsigned victim = (start + i) % threadCount;
+    if (victim == self) {
+      continue;
+    }
+    if (Job *job = m_deques[victim]->Steal()) {
+      m_counters[self].stolen.fetch_add(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+void JobSystem::WorkerLoop(unsigned index) {
+  t_system = this;
+  t_worker = index;
+  CpuProfiler::SetThreadName("Job worker " + std::to_string(index));
+  if (m_settings.pinThreads) {
+    PinCurrentThread(index);
+  }
+
+  uint32_t rng = 0x9E3779B9u * (index + 1);
+  unsigned misses = 0;
+  while (!m_stop.load(std::memory_order_relaxed)) {
+    uint32_t epoch = m_epoch.load();
+    if (Job *job = Find(index, rng)) {
+      Execute(job, index);
+      misses = 0;
+      continue;
+    }
+    if (++misses < m_settings.spinCount) {
+      std::this_thread::yield();
+      continue;
+    }
+    misses = 0;
+    m_sleepers.fetch_add(1);
+    if (!m_stop.load() && m_epoch.load() == epoch) {
+      m_counters[index].sleeps.fetch_add(1, std::memory_order_relaxed);
+      m_epoch.wait(epoch);
+    }
+    m_sleepers.fetch_sub(1);
+  }
+}
+
+void JobSystem::Wait(JobCounter &counter) {
+  int worker = CurrentWorker();
+  unsigned self = worker >= 0 ? (unsigned)worker : ThreadCount();
+  uint32_t rng = 0x85EBCA6Bu ^ (self + 1);
+  while (!counter.Done()) {
+    if (Job *job = Find(self, rng)) {
+      Execute(job, self);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  // The job that drained the counter may still be releasing its lock.
+  std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+void JobSystem::SplitRange(uint32_t begin, uint32_t end, uint32_t grain,
+                           const std::function<void(uint32_t, uint32_t)> &fn,
+                           JobCounter *counter) {
+  // Hand the upper half to the deque until what is left fits one grain;
+  // thieves take from the top, so they get the largest halves.
+  while (end - begin > grain) {
+    uint32_t mid = begin + (end - begin) / 2;
+    Run([this, mid, end, grain, &fn,
+         counter]() { SplitRange(mid, end, grain, fn, counter); },
+        counter);
+    end = mid;
+  }
+  fn(begin, end);
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t grain,
+                            const std::function<void(uint32_t, uint32_t)> &fn) {
+  grain = std::max(1u, grain);
+  if (count == 0) {
+    return;
+  }
+  if (count <= grain || ThreadCount() == 1) {
+    fn(0, count);
+    return;
+  }
+  JobCounter counter;
+  SplitRange(0, count, grain, fn, &counter);
+  Wait(counter);
+}
+
+JobSystemStats JobSystem::Stats() const {
+  JobSystemStats stats;
+  for (unsigned i = 0; i <= ThreadCount(); ++i) {
+    stats.executed += m_counters[i].executed.load(std::memory_order_relaxed);
+    stats.stolen += m_counters[i].stolen.load(std::memory_order_relaxed);
+    stats.sleeps += m_counters[i].sleeps.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
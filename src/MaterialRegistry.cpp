@@ -0,0 +1,51 @@
+#include "../include/MaterialRegistry.h"
+
+#include <cstring>
+
+namespace {
+
+// -0 and +0 shade identically, so they must not make two entries.
+MaterialData Canonical(const MaterialData &material) {
+  MaterialData m = material;
+  float *values[] = {&m.albedo.x,   &m.albedo.y,   &m.albedo.z,
+                     &m.reflectivity, &m.emissive.x, &m.emissive.y,
+                     &m.emissive.z};
+  for (float *v : values) {
+    if (*v == 0.0f) {
+      *v = 0.0f;
+    }
+  }
+  return m;
+}
+
+uint64_t HashMaterial(const MaterialData &m) {
+  unsigned char bytes[sizeof(MaterialData)];
+  std::memcpy(bytes, &m, sizeof(bytes));
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (unsigned char b : bytes) {
+    hash = (hash ^ b) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+} // namespace
+
+uint32_t MaterialRegistry::Add(const MaterialData &material) {
+  MaterialData m = Canonical(material);
+  uint64_t hash = HashMaterial(m);
+  auto [first, last] = m_lookup.equal_range(hash);
+  for (auto it = first; it != last; ++it) {
+    if (std::memcmp(&m_materials[it->second], &m, sizeof(m)) == 0) {
+      return it->second;
+    }
+  }
+  uint32_t index = (uint32_t)m_materials.size();
+  m_materials.push_back(m);
+  m_lookup.emplace(hash, index);
+  return index;
+}
+
+void MaterialRegistry::Clear() {
+  m_materials.clear();
+  m_lookup.clear();
+}
@@ -0,0 +1,166 @@
+#include "../include/MeshBvh.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Per-ray setup for the watertight ray/triangle test (Woop, Benthin and Wald,
+// JCGT 2013). DXR traversal is watertight, so plain Moller-Trumbore would
+// leak rays through shared edges that the GPU never misses.
+struct WatertightRay {
+  int kx, ky, kz;
+  float sx, sy, sz;
+};
+
+WatertightRay MakeWatertightRay(Float3 dir) {
+  const float *d = &dir.x;
+  WatertightRay w;
+  w.kz = 0;
+  if (std::fabs(d[1]) > std::fabs(d[w.kz]))
+    w.kz = 1;
+  if (std::fabs(d[2]) > std::fabs(d[w.kz]))
+    w.kz = 2;
+  w.kx = (w.kz + 1) % 3;
+  w.ky = (w.kx + 1) % 3;
+  if (d[w.kz] < 0.0f) {
+    std::swap(w.kx, w.ky);
+  }
+  w.sx = d[w.kx] / d[w.kz];
+  w.sy = d[w.ky] / d[w.kz];
+  w.sz = 1.0f / d[w.kz];
+  return w;
+}
+
+// RAY_FLAG_CULL_BACK_FACING_TRIANGLES with the default DXR winding: front
+// faces are clockwise seen from the ray origin, i.e. U, V, W all >= 0 here.
+bool IntersectTriangle(const Ray &ray, const WatertightRay &w, Float3 v0,
+                       Float3 v1, Float3 v2, float &t) {
+  Float3 a3 = v0 - ray.origin;
+  Float3 b3 = v1 - ray.origin;
+  Float3 c3 = v2 - ray.origin;
+  const float *a = &a3.x;
+  const float *b = &b3.x;
+  const float *c = &c3.x;
+
+  float ax = a[w.kx] - w.sx * a[w.kz];
+  float ay = a[w.ky] - w.sy * a[w.kz];
+  float bx = b[w.kx] - w.sx * b[w.kz];
+  float by = b[w.ky] - w.sy * b[w.kz];
+  float cx = c[w.kx] - w.sx * c[w.kz];
+  float cy = c[w.ky] - w.sy * c[w.kz];
+
+  float u = cx * by - cy * bx;
+  float v = ax * cy - ay * cx;
+  float e = bx * ay - by * ax;
+
+  // Edge hits are decided in double precision so neighbours agree.
+  if (u == 0.0f || v == 0.0f || e == 0.0f) {
+    u = (float)((double)cx * by - (double)cy * bx);
+    v = (float)((double)ax * cy - (double)ay * cx);
+    e = (float)((double)bx * ay - (double)by * ax);
+  }
+
+  if (u < 0.0f || v < 0.0f || e < 0.0f) {
+    return false;
+  }
+  float det = u + v + e;
+  if (det == 0.0f) {
+    return false;
+  }
+
+  float az = w.sz * a[w.kz];
+  float bz = w.sz * b[w.kz];
+  float cz = w.sz * c[w.kz];
+  float tScaled = u * az + v * bz + e * cz;
+  t = tScaled / det;
+  return t >= ray.tMin && t <= ray.tMax;
+}
+
+} // namespace
+
+void MeshBvh::Build(const std::vector<MeshVertex> &vertices,
+                    const std::vector<uint32_t> &indices) {
+  if (indices.size() < 3) {
+    throw std::runtime_error("MeshBvh: mesh has no triangles");
+  }
+
+  m_bvh.Build(vertices, indices);
+
+  const std::vector<uint32_t> &order = m_bvh.PrimIndices();
+  m_triangles.resize(order.size() * 3);
+  for (size_t i = 0; i < order.size(); ++i) {
+    for (int k = 0; k < 3; ++k) {
+      m_triangles[i * 3 + k] = vertices[indices[order[i] * 3 + k]].position;
+    }
+  }
+  m_bounds = {m_bvh.Nodes()[0].boundsMin, m_bvh.Nodes()[0].boundsMax};
+}
+
+template <bool AnyHit> bool MeshBvh::Traverse(Ray &ray) const {
+  Float3 invDir = SafeInverse(ray.direction);
+  WatertightRay w = MakeWatertightRay(ray.direction);
+  const Bvh::NodeArray &nodes = m_bvh.Nodes();
+
+  float tEntry;
+  if (!IntersectAabb(ray, invDir, nodes[0].boundsMin, nodes[0].boundsMax,
+                     ray.tMax, tEntry)) {
+    return false;
+  }
+
+  BvhTraversalStack traversalStack(m_bvh);
+  uint32_t *stack = traversalStack.Data();
+  uint32_t stackSize = 0;
+  uint32_t current = 0;
+  bool hit = false;
+
+  for (;;) {
+    const BvhNode &node = nodes[current];
+    if (node.IsLeaf()) {
+      for (uint32_t i = 0; i < node.primCount; ++i) {
+        const Float3 *tri = &m_triangles[(size_t)(node.leftFirst + i) * 3];
+        float t;
+        if (IntersectTriangle(ray, w, tri[0], tri[1], tri[2], t)) {
+          if (AnyHit) {
+            return true;
+          }
+          ray.tMax = t;
+          hit = true;
+        }
+      }
+    } else {
+      // Visit the nearer child first, defer the other.
+      uint32_t left = node.leftFirst;
+      float tLeft, tRight;
+      bool hitLeft = IntersectAabb(ray, invDir, nodes[left].boundsMin,
+                                   nodes[left].boundsMax, ray.tMax, tLeft);
+      bool hitRight =
+          IntersectAabb(ray, invDir, nodes[left + 1].boundsMin,
+                        nodes[left + 1].boundsMax, ray.tMax, tRight);
+      if (hitLeft && hitRight) {
+        bool leftFirst = tLeft <= tRight;
+        stack[stackSize++] = leftFirst ? left + 1 : left;
+        current = leftFirst ? left : left + 1;
+        continue;
+      }
+      if (hitLeft || hitRight) {
+        current = hitLeft ? left : left + 1;
+        continue;
+      }
+    }
+
+    if (stackSize == 0) {
+      break;
+    }
+    current = stack[--stackSize];
+  }
+  return hit;
+}
+
+bool MeshBvh::Intersect(Ray &ray) const { return Traverse<false>(ray); }
+
+bool MeshBvh::Occluded(const Ray &ray) const {
+  Ray copy = ray;
+  return Traverse<true>(copy);
+}
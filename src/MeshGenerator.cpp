@@ -0,0 +1,90 @@
+#include "../include/MeshGenerator.h"
+
+namespace {
+constexpr float kPi = 3.14159265358979323846f;
+}
+
+void GenerateSphere(std::vector<MeshVertex> &vertices,
+                    std::vector<uint32_t> &indices, float radius,
+                    int sliceCount, int stackCount) {
+  MeshVertex topVertex = {
+      {0.0f, radius, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f, 1.0f}};
+  MeshVertex bottomVertex = {
+      {0.0f, -radius, 0.0f}, {0.0f, -1.0f, 0.0f}, {1.0f, 1.0f, 1.0f}};
+
+  size_t firstVertex = vertices.size();
+  vertices.push_back(topVertex);
+
+  float phiStep = kPi / stackCount;
+  float thetaStep = 2.0f * kPi / sliceCount;
+
+  for (int i = 1; i <= stackCount - 1; ++i) {
+    float phi = i * phiStep;
+
+    for (int j = 0; j <= sliceCount; ++j) {
+      float theta = j * thetaStep;
+
+      MeshVertex v;
+      v.position.x = radius * sinf(phi) * cosf(theta);
+      v.position.y = radius * cosf(phi);
+      v.position.z = radius * sinf(phi) * sinf(theta);
+      v.normal = Normalize(v.position);
+      v.color = {1.0f, 1.0f, 1.0f};
+
+      vertices.push_back(v);
+    }
+  }
+
+  vertices.push_back(bottomVertex);
+
+  for (int i = 1; i <= sliceCount; ++i) {
+    indices.push_back(0);
+    indices.push_back(i + 1);
+    indices.push_back(i);
+  }
+
+  int baseIndex = 1;
+  int ringVertexCount = sliceCount + 1;
+  for (int i = 0; i < stackCount - 2; ++i) {
+    for (int j = 0; j < sliceCount; ++j) {
+      indices.push_back(baseIndex + i * ringVertexCount + j);
+      indices.push_back(baseIndex + i * ringVertexCount + j + 1);
+      indices.push_back(baseIndex + (i + 1) * ringVertexCount + j);
+
+      indices.push_back(baseIndex + (i + 1) * ringVertexCount + j);
+      indices.push_back(baseIndex + i * ringVertexCount + j + 1);
+      indices.push_back(baseIndex + (i + 1) * ringVertexCount + j + 1);
+    }
+  }
+
+  int southPoleIndex = (int)(vertices.size() - firstVertex) - 1;
+  baseIndex = southPoleIndex - ringVertexCount;
+
+  for (int i = 0; i < sliceCount; ++i) {
+    indices.push_back(southPoleIndex);
+    indices.push_back(baseIndex + i);
+    indices.push_back(baseIndex + i + 1);
+  }
+}
+
+void GeneratePlane(std::vector<MeshVertex> &vertices,
+                   std::vector<uint32_t> &indices, float width, float depth) {
+  float hw = width * 0.5f;
+  float hd = depth * 0.5f;
+
+  MeshVertex v[4];
+  v[0] = {{-hw, -0.5f, -hd}, {0.0f, 1.0f, 0.0f}, {0.5f, 0.5f, 0.5f}};
+  v[1] = {{-hw, -0.5f, hd}, {0.0f, 1.0f, 0.0f}, {0.5f, 0.5f, 0.5f}};
+  v[2] = {{hw, -0.5f, hd}, {0.0f, 1.0f, 0.0f}, {0.5f, 0.5f, 0.5f}};
+  v[3] = {{hw, -0.5f, -hd}, {0.0f, 1.0f, 0.0f}, {0.5f, 0.5f, 0.5f}};
+
+  for (auto &vert : v)
+    vertices.push_back(vert);
+
+  indices.push_back(0);
+  indices.push_back(1);
+  indices.push_back(2);
+  indices.push_back(0);
+  indices.push_back(2);
+  indices.push_back(3);
+}
@@ -0,0 +1,344 @@
+#include "../include/MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t kNone = UINT32_MAX;
+
+// Key of a weld grid cell. Distinct cells may share a key; that only costs
+// extra comparisons, since candidates are matched on their attributes.
+uint64_t CellKey(int64_t x, int64_t y, int64_t z) {
+  return (uint64_t)x * 0x9E3779B185EBCA87ull ^
+         (uint64_t)y * 0xC2B2AE3D27D4EB4Full ^
+         (uint64_t)z * 0x165667B19E3779F9ull;
+}
+
+bool Weldable(const MeshVertex &a, const MeshVertex &b, float epsilon,
+              float normalCos) {
+  return std::fabs(a.position.x - b.position.x) <= epsilon &&
+         std::fabs(a.position.y - b.position.y) <= epsilon &&
+         std::fabs(a.position.z - b.position.z) <= epsilon &&
+         Dot(a.normal, b.normal) >= normalCos &&
+         !std::memcmp(&a.color, &b.color, sizeof(Float3));
+}
+
+// Spreads the low 10 bits of v to every third bit.
+uint32_t SpreadBits(uint32_t v) {
+  v &= 0x3FFu;
+  v = (v | (v << 16)) & 0x030000FFu;
+  v = (v | (v << 8)) & 0x0300F00Fu;
+  v = (v | (v << 4)) & 0x030C30C3u;
+  v = (v | (v << 2)) & 0x09249249u;
+  return v;
+}
+
+size_t MaxIndexBytes(const std::vector<uint32_t> &indices) {
+  uint32_t maxIndex = 0;
+  for (uint32_t index : indices) {
+    maxIndex = std::max(maxIndex, index);
+  }
+  return maxIndex < 65536u ? 2 : 4;
+}
+
+} // namespace
+
+size_t WeldVertices(std::vector<MeshVertex> &vertices,
+                    std::vector<uint32_t> &indices, float positionEpsilon,
+                    float normalCos) {
+  const size_t count = vertices.size();
+  // Cells are several epsilons wide, so most vertices only look in their
+  // own cell and a vertex near a face looks in the neighbour as well.
+  const double cell = positionEpsilon > 0.0f ? 4.0 * positionEpsilon : 1.0;
+  auto CellOf = [&](double v) { return (int64_t)std::floor(v / cell); };
+
+  // Open-addressed table from cell key to the cell's newest welded vertex,
+  // at most half full. Each welded vertex chains to the previous one in
+  // its cell.
+  uint32_t bits = 4;
+  while ((size_t(1) << bits) < 2 * count) {
+    ++bits;
+  }
+  struct Slot {
+    uint64_t key;
+    uint32_t head = kNone;
+  };
+  const size_t mask = (size_t(1) << bits) - 1;
+  std::vector<Slot> slots(mask + 1);
+  auto Find = [&](uint64_t key) -> Slot & {
+    size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+    while (slots[slot].head != kNone && slots[slot].key != key) {
+      slot = (slot + 1) & mask;
+    }
+    return slots[slot];
+  };
+
+  std::vector<uint32_t> next; // per welded vertex
+  std::vector<uint32_t> remap(count);
+  std::vector<MeshVertex> welded;
+  welded.reserve(count);
+  next.reserve(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    const MeshVertex &v = vertices[i];
+    const float p[3] = {v.position.x, v.position.y, v.position.z};
+    int64_t lo[3], hi[3];
+    for (int c = 0; c < 3; ++c) {
+      lo[c] = CellOf((double)p[c] - positionEpsilon);
+      hi[c] = CellOf((double)p[c] + positionEpsilon);
+    }
+
+    uint32_t match = kNone;
+    for (int64_t x = lo[0]; x <= hi[0] && match == kNone; ++x) {
+      for (int64_t y = lo[1]; y <= hi[1] && match == kNone; ++y) {
+        for (int64_t z = lo[2]; z <= hi[2] && match == kNone; ++z) {
+          for (uint32_t j = Find(CellKey(x, y, z)).head; j != kNone;
+               j = next[j]) {
+            if (Weldable(welded[j], v, positionEpsilon, normalCos)) {
+              match = j;
+              break;
+            }
+          }
+        }
+      }
+    }
+
+    if (match == kNone) {
+      match = (uint32_t)welded.size();
+      welded.push_back(v);
+      uint64_t key = CellKey(CellOf(p[0]), CellOf(p[1]), CellOf(p[2]));
+      Slot &slot = Find(key);
+      slot.key = key;
+      next.push_back(slot.head);
+      slot.head = match;
+    }
+    remap[i] = match;
+  }
+
+  for (uint32_t &index : indices) {
+    index = remap[index];
+  }
+  size_t removed = count - welded.size();
+  vertices = std::move(welded);
+  return removed;
+}
+
+size_t RemoveDegenerateTriangles(std::vector<uint32_t> &indices) {
+  size_t kept = 0;
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    uint32_t a = indices[t], b = indices[t + 1], c = indices[t + 2];
+    if (a != b && b != c && a != c) {
+      indices[kept++] = a;
+      indices[kept++] = b;
+      indices[kept++] = c;
+    }
+  }
+  size_t removed = (indices.size() - kept) / 3;
+  indices.resize(kept);
+  return removed;
+}
+
+void SortTrianglesSpatially(const std::vector<MeshVertex> &vertices,
+                            std::vector<uint32_t> &indices) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount < 2) {
+    return;
+  }
+  Float3 lo = vertices[indices[0]].position, hi = lo;
+  for (uint32_t index : indices) {
+    lo = Min(lo, vertices[index].position);
+    hi = Max(hi, vertices[index].position);
+  }
+  // Centroids are summed rather than averaged, so scale by 1023 / (3 extent).
+  Float3 extent = hi - lo;
+  Float3 scale = {extent.x > 0.0f ? 1023.0f / (3.0f * extent.x) : 0.0f,
+                  extent.y > 0.0f ? 1023.0f / (3.0f * extent.y) : 0.0f,
+                  extent.z > 0.0f ? 1023.0f / (3.0f * extent.z) : 0.0f};
+
+  std::vector<std::pair<uint32_t, uint32_t>> keys(triangleCount);
+  for (size_t t = 0; t < triangleCount; ++t) {
+    Float3 sum = (vertices[indices[3 * t]].position - lo) +
+                 (vertices[indices[3 * t + 1]].position - lo) +
+                 (vertices[indices[3 * t + 2]].position - lo);
+    Float3 q = sum * scale;
+    keys[t] = {SpreadBits((uint32_t)q.x) | SpreadBits((uint32_t)q.y) << 1 |
+                   SpreadBits((uint32_t)q.z) << 2,
+               (uint32_t)t};
+  }
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<uint32_t> sorted(triangleCount * 3);
+  for (size_t t = 0; t < triangleCount; ++t) {
+    std::memcpy(&sorted[3 * t], &indices[3 * keys[t].second],
+                3 * sizeof(uint32_t));
+  }
+  indices = std::move(sorted);
+}
+
+void OptimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount,
+                         uint32_t cacheSize) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // Triangles around each vertex, and how many of them are not yet emitted.
+  std::vector<uint32_t> live(vertexCount, 0);
+  for (uint32_t index : indices) {
+    ++live[index];
+  }
+  std::vector<uint32_t> first(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    first[v + 1] = first[v] + live[v];
+  }
+  std::vector<uint32_t> adjacency(indices.size());
+  {
+    std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+    }
+  }
+
+  // Time stamps of a FIFO cache: vertex v is cached while
+  // time - cacheTime[v] <= cacheSize.
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  uint32_t time = cacheSize + 1;
+  std::vector<uint8_t> emitted(triangleCount, 0);
+  std::vector<uint32_t> deadEnd;
+  deadEnd.reserve(indices.size());
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> out;
+  out.reserve(indices.size());
+  size_t cursor = 0;
+
+  // Next vertex that still has triangles: one recently emitted, otherwise
+  // the next in input order.
+  auto SkipDeadEnd = [&]() -> uint32_t {
+    while (!deadEnd.empty()) {
+      uint32_t v = deadEnd.back();
+      deadEnd.pop_back();
+      if (live[v] > 0) {
+        return v;
+      }
+    }
+    for (; cursor < vertexCount; ++cursor) {
+      if (live[cursor] > 0) {
+        return (uint32_t)cursor;
+      }
+    }
+    return kNone;
+  };
+
+  for (uint32_t fan = SkipDeadEnd(); fan != kNone;) {
+    candidates.clear();
+    for (uint32_t a = first[fan]; a < first[fan + 1]; ++a) {
+      uint32_t t = adjacency[a];
+      if (emitted[t]) {
+        continue;
+      }
+      emitted[t] = 1;
+      for (int k = 0; k < 3; ++k) {
+        uint32_t v = indices[3 * t + k];
+        out.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        --live[v];
+        if (time - cacheTime[v] > cacheSize) {
+          cacheTime[v] = time++;
+        }
+      }
+    }
+
+    // Fan around the candidate that will still be cached after its
+    // remaining triangles are emitted, preferring the oldest such entry.
+    uint32_t best = kNone;
+    int64_t bestPriority = -1;
+    for (uint32_t v : candidates) {
+      if (live[v] == 0) {
+        continue;
+      }
+      int64_t priority = 0;
+      if (time - cacheTime[v] + 2 * live[v] <= cacheSize) {
+        priority = time - cacheTime[v];
+      }
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        best = v;
+      }
+    }
+    fan = best != kNone ? best : SkipDeadEnd();
+  }
+  indices = std::move(out);
+}
+
+void OptimizeVertexFetch(std::vector<MeshVertex> &vertices,
+                         std::vector<uint32_t> &indices) {
+  std::vector<uint32_t> remap(vertices.size(), kNone);
+  std::vector<MeshVertex> ordered;
+  ordered.reserve(vertices.size());
+  for (uint32_t &index : indices) {
+    if (remap[index] == kNone) {
+      remap[index] = (uint32_t)ordered.size();
+      ordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices = std::move(ordered);
+}
+
+float ComputeAcmr(const std::vector<uint32_t> &indices, size_t vertexCount,
+                  uint32_t cacheSize) {
+  if (indices.size() < 3) {
+    return 0.0f;
+  }
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  uint32_t time = cacheSize + 1;
+  size_t misses = 0;
+  for (uint32_t index : indices) {
+    if (time - cacheTime[index] > cacheSize) {
+      cacheTime[index] = time++;
+      ++misses;
+    }
+  }
+  return (float)((double)misses / (double)(indices.size() / 3));
+}
+
+MeshOptimizeStats OptimizeMesh(std::vector<MeshVertex> &vertices,
+                               std::vector<uint32_t> &indices,
+                               const MeshOptimizeSettings &settings) {
+  MeshOptimizeStats stats;
+  stats.verticesBefore = vertices.size();
+  stats.trianglesBefore = indices.size() / 3;
+  stats.vertexBytesBefore = vertices.size() * sizeof(MeshVertex);
+  stats.indexBytesBefore = indices.size() * sizeof(uint32_t);
+  stats.acmrBefore =
+      ComputeAcmr(indices, vertices.size(), settings.cacheSize);
+
+  WeldVertices(vertices, indices, settings.weldPositionEpsilon,
+               settings.weldNormalCos);
+  RemoveDegenerateTriangles(indices);
+  SortTrianglesSpatially(vertices, indices);
+  OptimizeVertexCache(indices, vertices.size(), settings.cacheSize);
+  OptimizeVertexFetch(vertices, indices);
+
+  stats.verticesAfter = vertices.size();
+  stats.trianglesAfter = indices.size() / 3;
+  stats.vertexBytesAfter = vertices.size() * sizeof(MeshVertex);
+  stats.indexBytesAfter = indices.size() * MaxIndexBytes(indices);
+  stats.acmrAfter = ComputeAcmr(indices, vertices.size(), settings.cacheSize);
+  return stats;
+}
+
+PackedIndices PackIndices(const std::vector<uint32_t> &indices) {
+  PackedIndices packed;
+  packed.sixteenBit = MaxIndexBytes(indices) == 2;
+  if (packed.sixteenBit) {
+    packed.indices16.assign(indices.begin(), indices.end());
+  } else {
+    packed.indices32 = indices;
+  }
+  return packed;
+}
@@ -0,0 +1,145 @@
+#include "../include/NullDevice.h"
+
+#include <stdexcept>
+
+NullDevice::NullDevice() {
+  for (uint32_t r = 0; r < kFrameResourceCount; ++r) {
+    m_states[r] = FrameResourceRestState((FrameResource)r);
+  }
+}
+
+uint64_t NullDevice::Signal() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return ++m_fence;
+}
+
+uint64_t NullDevice::CompletedValue() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_fence;
+}
+
+double NullDevice::Wait(uint64_t value) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (value > m_fence) {
+    throw std::logic_error("NullDevice: waiting on a value never signalled");
+  }
+  return 0.0;
+}
+
+void NullDevice::CreateAllocator(uint32_t allocator) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (allocator != m_allocators.size()) {
+    throw std::logic_error("NullDevice: allocators created out of order");
+  }
+  m_allocators.push_back({});
+}
+
+void NullDevice::CreateList(uint32_t list) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (list != m_lists.size()) {
+    throw std::logic_error("NullDevice: lists created out of order");
+  }
+  m_lists.emplace_back();
+}
+
+void NullDevice::ResetAllocator(uint32_t allocator) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const Allocator &a = m_allocators.at(allocator);
+  if (a.openLists != 0 || a.retireFence > m_fence) {
+    throw std::logic_error("NullDevice: allocator reset while in use");
+  }
+}
+
+void NullDevice::ResetList(uint32_t list, uint32_t allocator) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  List &l = m_lists.at(list);
+  Allocator &a = m_allocators.at(allocator);
+  if (l.open || a.openLists != 0) {
+    throw std::logic_error("NullDevice: list or allocator already recording");
+  }
+  l.open = true;
+  l.allocator = allocator;
+  l.barriers.clear();
+  l.tlasBuilds.clear();
+  l.barrierBatches = 0;
+  l.passes = 0;
+  ++a.openLists;
+}
+
+void NullDevice::CloseList(uint32_t list) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  List &l = OpenList(list);
+  l.open = false;
+  --m_allocators[l.allocator].openLists;
+}
+
+void NullDevice::ExecuteLists(const uint32_t *lists, uint32_t count) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (uint32_t i = 0; i < count; ++i) {
+    const List &l = m_lists.at(lists[i]);
+    if (l.open) {
+      throw std::logic_error("NullDevice: executing an open list");
+    }
+    for (const Tlas &tlas : l.tlasBuilds) {
+      for (uint32_t d = 0; d < tlas.count; ++d) {
+        const GpuInstanceDesc &desc = tlas.descs[d];
+        uint32_t id = desc.instanceIdAndMask & 0xFFFFFFu;
+        if (id != d || (desc.hitGroupAndFlags & 0xFFFFFFu) != id ||
+            desc.accelerationStructure == 0) {
+          ++m_stats.badInstanceDescs;
+        }
+      }
+      ++(tlas.refit ? m_stats.tlasRefits : m_stats.tlasBuilds);
+    }
+    for (const FrameBarrier &barrier : l.barriers) {
+      FrameResourceState &state = m_states[(uint32_t)barrier.resource];
+      if (state != barrier.before) {
+        ++m_stats.stateMismatches;
+      }
+      state = barrier.after;
+    }
+    m_stats.barriers += l.barriers.size();
+    m_stats.barrierBatches += l.barrierBatches;
+    m_stats.passes += l.passes;
+    // Retires with the next signal, which follows this batch.
+    m_allocators[l.allocator].retireFence = m_fence + 1;
+  }
+  m_stats.listsExecuted += count;
+}
+
+void NullDevice::ResourceBarriers(uint32_t list, const FrameBarrier *barriers,
+                                  uint32_t count) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  List &l = OpenList(list);
+  l.barriers.insert(l.barriers.end(), barriers, barriers + count);
+  ++l.barrierBatches;
+}
+
+void NullDevice::RecordPass(uint32_t list, FramePass) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ++OpenList(list).passes;
+}
+
+void NullDevice::BuildTlas(uint32_t list, const GpuInstanceDesc *descs,
+                           uint32_t count, bool refit) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  OpenList(list).tlasBuilds.push_back({descs, count, refit});
+}
+
+FrameResourceState NullDevice::ResourceState(FrameResource resource) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_states[(uint32_t)resource];
+}
+
+NullDeviceStats NullDevice::Stats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+NullDevice::List &NullDevice::OpenList(uint32_t list) {
+  List &l = m_lists.at(list);
+  if (!l.open) {
+    throw std::logic_error("NullDevice: recording into a closed list");
+  }
+  return l;
+}
@@ -0,0 +1,294 @@
+#include "../include/PipelineCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kIndexMagic[4] = {'P', 'L', 'C', 'I'};
+constexpr size_t kIndexHeaderSize = 4 + 4 + 4 + 4 + 8 + 4 + 4;
+constexpr size_t kIndexEntrySize = 4 * 8;
+constexpr uint64_t kFnvPrime = 0x100000001b3ull;
+
+void Put32(std::vector<uint8_t> &out, uint32_t v) {
+  for (int i = 0; i < 4; ++i) {
+    out.push_back((uint8_t)(v >> (8 * i)));
+  }
+}
+
+void Put64(std::vector<uint8_t> &out, uint64_t v) {
+  for (int i = 0; i < 8; ++i) {
+    out.push_back((uint8_t)(v >> (8 * i)));
+  }
+}
+
+uint32_t Get32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+uint64_t Get64(const uint8_t *p) {
+  return (uint64_t)Get32(p) | (uint64_t)Get32(p + 4) << 32;
+}
+
+bool ReadFile(const std::string &path, std::vector<uint8_t> &out) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  file.seekg(0, std::ios::end);
+  std::streamoff size = file.tellg();
+  file.seekg(0, std::ios::beg);
+  if (size < 0) {
+    return false;
+  }
+  out.resize((size_t)size);
+  return size == 0 || (bool)file.read((char *)out.data(), size);
+}
+
+// Writes through a temporary and renames it over path, so a crash never
+// leaves a half-written file under the real name.
+bool WriteFile(const std::string &path, const void *data, size_t size) {
+  std::string temp = path + ".tmp";
+  {
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    if (!file || !file.write((const char *)data, (std::streamsize)size)) {
+      return false;
+    }
+  }
+  std::error_code error;
+  fs::rename(temp, path, error);
+  if (error) {
+    fs::remove(temp, error);
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+uint64_t PipelineKey::Hash(const void *data, size_t size, uint64_t seed) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+
+void PipelineKey::Mix(const void *data, size_t size) {
+  m_hash = Hash(data, size, m_hash);
+}
+
+PipelineKey &PipelineKey::AddBytes(std::string_view field, const void *data,
+                                   size_t size) {
+  uint8_t lengths[16];
+  uint64_t fieldSize = field.size();
+  uint64_t dataSize = size;
+  for (int i = 0; i < 8; ++i) {
+    lengths[i] = (uint8_t)(fieldSize >> (8 * i));
+    lengths[8 + i] = (uint8_t)(dataSize >> (8 * i));
+  }
+  Mix(lengths, 8);
+  Mix(field.data(), field.size());
+  Mix(lengths + 8, 8);
+  Mix(data, size);
+  return *this;
+}
+
+PipelineKey &PipelineKey::AddString(std::string_view field,
+                                    std::string_view text) {
+  return AddBytes(field, text.data(), text.size());
+}
+
+PipelineKey &PipelineKey::AddU64(std::string_view field, uint64_t value) {
+  uint8_t bytes[8];
+  for (int i = 0; i < 8; ++i) {
+    bytes[i] = (uint8_t)(value >> (8 * i));
+  }
+  return AddBytes(field, bytes, sizeof(bytes));
+}
+
+PipelineCache::PipelineCache(std::string directory,
+                             const PipelineCacheDevice &device,
+                             uint64_t maxBytes)
+    : m_directory(std::move(directory)), m_device(device),
+      m_maxBytes(maxBytes) {
+  std::error_code error;
+  fs::create_directories(m_directory, error);
+  if (error || !fs::is_directory(m_directory)) {
+    throw std::runtime_error("PipelineCache: cannot create " + m_directory);
+  }
+  ReadIndex();
+  RemoveUnreferencedBlobs();
+}
+
+std::string PipelineCache::BlobPath(uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+  return (fs::path(m_directory) / name).string();
+}
+
+void PipelineCache::ReadIndex() {
+  std::vector<uint8_t> index;
+  if (!ReadFile((fs::path(m_directory) / "index.bin").string(), index)) {
+    return; // a new cache
+  }
+
+  auto discard = [this]() {
+    m_stats.indexDiscarded = true;
+    m_dirty = true;
+  };
+  if (index.size() < kIndexHeaderSize + 8 ||
+      !std::equal(kIndexMagic, kIndexMagic + 4, index.begin()) ||
+      Get32(index.data() + 4) != kFormatVersion) {
+    return discard();
+  }
+  size_t body = index.size() - 8;
+  if (Get64(index.data() + body) != PipelineKey::Hash(index.data(), body)) {
+    return discard();
+  }
+  uint32_t count = Get32(index.data() + 24);
+  if (body != kIndexHeaderSize + (size_t)count * kIndexEntrySize) {
+    return discard();
+  }
+
+  PipelineCacheDevice written;
+  written.vendorId = Get32(index.data() + 8);
+  written.deviceId = Get32(index.data() + 12);
+  written.driverVersion = Get64(index.data() + 16);
+  if (!(written == m_device)) {
+    m_stats.invalidated += count;
+    m_dirty = true;
+    return;
+  }
+
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint8_t *p = index.data() + kIndexHeaderSize + i * kIndexEntrySize;
+    Entry entry = {Get64(p + 8), Get64(p + 16), Get64(p + 24)};
+    if (m_entries.emplace(Get64(p), entry).second) {
+      m_totalBytes += entry.size;
+      m_useClock = std::max(m_useClock, entry.lastUse);
+    }
+  }
+}
+
+void PipelineCache::RemoveUnreferencedBlobs() {
+  std::error_code error;
+  for (const fs::directory_entry &file :
+       fs::directory_iterator(m_directory, error)) {
+    std::string name = file.path().filename().string();
+    bool referenced = false;
+    if (name.size() == 20 && name.compare(16, 4, ".bin") == 0) {
+      char *end = nullptr;
+      uint64_t key = std::strtoull(name.c_str(), &end, 16);
+      referenced = end == name.c_str() + 16 && m_entries.count(key);
+    } else if (name == "index.bin") {
+      referenced = true;
+    } else if (name.size() < 4 || name.compare(name.size() - 4, 4, ".tmp")) {
+      continue; // not ours
+    }
+    if (!referenced) {
+      std::error_code ignored;
+      fs::remove(file.path(), ignored);
+    }
+  }
+}
+
+bool PipelineCache::Load(uint64_t key, std::vector<uint8_t> &blob) {
+  auto it = m_entries.find(key);
+  if (it == m_entries.end()) {
+    ++m_stats.misses;
+    return false;
+  }
+  if (!ReadFile(BlobPath(key), blob) || blob.size() != it->second.size ||
+      PipelineKey::Hash(blob.data(), blob.size()) != it->second.checksum) {
+    ++m_stats.invalidated;
+    ++m_stats.misses;
+    Drop(key);
+    blob.clear();
+    return false;
+  }
+  it->second.lastUse = ++m_useClock;
+  m_dirty = true;
+  ++m_stats.hits;
+  return true;
+}
+
+void PipelineCache::Store(uint64_t key, const void *data, size_t size) {
+  if (m_entries.count(key)) {
+    Drop(key);
+  }
+  if (size > m_maxBytes || !WriteFile(BlobPath(key), data, size)) {
+    return;
+  }
+  m_entries[key] = {size, PipelineKey::Hash(data, size), ++m_useClock};
+  m_totalBytes += size;
+  m_dirty = true;
+  ++m_stats.stores;
+
+  while (m_totalBytes > m_maxBytes) {
+    auto oldest = std::min_element(
+        m_entries.begin(), m_entries.end(), [](const auto &a, const auto &b) {
+          return a.second.lastUse < b.second.lastUse;
+        });
+    Drop(oldest->first);
+    ++m_stats.evicted;
+  }
+}
+
+bool PipelineCache::Contains(uint64_t key) const {
+  return m_entries.count(key) != 0;
+}
+
+void PipelineCache::Invalidate(uint64_t key) {
+  if (m_entries.count(key)) {
+    Drop(key);
+    ++m_stats.invalidated;
+  }
+}
+
+void PipelineCache::Drop(uint64_t key) {
+  auto it = m_entries.find(key);
+  m_totalBytes -= it->second.size;
+  m_entries.erase(it);
+  std::error_code ignored;
+  fs::remove(BlobPath(key), ignored);
+  m_dirty = true;
+}
+
+void PipelineCache::Flush() {
+  if (!m_dirty) {
+    return;
+  }
+  std::vector<uint8_t> index;
+  index.reserve(kIndexHeaderSize + m_entries.size() * kIndexEntrySize + 8);
+  index.insert(index.end(), kIndexMagic, kIndexMagic + 4);
+  Put32(index, kFormatVersion);
+  Put32(index, m_device.vendorId);
+  Put32(index, m_device.deviceId);
+  Put64(index, m_device.driverVersion);
+  Put32(index, (uint32_t)m_entries.size());
+  Put32(index, 0);
+  for (const auto &[key, entry] : m_entries) {
+    Put64(index, key);
+    Put64(index, entry.size);
+    Put64(index, entry.checksum);
+    Put64(index, entry.lastUse);
+  }
+  Put64(index, PipelineKey::Hash(index.data(), index.size()));
+  if (!WriteFile((fs::path(m_directory) / "index.bin").string(), index.data(),
+                 index.size())) {
+    throw std::runtime_error("PipelineCache: cannot write the index in " +
+                             m_directory);
+  }
+  m_dirty = false;
+}
@@ -0,0 +1,106 @@
+#include "../include/SceneInstances.h"
+#include "../include/InstanceAnimator.h"
+#include "../include/MaterialRegistry.h"
+
+#include <stdexcept>
+
+namespace {
+
+// The pastel balls' colour, hashed from the instance ID.
+Float3 PastelColor(uint32_t instanceID) {
+  uint32_t h = instanceID * 0x9E3779B9u;
+  h = ((h >> 16) ^ h) * 0x45D9F3Bu;
+  h = ((h >> 16) ^ h) * 0x45D9F3Bu;
+  h = (h >> 16) ^ h;
+
+  float r = float(h & 0xFF) / 255.0f;
+  float g = float((h >> 8) & 0xFF) / 255.0f;
+  float b = float((h >> 16) & 0xFF) / 255.0f;
+
+  return Lerp({r, g, b}, {1.0f, 1.0f, 1.0f}, 0.5f);
+}
+
+} // namespace
+
+void BuildSceneInstances(float animationTime, float animationSpeed,
+                         std::vector<SceneInstance> &instances) {
+  instances.clear();
+  instances.reserve(2 + kSceneBallCount);
+
+  // 1. Plane (ID 0)
+  {
+    SceneInstance inst = {};
+    inst.transform.m[0][0] = inst.transform.m[1][1] = inst.transform.m[2][2] =
+        1.0f;
+    inst.instanceID = 0;
+    inst.mesh = SceneMesh::Plane;
+    instances.push_back(inst);
+  }
+
+  // 2. Main Mirror Sphere (ID 1) - Scale 1.5, Pos (0, 1.5, 0)
+  {
+    SceneInstance inst = {};
+    inst.transform.m[0][0] = 1.5f;
+    inst.transform.m[1][1] = 1.5f;
+    inst.transform.m[1][3] = 1.5f;
+    inst.transform.m[2][2] = 1.5f;
+    inst.instanceID = 1;
+    inst.mesh = SceneMesh::Sphere;
+    instances.push_back(inst);
+  }
+
+  // 3. Pastel Balls (ID 2+), evaluated by the same kernel that writes the
+  // renderer's instance descs so CPU and GPU transforms match exactly.
+  static const InstanceAnimator balls(kSceneBallCount, 2);
+  instances.resize(2 + kSceneBallCount);
+  balls.Evaluate(animationTime, animationSpeed, &instances[2]);
+}
+
+void BuildSceneMaterials(uint32_t instanceCount, MaterialRegistry &registry,
+                         std::vector<uint32_t> &instanceMaterials) {
+  instanceMaterials.resize(instanceCount);
+  for (uint32_t id = 0; id < instanceCount; ++id) {
+    MaterialData material = {};
+    if (id == 0) {
+      // Floor: 0.9 / 0.5 grey checkers
+      material.albedo = {0.9f, 0.9f, 0.9f};
+      material.pattern = MATERIAL_PATTERN_CHECKER;
+    } else if (id == 1) {
+      // Main Metal Sphere: 80% reflection, 10% of its tint as direct light
+      material.albedo = {0.4f, 0.4f, 0.45f};
+      material.reflectivity = 0.8f;
+    } else {
+      // Pastel Balls
+      Float3 color = PastelColor(id);
+      material.albedo = {color.x, color.y, color.z};
+      material.emissive = {color.x * 0.5f, color.y * 0.5f, color.z * 0.5f};
+    }
+    instanceMaterials[id] = registry.Add(material);
+  }
+}
+
+HitGroupRecord MakeHitGroupRecord(SceneMesh mesh, uint32_t materialIndex) {
+  HitGroupRecord record = {};
+  record.materialIndex = materialIndex;
+  if (mesh == SceneMesh::Plane) {
+    record.geometry = GEOMETRY_FLAT;
+    record.flatNormal = {0.0f, 1.0f, 0.0f};
+  } else {
+    record.geometry = GEOMETRY_SPHERE;
+  }
+  return record;
+}
+
+void BuildSceneHitGroupRecords(const std::vector<SceneInstance> &instances,
+                               const std::vector<uint32_t> &instanceMaterials,
+                               std::vector<HitGroupRecord> &records) {
+  records.assign(instanceMaterials.size(), HitGroupRecord{});
+  for (const SceneInstance &instance : instances) {
+    if (instance.instanceID >= instanceMaterials.size()) {
+      throw std::runtime_error(
+          "BuildSceneHitGroupRecords: instance ID without a material");
+    }
+    records[instance.instanceID] = MakeHitGroupRecord(
+        instance.mesh, instanceMaterials[instance.instanceID]);
+  }
+}
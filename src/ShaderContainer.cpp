@@ -0,0 +1,608 @@
+#include "../include/ShaderContainer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr uint32_t kDxbcMagic = MakeFourCC('D', 'X', 'B', 'C');
+constexpr uint32_t kPartFeatureInfo = MakeFourCC('S', 'F', 'I', '0');
+constexpr uint32_t kPartVersion = MakeFourCC('V', 'E', 'R', 'S');
+constexpr uint32_t kPartRuntimeData = MakeFourCC('R', 'D', 'A', 'T');
+constexpr uint32_t kPartHash = MakeFourCC('H', 'A', 'S', 'H');
+constexpr uint32_t kPartDxil = MakeFourCC('D', 'X', 'I', 'L');
+constexpr uint32_t kDxilMagic = MakeFourCC('D', 'X', 'I', 'L');
+
+// Magic, digest, major/minor version, container size, part count.
+constexpr size_t kHeaderSize = 4 + 16 + 2 + 2 + 4 + 4;
+constexpr size_t kDigestOffset = 4;
+constexpr size_t kDigestEnd = kDigestOffset + 16;
+// DxilProgramHeader: version, size in dwords, then DxilBitcodeHeader
+// (magic, DXIL version, bitcode offset and size).
+constexpr size_t kProgramHeaderSize = 24;
+constexpr size_t kBitcodeHeaderOffset = 8;
+
+constexpr uint32_t kRdatVersion = 0x10;
+constexpr uint32_t kRdatStringBuffer = 1;
+constexpr uint32_t kRdatResourceTable = 3;
+constexpr uint32_t kRdatFunctionTable = 4;
+// Class, Kind, ID, Space, LowerBound, UpperBound, Name; Flags is not read.
+constexpr uint32_t kResourceRecordMinSize = 7 * 4;
+// Name, UnmangledName, Resources, FunctionDependencies, ShaderKind,
+// PayloadSizeInBytes, AttributeSizeInBytes; later fields are not read.
+constexpr uint32_t kFunctionRecordMinSize = 7 * 4;
+
+constexpr uint32_t kHashIncludesSource = 1;
+
+[[noreturn]] void Fail(const std::string &message) {
+  throw std::runtime_error("ShaderContainer: " + message);
+}
+
+uint16_t Read16(const uint8_t *p) {
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+uint32_t Read32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+uint64_t Read64(const uint8_t *p) {
+  return (uint64_t)Read32(p) | (uint64_t)Read32(p + 4) << 32;
+}
+
+std::string FourCCName(uint32_t fourcc) {
+  std::string name(4, '?');
+  for (int i = 0; i < 4; ++i) {
+    char c = (char)(fourcc >> (8 * i));
+    if (c >= 0x20 && c < 0x7f) {
+      name[i] = c;
+    }
+  }
+  return name;
+}
+
+// RFC 1321 MD5 block transform; the container digest and the HASH part
+// pad their input differently but share it.
+void Md5Transform(uint32_t state[4], const uint8_t block[64]) {
+  static const uint32_t kSine[64] = {
+      0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+      0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+      0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+      0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+      0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+      0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+      0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+      0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+      0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+      0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+      0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+  static const uint32_t kShift[16] = {7, 12, 17, 22, 5, 9,  14, 20,
+                                      4, 11, 16, 23, 6, 10, 15, 21};
+  uint32_t m[16];
+  for (int i = 0; i < 16; ++i) {
+    m[i] = Read32(block + 4 * i);
+  }
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  for (int i = 0; i < 64; ++i) {
+    uint32_t f;
+    int g;
+    if (i < 16) {
+      f = (b & c) | (~b & d);
+      g = i;
+    } else if (i < 32) {
+      f = (d & b) | (~d & c);
+      g = (5 * i + 1) & 15;
+    } else if (i < 48) {
+      f = b ^ c ^ d;
+      g = (3 * i + 5) & 15;
+    } else {
+      f = c ^ (b | ~d);
+      g = (7 * i) & 15;
+    }
+    f += a + kSine[i] + m[g];
+    uint32_t s = kShift[(i >> 4) * 4 + (i & 3)];
+    a = d;
+    d = c;
+    c = b;
+    b += (f << s) | (f >> (32 - s));
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+}
+
+void Md5Init(uint32_t state[4]) {
+  state[0] = 0x67452301;
+  state[1] = 0xefcdab89;
+  state[2] = 0x98badcfe;
+  state[3] = 0x10325476;
+}
+
+ShaderContainer::Digest Md5Output(const uint32_t state[4]) {
+  ShaderContainer::Digest digest;
+  for (int i = 0; i < 16; ++i) {
+    digest[i] = (uint8_t)(state[i / 4] >> (8 * (i % 4)));
+  }
+  return digest;
+}
+
+void Write32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+// Plain MD5, which is what the HASH part stores for the bitcode.
+ShaderContainer::Digest Md5(const uint8_t *data, size_t size) {
+  uint32_t state[4];
+  Md5Init(state);
+  size_t full = size & ~(size_t)63;
+  for (size_t offset = 0; offset < full; offset += 64) {
+    Md5Transform(state, data + offset);
+  }
+  uint8_t tail[128] = {};
+  size_t left = size - full;
+  std::memcpy(tail, data + full, left);
+  tail[left] = 0x80;
+  size_t tailSize = left < 56 ? 64 : 128;
+  uint64_t bits = (uint64_t)size * 8;
+  Write32(tail + tailSize - 8, (uint32_t)bits);
+  Write32(tail + tailSize - 4, (uint32_t)(bits >> 32));
+  Md5Transform(state, tail);
+  if (tailSize == 128) {
+    Md5Transform(state, tail + 64);
+  }
+  return Md5Output(state);
+}
+
+// Checks that a NUL-terminated string starts at offset inside the buffer.
+std::string_view StringAt(const uint8_t *strings, uint32_t size,
+                          uint32_t offset) {
+  if (offset >= size) {
+    Fail("RDAT string offset out of range");
+  }
+  const char *begin = (const char *)strings + offset;
+  const void *end = std::memchr(begin, 0, size - offset);
+  if (!end) {
+    Fail("RDAT string is not terminated");
+  }
+  return std::string_view(begin, (size_t)((const char *)end - begin));
+}
+
+// Puts the file name on container errors.
+ShaderContainer ParseMapped(const MappedFile &file, const std::string &path) {
+  try {
+    return ShaderContainer(file.Data(), file.Size());
+  } catch (const std::runtime_error &e) {
+    throw std::runtime_error(path + ": " + e.what());
+  }
+}
+
+} // namespace
+
+const char *DxilShaderKindName(DxilShaderKind kind) {
+  static const char *const kNames[] = {
+      "pixel",        "vertex",   "geometry",      "hull",
+      "domain",       "compute",  "library",       "raygeneration",
+      "intersection", "anyhit",   "closesthit",    "miss",
+      "callable",     "mesh",     "amplification", "node"};
+  uint32_t index = (uint32_t)kind;
+  return index < sizeof(kNames) / sizeof(kNames[0]) ? kNames[index]
+                                                    : "invalid";
+}
+
+const char *DxilResourceClassName(DxilResourceClass resourceClass) {
+  static const char *const kNames[] = {"srv", "uav", "cbuffer", "sampler"};
+  uint32_t index = (uint32_t)resourceClass;
+  return index < sizeof(kNames) / sizeof(kNames[0]) ? kNames[index]
+                                                    : "invalid";
+}
+
+MappedFile::MappedFile(const std::string &path) {
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("MappedFile: cannot open " + path);
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    throw std::runtime_error("MappedFile: cannot size " + path);
+  }
+  m_file = file;
+  m_size = (size_t)size.QuadPart;
+  if (m_size == 0) {
+    return;
+  }
+  m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping) {
+    m_data = (const uint8_t *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+  }
+  if (!m_data) {
+    if (m_mapping) {
+      CloseHandle(m_mapping);
+    }
+    CloseHandle(file);
+    throw std::runtime_error("MappedFile: cannot map " + path);
+  }
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("MappedFile: cannot open " + path);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw std::runtime_error("MappedFile: cannot size " + path);
+  }
+  m_size = (size_t)info.st_size;
+  if (m_size != 0) {
+    void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("MappedFile: cannot map " + path);
+    }
+    m_data = (const uint8_t *)data;
+  }
+  // The mapping keeps its own reference to the file.
+  close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#if defined(_WIN32)
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file) {
+    CloseHandle(m_file);
+  }
+#else
+  if (m_data) {
+    munmap((void *)m_data, m_size);
+  }
+#endif
+}
+
+ShaderContainer::Digest ShaderContainer::ComputeDigest(const void *data,
+                                                       size_t size) {
+  if (size < kHeaderSize) {
+    Fail("container smaller than its header");
+  }
+  // MD5's block function with its own padding: the bit count goes first in
+  // the final block and a second count, (bits >> 2) | 1, replaces the high
+  // word of the length.
+  const uint8_t *bytes = (const uint8_t *)data + kDigestEnd;
+  size_t length = size - kDigestEnd;
+  uint32_t bits = (uint32_t)(length * 8);
+  uint32_t state[4];
+  Md5Init(state);
+  size_t full = length & ~(size_t)63;
+  for (size_t offset = 0; offset < full; offset += 64) {
+    Md5Transform(state, bytes + offset);
+  }
+  size_t left = length - full;
+  uint8_t block[64] = {};
+  if (left >= 56) {
+    std::memcpy(block, bytes + full, left);
+    block[left] = 0x80;
+    Md5Transform(state, block);
+    std::memset(block, 0, sizeof(block));
+    Write32(block, bits);
+  } else {
+    Write32(block, bits);
+    std::memcpy(block + 4, bytes + full, left);
+    block[4 + left] = 0x80;
+  }
+  Write32(block + 60, (bits >> 2) | 1);
+  Md5Transform(state, block);
+  return Md5Output(state);
+}
+
+ShaderContainer::ShaderContainer(const void *data, size_t size)
+    : m_data((const uint8_t *)data), m_size(size) {
+  if (!m_data || size < kHeaderSize) {
+    Fail("container smaller than its header");
+  }
+  if (Read32(m_data) != kDxbcMagic) {
+    Fail("not a DXBC container");
+  }
+  if (Read16(m_data + 20) != 1 || Read16(m_data + 22) != 0) {
+    Fail("unsupported container version");
+  }
+  if (Read32(m_data + 24) != size) {
+    Fail("container size " + std::to_string(Read32(m_data + 24)) +
+         " does not match " + std::to_string(size) + " bytes");
+  }
+  uint32_t partCount = Read32(m_data + 28);
+  if (partCount > (size - kHeaderSize) / 4) {
+    Fail("part table runs past the end");
+  }
+
+  Digest stored;
+  std::memcpy(stored.data(), m_data + kDigestOffset, stored.size());
+  if (stored == Digest{}) {
+    Fail("container is unsigned; compile it with validation enabled");
+  }
+  if (stored != ComputeDigest(m_data, size)) {
+    Fail("container digest mismatch");
+  }
+
+  size_t partsBegin = kHeaderSize + 4 * (size_t)partCount;
+  m_parts.reserve(partCount);
+  for (uint32_t i = 0; i < partCount; ++i) {
+    uint32_t offset = Read32(m_data + kHeaderSize + 4 * i);
+    if (offset < partsBegin || offset > size - 8) {
+      Fail("part " + std::to_string(i) + " offset out of range");
+    }
+    ShaderContainerPart part = {Read32(m_data + offset), m_data + offset + 8,
+                                Read32(m_data + offset + 4)};
+    if (part.size > size - offset - 8) {
+      Fail(FourCCName(part.fourcc) + " part runs past the end");
+    }
+    if (FindPart(part.fourcc)) {
+      Fail("duplicate " + FourCCName(part.fourcc) + " part");
+    }
+    m_parts.push_back(part);
+  }
+
+  if (const ShaderContainerPart *sfi0 = FindPart(kPartFeatureInfo)) {
+    if (sfi0->size != 8) {
+      Fail("SFI0 part is not 8 bytes");
+    }
+    m_featureFlags = Read64(sfi0->data);
+  }
+  if (const ShaderContainerPart *vers = FindPart(kPartVersion)) {
+    // Major, minor, flags, commit count, string list size, then the commit
+    // hash and version strings.
+    if (vers->size < 16 || Read32(vers->data + 12) > vers->size - 16) {
+      Fail("VERS part is truncated");
+    }
+    const uint8_t *strings = vers->data + 16;
+    uint32_t stringsSize = Read32(vers->data + 12);
+    if (stringsSize > 0) {
+      std::string_view commit = StringAt(strings, stringsSize, 0);
+      if (commit.size() + 1 < stringsSize) {
+        m_compilerVersion =
+            StringAt(strings, stringsSize, (uint32_t)commit.size() + 1);
+      }
+    }
+  }
+
+  const ShaderContainerPart *dxil = FindPart(kPartDxil);
+  if (!dxil) {
+    Fail("no DXIL part");
+  }
+  ParseDxil(*dxil);
+
+  if (const ShaderContainerPart *hash = FindPart(kPartHash)) {
+    if (hash->size != 20) {
+      Fail("HASH part is not 20 bytes");
+    }
+    // With source included the hash covers files that are not in here.
+    if (!(Read32(hash->data) & kHashIncludesSource)) {
+      Digest expected;
+      std::memcpy(expected.data(), hash->data + 4, expected.size());
+      if (expected != Md5(m_bitcode, m_bitcodeSize)) {
+        Fail("HASH part does not match the DXIL bitcode");
+      }
+    }
+  }
+
+  if (const ShaderContainerPart *rdat = FindPart(kPartRuntimeData)) {
+    ParseRdat(*rdat);
+  } else if (m_programKind == DxilShaderKind::Library) {
+    Fail("library has no RDAT part");
+  }
+}
+
+void ShaderContainer::ParseDxil(const ShaderContainerPart &part) {
+  if (part.size < kProgramHeaderSize) {
+    Fail("DXIL part smaller than its program header");
+  }
+  uint32_t version = Read32(part.data);
+  m_programKind = (DxilShaderKind)(version >> 16);
+  m_shaderModelMajor = (version >> 4) & 0xf;
+  m_shaderModelMinor = version & 0xf;
+  if ((uint64_t)Read32(part.data + 4) * 4 > part.size) {
+    Fail("DXIL program size exceeds its part");
+  }
+
+  const uint8_t *header = part.data + kBitcodeHeaderOffset;
+  if (Read32(header) != kDxilMagic) {
+    Fail("DXIL bitcode header has the wrong magic");
+  }
+  uint32_t offset = Read32(header + 8);
+  uint32_t size = Read32(header + 12);
+  uint32_t available = part.size - (uint32_t)kBitcodeHeaderOffset;
+  if (offset < 16 || offset > available || size > available - offset) {
+    Fail("DXIL bitcode runs past its part");
+  }
+  m_bitcode = header + offset;
+  m_bitcodeSize = size;
+  if (size < 4 || m_bitcode[0] != 'B' || m_bitcode[1] != 'C' ||
+      m_bitcode[2] != 0xC0 || m_bitcode[3] != 0xDE) {
+    Fail("DXIL part does not hold LLVM bitcode");
+  }
+}
+
+void ShaderContainer::ParseRdat(const ShaderContainerPart &part) {
+  if (part.size < 8 || Read32(part.data) != kRdatVersion) {
+    Fail("unsupported RDAT version");
+  }
+  uint32_t count = Read32(part.data + 4);
+  if (count > (part.size - 8) / 4) {
+    Fail("RDAT part table runs past the end");
+  }
+
+  const uint8_t *strings = nullptr;
+  uint32_t stringsSize = 0;
+  const uint8_t *functions = nullptr;
+  uint32_t functionsSize = 0;
+  const uint8_t *resources = nullptr;
+  uint32_t resourcesSize = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t offset = Read32(part.data + 8 + 4 * i);
+    if (offset > part.size - 8) {
+      Fail("RDAT sub-part offset out of range");
+    }
+    uint32_t type = Read32(part.data + offset);
+    uint32_t size = Read32(part.data + offset + 4);
+    if (size > part.size - offset - 8) {
+      Fail("RDAT sub-part runs past the end");
+    }
+    if (type == kRdatStringBuffer) {
+      strings = part.data + offset + 8;
+      stringsSize = size;
+    } else if (type == kRdatFunctionTable) {
+      functions = part.data + offset + 8;
+      functionsSize = size;
+    } else if (type == kRdatResourceTable) {
+      resources = part.data + offset + 8;
+      resourcesSize = size;
+    }
+  }
+  if (!functions && !resources) {
+    return;
+  }
+  if (!strings) {
+    Fail("RDAT has functions or resources but no string buffer");
+  }
+
+  if (resources) {
+    if (resourcesSize < 8) {
+      Fail("RDAT resource table is truncated");
+    }
+    uint32_t records = Read32(resources);
+    uint32_t stride = Read32(resources + 4);
+    if (stride < kResourceRecordMinSize ||
+        (uint64_t)records * stride > resourcesSize - 8) {
+      Fail("RDAT resource table is truncated");
+    }
+    m_resources.reserve(records);
+    for (uint32_t i = 0; i < records; ++i) {
+      const uint8_t *record = resources + 8 + (size_t)i * stride;
+      ShaderResource resource;
+      resource.resourceClass = (DxilResourceClass)Read32(record);
+      resource.space = Read32(record + 12);
+      resource.lowerBound = Read32(record + 16);
+      resource.upperBound = Read32(record + 20);
+      resource.name = StringAt(strings, stringsSize, Read32(record + 24));
+      m_resources.push_back(resource);
+    }
+  }
+  if (!functions) {
+    return;
+  }
+
+  if (functionsSize < 8) {
+    Fail("RDAT function table is truncated");
+  }
+  uint32_t records = Read32(functions);
+  uint32_t stride = Read32(functions + 4);
+  if (stride < kFunctionRecordMinSize ||
+      (uint64_t)records * stride > functionsSize - 8) {
+    Fail("RDAT function table is truncated");
+  }
+  m_exports.reserve(records);
+  for (uint32_t i = 0; i < records; ++i) {
+    const uint8_t *record = functions + 8 + (size_t)i * stride;
+    ShaderExport function;
+    function.mangledName = StringAt(strings, stringsSize, Read32(record));
+    function.name = StringAt(strings, stringsSize, Read32(record + 4));
+    function.kind = (DxilShaderKind)Read32(record + 16);
+    function.payloadSize = Read32(record + 20);
+    function.attributeSize = Read32(record + 24);
+    // Mangled names carry LLVM's "\x01" no-prefix marker.
+    if (!function.mangledName.empty() && function.mangledName[0] == '\x01') {
+      function.mangledName.remove_prefix(1);
+    }
+    m_exports.push_back(function);
+  }
+}
+
+const ShaderContainerPart *ShaderContainer::FindPart(uint32_t fourcc) const {
+  for (const ShaderContainerPart &part : m_parts) {
+    if (part.fourcc == fourcc) {
+      return &part;
+    }
+  }
+  return nullptr;
+}
+
+const ShaderExport *ShaderContainer::FindExport(std::string_view name) const {
+  for (const ShaderExport &function : m_exports) {
+    if (function.name == name) {
+      return &function;
+    }
+  }
+  return nullptr;
+}
+
+void ShaderContainer::RequireExports(
+    std::initializer_list<ShaderExportRequirement> requirements) const {
+  std::string problems;
+  for (const ShaderExportRequirement &required : requirements) {
+    const ShaderExport *function = FindExport(required.name);
+    if (!function) {
+      problems += "\n  " + std::string(required.name) + " is not exported";
+    } else if (function->kind != required.kind) {
+      problems += "\n  " + std::string(required.name) + " is a " +
+                  DxilShaderKindName(function->kind) + " shader, expected " +
+                  DxilShaderKindName(required.kind);
+    }
+  }
+  if (!problems.empty()) {
+    Fail("missing exports:" + problems);
+  }
+}
+
+const ShaderResource *
+ShaderContainer::FindResource(DxilResourceClass resourceClass, uint32_t reg,
+                              uint32_t space) const {
+  for (const ShaderResource &resource : m_resources) {
+    if (resource.resourceClass == resourceClass && resource.space == space &&
+        resource.lowerBound <= reg && reg <= resource.upperBound) {
+      return &resource;
+    }
+  }
+  return nullptr;
+}
+
+void ShaderContainer::RequireResources(
+    std::initializer_list<ShaderResourceRequirement> requirements) const {
+  std::string problems;
+  for (const ShaderResourceRequirement &required : requirements) {
+    if (!FindResource(required.resourceClass, required.reg, required.space)) {
+      problems += "\n  " + std::string(required.name) + " (" +
+                  DxilResourceClassName(required.resourceClass) + " " +
+                  std::to_string(required.reg) + ", space " +
+                  std::to_string(required.space) + ") is not bound";
+    }
+  }
+  if (!problems.empty()) {
+    Fail("missing resources:" + problems);
+  }
+}
+
+ShaderBlob::ShaderBlob(const std::string &path)
+    : m_file(path), m_container(ParseMapped(m_file, path)) {}
@@ -0,0 +1,187 @@
+#include "../include/ShaderTable.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+} // namespace
+
+const char *ShaderTableKindName(ShaderTableKind kind) {
+  switch (kind) {
+  case ShaderTableKind::RayGen:
+    return "raygen";
+  case ShaderTableKind::Miss:
+    return "miss";
+  case ShaderTableKind::HitGroup:
+    return "hit group";
+  case ShaderTableKind::Callable:
+    return "callable";
+  }
+  return "unknown";
+}
+
+ShaderTableBuilder::ShaderTableBuilder(uint32_t rayTypeCount)
+    : m_rayTypeCount(rayTypeCount) {
+  if (rayTypeCount == 0) {
+    throw std::runtime_error("ShaderTableBuilder: ray type count is zero");
+  }
+}
+
+void ShaderTableBuilder::ClearRecords() {
+  for (Table &table : m_tables) {
+    table.records.clear();
+    table.maxArgsSize = 0;
+  }
+  m_args.clear();
+}
+
+uint32_t ShaderTableBuilder::AddIdentifier(const void *identifier) {
+  if (!identifier) {
+    throw std::runtime_error("ShaderTableBuilder: null shader identifier");
+  }
+  const uint8_t *bytes = (const uint8_t *)identifier;
+  m_identifiers.insert(m_identifiers.end(), bytes, bytes + kIdentifierSize);
+  return (uint32_t)(m_identifiers.size() / kIdentifierSize - 1);
+}
+
+uint32_t ShaderTableBuilder::Append(ShaderTableKind kind, uint32_t identifier,
+                                    uint32_t argsOffset, uint32_t argsSize) {
+  if (identifier >= m_identifiers.size() / kIdentifierSize) {
+    throw std::runtime_error("ShaderTableBuilder: unknown shader identifier");
+  }
+  Table &table = m_tables[(uint32_t)kind];
+  if (kind == ShaderTableKind::HitGroup &&
+      table.records.size() >= kMaxHitGroupRecords) {
+    throw std::runtime_error(
+        "ShaderTableBuilder: more hit group records than "
+        "InstanceContributionToHitGroupIndex can address");
+  }
+  table.records.push_back({identifier, argsOffset, argsSize});
+  table.maxArgsSize = std::max(table.maxArgsSize, argsSize);
+  return (uint32_t)table.records.size() - 1;
+}
+
+uint32_t ShaderTableBuilder::AddRecord(ShaderTableKind kind,
+                                       uint32_t identifier,
+                                       const void *localArgs,
+                                       uint32_t localArgsSize) {
+  if (localArgsSize % 4 != 0 || (localArgsSize && !localArgs)) {
+    throw std::runtime_error(
+        "ShaderTableBuilder: local root arguments must be whole 32-bit "
+        "values");
+  }
+  uint32_t offset = (uint32_t)m_args.size();
+  const uint8_t *bytes = (const uint8_t *)localArgs;
+  m_args.insert(m_args.end(), bytes, bytes + localArgsSize);
+  return Append(kind, identifier, offset, localArgsSize);
+}
+
+uint32_t ShaderTableBuilder::AddInstance(const uint32_t *hitGroups,
+                                         const void *localArgs,
+                                         uint32_t localArgsSize) {
+  uint32_t first = AddRecord(ShaderTableKind::HitGroup, hitGroups[0],
+                             localArgs, localArgsSize);
+  // The other ray types share the copy of the arguments made above.
+  uint32_t offset = m_tables[(uint32_t)ShaderTableKind::HitGroup]
+                        .records[first]
+                        .argsOffset;
+  for (uint32_t r = 1; r < m_rayTypeCount; ++r) {
+    Append(ShaderTableKind::HitGroup, hitGroups[r], offset, localArgsSize);
+  }
+  return first;
+}
+
+ShaderTableBuilder::Layout ShaderTableBuilder::ComputeLayout() const {
+  Layout layout;
+  uint32_t order[kShaderTableKindCount];
+  uint32_t used = 0;
+  uint64_t payload = 0;
+  for (uint32_t k = 0; k < kShaderTableKindCount; ++k) {
+    const Table &table = m_tables[k];
+    ShaderTableRange &range = layout.tables[k];
+    range.count = (uint32_t)table.records.size();
+    if (range.count == 0) {
+      continue;
+    }
+    uint64_t stride = AlignUp(kIdentifierSize + table.maxArgsSize,
+                              kRecordAlignment);
+    if (stride > kMaxRecordStride) {
+      throw std::runtime_error(
+          std::string("ShaderTableBuilder: ") +
+          ShaderTableKindName((ShaderTableKind)k) +
+          " records exceed the 4096-byte shader record stride");
+    }
+    range.stride = (uint32_t)stride;
+    range.size = stride * range.count;
+    for (const Record &record : table.records) {
+      payload += kIdentifierSize + record.argsSize;
+    }
+    order[used++] = k;
+  }
+
+  // Every table but the last is padded out to the next table start, so the
+  // one with the largest remainder goes last. Ties keep DispatchRays order.
+  auto tailPadding = [&](uint32_t k) {
+    return AlignUp(layout.tables[k].size, kTableAlignment) -
+           layout.tables[k].size;
+  };
+  std::stable_sort(order, order + used, [&](uint32_t a, uint32_t b) {
+    return tailPadding(a) < tailPadding(b);
+  });
+
+  uint64_t offset = 0;
+  for (uint32_t i = 0; i < used; ++i) {
+    ShaderTableRange &range = layout.tables[order[i]];
+    offset = AlignUp(offset, kTableAlignment);
+    range.offset = offset;
+    offset += range.size;
+  }
+  layout.totalSize = offset;
+  layout.paddingBytes = offset - payload;
+  return layout;
+}
+
+void ShaderTableBuilder::Write(void *dst) const {
+  Write(dst, ComputeLayout());
+}
+
+void ShaderTableBuilder::Write(void *dst, const Layout &layout) const {
+  uint8_t *out = (uint8_t *)dst;
+
+  // Visit the tables in address order so every byte is written once, in
+  // sequence, gaps included.
+  uint32_t order[kShaderTableKindCount] = {0, 1, 2, 3};
+  std::sort(order, order + kShaderTableKindCount, [&](uint32_t a, uint32_t b) {
+    return layout.tables[a].offset < layout.tables[b].offset;
+  });
+
+  uint64_t cursor = 0;
+  for (uint32_t k : order) {
+    const ShaderTableRange &range = layout.tables[k];
+    if (range.count == 0) {
+      continue;
+    }
+    std::memset(out + cursor, 0, range.offset - cursor);
+    uint8_t *record = out + range.offset;
+    for (const Record &r : m_tables[k].records) {
+      std::memcpy(record,
+                  &m_identifiers[(size_t)r.identifier * kIdentifierSize],
+                  kIdentifierSize);
+      if (r.argsSize) {
+        std::memcpy(record + kIdentifierSize, m_args.data() + r.argsOffset,
+                    r.argsSize);
+      }
+      std::memset(record + kIdentifierSize + r.argsSize, 0,
+                  range.stride - kIdentifierSize - r.argsSize);
+      record += range.stride;
+    }
+    cursor = range.offset + range.size;
+  }
+}
@@ -0,0 +1,272 @@
+#include "../include/SimdIntersect.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(RAYTRACING_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(RAYTRACING_SIMD_X86)
+// Defined in SimdIntersectSse41.cpp / SimdIntersectAvx2.cpp, which are built
+// with the matching instruction set flags.
+extern const IntersectKernels kSse41IntersectKernels;
+extern const IntersectKernels kAvx2IntersectKernels;
+#endif
+
+namespace {
+
+// Rejects triangles seen exactly edge-on (and the zero-edge padding lanes).
+constexpr float kDetEpsilon = 1e-12f;
+
+struct LaneHit {
+  float t, u, v;
+};
+
+bool IntersectTriangleLane(Float3 o, Float3 d, float tMin, float tMax,
+                           Float3 v0, Float3 e1, Float3 e2, bool cull,
+                           LaneHit &hit) {
+  Float3 p = Cross(d, e2);
+  float det = Dot(e1, p);
+  if (cull ? !(det > kDetEpsilon) : !(std::fabs(det) > kDetEpsilon)) {
+    return false;
+  }
+  float invDet = 1.0f / det;
+  Float3 s = o - v0;
+  float u = Dot(s, p) * invDet;
+  Float3 q = Cross(s, e1);
+  float v = Dot(d, q) * invDet;
+  float t = Dot(e2, q) * invDet;
+  if (!(u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= tMin && t < tMax)) {
+    return false;
+  }
+  hit = {t, u, v};
+  return true;
+}
+
+int ScalarRayTriangles8(const SimdRay &ray, const TriangleBlock8 &tris,
+                        bool cullBackFaces, SimdHit &hit) {
+  int best = -1;
+  float closest = ray.tMax;
+  for (int i = 0; i < kSimdWidth; ++i) {
+    LaneHit h;
+    if (IntersectTriangleLane(ray.origin, ray.direction, ray.tMin, closest,
+                              {tris.v0x[i], tris.v0y[i], tris.v0z[i]},
+                              {tris.e1x[i], tris.e1y[i], tris.e1z[i]},
+                              {tris.e2x[i], tris.e2y[i], tris.e2z[i]},
+                              cullBackFaces, h)) {
+      closest = h.t;
+      hit = {h.t, h.u, h.v, (uint32_t)i};
+      best = i;
+    }
+  }
+  return best;
+}
+
+uint32_t ScalarPacketTriangle(RayPacket8 &rays, const PackedTriangle &tri,
+                              uint32_t primIndex, bool cullBackFaces,
+                              HitPacket8 &hits) {
+  uint32_t mask = 0;
+  for (int i = 0; i < kSimdWidth; ++i) {
+    LaneHit h;
+    if (IntersectTriangleLane({rays.ox[i], rays.oy[i], rays.oz[i]},
+                              {rays.dx[i], rays.dy[i], rays.dz[i]},
+                              rays.tMin[i], rays.tMax[i], tri.v0, tri.e1,
+                              tri.e2, cullBackFaces, h)) {
+      rays.tMax[i] = h.t;
+      hits.u[i] = h.u;
+      hits.v[i] = h.v;
+      hits.primIndex[i] = primIndex;
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+}
+
+int ScalarRaySpheres8(const SimdRay &ray, const SphereBlock8 &spheres,
+                      SimdHit &hit) {
+  Float3 d = ray.direction;
+  float a = Dot(d, d);
+  float invA = 1.0f / a;
+  int best = -1;
+  float closest = ray.tMax;
+  for (int i = 0; i < kSimdWidth; ++i) {
+    Float3 oc = ray.origin - Float3{spheres.cx[i], spheres.cy[i],
+                                    spheres.cz[i]};
+    float b = Dot(oc, d);
+    // b^2 - ac written as a * (r^2 - |l|^2), where l is the offset from the
+    // center to the closest point on the ray; this avoids the cancellation
+    // that makes grazing hits unstable (Ray Tracing Gems, chapter 7).
+    Float3 l = oc - d * (b * invA);
+    float disc = a * (spheres.radiusSq[i] - Dot(l, l));
+    if (!(disc >= 0.0f)) {
+      continue;
+    }
+    float root = std::sqrt(disc);
+    float t0 = (-b - root) * invA;
+    float t1 = (-b + root) * invA;
+    float t = t0 >= ray.tMin ? t0 : t1;
+    if (t >= ray.tMin && t < closest) {
+      closest = t;
+      hit = {t, 0.0f, 0.0f, (uint32_t)i};
+      best = i;
+    }
+  }
+  return best;
+}
+
+const IntersectKernels kScalarIntersectKernels = {
+    SimdLevel::Scalar, ScalarRayTriangles8, ScalarPacketTriangle,
+    ScalarRaySpheres8};
+
+bool CpuSupports(SimdLevel level) {
+  if (level == SimdLevel::Scalar) {
+    return true;
+  }
+#if defined(RAYTRACING_SIMD_X86) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  bool sse41 = (info[2] & (1 << 19)) != 0;
+  bool fma = (info[2] & (1 << 12)) != 0;
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  // The OS must save YMM state across context switches.
+  bool ymm = osxsave && avx && (_xgetbv(0) & 6) == 6;
+  __cpuidex(info, 7, 0);
+  bool avx2 = (info[1] & (1 << 5)) != 0;
+  return level == SimdLevel::Sse41 ? sse41 : ymm && avx2 && fma;
+#elif defined(RAYTRACING_SIMD_X86)
+  __builtin_cpu_init();
+  return level == SimdLevel::Sse41
+             ? __builtin_cpu_supports("sse4.1") != 0
+             : __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+  return false;
+#endif
+}
+
+} // namespace
+
+SimdLevel DetectSimdLevel() {
+  static const SimdLevel level = []() {
+    if (CpuSupports(SimdLevel::Avx2)) {
+      return SimdLevel::Avx2;
+    }
+    if (CpuSupports(SimdLevel::Sse41)) {
+      return SimdLevel::Sse41;
+    }
+    return SimdLevel::Scalar;
+  }();
+  return level;
+}
+
+const char *SimdLevelName(SimdLevel level) {
+  switch (level) {
+  case SimdLevel::Avx2:
+    return "AVX2";
+  case SimdLevel::Sse41:
+    return "SSE4.1";
+  default:
+    return "scalar";
+  }
+}
+
+const IntersectKernels *GetIntersectKernels(SimdLevel level) {
+  if (!CpuSupports(level)) {
+    return nullptr;
+  }
+  switch (level) {
+#if defined(RAYTRACING_SIMD_X86)
+  case SimdLevel::Avx2:
+    return &kAvx2IntersectKernels;
+  case SimdLevel::Sse41:
+    return &kSse41IntersectKernels;
+#endif
+  case SimdLevel::Scalar:
+    return &kScalarIntersectKernels;
+  default:
+    return nullptr;
+  }
+}
+
+const IntersectKernels &GetIntersectKernels() {
+  static const IntersectKernels *kernels =
+      GetIntersectKernels(DetectSimdLevel());
+  return *kernels;
+}
+
+PackedTriangle PackTriangle(Float3 v0, Float3 v1, Float3 v2) {
+  return {v0, v1 - v0, v2 - v0};
+}
+
+void BuildTriangleBlocks(const std::vector<MeshVertex> &vertices,
+                         const std::vector<uint32_t> &indices,
+                         std::vector<TriangleBlock8> &blocks) {
+  size_t triCount = indices.size() / 3;
+  blocks.assign((triCount + kSimdWidth - 1) / kSimdWidth, TriangleBlock8{});
+  for (TriangleBlock8 &block : blocks) {
+    std::memset(block.primIndex, 0xFF, sizeof(block.primIndex));
+  }
+  for (size_t i = 0; i < triCount; ++i) {
+    TriangleBlock8 &block = blocks[i / kSimdWidth];
+    size_t lane = i % kSimdWidth;
+    PackedTriangle tri = PackTriangle(vertices[indices[i * 3 + 0]].position,
+                                      vertices[indices[i * 3 + 1]].position,
+                                      vertices[indices[i * 3 + 2]].position);
+    block.v0x[lane] = tri.v0.x;
+    block.v0y[lane] = tri.v0.y;
+    block.v0z[lane] = tri.v0.z;
+    block.e1x[lane] = tri.e1.x;
+    block.e1y[lane] = tri.e1.y;
+    block.e1z[lane] = tri.e1.z;
+    block.e2x[lane] = tri.e2.x;
+    block.e2y[lane] = tri.e2.y;
+    block.e2z[lane] = tri.e2.z;
+    block.primIndex[lane] = (uint32_t)i;
+  }
+}
+
+void BuildSphereBlocks(const std::vector<SceneInstance> &instances,
+                       std::vector<SphereBlock8> &blocks) {
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  blocks.clear();
+  size_t count = 0;
+  for (size_t i = 0; i < instances.size(); ++i) {
+    const SceneInstance &inst = instances[i];
+    if (inst.mesh != SceneMesh::Sphere) {
+      continue;
+    }
+    size_t lane = count % kSimdWidth;
+    if (lane == 0) {
+      SphereBlock8 block;
+      for (int l = 0; l < kSimdWidth; ++l) {
+        block.cx[l] = block.cy[l] = block.cz[l] = nan;
+        block.radiusSq[l] = 0.0f;
+        block.instanceIndex[l] = UINT32_MAX;
+      }
+      blocks.push_back(block);
+    }
+    const float(&m)[3][4] = inst.transform.m;
+    float scale = Length({m[0][0], m[1][0], m[2][0]});
+    float radius = kSphereRadius * scale;
+    SphereBlock8 &block = blocks.back();
+    block.cx[lane] = m[0][3];
+    block.cy[lane] = m[1][3];
+    block.cz[lane] = m[2][3];
+    block.radiusSq[lane] = radius * radius;
+    block.instanceIndex[lane] = (uint32_t)i;
+    ++count;
+  }
+}
+
+void SetRayPacketLane(RayPacket8 &rays, int lane, const SimdRay &ray) {
+  rays.ox[lane] = ray.origin.x;
+  rays.oy[lane] = ray.origin.y;
+  rays.oz[lane] = ray.origin.z;
+  rays.dx[lane] = ray.direction.x;
+  rays.dy[lane] = ray.direction.y;
+  rays.dz[lane] = ray.direction.z;
+  rays.tMin[lane] = ray.tMin;
+  rays.tMax[lane] = ray.tMax;
+}
@@ -0,0 +1,195 @@
+// Built with AVX2 + FMA enabled; only reached through GetIntersectKernels()
+// after DetectSimdLevel() confirmed support. Keep this file free of inline
+// functions from shared headers so no AVX-encoded copy can leak into code
+// that runs on older CPUs.
+
+#include "../include/SimdIntersect.h"
+
+#include <cmath>
+#include <immintrin.h>
+
+namespace {
+
+constexpr float kDetEpsilon = 1e-12f;
+
+inline int LowestLane(uint32_t mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (int)index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+inline __m256 Dot3(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by,
+                   __m256 bz) {
+  return _mm256_fmadd_ps(ax, bx,
+                         _mm256_fmadd_ps(ay, by, _mm256_mul_ps(az, bz)));
+}
+
+// a * b - c * d
+inline __m256 MulSub(__m256 a, __m256 b, __m256 c, __m256 d) {
+  return _mm256_fmsub_ps(a, b, _mm256_mul_ps(c, d));
+}
+
+inline __m256 HorizontalMin(__m256 v) {
+  v = _mm256_min_ps(v, _mm256_permute2f128_ps(v, v, 1));
+  v = _mm256_min_ps(v, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  return _mm256_min_ps(v, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+struct LaneResult {
+  __m256 valid;
+  __m256 t, u, v;
+};
+
+// Moller-Trumbore on eight lanes; any operand may be a broadcast.
+inline LaneResult IntersectTriangles(__m256 ox, __m256 oy, __m256 oz, __m256 dx,
+                                     __m256 dy, __m256 dz, __m256 tMin,
+                                     __m256 tMax, __m256 v0x, __m256 v0y,
+                                     __m256 v0z, __m256 e1x, __m256 e1y,
+                                     __m256 e1z, __m256 e2x, __m256 e2y,
+                                     __m256 e2z, bool cull) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 eps = _mm256_set1_ps(kDetEpsilon);
+
+  __m256 px = MulSub(dy, e2z, dz, e2y);
+  __m256 py = MulSub(dz, e2x, dx, e2z);
+  __m256 pz = MulSub(dx, e2y, dy, e2x);
+  __m256 det = Dot3(e1x, e1y, e1z, px, py, pz);
+  __m256 absDet = cull ? det : _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+  __m256 valid = _mm256_cmp_ps(absDet, eps, _CMP_GT_OQ);
+  __m256 invDet = _mm256_div_ps(one, det);
+
+  __m256 sx = _mm256_sub_ps(ox, v0x);
+  __m256 sy = _mm256_sub_ps(oy, v0y);
+  __m256 sz = _mm256_sub_ps(oz, v0z);
+  __m256 u = _mm256_mul_ps(Dot3(sx, sy, sz, px, py, pz), invDet);
+
+  __m256 qx = MulSub(sy, e1z, sz, e1y);
+  __m256 qy = MulSub(sz, e1x, sx, e1z);
+  __m256 qz = MulSub(sx, e1y, sy, e1x);
+  __m256 v = _mm256_mul_ps(Dot3(dx, dy, dz, qx, qy, qz), invDet);
+  __m256 t = _mm256_mul_ps(Dot3(e2x, e2y, e2z, qx, qy, qz), invDet);
+
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+  valid = _mm256_and_ps(
+      valid, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, tMin, _CMP_GE_OQ));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, tMax, _CMP_LT_OQ));
+  return {valid, t, u, v};
+}
+
+// Picks the lowest lane holding the smallest valid t.
+inline int ClosestLane(__m256 valid, __m256 t, __m256 u, __m256 v,
+                       SimdHit &hit) {
+  uint32_t validMask = (uint32_t)_mm256_movemask_ps(valid);
+  if (!validMask) {
+    return -1;
+  }
+  __m256 masked = _mm256_blendv_ps(_mm256_set1_ps(INFINITY), t, valid);
+  __m256 closest = HorizontalMin(masked);
+  uint32_t mask = validMask & (uint32_t)_mm256_movemask_ps(
+                                  _mm256_cmp_ps(masked, closest, _CMP_EQ_OQ));
+  int lane = LowestLane(mask);
+
+  alignas(32) float ts[8], us[8], vs[8];
+  _mm256_store_ps(ts, t);
+  _mm256_store_ps(us, u);
+  _mm256_store_ps(vs, v);
+  hit = {ts[lane], us[lane], vs[lane], (uint32_t)lane};
+  return lane;
+}
+
+int Avx2RayTriangles8(const SimdRay &ray, const TriangleBlock8 &tris,
+                      bool cullBackFaces, SimdHit &hit) {
+  LaneResult r = IntersectTriangles(
+      _mm256_set1_ps(ray.origin.x), _mm256_set1_ps(ray.origin.y),
+      _mm256_set1_ps(ray.origin.z), _mm256_set1_ps(ray.direction.x),
+      _mm256_set1_ps(ray.direction.y), _mm256_set1_ps(ray.direction.z),
+      _mm256_set1_ps(ray.tMin), _mm256_set1_ps(ray.tMax),
+      _mm256_load_ps(tris.v0x), _mm256_load_ps(tris.v0y),
+      _mm256_load_ps(tris.v0z), _mm256_load_ps(tris.e1x),
+      _mm256_load_ps(tris.e1y), _mm256_load_ps(tris.e1z),
+      _mm256_load_ps(tris.e2x), _mm256_load_ps(tris.e2y),
+      _mm256_load_ps(tris.e2z), cullBackFaces);
+  return ClosestLane(r.valid, r.t, r.u, r.v, hit);
+}
+
+uint32_t Avx2PacketTriangle(RayPacket8 &rays, const PackedTriangle &tri,
+                            uint32_t primIndex, bool cullBackFaces,
+                            HitPacket8 &hits) {
+  __m256 tMax = _mm256_load_ps(rays.tMax);
+  LaneResult r = IntersectTriangles(
+      _mm256_load_ps(rays.ox), _mm256_load_ps(rays.oy),
+      _mm256_load_ps(rays.oz), _mm256_load_ps(rays.dx),
+      _mm256_load_ps(rays.dy), _mm256_load_ps(rays.dz),
+      _mm256_load_ps(rays.tMin), tMax, _mm256_set1_ps(tri.v0.x),
+      _mm256_set1_ps(tri.v0.y), _mm256_set1_ps(tri.v0.z),
+      _mm256_set1_ps(tri.e1.x), _mm256_set1_ps(tri.e1.y),
+      _mm256_set1_ps(tri.e1.z), _mm256_set1_ps(tri.e2.x),
+      _mm256_set1_ps(tri.e2.y), _mm256_set1_ps(tri.e2.z), cullBackFaces);
+  uint32_t mask = (uint32_t)_mm256_movemask_ps(r.valid);
+  if (!mask) {
+    return 0;
+  }
+  _mm256_store_ps(rays.tMax, _mm256_blendv_ps(tMax, r.t, r.valid));
+  _mm256_store_ps(hits.u, _mm256_blendv_ps(_mm256_load_ps(hits.u), r.u,
+                                           r.valid));
+  _mm256_store_ps(hits.v, _mm256_blendv_ps(_mm256_load_ps(hits.v), r.v,
+                                           r.valid));
+  __m256i prims = _mm256_load_si256((const __m256i *)hits.primIndex);
+  prims = _mm256_blendv_epi8(prims, _mm256_set1_epi32((int)primIndex),
+                             _mm256_castps_si256(r.valid));
+  _mm256_store_si256((__m256i *)hits.primIndex, prims);
+  return mask;
+}
+
+int Avx2RaySpheres8(const SimdRay &ray, const SphereBlock8 &spheres,
+                    SimdHit &hit) {
+  __m256 dx = _mm256_set1_ps(ray.direction.x);
+  __m256 dy = _mm256_set1_ps(ray.direction.y);
+  __m256 dz = _mm256_set1_ps(ray.direction.z);
+  float aScalar = ray.direction.x * ray.direction.x +
+                  ray.direction.y * ray.direction.y +
+                  ray.direction.z * ray.direction.z;
+  __m256 a = _mm256_set1_ps(aScalar);
+  __m256 invA = _mm256_set1_ps(1.0f / aScalar);
+  __m256 tMin = _mm256_set1_ps(ray.tMin);
+
+  __m256 ocx = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x),
+                             _mm256_load_ps(spheres.cx));
+  __m256 ocy = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y),
+                             _mm256_load_ps(spheres.cy));
+  __m256 ocz = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z),
+                             _mm256_load_ps(spheres.cz));
+  __m256 b = Dot3(ocx, ocy, ocz, dx, dy, dz);
+  __m256 s = _mm256_mul_ps(b, invA);
+  __m256 lx = _mm256_fnmadd_ps(dx, s, ocx);
+  __m256 ly = _mm256_fnmadd_ps(dy, s, ocy);
+  __m256 lz = _mm256_fnmadd_ps(dz, s, ocz);
+  __m256 disc = _mm256_mul_ps(
+      a, _mm256_sub_ps(_mm256_load_ps(spheres.radiusSq),
+                       Dot3(lx, ly, lz, lx, ly, lz)));
+  __m256 valid = _mm256_cmp_ps(disc, _mm256_setzero_ps(), _CMP_GE_OQ);
+
+  __m256 root = _mm256_sqrt_ps(_mm256_max_ps(disc, _mm256_setzero_ps()));
+  __m256 negB = _mm256_xor_ps(b, _mm256_set1_ps(-0.0f));
+  __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(negB, root), invA);
+  __m256 t1 = _mm256_mul_ps(_mm256_add_ps(negB, root), invA);
+  __m256 t = _mm256_blendv_ps(t1, t0, _mm256_cmp_ps(t0, tMin, _CMP_GE_OQ));
+  valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, tMin, _CMP_GE_OQ));
+  valid = _mm256_and_ps(
+      valid, _mm256_cmp_ps(t, _mm256_set1_ps(ray.tMax), _CMP_LT_OQ));
+
+  __m256 zero = _mm256_setzero_ps();
+  return ClosestLane(valid, t, zero, zero, hit);
+}
+
+} // namespace
+
+extern const IntersectKernels kAvx2IntersectKernels = {
+    SimdLevel::Avx2, Avx2RayTriangles8, Avx2PacketTriangle, Avx2RaySpheres8};
@@ -0,0 +1,222 @@
+// Built with SSE4.1 enabled; only reached through GetIntersectKernels() after
+// DetectSimdLevel() confirmed support. Each 8-wide block is processed as two
+// 4-wide halves. Keep this file free of inline functions from shared headers
+// so no SSE4.1-encoded copy can leak into code that runs on older CPUs.
+
+#include "../include/SimdIntersect.h"
+
+#include <cmath>
+#include <smmintrin.h>
+
+namespace {
+
+constexpr float kDetEpsilon = 1e-12f;
+
+inline int LowestLane(uint32_t mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (int)index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+inline __m128 Dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by,
+                   __m128 bz) {
+  return _mm_add_ps(_mm_mul_ps(ax, bx),
+                    _mm_add_ps(_mm_mul_ps(ay, by), _mm_mul_ps(az, bz)));
+}
+
+// a * b - c * d
+inline __m128 MulSub(__m128 a, __m128 b, __m128 c, __m128 d) {
+  return _mm_sub_ps(_mm_mul_ps(a, b), _mm_mul_ps(c, d));
+}
+
+inline __m128 HorizontalMin(__m128 v) {
+  v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  return _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+struct LaneResult {
+  __m128 valid;
+  __m128 t, u, v;
+};
+
+// Moller-Trumbore on four lanes; any operand may be a broadcast.
+inline LaneResult IntersectTriangles(__m128 ox, __m128 oy, __m128 oz, __m128 dx,
+                                     __m128 dy, __m128 dz, __m128 tMin,
+                                     __m128 tMax, __m128 v0x, __m128 v0y,
+                                     __m128 v0z, __m128 e1x, __m128 e1y,
+                                     __m128 e1z, __m128 e2x, __m128 e2y,
+                                     __m128 e2z, bool cull) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 eps = _mm_set1_ps(kDetEpsilon);
+
+  __m128 px = MulSub(dy, e2z, dz, e2y);
+  __m128 py = MulSub(dz, e2x, dx, e2z);
+  __m128 pz = MulSub(dx, e2y, dy, e2x);
+  __m128 det = Dot3(e1x, e1y, e1z, px, py, pz);
+  __m128 absDet = cull ? det : _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+  __m128 valid = _mm_cmpgt_ps(absDet, eps);
+  __m128 invDet = _mm_div_ps(one, det);
+
+  __m128 sx = _mm_sub_ps(ox, v0x);
+  __m128 sy = _mm_sub_ps(oy, v0y);
+  __m128 sz = _mm_sub_ps(oz, v0z);
+  __m128 u = _mm_mul_ps(Dot3(sx, sy, sz, px, py, pz), invDet);
+
+  __m128 qx = MulSub(sy, e1z, sz, e1y);
+  __m128 qy = MulSub(sz, e1x, sx, e1z);
+  __m128 qz = MulSub(sx, e1y, sy, e1x);
+  __m128 v = _mm_mul_ps(Dot3(dx, dy, dz, qx, qy, qz), invDet);
+  __m128 t = _mm_mul_ps(Dot3(e2x, e2y, e2z, qx, qy, qz), invDet);
+
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+  valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(t, tMin));
+  valid = _mm_and_ps(valid, _mm_cmplt_ps(t, tMax));
+  return {valid, t, u, v};
+}
+
+// Picks the lowest lane holding the smallest valid t across both halves.
+inline int ClosestLane(const LaneResult (&r)[2], SimdHit &hit) {
+  uint32_t validMask = (uint32_t)_mm_movemask_ps(r[0].valid) |
+                       ((uint32_t)_mm_movemask_ps(r[1].valid) << 4);
+  if (!validMask) {
+    return -1;
+  }
+  const __m128 inf = _mm_set1_ps(INFINITY);
+  __m128 lo = _mm_blendv_ps(inf, r[0].t, r[0].valid);
+  __m128 hi = _mm_blendv_ps(inf, r[1].t, r[1].valid);
+  __m128 closest = HorizontalMin(_mm_min_ps(lo, hi));
+  uint32_t mask = (uint32_t)_mm_movemask_ps(_mm_cmpeq_ps(lo, closest)) |
+                  ((uint32_t)_mm_movemask_ps(_mm_cmpeq_ps(hi, closest)) << 4);
+  int lane = LowestLane(mask & validMask);
+
+  const LaneResult &half = r[lane >> 2];
+  alignas(16) float ts[4], us[4], vs[4];
+  _mm_store_ps(ts, half.t);
+  _mm_store_ps(us, half.u);
+  _mm_store_ps(vs, half.v);
+  hit = {ts[lane & 3], us[lane & 3], vs[lane & 3], (uint32_t)lane};
+  return lane;
+}
+
+int Sse41RayTriangles8(const SimdRay &ray, const TriangleBlock8 &tris,
+                       bool cullBackFaces, SimdHit &hit) {
+  __m128 ox = _mm_set1_ps(ray.origin.x);
+  __m128 oy = _mm_set1_ps(ray.origin.y);
+  __m128 oz = _mm_set1_ps(ray.origin.z);
+  __m128 dx = _mm_set1_ps(ray.direction.x);
+  __m128 dy = _mm_set1_ps(ray.direction.y);
+  __m128 dz = _mm_set1_ps(ray.direction.z);
+  __m128 tMin = _mm_set1_ps(ray.tMin);
+  __m128 tMax = _mm_set1_ps(ray.tMax);
+
+  LaneResult r[2];
+  for (int h = 0; h < 2; ++h) {
+    int o = h * 4;
+    r[h] = IntersectTriangles(
+        ox, oy, oz, dx, dy, dz, tMin, tMax, _mm_load_ps(tris.v0x + o),
+        _mm_load_ps(tris.v0y + o), _mm_load_ps(tris.v0z + o),
+        _mm_load_ps(tris.e1x + o), _mm_load_ps(tris.e1y + o),
+        _mm_load_ps(tris.e1z + o), _mm_load_ps(tris.e2x + o),
+        _mm_load_ps(tris.e2y + o), _mm_load_ps(tris.e2z + o), cullBackFaces);
+  }
+  return ClosestLane(r, hit);
+}
+
+uint32_t Sse41PacketTriangle(RayPacket8 &rays, const PackedTriangle &tri,
+                             uint32_t primIndex, bool cullBackFaces,
+                             HitPacket8 &hits) {
+  __m128 v0x = _mm_set1_ps(tri.v0.x);
+  __m128 v0y = _mm_set1_ps(tri.v0.y);
+  __m128 v0z = _mm_set1_ps(tri.v0.z);
+  __m128 e1x = _mm_set1_ps(tri.e1.x);
+  __m128 e1y = _mm_set1_ps(tri.e1.y);
+  __m128 e1z = _mm_set1_ps(tri.e1.z);
+  __m128 e2x = _mm_set1_ps(tri.e2.x);
+  __m128 e2y = _mm_set1_ps(tri.e2.y);
+  __m128 e2z = _mm_set1_ps(tri.e2.z);
+  __m128i prim = _mm_set1_epi32((int)primIndex);
+
+  uint32_t mask = 0;
+  for (int h = 0; h < 2; ++h) {
+    int o = h * 4;
+    __m128 tMax = _mm_load_ps(rays.tMax + o);
+    LaneResult r = IntersectTriangles(
+        _mm_load_ps(rays.ox + o), _mm_load_ps(rays.oy + o),
+        _mm_load_ps(rays.oz + o), _mm_load_ps(rays.dx + o),
+        _mm_load_ps(rays.dy + o), _mm_load_ps(rays.dz + o),
+        _mm_load_ps(rays.tMin + o), tMax, v0x, v0y, v0z, e1x, e1y, e1z, e2x,
+        e2y, e2z, cullBackFaces);
+    uint32_t halfMask = (uint32_t)_mm_movemask_ps(r.valid);
+    if (!halfMask) {
+      continue;
+    }
+    _mm_store_ps(rays.tMax + o, _mm_blendv_ps(tMax, r.t, r.valid));
+    _mm_store_ps(hits.u + o,
+                 _mm_blendv_ps(_mm_load_ps(hits.u + o), r.u, r.valid));
+    _mm_store_ps(hits.v + o,
+                 _mm_blendv_ps(_mm_load_ps(hits.v + o), r.v, r.valid));
+    __m128i *prims = (__m128i *)(hits.primIndex + o);
+    _mm_store_si128(prims, _mm_blendv_epi8(_mm_load_si128(prims), prim,
+                                           _mm_castps_si128(r.valid)));
+    mask |= halfMask << o;
+  }
+  return mask;
+}
+
+int Sse41RaySpheres8(const SimdRay &ray, const SphereBlock8 &spheres,
+                     SimdHit &hit) {
+  __m128 ox = _mm_set1_ps(ray.origin.x);
+  __m128 oy = _mm_set1_ps(ray.origin.y);
+  __m128 oz = _mm_set1_ps(ray.origin.z);
+  __m128 dx = _mm_set1_ps(ray.direction.x);
+  __m128 dy = _mm_set1_ps(ray.direction.y);
+  __m128 dz = _mm_set1_ps(ray.direction.z);
+  float aScalar = ray.direction.x * ray.direction.x +
+                  ray.direction.y * ray.direction.y +
+                  ray.direction.z * ray.direction.z;
+  __m128 a = _mm_set1_ps(aScalar);
+  __m128 invA = _mm_set1_ps(1.0f / aScalar);
+  __m128 tMin = _mm_set1_ps(ray.tMin);
+  __m128 tMax = _mm_set1_ps(ray.tMax);
+  __m128 zero = _mm_setzero_ps();
+
+  LaneResult r[2];
+  for (int h = 0; h < 2; ++h) {
+    int o = h * 4;
+    __m128 ocx = _mm_sub_ps(ox, _mm_load_ps(spheres.cx + o));
+    __m128 ocy = _mm_sub_ps(oy, _mm_load_ps(spheres.cy + o));
+    __m128 ocz = _mm_sub_ps(oz, _mm_load_ps(spheres.cz + o));
+    __m128 b = Dot3(ocx, ocy, ocz, dx, dy, dz);
+    __m128 s = _mm_mul_ps(b, invA);
+    __m128 lx = _mm_sub_ps(ocx, _mm_mul_ps(dx, s));
+    __m128 ly = _mm_sub_ps(ocy, _mm_mul_ps(dy, s));
+    __m128 lz = _mm_sub_ps(ocz, _mm_mul_ps(dz, s));
+    __m128 disc =
+        _mm_mul_ps(a, _mm_sub_ps(_mm_load_ps(spheres.radiusSq + o),
+                                 Dot3(lx, ly, lz, lx, ly, lz)));
+    __m128 valid = _mm_cmpge_ps(disc, zero);
+
+    __m128 root = _mm_sqrt_ps(_mm_max_ps(disc, zero));
+    __m128 negB = _mm_xor_ps(b, _mm_set1_ps(-0.0f));
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(negB, root), invA);
+    __m128 t1 = _mm_mul_ps(_mm_add_ps(negB, root), invA);
+    __m128 t = _mm_blendv_ps(t1, t0, _mm_cmpge_ps(t0, tMin));
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(t, tMin));
+    valid = _mm_and_ps(valid, _mm_cmplt_ps(t, tMax));
+    r[h] = {valid, t, zero, zero};
+  }
+  return ClosestLane(r, hit);
+}
+
+} // namespace
+
+extern const IntersectKernels kSse41IntersectKernels = {
+    SimdLevel::Sse41, Sse41RayTriangles8, Sse41PacketTriangle,
+    Sse41RaySpheres8};
@@ -0,0 +1,149 @@
+#include "../include/SphereLod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) ||              \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPHERE_LOD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr float kPi = 3.14159265f;
+
+// The projected radius of a sphere of radius r at distance d is
+// focal * r / sqrt(d^2 - r^2). Level L is allowed when that is at most
+// switch_L, which without the square root and the division reads
+//   focal^2 * r^2 <= switch_L^2 * (d^2 - r^2).
+// From inside the sphere the right side is negative and every comparison
+// fails, leaving level 0. Both paths below evaluate it in this order.
+
+#if defined(SPHERE_LOD_SSE2)
+
+inline __m128 Gather(const SceneInstance *instances, size_t i, int row,
+                     int column) {
+  return _mm_setr_ps(instances[i].transform.m[row][column],
+                     instances[i + 1].transform.m[row][column],
+                     instances[i + 2].transform.m[row][column],
+                     instances[i + 3].transform.m[row][column]);
+}
+
+#endif
+
+} // namespace
+
+float SphereLodError(const SphereLodLevel &level) {
+  return 1.0f - std::cos(kPi / level.slices) *
+                    std::cos(kPi / (2.0f * level.stacks));
+}
+
+SphereLodView MakeSphereLodView(Float3 cameraPosition, float fovY,
+                                uint32_t viewportHeight) {
+  SphereLodView view;
+  view.cameraPosition = cameraPosition;
+  view.focalPixels = 0.5f * (float)viewportHeight / std::tan(0.5f * fovY);
+  return view;
+}
+
+SphereLodSelector::SphereLodSelector(const SphereLodSettings &settings) {
+  SetSettings(settings);
+}
+
+void SphereLodSelector::SetSettings(const SphereLodSettings &settings) {
+  m_settings = settings;
+  for (uint32_t level = 1; level < kSphereLodCount; ++level) {
+    float pixels = SwitchPixels(level);
+    float band = pixels * (1.0f - settings.hysteresis);
+    m_switchSq[level - 1] = pixels * pixels;
+    m_switchBandSq[level - 1] = band * band;
+  }
+}
+
+float SphereLodSelector::SwitchPixels(uint32_t level) const {
+  return m_settings.errorPixels / SphereLodError(kSphereLodLevels[level]);
+}
+
+uint8_t SphereLodSelector::SelectOne(const SceneInstance &instance,
+                                     const SphereLodView &view,
+                                     uint8_t previous) const {
+  const Float3x4 &t = instance.transform;
+  float dx = t.m[0][3] - view.cameraPosition.x;
+  float dy = t.m[1][3] - view.cameraPosition.y;
+  float dz = t.m[2][3] - view.cameraPosition.z;
+  float distanceSq = (dx * dx + dy * dy) + dz * dz;
+  float scaleSq =
+      (t.m[0][0] * t.m[0][0] + t.m[1][0] * t.m[1][0]) + t.m[2][0] * t.m[2][0];
+  float radiusSq = scaleSq * (kSphereRadius * kSphereRadius);
+  float projected = radiusSq * (view.focalPixels * view.focalPixels);
+  float depth = distanceSq - radiusSq;
+
+  // Coarsest level allowed, and the finest one the ball may stay at.
+  float finest = 0.0f, coarsest = 0.0f;
+  for (uint32_t s = 0; s < kSphereLodCount - 1; ++s) {
+    finest += projected <= m_switchBandSq[s] * depth ? 1.0f : 0.0f;
+    coarsest += projected <= m_switchSq[s] * depth ? 1.0f : 0.0f;
+  }
+  float level = std::min(std::max((float)previous, finest), coarsest);
+  return (uint8_t)level;
+}
+
+void SphereLodSelector::Select(const SceneInstance *instances, size_t count,
+                               const SphereLodView &view,
+                               uint8_t *levels) const {
+  size_t i = 0;
+#if defined(SPHERE_LOD_SSE2)
+  const __m128 camX = _mm_set1_ps(view.cameraPosition.x);
+  const __m128 camY = _mm_set1_ps(view.cameraPosition.y);
+  const __m128 camZ = _mm_set1_ps(view.cameraPosition.z);
+  const __m128 meshRadiusSq = _mm_set1_ps(kSphereRadius * kSphereRadius);
+  const __m128 focalSq = _mm_set1_ps(view.focalPixels * view.focalPixels);
+  const __m128 one = _mm_set1_ps(1.0f);
+  for (; i + 4 <= count; i += 4) {
+    __m128 dx = _mm_sub_ps(Gather(instances, i, 0, 3), camX);
+    __m128 dy = _mm_sub_ps(Gather(instances, i, 1, 3), camY);
+    __m128 dz = _mm_sub_ps(Gather(instances, i, 2, 3), camZ);
+    __m128 distanceSq = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+        _mm_mul_ps(dz, dz));
+    __m128 sx = Gather(instances, i, 0, 0);
+    __m128 sy = Gather(instances, i, 1, 0);
+    __m128 sz = Gather(instances, i, 2, 0);
+    __m128 scaleSq = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy)),
+        _mm_mul_ps(sz, sz));
+    __m128 radiusSq = _mm_mul_ps(scaleSq, meshRadiusSq);
+    __m128 projected = _mm_mul_ps(radiusSq, focalSq);
+    __m128 depth = _mm_sub_ps(distanceSq, radiusSq);
+
+    __m128 finest = _mm_setzero_ps(), coarsest = _mm_setzero_ps();
+    for (uint32_t s = 0; s < kSphereLodCount - 1; ++s) {
+      __m128 band = _mm_mul_ps(_mm_set1_ps(m_switchBandSq[s]), depth);
+      __m128 allowed = _mm_mul_ps(_mm_set1_ps(m_switchSq[s]), depth);
+      finest =
+          _mm_add_ps(finest, _mm_and_ps(_mm_cmple_ps(projected, band), one));
+      coarsest = _mm_add_ps(coarsest,
+                            _mm_and_ps(_mm_cmple_ps(projected, allowed), one));
+    }
+
+    int32_t packedPrevious;
+    std::memcpy(&packedPrevious, levels + i, 4);
+    __m128i previous = _mm_unpacklo_epi16(
+        _mm_unpacklo_epi8(_mm_cvtsi32_si128(packedPrevious),
+                          _mm_setzero_si128()),
+        _mm_setzero_si128());
+    __m128 level = _mm_min_ps(
+        _mm_max_ps(_mm_cvtepi32_ps(previous), finest), coarsest);
+    __m128i level32 = _mm_cvttps_epi32(level);
+    __m128i level8 = _mm_packus_epi16(
+        _mm_packs_epi32(level32, _mm_setzero_si128()), _mm_setzero_si128());
+    int32_t packed = _mm_cvtsi128_si32(level8);
+    std::memcpy(levels + i, &packed, 4);
+  }
+#endif
+  for (; i < count; ++i) {
+    levels[i] = SelectOne(instances[i], view, levels[i]);
+  }
+}
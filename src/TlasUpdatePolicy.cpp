@@ -0,0 +1,112 @@
+#include "../include/TlasUpdatePolicy.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+bool SameTransform(const Float3x4 &a, const Float3x4 &b) {
+  // Bitwise: any change the GPU would see counts, including -0.0 vs 0.0.
+  return std::memcmp(a.m, b.m, sizeof(a.m)) == 0;
+}
+
+} // namespace
+
+const char *TlasBuildActionName(TlasBuildAction action) {
+  switch (action) {
+  case TlasBuildAction::None:
+    return "none";
+  case TlasBuildAction::Refit:
+    return "refit";
+  case TlasBuildAction::Rebuild:
+    return "rebuild";
+  }
+  return "?";
+}
+
+TlasUpdateTracker::TlasUpdateTracker(const TlasUpdateSettings &settings)
+    : m_settings(settings) {}
+
+void TlasUpdateTracker::Invalidate() { m_valid = false; }
+
+void TlasUpdateTracker::MarkDirty(uint32_t index) {
+  if (index >= m_marked.size()) {
+    m_marked.resize(index + 1, 0);
+  }
+  m_marked[index] = 1;
+}
+
+TlasBuildAction
+TlasUpdateTracker::Plan(const std::vector<SceneInstance> &instances,
+                        const Aabb *worldBounds) {
+  m_dirty.clear();
+  size_t count = instances.size();
+
+  // Updates require the same instance count, and a different bottom level
+  // changes the structure too much to refit.
+  bool rebuild = !m_valid || count != m_instances.size();
+  if (rebuild) {
+    for (size_t i = 0; i < count; ++i) {
+      m_dirty.push_back((uint32_t)i);
+    }
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      const SceneInstance &now = instances[i];
+      const SceneInstance &was = m_instances[i];
+      bool marked = i < m_marked.size() && m_marked[i];
+      if (now.mesh != was.mesh) {
+        rebuild = true;
+      } else if (!marked && now.instanceID == was.instanceID &&
+                 SameTransform(now.transform, was.transform)) {
+        continue;
+      }
+      m_dirty.push_back((uint32_t)i);
+    }
+  }
+  std::fill(m_marked.begin(), m_marked.end(), (uint8_t)0);
+  m_stats.dirtyCount = (uint32_t)m_dirty.size();
+
+  TlasBuildAction action = TlasBuildAction::Rebuild;
+  if (!rebuild) {
+    if (m_dirty.empty()) {
+      action = TlasBuildAction::None;
+    } else {
+      float sah = m_estimate.Empty() ? 0.0f : m_estimate.Refit(worldBounds);
+      float ratio = m_buildSahCost > 0.0f ? sah / m_buildSahCost : 1.0f;
+      bool tooManyRefits = m_settings.maxRefits != 0 &&
+                           m_stats.refitsSinceBuild >= m_settings.maxRefits;
+      if (ratio <= m_settings.rebuildSahRatio && !tooManyRefits) {
+        action = TlasBuildAction::Refit;
+        m_stats.sahRatio = ratio;
+      }
+    }
+  }
+
+  switch (action) {
+  case TlasBuildAction::None:
+    ++m_stats.skipCount;
+    break;
+  case TlasBuildAction::Refit:
+    ++m_stats.refitsSinceBuild;
+    ++m_stats.refitCount;
+    break;
+  case TlasBuildAction::Rebuild:
+    m_estimate.Build(worldBounds, count);
+    m_buildSahCost = m_estimate.Stats().sahCost;
+    m_stats.sahRatio = 1.0f;
+    m_stats.refitsSinceBuild = 0;
+    ++m_stats.rebuildCount;
+    m_valid = true;
+    break;
+  }
+  m_stats.lastAction = action;
+
+  if (rebuild) {
+    m_instances = instances;
+  } else {
+    for (uint32_t i : m_dirty) {
+      m_instances[i] = instances[i];
+    }
+  }
+  return action;
+}
@@ -0,0 +1,285 @@
+#include "../include/TlsfAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+constexpr uint32_t kNone = TlsfAllocator::kInvalidHandle;
+
+inline uint32_t HighestBit(uint64_t mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse64(&index, mask);
+  return (uint32_t)index;
+#else
+  return 63u - (uint32_t)__builtin_clzll(mask);
+#endif
+}
+
+inline uint32_t LowestBit(uint64_t mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, mask);
+  return (uint32_t)index;
+#else
+  return (uint32_t)__builtin_ctzll(mask);
+#endif
+}
+
+inline uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+inline bool IsPowerOfTwo(uint64_t value) {
+  return value != 0 && (value & (value - 1)) == 0;
+}
+
+} // namespace
+
+TlsfAllocator::TlsfAllocator(uint64_t capacity, uint64_t granularity) {
+  Reset(capacity, granularity);
+}
+
+void TlsfAllocator::Reset(uint64_t capacity, uint64_t granularity) {
+  if (!IsPowerOfTwo(granularity)) {
+    throw std::runtime_error(
+        "TlsfAllocator: granularity must be a power of two");
+  }
+  m_granularity = granularity;
+  m_granularityLog2 = HighestBit(granularity);
+  m_capacity = capacity & ~(granularity - 1);
+  m_usedBytes = 0;
+  m_allocationCount = 0;
+  m_freeBlockCount = 0;
+  m_firstLevelMap = 0;
+  std::fill(std::begin(m_secondLevelMap), std::end(m_secondLevelMap), 0u);
+  for (auto &bins : m_bins) {
+    std::fill(std::begin(bins), std::end(bins), kNone);
+  }
+  m_blocks.clear();
+  m_unusedBlocks.clear();
+
+  if (m_capacity != 0) {
+    uint32_t block = NewBlock();
+    m_blocks[block] = {0, m_capacity, kNone, kNone, kNone, kNone, true};
+    InsertFree(block);
+  }
+}
+
+void TlsfAllocator::Mapping(uint64_t units, uint32_t &fl, uint32_t &sl) {
+  if (units < kSecondLevelCount) {
+    fl = 0;
+    sl = (uint32_t)units;
+  } else {
+    uint32_t msb = HighestBit(units);
+    fl = msb - kSecondLevelLog2 + 1;
+    sl = (uint32_t)(units >> (msb - kSecondLevelLog2)) - kSecondLevelCount;
+  }
+}
+
+uint32_t TlsfAllocator::FindFreeBlock(uint64_t size,
+                                      uint64_t alignment) const {
+  // Worst case the block starts one granule past an aligned offset.
+  uint64_t units = (size + alignment - m_granularity) >> m_granularityLog2;
+
+  // Round up to the next bin boundary so any block in the bin found is large
+  // enough without walking its list.
+  uint64_t rounded = units;
+  if (units >= kSecondLevelCount) {
+    rounded += (1ull << (HighestBit(units) - kSecondLevelLog2)) - 1;
+  }
+  uint32_t fl, sl;
+  Mapping(rounded, fl, sl);
+  uint32_t slMap = m_secondLevelMap[fl] & (~0u << sl);
+  if (slMap == 0) {
+    uint64_t flMap =
+        fl + 1 < kFirstLevelCount ? m_firstLevelMap & (~0ull << (fl + 1)) : 0;
+    if (flMap != 0) {
+      fl = LowestBit(flMap);
+      slMap = m_secondLevelMap[fl];
+    }
+  }
+  if (slMap != 0) {
+    return m_bins[fl][LowestBit(slMap)];
+  }
+
+  // The rounding skips the bin the request itself falls into, which can
+  // still hold a block that fits (e.g. the whole range when it is empty).
+  Mapping(units, fl, sl);
+  for (uint32_t b = m_bins[fl][sl]; b != kNone; b = m_blocks[b].nextFree) {
+    const Block &block = m_blocks[b];
+    if (AlignUp(block.offset, alignment) + size <= block.offset + block.size) {
+      return b;
+    }
+  }
+  return kNone;
+}
+
+void TlsfAllocator::InsertFree(uint32_t block) {
+  Block &b = m_blocks[block];
+  uint32_t fl, sl;
+  Mapping(b.size >> m_granularityLog2, fl, sl);
+  uint32_t head = m_bins[fl][sl];
+  b.free = true;
+  b.prevFree = kNone;
+  b.nextFree = head;
+  if (head != kNone) {
+    m_blocks[head].prevFree = block;
+  }
+  m_bins[fl][sl] = block;
+  m_firstLevelMap |= 1ull << fl;
+  m_secondLevelMap[fl] |= 1u << sl;
+  ++m_freeBlockCount;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t block) {
+  Block &b = m_blocks[block];
+  uint32_t fl, sl;
+  Mapping(b.size >> m_granularityLog2, fl, sl);
+  if (b.prevFree != kNone) {
+    m_blocks[b.prevFree].nextFree = b.nextFree;
+  } else {
+    m_bins[fl][sl] = b.nextFree;
+    if (b.nextFree == kNone) {
+      m_secondLevelMap[fl] &= ~(1u << sl);
+      if (m_secondLevelMap[fl] == 0) {
+        m_firstLevelMap &= ~(1ull << fl);
+      }
+    }
+  }
+  if (b.nextFree != kNone) {
+    m_blocks[b.nextFree].prevFree = b.prevFree;
+  }
+  b.free = false;
+  b.prevFree = kNone;
+  b.nextFree = kNone;
+  --m_freeBlockCount;
+}
+
+uint32_t TlsfAllocator::NewBlock() {
+  if (!m_unusedBlocks.empty()) {
+    uint32_t block = m_unusedBlocks.back();
+    m_unusedBlocks.pop_back();
+    return block;
+  }
+  m_blocks.push_back({});
+  return (uint32_t)m_blocks.size() - 1;
+}
+
+void TlsfAllocator::ReleaseBlock(uint32_t block) {
+  // Marked free so a stale handle passed to Free() is rejected.
+  m_blocks[block] = {0, 0, kNone, kNone, kNone, kNone, true};
+  m_unusedBlocks.push_back(block);
+}
+
+uint32_t TlsfAllocator::SplitFront(uint32_t block, uint64_t size) {
+  uint32_t front = NewBlock(); // may reallocate m_blocks
+  Block &b = m_blocks[block];
+  m_blocks[front] = {b.offset, size, b.prevPhysical, block, kNone, kNone,
+                     false};
+  if (b.prevPhysical != kNone) {
+    m_blocks[b.prevPhysical].nextPhysical = front;
+  }
+  b.prevPhysical = front;
+  b.offset += size;
+  b.size -= size;
+  return front;
+}
+
+TlsfAllocator::Allocation TlsfAllocator::Allocate(uint64_t size,
+                                                  uint64_t alignment) {
+  if (!IsPowerOfTwo(alignment)) {
+    throw std::runtime_error("TlsfAllocator: alignment must be a power of two");
+  }
+  if (size > m_capacity) {
+    return {};
+  }
+  size = std::max(AlignUp(size, m_granularity), m_granularity);
+  alignment = std::max(alignment, m_granularity);
+
+  uint32_t block = FindFreeBlock(size, alignment);
+  if (block == kNone) {
+    return {};
+  }
+  RemoveFree(block);
+
+  // The free neighbours of a free block are always merged into it, so the
+  // pieces split off here never need merging themselves.
+  uint64_t padding = AlignUp(m_blocks[block].offset, alignment) -
+                     m_blocks[block].offset;
+  if (padding != 0) {
+    InsertFree(SplitFront(block, padding));
+  }
+  if (m_blocks[block].size > size) {
+    uint32_t used = SplitFront(block, size);
+    InsertFree(block);
+    block = used;
+  }
+
+  m_usedBytes += size;
+  ++m_allocationCount;
+  return {m_blocks[block].offset, size, block};
+}
+
+void TlsfAllocator::Free(uint32_t handle) {
+  if (handle >= m_blocks.size() || m_blocks[handle].free) {
+    throw std::runtime_error("TlsfAllocator: handle is not allocated");
+  }
+  m_usedBytes -= m_blocks[handle].size;
+  --m_allocationCount;
+
+  uint32_t prev = m_blocks[handle].prevPhysical;
+  if (prev != kNone && m_blocks[prev].free) {
+    RemoveFree(prev);
+    Block &p = m_blocks[prev];
+    const Block &b = m_blocks[handle];
+    p.size += b.size;
+    p.nextPhysical = b.nextPhysical;
+    if (b.nextPhysical != kNone) {
+      m_blocks[b.nextPhysical].prevPhysical = prev;
+    }
+    ReleaseBlock(handle);
+    handle = prev;
+  }
+
+  uint32_t next = m_blocks[handle].nextPhysical;
+  if (next != kNone && m_blocks[next].free) {
+    RemoveFree(next);
+    Block &b = m_blocks[handle];
+    const Block &n = m_blocks[next];
+    b.size += n.size;
+    b.nextPhysical = n.nextPhysical;
+    if (n.nextPhysical != kNone) {
+      m_blocks[n.nextPhysical].prevPhysical = handle;
+    }
+    ReleaseBlock(next);
+  }
+  InsertFree(handle);
+}
+
+TlsfStats TlsfAllocator::Stats() const {
+  TlsfStats stats;
+  stats.capacity = m_capacity;
+  stats.usedBytes = m_usedBytes;
+  stats.freeBytes = m_capacity - m_usedBytes;
+  stats.allocationCount = m_allocationCount;
+  stats.freeBlockCount = m_freeBlockCount;
+  if (m_firstLevelMap != 0) {
+    // The largest block sits in the highest non-empty bin, whose list is
+    // short in practice.
+    uint32_t fl = HighestBit(m_firstLevelMap);
+    uint32_t sl = HighestBit(m_secondLevelMap[fl]);
+    for (uint32_t b = m_bins[fl][sl]; b != kNone; b = m_blocks[b].nextFree) {
+      stats.largestFreeBlock =
+          std::max(stats.largestFreeBlock, m_blocks[b].size);
+    }
+    stats.fragmentation =
+        1.0f - (float)((double)stats.largestFreeBlock / stats.freeBytes);
+  }
+  return stats;
+}
@@ -0,0 +1,61 @@
+#include "../include/UploadRing.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+UploadRing::UploadRing(uint64_t capacity) { Reset(capacity); }
+
+void UploadRing::Reset(uint64_t capacity) {
+  m_capacity = capacity;
+  m_head = 0;
+  m_tail = 0;
+  m_offset = 0;
+  m_frames.clear();
+  m_stats = UploadRingStats();
+}
+
+uint64_t UploadRing::Allocate(uint64_t size, uint64_t alignment) {
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+    throw std::runtime_error("UploadRing: alignment must be a power of two");
+  }
+  if (size > m_capacity || m_capacity == 0) {
+    ++m_stats.failures;
+    return kInvalidOffset;
+  }
+
+  uint64_t aligned = (m_offset + alignment - 1) & ~(alignment - 1);
+  uint64_t padding = aligned - m_offset;
+  bool wrap = aligned >= m_capacity || aligned + size > m_capacity;
+  if (wrap) {
+    // Skipping the end of the buffer is free when nothing is live.
+    padding = m_head == m_tail ? 0 : m_capacity - m_offset;
+    aligned = 0;
+  }
+  if (m_head + padding + size - m_tail > m_capacity) {
+    ++m_stats.failures;
+    return kInvalidOffset;
+  }
+
+  m_head += padding + size;
+  m_offset = aligned + size;
+  ++m_stats.allocations;
+  m_stats.bytesAllocated += size;
+  m_stats.paddingBytes += padding;
+  m_stats.wraps += wrap;
+  m_stats.peakUsed = std::max(m_stats.peakUsed, m_head - m_tail);
+  return aligned;
+}
+
+void UploadRing::FinishFrame(uint64_t fenceValue) {
+  if (!m_frames.empty() && fenceValue < m_frames.back().fence) {
+    throw std::runtime_error("UploadRing: fence values must not decrease");
+  }
+  m_frames.push_back({fenceValue, m_head});
+}
+
+void UploadRing::Retire(uint64_t completedValue) {
+  while (!m_frames.empty() && m_frames.front().fence <= completedValue) {
+    m_tail = m_frames.front().end;
+    m_frames.pop_front();
+  }
+}
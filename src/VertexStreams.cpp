@@ -0,0 +1,233 @@
+#include "../include/VertexStreams.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) ||              \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VERTEX_STREAMS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr float kSnormMax = 32767.0f;
+
+// The scalar and SSE2 paths below use the same operations in the same
+// order (division rather than reciprocal estimates, round to nearest even,
+// copysign rather than comparisons), so both produce identical bits.
+
+inline int32_t ToSnorm16(float v) {
+  v = std::min(std::max(v, -1.0f), 1.0f);
+  return (int32_t)std::nearbyint(v * kSnormMax);
+}
+
+inline float LoadCoord(const Float3 *base, size_t stride, size_t i, int c) {
+  const float *p = reinterpret_cast<const float *>(
+      reinterpret_cast<const uint8_t *>(base) + i * stride);
+  return p[c];
+}
+
+#if defined(VERTEX_STREAMS_SSE2)
+
+inline __m128 SignMask() {
+  return _mm_castsi128_ps(_mm_set1_epi32(INT32_MIN));
+}
+inline __m128 Abs(__m128 v) { return _mm_andnot_ps(SignMask(), v); }
+// copysign(magnitude, sign) for magnitude >= 0.
+inline __m128 WithSignOf(__m128 magnitude, __m128 sign) {
+  return _mm_or_ps(magnitude, _mm_and_ps(sign, SignMask()));
+}
+inline __m128 Select(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Four x, y or z coordinates of consecutive strided vectors.
+inline __m128 Gather(const Float3 *base, size_t stride, size_t i, int c) {
+  return _mm_setr_ps(LoadCoord(base, stride, i, c),
+                     LoadCoord(base, stride, i + 1, c),
+                     LoadCoord(base, stride, i + 2, c),
+                     LoadCoord(base, stride, i + 3, c));
+}
+
+inline __m128i ToSnorm16(__m128 v) {
+  v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+  return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(kSnormMax)));
+}
+
+#endif
+
+} // namespace
+
+uint32_t EncodeOctahedral(Float3 n) {
+  float l1 = (std::fabs(n.x) + std::fabs(n.y)) + std::fabs(n.z);
+  float inv = l1 > 0.0f ? 1.0f / l1 : 0.0f;
+  float px = n.x * inv;
+  float py = n.y * inv;
+  if (n.z < 0.0f) {
+    // Fold the lower hemisphere over the diagonals.
+    float fx = (1.0f - std::fabs(py)) * std::copysign(1.0f, px);
+    float fy = (1.0f - std::fabs(px)) * std::copysign(1.0f, py);
+    px = fx;
+    py = fy;
+  }
+  return ((uint32_t)ToSnorm16(px) & 0xFFFFu) | ((uint32_t)ToSnorm16(py) << 16);
+}
+
+Float3 DecodeOctahedral(uint32_t packed) {
+  float x = std::max((float)(int16_t)(packed & 0xFFFFu) / kSnormMax, -1.0f);
+  float y = std::max((float)(int16_t)(packed >> 16) / kSnormMax, -1.0f);
+  float z = (1.0f - std::fabs(x)) - std::fabs(y);
+  float t = std::max(-z, 0.0f);
+  x -= std::copysign(t, x);
+  y -= std::copysign(t, y);
+  float inv = 1.0f / std::sqrt((x * x + y * y) + z * z);
+  return {x * inv, y * inv, z * inv};
+}
+
+float Snorm16Scale(const Float3 *positions, size_t stride, size_t count) {
+  float scale = 0.0f;
+  for (size_t i = 0; i < count; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      scale = std::max(scale, std::fabs(LoadCoord(positions, stride, i, c)));
+    }
+  }
+  return scale > 0.0f ? scale : 1.0f;
+}
+
+void EncodeOctahedralNormals(const Float3 *normals, size_t stride,
+                             size_t count, uint32_t *dst) {
+  size_t i = 0;
+#if defined(VERTEX_STREAMS_SSE2)
+  const __m128 one = _mm_set1_ps(1.0f);
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = Gather(normals, stride, i, 0);
+    __m128 y = Gather(normals, stride, i, 1);
+    __m128 z = Gather(normals, stride, i, 2);
+    __m128 l1 = _mm_add_ps(_mm_add_ps(Abs(x), Abs(y)), Abs(z));
+    __m128 inv = _mm_and_ps(_mm_cmpgt_ps(l1, _mm_setzero_ps()),
+                            _mm_div_ps(one, l1));
+    __m128 px = _mm_mul_ps(x, inv);
+    __m128 py = _mm_mul_ps(y, inv);
+    __m128 fx = _mm_mul_ps(_mm_sub_ps(one, Abs(py)), WithSignOf(one, px));
+    __m128 fy = _mm_mul_ps(_mm_sub_ps(one, Abs(px)), WithSignOf(one, py));
+    __m128 lower = _mm_cmplt_ps(z, _mm_setzero_ps());
+    px = Select(lower, fx, px);
+    py = Select(lower, fy, py);
+    __m128i packed = _mm_or_si128(
+        _mm_and_si128(ToSnorm16(px), _mm_set1_epi32(0xFFFF)),
+        _mm_slli_epi32(ToSnorm16(py), 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), packed);
+  }
+#endif
+  for (; i < count; ++i) {
+    dst[i] = EncodeOctahedral({LoadCoord(normals, stride, i, 0),
+                               LoadCoord(normals, stride, i, 1),
+                               LoadCoord(normals, stride, i, 2)});
+  }
+}
+
+void DecodeOctahedralNormals(const uint32_t *src, size_t count, Float3 *dst) {
+  size_t i = 0;
+#if defined(VERTEX_STREAMS_SSE2)
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 snormMax = _mm_set1_ps(kSnormMax);
+  for (; i + 4 <= count; i += 4) {
+    __m128i packed =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i sx = _mm_srai_epi32(_mm_slli_epi32(packed, 16), 16);
+    __m128i sy = _mm_srai_epi32(packed, 16);
+    __m128 x = _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(sx), snormMax),
+                          _mm_set1_ps(-1.0f));
+    __m128 y = _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(sy), snormMax),
+                          _mm_set1_ps(-1.0f));
+    __m128 z = _mm_sub_ps(_mm_sub_ps(one, Abs(x)), Abs(y));
+    __m128 t = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), z), _mm_setzero_ps());
+    x = _mm_sub_ps(x, WithSignOf(t, x));
+    y = _mm_sub_ps(y, WithSignOf(t, y));
+    __m128 lengthSq = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+    __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+    alignas(16) float out[3][4];
+    _mm_store_ps(out[0], _mm_mul_ps(x, inv));
+    _mm_store_ps(out[1], _mm_mul_ps(y, inv));
+    _mm_store_ps(out[2], _mm_mul_ps(z, inv));
+    for (int l = 0; l < 4; ++l) {
+      dst[i + l] = {out[0][l], out[1][l], out[2][l]};
+    }
+  }
+#endif
+  for (; i < count; ++i) {
+    dst[i] = DecodeOctahedral(src[i]);
+  }
+}
+
+void EncodePositionsSnorm16(const Float3 *positions, size_t stride,
+                            size_t count, float scale, int16_t *dst) {
+  const float invScale = 1.0f / scale;
+  size_t i = 0;
+#if defined(VERTEX_STREAMS_SSE2)
+  const __m128 inv = _mm_set1_ps(invScale);
+  for (; i + 4 <= count; i += 4) {
+    __m128i qx = ToSnorm16(_mm_mul_ps(Gather(positions, stride, i, 0), inv));
+    __m128i qy = ToSnorm16(_mm_mul_ps(Gather(positions, stride, i, 1), inv));
+    __m128i qz = ToSnorm16(_mm_mul_ps(Gather(positions, stride, i, 2), inv));
+    // x0..x3 y0..y3 and z0..z3 0..0, interleaved into x y z 0 per vertex.
+    __m128i xy = _mm_packs_epi32(qx, qy);
+    __m128i z0 = _mm_packs_epi32(qz, _mm_setzero_si128());
+    __m128i xz = _mm_unpacklo_epi16(xy, z0);
+    __m128i y0 = _mm_unpackhi_epi16(xy, z0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i),
+                     _mm_unpacklo_epi16(xz, y0));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i + 8),
+                     _mm_unpackhi_epi16(xz, y0));
+  }
+#endif
+  for (; i < count; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      dst[4 * i + c] =
+          (int16_t)ToSnorm16(LoadCoord(positions, stride, i, c) * invScale);
+    }
+    dst[4 * i + 3] = 0;
+  }
+}
+
+void DecodePositionsSnorm16(const int16_t *src, size_t count, float scale,
+                            Float3 *dst) {
+  const float step = scale / kSnormMax;
+  size_t i = 0;
+#if defined(VERTEX_STREAMS_SSE2)
+  const __m128 stepV = _mm_set1_ps(step);
+  for (; i + 2 <= count; i += 2) {
+    __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4 * i));
+    __m128 a = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(q, q), 16));
+    __m128 b = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(q, q), 16));
+    alignas(16) float out[8];
+    _mm_store_ps(out, _mm_mul_ps(a, stepV));
+    _mm_store_ps(out + 4, _mm_mul_ps(b, stepV));
+    dst[i] = {out[0], out[1], out[2]};
+    dst[i + 1] = {out[4], out[5], out[6]};
+  }
+#endif
+  for (; i < count; ++i) {
+    dst[i] = {src[4 * i] * step, src[4 * i + 1] * step, src[4 * i + 2] * step};
+  }
+}
+
+void BuildVertexStreams(const std::vector<MeshVertex> &vertices,
+                        VertexStreams &streams) {
+  streams.positions.resize(vertices.size());
+  streams.attributes.resize(vertices.size());
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    streams.positions[i] = vertices[i].position;
+  }
+  if (!vertices.empty()) {
+    static_assert(sizeof(VertexAttributes) == sizeof(uint32_t),
+                  "one packed normal per vertex");
+    EncodeOctahedralNormals(&vertices[0].normal, sizeof(MeshVertex),
+                            vertices.size(),
+                            &streams.attributes[0].normal);
+  }
+}
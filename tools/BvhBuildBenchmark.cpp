@@ -0,0 +1,161 @@
+// Measures binned-SAH BVH build time and quality for the renderer's meshes.
+//
+// Sweeps CreateSphere-style tessellations from the 32x32 sphere the renderer
+// uses up to multi-million-triangle meshes, optionally followed by Wavefront
+// OBJ files passed on the command line, and prints build time (single thread
+// and all threads), SAH cost, depth and node counts.
+
+#include "Bvh.h"
+#include "MeshGenerator.h"
+#include "SceneInstances.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct BenchMesh {
+  std::string name;
+  std::vector<MeshVertex> vertices;
+  std::vector<uint32_t> indices;
+};
+
+// Minimal OBJ reader: positions and (triangulated) faces only.
+bool LoadObj(const char *path, BenchMesh &mesh) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+  mesh.name = path;
+  std::string line;
+  std::vector<uint32_t> face;
+  while (std::getline(file, line)) {
+    if (line.size() < 2) {
+      continue;
+    }
+    if (line[0] == 'v' && line[1] == ' ') {
+      MeshVertex v = {};
+      std::sscanf(line.c_str() + 2, "%f %f %f", &v.position.x, &v.position.y,
+                  &v.position.z);
+      mesh.vertices.push_back(v);
+    } else if (line[0] == 'f' && line[1] == ' ') {
+      face.clear();
+      std::istringstream tokens(line.substr(2));
+      std::string token;
+      while (tokens >> token) {
+        long index = std::strtol(token.c_str(), nullptr, 10);
+        if (index < 0) {
+          index += (long)mesh.vertices.size() + 1;
+        }
+        face.push_back((uint32_t)(index - 1));
+      }
+      for (size_t i = 2; i < face.size(); ++i) {
+        mesh.indices.push_back(face[0]);
+        mesh.indices.push_back(face[i - 1]);
+        mesh.indices.push_back(face[i]);
+      }
+    }
+  }
+  return !mesh.indices.empty();
+}
+
+BenchMesh MakeSphere(int slices, int stacks) {
+  BenchMesh mesh;
+  mesh.name = "sphere " + std::to_string(slices) + "x" + std::to_string(stacks);
+  GenerateSphere(mesh.vertices, mesh.indices, kSphereRadius, slices, stacks);
+  return mesh;
+}
+
+double BestBuildMs(Bvh &bvh, const BenchMesh &mesh,
+                   const BvhBuildSettings &settings, int repeats) {
+  double best = 1e30;
+  for (int r = 0; r < repeats; ++r) {
+    bvh.Build(mesh.vertices, mesh.indices, settings);
+    best = std::min(best, bvh.Stats().buildMs);
+  }
+  return best;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  BvhBuildSettings settings;
+  int repeats = 3;
+  bool large = true;
+  std::vector<const char *> objFiles;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--bins") && i + 1 < argc) {
+      settings.binCount = (uint32_t)std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--leaf") && i + 1 < argc) {
+      settings.maxLeafSize = (uint32_t)std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+      settings.threadCount = (unsigned)std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--repeats") && i + 1 < argc) {
+      repeats = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--small")) {
+      large = false;
+    } else if (argv[i][0] != '-') {
+      objFiles.push_back(argv[i]);
+    } else {
+      std::printf("Usage: BvhBuildBenchmark [--bins N] [--leaf N] "
+                  "[--threads N] [--repeats N] [--small] [mesh.obj ...]\n");
+      return 1;
+    }
+  }
+
+  std::vector<std::pair<int, int>> tessellations = {
+      {kSphereSlices, kSphereStacks}, {128, 128}, {512, 256}};
+  if (large) {
+    tessellations.push_back({1024, 512});
+    tessellations.push_back({2048, 1024});
+  }
+
+  std::vector<BenchMesh> meshes;
+  for (auto [slices, stacks] : tessellations) {
+    meshes.push_back(MakeSphere(slices, stacks));
+  }
+  for (const char *path : objFiles) {
+    BenchMesh mesh;
+    if (!LoadObj(path, mesh)) {
+      std::fprintf(stderr, "Failed to load %s\n", path);
+      return 1;
+    }
+    meshes.push_back(std::move(mesh));
+  }
+
+  unsigned threads = settings.threadCount
+                         ? settings.threadCount
+                         : std::max(1u, std::thread::hardware_concurrency());
+
+  std::printf("%-22s %10s %10s %10s %8s %8s %6s %9s %6s\n", "mesh", "tris",
+              "1T ms", "MT ms", "speedup", "Mtri/s", "depth", "nodes",
+              "SAH");
+  for (const BenchMesh &mesh : meshes) {
+    Bvh bvh;
+    BvhBuildSettings single = settings;
+    single.threadCount = 1;
+    double singleMs = BestBuildMs(bvh, mesh, single, repeats);
+
+    BvhBuildSettings multi = settings;
+    multi.threadCount = threads;
+    double multiMs = BestBuildMs(bvh, mesh, multi, repeats);
+
+    const BvhBuildStats &stats = bvh.Stats();
+    size_t tris = mesh.indices.size() / 3;
+    std::printf("%-22s %10zu %10.2f %10.2f %7.2fx %8.2f %6u %9u %6.2f\n",
+                mesh.name.c_str(), tris, singleMs, multiMs,
+                singleMs / multiMs, tris / (multiMs * 1000.0), stats.maxDepth,
+                stats.nodeCount, stats.sahCost);
+  }
+  std::printf("threads: %u, bins: %u, max leaf: %u\n", threads,
+              settings.binCount, settings.maxLeafSize);
+  return 0;
+}
@@ -0,0 +1,304 @@
+// Exercises the checkerboard half-rate mode: the launch-to-pixel mapping
+// RayGen uses and the reconstruction filter behind
+// shaders/CheckerboardResolve.hlsl, on frames from CpuPathTracer.
+//
+// Checks that both parities together trace every pixel exactly once and
+// that each traces half of them, that traced pixels pass through the
+// resolve untouched and flat colour reconstructs exactly. Then a static and an
+// animated sequence are rendered at full rate and in checkerboard mode,
+// resolving every frame against the previous resolved one as the renderer
+// does: the result must stay close to the full-rate frames, the history
+// must sharpen the static scene and the clamp must keep it from smearing
+// the moving one. Any failure makes the tool exit with status 1. The
+// throughput table times the resolve at 1080p, 1440p and 4K on one thread
+// and on the job system.
+
+#include "CheckerboardResolve.h"
+#include "CpuPathTracer.h"
+#include "JobSystem.h"
+#include "MeshGenerator.h"
+#include "SceneInstances.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+void CheckPattern() {
+  bool once = true, half = true, launch = true;
+  for (uint32_t width = 1; width <= 9; ++width) {
+    for (uint32_t height = 1; height <= 5; ++height) {
+      std::vector<int> hits(width * height, 0);
+      for (uint32_t parity = 0; parity < 2; ++parity) {
+        uint32_t traced = 0;
+        for (uint32_t y = 0; y < height; ++y) {
+          for (uint32_t lx = 0; lx < CheckerboardLaunchWidth(width); ++lx) {
+            uint32_t x = CheckerboardPixelX(lx, y, parity);
+            if (x >= width) {
+              continue; // RayGen returns early
+            }
+            launch &= CheckerboardTraced(x, y, parity);
+            ++hits[y * width + x];
+            ++traced;
+          }
+        }
+        half &= traced == (width * height + 1 - parity) / 2 ||
+                traced == (width * height + parity) / 2;
+      }
+      for (int h : hits) {
+        once &= h == 1;
+      }
+    }
+  }
+  Expect(launch, "launch indices land on the traced pixels");
+  Expect(once, "the two parities trace every pixel exactly once");
+  Expect(half, "each parity traces half the pixels");
+}
+
+void CheckFilter() {
+  const int width = 37, height = 23;
+  std::vector<uint8_t> current((size_t)width * height * 4);
+  std::vector<uint8_t> history(current.size());
+  std::vector<uint8_t> out(current.size());
+  for (size_t i = 0; i < current.size(); ++i) {
+    current[i] = (uint8_t)(i * 7919 >> 3);
+    history[i] = (uint8_t)(i * 104729 >> 5);
+  }
+
+  CheckerboardSettings settings;
+  bool passthrough = true;
+  for (uint32_t parity = 0; parity < 2; ++parity) {
+    ResolveCheckerboard({current.data(), history.data(), out.data(), width,
+                         height},
+                        parity, settings);
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        size_t i = ((size_t)y * width + x) * 4;
+        if (CheckerboardTraced(x, y, parity)) {
+          passthrough &= std::memcmp(&out[i], &current[i], 4) == 0;
+        } else {
+          passthrough &= out[i + 3] == 255;
+        }
+      }
+    }
+  }
+  Expect(passthrough, "traced pixels pass through unchanged");
+
+  // Flat colour: neighbours, history and their blend all agree.
+  const uint8_t color[4] = {200, 90, 17, 255};
+  for (size_t i = 0; i < current.size(); i += 4) {
+    std::memcpy(&current[i], color, 4);
+    std::memcpy(&history[i], color, 4);
+  }
+  bool flat = true;
+  for (int withHistory = 0; withHistory < 2; ++withHistory) {
+    ResolveCheckerboard({current.data(),
+                         withHistory ? history.data() : nullptr, out.data(),
+                         width, height},
+                        1, settings);
+    for (size_t i = 0; i < out.size(); i += 4) {
+      flat &= std::memcmp(&out[i], color, 4) == 0;
+    }
+  }
+  Expect(flat, "flat colour reconstructs exactly");
+}
+
+double Psnr(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) {
+  double squared = 0.0;
+  size_t count = 0;
+  for (size_t i = 0; i < a.size(); i += 4) {
+    for (int c = 0; c < 3; ++c) {
+      double d = (double)a[i + c] - (double)b[i + c];
+      squared += d * d;
+      ++count;
+    }
+  }
+  double mse = squared / (double)count;
+  return mse == 0.0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+struct Variant {
+  const char *name;
+  bool useHistory;
+  CheckerboardSettings settings;
+};
+
+const Variant kVariants[] = {
+    {"neighbours only", false, {}},
+    {"history, unclamped", true, {0.5f, 1.0f}},
+    {"history, clamped", true, {}},
+};
+constexpr int kVariantCount = (int)(sizeof(kVariants) / sizeof(kVariants[0]));
+
+struct Quality {
+  double meanPsnr[kVariantCount] = {};
+  double worstPsnr[kVariantCount] = {};
+  double rayShare = 0.0; // checkerboard rays / full-rate rays
+};
+
+// Renders frames at 60 Hz steps of the scene animation, full rate and
+// checkerboarded, resolving each frame against the previous resolved one.
+// The first frame has no history and is left out of the statistics.
+Quality MeasureQuality(CpuPathTracer &tracer, int width, int height,
+                       int frames, float speed) {
+  CpuCamera camera = CpuCamera::FromYawPitch({0.0f, 5.0f, -10.0f}, 0.0f,
+                                             0.0f, (float)width / height);
+  CpuPathTracer::Settings settings;
+  settings.width = width;
+  settings.height = height;
+
+  Quality quality;
+  std::vector<uint8_t> resolved[kVariantCount][2];
+  uint64_t fullRays = 0, checkerRays = 0;
+  std::vector<SceneInstance> instances;
+  std::vector<uint8_t> full, traced;
+  for (int v = 0; v < kVariantCount; ++v) {
+    quality.worstPsnr[v] = 99.0;
+  }
+
+  for (int frame = 0; frame < frames; ++frame) {
+    BuildSceneInstances(frame / 60.0f, speed, instances);
+    settings.checkerboardParity = -1;
+    fullRays += tracer.Render(settings, camera, instances, full).totalRays;
+    uint32_t parity = frame & 1;
+    settings.checkerboardParity = (int)parity;
+    checkerRays +=
+        tracer.Render(settings, camera, instances, traced).totalRays;
+
+    for (int v = 0; v < kVariantCount; ++v) {
+      std::vector<uint8_t> &out = resolved[v][frame & 1];
+      const std::vector<uint8_t> &previous = resolved[v][(frame + 1) & 1];
+      out.resize(full.size());
+      bool history = kVariants[v].useHistory && frame > 0;
+      ResolveCheckerboard({traced.data(),
+                           history ? previous.data() : nullptr, out.data(),
+                           width, height},
+                          parity, kVariants[v].settings);
+      if (frame > 0) {
+        double psnr = Psnr(out, full);
+        quality.meanPsnr[v] += psnr / (frames - 1);
+        quality.worstPsnr[v] = std::min(quality.worstPsnr[v], psnr);
+      }
+    }
+  }
+  quality.rayShare = (double)checkerRays / (double)fullRays;
+  return quality;
+}
+
+void CheckQuality(int width, int height, int frames, float speed) {
+  CpuPathTracer tracer;
+  std::vector<MeshVertex> vertices;
+  std::vector<uint32_t> indices;
+  GenerateSphere(vertices, indices, kSphereRadius, kSphereSlices,
+                 kSphereStacks);
+  tracer.SetMesh(SceneMesh::Sphere, vertices, indices);
+  GeneratePlane(vertices, indices, kPlaneSize, kPlaneSize);
+  tracer.SetMesh(SceneMesh::Plane, vertices, indices);
+
+  Quality still = MeasureQuality(tracer, width, height, frames, 0.0f);
+  Quality moving = MeasureQuality(tracer, width, height, frames, speed);
+
+  std::printf("%dx%d, %d frames: %.1f%% of the full-rate rays\n", width,
+              height, frames, 100.0 * moving.rayShare);
+  std::printf("%-20s %15s %22s\n", "PSNR vs full rate", "static",
+              "moving");
+  std::printf("%-20s %7s %7s %7s %7s   (speed %.1f)\n", "reconstruction",
+              "mean", "worst", "mean", "worst", speed);
+  for (int v = 0; v < kVariantCount; ++v) {
+    std::printf("%-20s %7.1f %7.1f %7.1f %7.1f\n", kVariants[v].name,
+                still.meanPsnr[v], still.worstPsnr[v], moving.meanPsnr[v],
+                moving.worstPsnr[v]);
+  }
+
+  Expect(moving.rayShare < 0.55, "checkerboard traces about half the rays");
+  Expect(still.worstPsnr[2] > 40.0 && moving.worstPsnr[2] > 40.0,
+         "resolved frames stay close to full rate");
+  // Where nothing moves the history is the traced pixel from last frame.
+  Expect(still.meanPsnr[2] > still.meanPsnr[0] + 2.0,
+         "history sharpens a static scene");
+  // Where things move the clamp must keep ghosts from costing quality.
+  Expect(moving.meanPsnr[2] > moving.meanPsnr[1],
+         "clamping rejects stale history");
+  Expect(moving.meanPsnr[2] > moving.meanPsnr[0] - 1.0,
+         "history does not smear a moving scene");
+}
+
+void Measure(int width, int height, JobSystem *jobs, double minSeconds) {
+  std::vector<uint8_t> current((size_t)width * height * 4);
+  std::vector<uint8_t> history(current.size()), out(current.size());
+  for (size_t i = 0; i < current.size(); ++i) {
+    current[i] = (uint8_t)(i * 7919 >> 3);
+    history[i] = (uint8_t)(i * 104729 >> 5);
+  }
+  CheckerboardSettings settings;
+  int reps = 0;
+  double seconds = 0.0;
+  auto start = std::chrono::steady_clock::now();
+  do {
+    ResolveCheckerboard({current.data(), history.data(), out.data(), width,
+                         height},
+                        reps & 1, settings, jobs);
+    ++reps;
+    seconds = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  } while (seconds < minSeconds);
+  std::printf("%5dx%-5d %7u %9.2f %9.1f\n", width, height,
+              jobs ? jobs->ThreadCount() : 1u, seconds * 1e3 / reps,
+              (double)width * height * reps / seconds * 1e-6);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int width = 320, height = 180, frames = 12;
+  float speed = 2.0f; // twice the UI default, so the clamp has work to do
+  double minSeconds = 0.25;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--width") && i + 1 < argc) {
+      width = std::max(2, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--height") && i + 1 < argc) {
+      height = std::max(2, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--frames") && i + 1 < argc) {
+      frames = std::max(2, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--speed") && i + 1 < argc) {
+      speed = (float)std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      minSeconds = std::atof(argv[++i]);
+    } else {
+      std::printf("Usage: CheckerboardBenchmark [--width N] [--height N] "
+                  "[--frames N] [--speed S] [--seconds S]\n");
+      return 1;
+    }
+  }
+
+  CheckPattern();
+  CheckFilter();
+  std::printf("Pattern and filter checks: %s\n\n", g_failures ? "FAIL" : "ok");
+  CheckQuality(width, height, frames, speed);
+  std::printf("\n");
+
+  JobSystem jobs;
+  std::printf("%-11s %7s %9s %9s\n", "resolve", "threads", "ms", "Mpix/s");
+  const int sizes[][2] = {{1920, 1080}, {2560, 1440}, {3840, 2160}};
+  for (const auto &size : sizes) {
+    Measure(size[0], size[1], nullptr, minSeconds);
+    Measure(size[0], size[1], &jobs, minSeconds);
+  }
+  return g_failures ? 1 : 0;
+}
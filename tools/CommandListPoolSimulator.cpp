@@ -0,0 +1,302 @@
+// Runs CommandListPool, the renderer's command allocator/list pool, against
+// a mock device on SimulatedGpuQueue so allocator recycling can be checked
+// without a GPU.
+//
+// MockCommandDevice enforces the D3D12 rules the pool exists for: an
+// allocator is only reset once every list recorded from it has retired on
+// the GPU, it backs at most one open list at a time, lists are only reset
+// while closed and only executed once closed. Every frame records several
+// lists on the job system in parallel, and the mock checks each batch
+// arrives sorted by recording order. A scripted run with too few
+// allocators, serial and on the job system, must wait on fences instead of
+// breaking the rules or growing past its cap; the paced runs, sized like
+// the renderer, must never wait. Any violation makes the tool exit with
+// status 1.
+
+#include "CommandListPool.h"
+#include "FramePacer.h"
+#include "GpuQueue.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+// SimulatedGpuQueue plus mock command allocators and lists. All entry
+// points lock, since recordings come from job threads.
+class MockCommandDevice : public SimulatedGpuQueue, public CommandListBackend {
+public:
+  explicit MockCommandDevice(double gpuMsPerList)
+      : m_gpuMsPerList(gpuMsPerList) {}
+
+  // Tags the open list with its recording order, standing in for commands.
+  void Record(uint32_t list, uint32_t order) {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    Expect(m_lists[list].open, "recording into a closed list");
+    m_lists[list].order = order;
+  }
+
+  void AdvanceCpuLocked(double ms) {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    AdvanceCpu(ms);
+  }
+
+  uint64_t Signal() override {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    return m_lastSignal = SimulatedGpuQueue::Signal();
+  }
+  uint64_t CompletedValue() override {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    return SimulatedGpuQueue::CompletedValue();
+  }
+  double Wait(uint64_t value) override {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    return SimulatedGpuQueue::Wait(value);
+  }
+
+  void CreateAllocator(uint32_t allocator) override {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    Expect(allocator == m_allocators.size(), "allocators created in order");
+    m_allocators.push_back({});
+  }
+  void CreateList(uint32_t list) override {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    Expect(list == m_lists.size(), "lists created in order");
+    m_lists.push_back({});
+  }
+  void ResetAllocator(uint32_t allocator) override {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    Allocator &a = m_allocators[allocator];
+    Expect(a.openLists == 0, "allocator reset while a list records into it");
+    Expect(SimulatedGpuQueue::CompletedValue() >= a.retireFence,
+           "allocator reset before its lists retired on the GPU");
+    ++m_allocatorResets;
+  }
+  void ResetList(uint32_t list, uint32_t allocator) override {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    List &l = m_lists[list];
+    Allocator &a = m_allocators[allocator];
+    Expect(!l.open, "list reset while open");
+    Expect(a.openLists == 0, "allocator backs two open lists");
+    l.open = true;
+    l.recorded = false;
+    l.allocator = allocator;
+    ++a.openLists;
+  }
+  void CloseList(uint32_t list) override {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    List &l = m_lists[list];
+    Expect(l.open, "closing a list that is not open");
+    l.open = false;
+    l.recorded = true;
+    --m_allocators[l.allocator].openLists;
+  }
+  void ExecuteLists(const uint32_t *lists, uint32_t count) override {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    for (uint32_t i = 0; i < count; ++i) {
+      List &l = m_lists[lists[i]];
+      Expect(l.recorded && !l.open, "executing a list that is not closed");
+      Expect(i == 0 || m_lists[lists[i - 1]].order <= l.order,
+             "batch is sorted by recording order");
+      l.recorded = false;
+      // Complete once the next signal after this batch does.
+      m_allocators[l.allocator].retireFence = m_lastSignal + 1;
+      Submit(m_gpuMsPerList);
+    }
+    m_listsExecuted += count;
+  }
+
+  uint64_t ListsExecuted() const { return m_listsExecuted; }
+  uint64_t AllocatorResets() const { return m_allocatorResets; }
+
+private:
+  struct Allocator {
+    uint64_t retireFence = 0;
+    uint32_t openLists = 0;
+  };
+  struct List {
+    bool open = false;
+    bool recorded = false;
+    uint32_t allocator = 0;
+    uint32_t order = 0;
+  };
+
+  // Recursive: SimulatedGpuQueue::Wait calls back into CompletedValue().
+  std::recursive_mutex m_mutex;
+  double m_gpuMsPerList;
+  uint64_t m_lastSignal = 0;
+  std::vector<Allocator> m_allocators;
+  std::vector<List> m_lists;
+  uint64_t m_listsExecuted = 0;
+  uint64_t m_allocatorResets = 0;
+};
+
+// Too few allocators for the GPU latency: Begin has to wait on fences.
+void RunStarved() {
+  MockCommandDevice device(4.0);
+  CommandListPool pool(device, device, 3, 2);
+  for (int frame = 0; frame < 100; ++frame) {
+    for (uint32_t order = 0; order < 2; ++order) {
+      CommandListPool::Recording rec = pool.Begin(order);
+      device.Record(rec.list, order);
+      pool.End(rec);
+    }
+    device.AdvanceCpuLocked(1.0);
+    pool.Submit();
+    pool.FinishFrame(device.Signal());
+    pool.Retire(device.CompletedValue());
+  }
+  pool.Retire(device.CompletedValue());
+
+  CommandListPoolStats stats = pool.Stats();
+  Expect(stats.allocatorsCreated == 3, "starved pool stops at maxAllocators");
+  Expect(stats.listsCreated == 2, "lists are reused after submission");
+  Expect(stats.fenceWaits > 0, "starved pool waits for the GPU");
+  Expect(device.ListsExecuted() == 200, "every recording was executed");
+  std::printf("starved (3 allocators, 2 lists/frame, gpu 8 ms vs cpu 1 ms):"
+              " %llu fence waits, %.0f ms waited\n\n",
+              (unsigned long long)stats.fenceWaits, stats.fenceWaitMs);
+}
+
+// The same starvation with every frame's recordings on the job system:
+// several Begin calls wait on fences at once, and whichever retires an
+// allocator first may hand it to another thread. The pool must keep
+// waiting rather than grow past maxAllocators.
+void RunStarvedParallel(JobSystem &jobs) {
+  const uint32_t recordings = 4;
+  MockCommandDevice device(4.0);
+  CommandListPool pool(device, device, recordings + 1, recordings);
+  for (int frame = 0; frame < 100; ++frame) {
+    jobs.ParallelFor(recordings, 1, [&](uint32_t begin, uint32_t end) {
+      for (uint32_t i = begin; i < end; ++i) {
+        CommandListPool::Recording rec = pool.Begin(i);
+        device.Record(rec.list, i);
+        pool.End(rec);
+      }
+    });
+    device.AdvanceCpuLocked(1.0);
+    pool.Submit();
+    pool.FinishFrame(device.Signal());
+  }
+  pool.Retire(device.CompletedValue());
+
+  CommandListPoolStats stats = pool.Stats();
+  Expect(stats.allocatorsCreated == recordings + 1,
+         "parallel starved pool stops at maxAllocators");
+  Expect(stats.fenceWaits > 0, "parallel starved pool waits for the GPU");
+  Expect(device.ListsExecuted() == 100 * recordings,
+         "every parallel recording was executed");
+  std::printf("starved, parallel (%u allocators, %u lists/frame): %llu fence "
+              "waits, %.0f ms waited\n\n",
+              recordings + 1, recordings,
+              (unsigned long long)stats.fenceWaits, stats.fenceWaitMs);
+}
+
+struct PacedResult {
+  CommandListPoolStats stats;
+  double poolUsPerFrame;
+};
+
+// The renderer's loop: FramePacer bounds frames in flight, each frame
+// records `recordings` lists in parallel and submits them in one batch.
+PacedResult RunPaced(JobSystem &jobs, uint32_t framesInFlight,
+                     uint32_t recordings, int frames) {
+  MockCommandDevice device(2.0 / recordings);
+  FramePacer pacer(device, framesInFlight);
+  uint32_t maxAllocators = (FramePacer::kMaxFramesInFlight + 1) * recordings;
+  CommandListPool pool(device, device, maxAllocators, recordings);
+
+  double poolSeconds = 0.0;
+  for (int frame = 0; frame < frames; ++frame) {
+    pacer.BeginFrame();
+    pool.Retire(device.CompletedValue());
+
+    auto start = std::chrono::steady_clock::now();
+    // Reverse order so End() order differs from submission order.
+    jobs.ParallelFor(recordings, 1, [&](uint32_t begin, uint32_t end) {
+      for (uint32_t i = begin; i < end; ++i) {
+        uint32_t order = recordings - 1 - i;
+        CommandListPool::Recording rec = pool.Begin(order);
+        device.Record(rec.list, order);
+        pool.End(rec);
+      }
+    });
+    Expect(pool.Submit() == recordings, "one batch per frame");
+    poolSeconds += std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+    device.AdvanceCpuLocked(1.5);
+    pacer.EndFrame();
+    pool.FinishFrame(pacer.SlotFence(pacer.FrameSlot()));
+  }
+  pacer.WaitIdle();
+  pool.Retire(device.CompletedValue());
+
+  PacedResult result;
+  result.stats = pool.Stats();
+  result.poolUsPerFrame = poolSeconds * 1e6 / frames;
+  Expect(result.stats.fenceWaits == 0,
+         "a pool sized like the renderer's never waits");
+  Expect(device.ListsExecuted() == (uint64_t)frames * recordings,
+         "every paced recording was executed");
+  Expect(device.AllocatorResets() == (uint64_t)frames * recordings,
+         "every recording reset its allocator");
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int frames = 2000;
+  unsigned threads = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--frames") && i + 1 < argc) {
+      frames = std::max(8, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = (unsigned)std::max(1, std::atoi(argv[++i]));
+    } else {
+      std::printf("Usage: CommandListPoolSimulator [--frames N] "
+                  "[--threads N]\n");
+      return 1;
+    }
+  }
+
+  RunStarved();
+
+  JobSystemSettings settings;
+  settings.threadCount = threads;
+  JobSystem jobs(settings);
+  std::printf("%d frames, recording on %u threads\n\n", frames,
+              jobs.ThreadCount());
+  RunStarvedParallel(jobs);
+  std::printf("%9s %10s %10s %8s %10s %8s %12s\n", "in flight", "lists/frm",
+              "allocators", "lists", "reuses", "waits", "pool us/frm");
+  for (uint32_t framesInFlight = 1;
+       framesInFlight <= FramePacer::kMaxFramesInFlight; ++framesInFlight) {
+    for (uint32_t recordings : {1u, 2u, 4u, 8u}) {
+      PacedResult r = RunPaced(jobs, framesInFlight, recordings, frames);
+      std::printf("%9u %10u %10u %8u %10llu %8llu %12.2f\n", framesInFlight,
+                  recordings, r.stats.allocatorsCreated, r.stats.listsCreated,
+                  (unsigned long long)r.stats.allocatorReuses,
+                  (unsigned long long)r.stats.fenceWaits, r.poolUsPerFrame);
+    }
+  }
+  std::printf("\nCommand list pool checks: %s\n", g_failures ? "FAIL" : "ok");
+  return g_failures ? 1 : 0;
+}
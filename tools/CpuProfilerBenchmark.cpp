@@ -0,0 +1,368 @@
+// Exercises CpuProfiler, the scoped CPU markers around the renderer's frame
+// and startup work, and its Chrome trace export.
+//
+// Checks that nested scopes come back with their depth, that disabled
+// recording leaves nothing behind, that a full ring keeps exactly the
+// newest events and counts the rest as dropped, that captures taken while
+// threads are recording (and wrapping their rings) never return a torn
+// event, that the exported JSON is well formed with names escaped, and that
+// a timed sleep comes out at the right length. Any failure makes the tool
+// exit with status 1. The table times a scope with recording on and off,
+// on one and several threads, next to the two clock reads it contains.
+
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+uint32_t ThreadIndex(const CpuProfileCapture &capture, const char *name) {
+  for (uint32_t i = 0; i < capture.threadNames.size(); ++i) {
+    if (capture.threadNames[i] == name) {
+      return i;
+    }
+  }
+  return UINT32_MAX;
+}
+
+std::vector<CpuProfileEvent> EventsOf(const CpuProfileCapture &capture,
+                                      uint32_t thread) {
+  std::vector<CpuProfileEvent> events;
+  for (const CpuProfileEvent &event : capture.events) {
+    if (event.thread == thread) {
+      events.push_back(event);
+    }
+  }
+  return events;
+}
+
+void CheckNesting() {
+  CpuProfiler &profiler = CpuProfiler::Get();
+  profiler.Clear();
+  for (int i = 0; i < 10; ++i) {
+    CPU_PROFILE_SCOPE("Frame");
+    {
+      CPU_PROFILE_SCOPE("Record");
+      CPU_PROFILE_SCOPE("Build");
+    }
+  }
+  CpuProfileCapture capture = profiler.Capture();
+  std::vector<CpuProfileEvent> events =
+      EventsOf(capture, ThreadIndex(capture, "Main"));
+
+  bool depths = events.size() == 30, inside = true;
+  const char *expected[] = {"Frame", "Record", "Build"};
+  for (size_t i = 0; i < events.size(); ++i) {
+    const CpuProfileEvent &event = events[i];
+    depths &= event.depth == i % 3 && !std::strcmp(event.name, expected[i % 3]);
+    if (i % 3) {
+      const CpuProfileEvent &parent = events[i - 1];
+      inside &= event.begin >= parent.begin && event.end <= parent.end;
+    }
+  }
+  Expect(depths, "nested scopes come back in order with their depth");
+  Expect(inside, "children lie inside their parents");
+
+  profiler.Clear();
+  CpuProfiler::SetEnabled(false);
+  for (int i = 0; i < 100; ++i) {
+    CPU_PROFILE_SCOPE("Disabled");
+  }
+  CpuProfiler::SetEnabled(true);
+  Expect(profiler.Capture().events.empty(), "disabled scopes record nothing");
+}
+
+void CheckWrap() {
+  CpuProfiler &profiler = CpuProfiler::Get();
+  profiler.Clear();
+  const uint64_t extra = 1000;
+  const uint64_t total = CpuProfiler::kEventsPerThread + extra;
+  for (uint64_t i = 0; i < total; ++i) {
+    CpuProfiler::Record("Wrap", i * 10, i * 10 + 5);
+  }
+  CpuProfileCapture capture = profiler.Capture();
+  std::vector<CpuProfileEvent> events =
+      EventsOf(capture, ThreadIndex(capture, "Main"));
+  // The slot the next event will overwrite is not read.
+  const uint64_t kept = CpuProfiler::kEventsPerThread - 1;
+  Expect(events.size() == kept && capture.dropped == total - kept,
+         "a full ring keeps the newest events and counts the rest");
+  Expect(!events.empty() && events.front().begin == (total - kept) * 10 &&
+             events.back().begin == (total - 1) * 10,
+         "the oldest events are the ones overwritten");
+}
+
+// Writers record synthetic events whose fields all derive from one
+// counter, so a capture mixing two writes of a slot shows up.
+const char *const kNames[] = {"A", "B", "C", "D", "E"};
+
+void CheckConcurrentCapture(int threadCount, uint64_t perThread) {
+  CpuProfiler &profiler = CpuProfiler::Get();
+  profiler.Clear();
+  std::atomic<int> running{threadCount};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < threadCount; ++t) {
+    threads.emplace_back([t, perThread, &running]() {
+      CpuProfiler::SetThreadName("Writer " + std::to_string(t));
+      for (uint64_t i = 0; i < perThread; ++i) {
+        CpuProfiler::Record(kNames[i % 5], i * 4 + 1, i * 4 + 3);
+      }
+      running.fetch_sub(1);
+    });
+  }
+
+  int captures = 0;
+  bool intact = true, ordered = true;
+  auto verify = [&](const CpuProfileCapture &capture) {
+    uint32_t lastThread = UINT32_MAX;
+    uint64_t lastBegin = 0;
+    for (const CpuProfileEvent &event : capture.events) {
+      if (capture.threadNames[event.thread].rfind("Writer ", 0) != 0) {
+        continue;
+      }
+      uint64_t i = event.begin / 4;
+      intact &= event.begin == i * 4 + 1 && event.end == i * 4 + 3 &&
+                event.name == kNames[i % 5] && event.depth == 0;
+      if (event.thread == lastThread) {
+        ordered &= event.begin == lastBegin + 4;
+      }
+      lastThread = event.thread;
+      lastBegin = event.begin;
+    }
+  };
+  while (running.load() > 0) {
+    verify(profiler.Capture());
+    ++captures;
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  CpuProfileCapture capture = profiler.Capture();
+  verify(capture);
+
+  bool complete = true;
+  for (int t = 0; t < threadCount; ++t) {
+    std::string name = "Writer " + std::to_string(t);
+    std::vector<CpuProfileEvent> events =
+        EventsOf(capture, ThreadIndex(capture, name.c_str()));
+    complete &= events.size() == std::min<uint64_t>(
+                                     perThread,
+                                     CpuProfiler::kEventsPerThread - 1) &&
+                !events.empty() && events.back().begin == (perThread - 1) * 4 + 1;
+  }
+  std::printf("%d writers x %llu events, %d captures while recording\n",
+              threadCount, (unsigned long long)perThread, captures);
+  Expect(intact, "captures during recording never return a torn event");
+  Expect(ordered, "captured events are contiguous per thread");
+  Expect(complete, "each thread's newest events are kept under its name");
+}
+
+// Balanced brackets outside strings and no raw control characters.
+bool WellFormedJson(const std::string &json) {
+  std::vector<char> stack;
+  bool inString = false;
+  for (size_t i = 0; i < json.size(); ++i) {
+    char c = json[i];
+    if (inString) {
+      if ((unsigned char)c < 0x20) {
+        return false;
+      }
+      if (c == '\\') {
+        ++i;
+      } else if (c == '"') {
+        inString = false;
+      }
+    } else if (c == '"') {
+      inString = true;
+    } else if (c == '{' || c == '[') {
+      stack.push_back(c == '{' ? '}' : ']');
+    } else if (c == '}' || c == ']') {
+      if (stack.empty() || stack.back() != c) {
+        return false;
+      }
+      stack.pop_back();
+    }
+  }
+  return stack.empty() && !inString;
+}
+
+size_t Count(const std::string &text, const std::string &pattern) {
+  size_t count = 0;
+  for (size_t at = text.find(pattern); at != std::string::npos;
+       at = text.find(pattern, at + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+void CheckExport(const char *tracePath) {
+  CpuProfiler &profiler = CpuProfiler::Get();
+  profiler.Clear();
+  {
+    CPU_PROFILE_SCOPE("Sleep 10 ms");
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::thread([]() {
+    CpuProfiler::SetThreadName("Quote \" and \\ and \t");
+    CPU_PROFILE_SCOPE("Tab\tname");
+  }).join();
+
+  CpuProfileCapture capture = profiler.Capture();
+  std::vector<CpuProfileEvent> events =
+      EventsOf(capture, ThreadIndex(capture, "Main"));
+  double sleepMs = events.size() == 1 ? (events[0].end - events[0].begin) *
+                                            1e3 / capture.ticksPerSecond
+                                      : 0.0;
+  std::printf("ticks per second %.0f, 10 ms sleep measured as %.3f ms\n",
+              capture.ticksPerSecond, sleepMs);
+  Expect(sleepMs >= 9.5 && sleepMs < 60.0, "scope times are in real time");
+
+  std::string json = CpuProfiler::ChromeTraceJson(capture);
+  Expect(WellFormedJson(json), "trace JSON is well formed");
+  Expect(Count(json, "\"ph\":\"X\"") == capture.events.size() &&
+             Count(json, "\"ph\":\"M\"") == capture.threadNames.size(),
+         "one trace event per scope and one name per thread");
+  Expect(json.find("Quote \\\" and \\\\ and \\u0009") != std::string::npos &&
+             json.find("Tab\\u0009name") != std::string::npos,
+         "names are escaped");
+
+  if (tracePath) {
+    // A short multi-threaded sample for chrome://tracing or Perfetto.
+    profiler.Clear();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([t]() {
+        CpuProfiler::SetThreadName("Sample " + std::to_string(t));
+        for (int frame = 0; frame < 20; ++frame) {
+          CPU_PROFILE_SCOPE("Frame");
+          for (int pass = 0; pass < 3; ++pass) {
+            CPU_PROFILE_SCOPE("Pass");
+            std::this_thread::sleep_for(std::chrono::microseconds(100 + 50 * t));
+          }
+        }
+      });
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    bool written = profiler.WriteChromeTrace(tracePath);
+    std::printf("Trace written to %s\n", tracePath);
+    Expect(written, "the trace file is written");
+  }
+}
+
+// Nanoseconds of CPU per scope: wall time over the scopes each core ran,
+// so the figure holds on hosts with fewer cores than threads.
+double TimeScopes(int threadCount, bool enabled, double minSeconds) {
+  CpuProfiler::SetEnabled(enabled);
+  std::atomic<uint64_t> scopes{0};
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < threadCount; ++t) {
+    threads.emplace_back([&]() {
+      uint64_t count = 0;
+      do {
+        for (int i = 0; i < 4096; ++i, ++count) {
+          CPU_PROFILE_SCOPE("Benchmark");
+        }
+      } while (std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+                   .count() < minSeconds);
+      scopes.fetch_add(count);
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  CpuProfiler::SetEnabled(true);
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  return seconds * 1e9 * std::min((unsigned)threadCount, cores) /
+         (double)scopes.load();
+}
+
+// Two reads of a clock, the floor under a scope's cost. Under some
+// hypervisors both are trapped and take tens of nanoseconds.
+template <typename Read> double TimeClockPair(Read read, double minSeconds) {
+  uint64_t count = 0, sink = 0;
+  double seconds = 0.0;
+  auto start = std::chrono::steady_clock::now();
+  do {
+    for (int i = 0; i < 4096; ++i, ++count) {
+      uint64_t a = read();
+      uint64_t b = read();
+      sink += b - a;
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            start)
+                  .count();
+  } while (seconds < minSeconds);
+  return sink == UINT64_MAX ? 0.0 : seconds * 1e9 / (double)count;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double minSeconds = 0.25;
+  const char *tracePath = nullptr;
+  int threads = 4;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      minSeconds = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--trace") && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else {
+      std::printf("Usage: CpuProfilerBenchmark [--seconds S] [--threads N] "
+                  "[--trace out.json]\n");
+      return 1;
+    }
+  }
+
+  CpuProfiler::SetThreadName("Main");
+  CheckNesting();
+  CheckWrap();
+  CheckConcurrentCapture(threads, 4 * CpuProfiler::kEventsPerThread);
+  CheckExport(tracePath);
+  std::printf("Profiler checks: %s\n\n", g_failures ? "FAIL" : "ok");
+
+  std::printf("%-24s %7s %9s\n", "scope cost", "threads", "ns");
+  std::printf("%-24s %7d %9.2f\n", "steady_clock pair", 1,
+              TimeClockPair(
+                  []() {
+                    return (uint64_t)std::chrono::steady_clock::now()
+                        .time_since_epoch()
+                        .count();
+                  },
+                  minSeconds));
+  std::printf("%-24s %7d %9.2f\n", "CpuProfiler::Now pair", 1,
+              TimeClockPair(CpuProfiler::Now, minSeconds));
+  std::printf("%-24s %7d %9.2f\n", "recording off", 1,
+              TimeScopes(1, false, minSeconds));
+  std::printf("%-24s %7d %9.2f\n", "recording", 1,
+              TimeScopes(1, true, minSeconds));
+  std::printf("%-24s %7d %9.2f\n", "recording", threads,
+              TimeScopes(threads, true, minSeconds));
+  return g_failures ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+// Headless CPU reference renderer for the ray tracing scene.
+//
+// Renders the same frame the DXR path produces (shaders/RayTracing.hlsl over
+// the instances from BuildSceneInstances) on all cores and writes a PPM.
+// Prints rays per second so it doubles as a throughput baseline.
+
+#include "CpuPathTracer.h"
+#include "MeshGenerator.h"
+#include "SceneInstances.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+
+namespace {
+
+void PrintUsage() {
+  std::printf(
+      "Usage: CpuReferenceTracer [options]\n"
+      "  --width N         image width (default 1280)\n"
+      "  --height N        image height (default 720)\n"
+      "  --bounces N       maxBounces (default 3)\n"
+      "  --time T          animation time in seconds (default 0)\n"
+      "  --speed S         animation speed (default 1)\n"
+      "  --emissive E      emissive intensity (default 2)\n"
+      "  --threads N       worker threads, 0 = all cores (default 0)\n"
+      "  --tile N          tile size in pixels (default 32)\n"
+      "  --frames N        frames to render for timing (default 1)\n"
+      "  --out PATH        output image (default reference.ppm)\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  CpuPathTracer::Settings settings;
+  float animationTime = 0.0f;
+  float animationSpeed = 1.0f;
+  int frames = 1;
+  std::string outPath = "reference.ppm";
+
+  for (int i = 1; i < argc; ++i) {
+    auto next = [&]() -> const char * {
+      if (i + 1 >= argc) {
+        std::fprintf(stderr, "Missing value for %s\n", argv[i]);
+        std::exit(1);
+      }
+      return argv[++i];
+    };
+    if (!std::strcmp(argv[i], "--width")) {
+      settings.width = std::atoi(next());
+    } else if (!std::strcmp(argv[i], "--height")) {
+      settings.height = std::atoi(next());
+    } else if (!std::strcmp(argv[i], "--bounces")) {
+      settings.maxBounces = (uint32_t)std::atoi(next());
+    } else if (!std::strcmp(argv[i], "--time")) {
+      animationTime = (float)std::atof(next());
+    } else if (!std::strcmp(argv[i], "--speed")) {
+      animationSpeed = (float)std::atof(next());
+    } else if (!std::strcmp(argv[i], "--emissive")) {
+      settings.emissiveIntensity = (float)std::atof(next());
+    } else if (!std::strcmp(argv[i], "--threads")) {
+      settings.threadCount = (unsigned)std::atoi(next());
+    } else if (!std::strcmp(argv[i], "--tile")) {
+      settings.tileSize = std::atoi(next());
+    } else if (!std::strcmp(argv[i], "--frames")) {
+      frames = std::atoi(next());
+    } else if (!std::strcmp(argv[i], "--out")) {
+      outPath = next();
+    } else {
+      PrintUsage();
+      return std::strcmp(argv[i], "--help") ? 1 : 0;
+    }
+  }
+
+  if (settings.width <= 0 || settings.height <= 0 || frames <= 0) {
+    std::fprintf(stderr, "Invalid image size or frame count\n");
+    return 1;
+  }
+
+  try {
+    CpuPathTracer tracer;
+
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    GenerateSphere(vertices, indices, kSphereRadius, kSphereSlices,
+                   kSphereStacks);
+    tracer.SetMesh(SceneMesh::Sphere, vertices, indices);
+
+    vertices.clear();
+    indices.clear();
+    GeneratePlane(vertices, indices, kPlaneSize, kPlaneSize);
+    tracer.SetMesh(SceneMesh::Plane, vertices, indices);
+
+    std::vector<SceneInstance> instances;
+    BuildSceneInstances(animationTime, animationSpeed, instances);
+
+    // Initial camera of D3DRenderer: position (0, 5, -10), yaw = pitch = 0.
+    CpuCamera camera = CpuCamera::FromYawPitch(
+        {0.0f, 5.0f, -10.0f}, 0.0f, 0.0f,
+        (float)settings.width / (float)settings.height);
+
+    std::vector<uint8_t> image;
+    double totalSeconds = 0.0;
+    uint64_t totalRays = 0;
+    CpuPathTracer::Stats stats;
+    for (int f = 0; f < frames; ++f) {
+      stats = tracer.Render(settings, camera, instances, image);
+      totalSeconds += stats.seconds;
+      totalRays += stats.totalRays;
+    }
+
+    std::printf("Resolution      : %dx%d, %u bounces, %zu instances\n",
+                settings.width, settings.height, settings.maxBounces,
+                instances.size());
+    std::printf("Threads         : %u (tile %d)\n", stats.threadCount,
+                settings.tileSize);
+    std::printf("Rays per frame  : %llu (%llu primary)\n",
+                (unsigned long long)stats.totalRays,
+                (unsigned long long)stats.primaryRays);
+    std::printf("Frame time      : %.2f ms (avg of %d)\n",
+                totalSeconds * 1000.0 / frames, frames);
+    std::printf("Throughput      : %.2f Mrays/s (%.2f Mrays/s per thread)\n",
+                totalRays / totalSeconds / 1e6,
+                totalRays / totalSeconds / 1e6 / stats.threadCount);
+
+    if (!WritePpm(outPath.c_str(), settings.width, settings.height, image)) {
+      std::fprintf(stderr, "Failed to write %s\n", outPath.c_str());
+      return 1;
+    }
+    std::printf("Wrote %s\n", outPath.c_str());
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "Exception: %s\n", e.what());
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,318 @@
+// Drives DynamicResolutionController with synthetic frame-time traces, or a
+// recorded one, so the renderer's resolution control can be tuned and
+// checked without a GPU.
+//
+// The simulated GPU spends a fixed overhead (TLAS build, resolve, ImGui)
+// plus a full-resolution ray tracing cost scaled by the rendered pixel
+// fraction, with optional noise and spikes. Measured frame times reach the
+// controller --latency frames late, as they do with frames in flight. The
+// scenarios step the load up and down like a bounce count change, push it
+// out of reach of the minimum scale, add noise, spikes and a slow sweep.
+// Checks: light load stays at full resolution, load steps settle on the
+// budget within a second at 60 Hz, an unreachable budget pins the minimum
+// scale and recovers without windup, single slow frames do not resize,
+// and the hysteresis band resizes less on noise than no band does. Any
+// failure makes the tool exit with status 1.
+
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t kOutputWidth = 1920;
+constexpr uint32_t kOutputHeight = 1080;
+
+struct Rng {
+  uint32_t state;
+  double Next() {
+    state = state * 1664525u + 1013904223u;
+    return (double)(state >> 8) * (1.0 / 16777216.0);
+  }
+};
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+struct Scenario {
+  const char *name;
+  std::vector<double> fullMs; // ray tracing cost at full resolution, per frame
+  int changeFrame = 0;        // last load change; statistics start after it
+  bool step = false;          // changeFrame is a step worth timing
+  double noise = 0.0;         // +- fraction of the ray tracing cost
+  int spikeEvery = 0;         // frames between spikes, 0 = none
+  double spikeMs = 0.0;
+};
+
+struct Result {
+  std::vector<float> scales; // per frame
+  int settleFrames = -1;     // after changeFrame, -1 if never settled
+  double meanMs = 0.0;       // from changeFrame + 60 on
+  double p95Ms = 0.0;
+  double overPercent = 0.0;  // frames over budget by more than 10%
+  int resizes = 0;           // render size changes from changeFrame + 60 on
+  double meanScale = 0.0;
+};
+
+Result Simulate(const Scenario &scenario,
+                const DynamicResolutionSettings &settings, double overheadMs,
+                int latency) {
+  DynamicResolutionController controller(settings);
+  Rng rng{1234};
+  int frames = (int)scenario.fullMs.size();
+  std::vector<double> frameMs(frames);
+  Result result;
+  result.scales.resize(frames);
+  DynamicResolutionSize size = controller.RenderSize(kOutputWidth,
+                                                     kOutputHeight);
+
+  for (int f = 0; f < frames; ++f) {
+    if (f >= latency) {
+      controller.Update(frameMs[f - latency]);
+    }
+    DynamicResolutionSize next = controller.RenderSize(kOutputWidth,
+                                                       kOutputHeight);
+    int window = scenario.changeFrame + 60;
+    if (f >= window && (next.width != size.width ||
+                        next.height != size.height)) {
+      ++result.resizes;
+    }
+    size = next;
+    double area = (double)size.width * size.height /
+                  ((double)kOutputWidth * kOutputHeight);
+    double rays = scenario.fullMs[f] * area *
+                  (1.0 + scenario.noise * (rng.Next() * 2.0 - 1.0));
+    double spike = scenario.spikeEvery && f % scenario.spikeEvery ==
+                                              scenario.spikeEvery - 1
+                       ? scenario.spikeMs
+                       : 0.0;
+    frameMs[f] = overheadMs + rays + spike;
+    result.scales[f] = controller.Scale();
+  }
+
+  // Settled once the scale stays within 0.05 of where it ends up.
+  double finalScale = 0.0;
+  int tail = std::min(100, frames - scenario.changeFrame);
+  for (int f = frames - tail; f < frames; ++f) {
+    finalScale += result.scales[f] / tail;
+  }
+  result.settleFrames = 0;
+  for (int f = scenario.changeFrame; f < frames; ++f) {
+    if (std::fabs(result.scales[f] - finalScale) > 0.05) {
+      result.settleFrames = f + 1 - scenario.changeFrame;
+    }
+  }
+
+  std::vector<double> window(frameMs.begin() + std::min(
+                                 frames, scenario.changeFrame + 60),
+                             frameMs.end());
+  if (!window.empty()) {
+    int over = 0;
+    for (double ms : window) {
+      result.meanMs += ms / window.size();
+      over += ms > settings.targetMs * 1.1;
+    }
+    result.overPercent = 100.0 * over / window.size();
+    std::sort(window.begin(), window.end());
+    result.p95Ms = window[(window.size() * 95) / 100];
+    for (int f = frames - (int)window.size(); f < frames; ++f) {
+      result.meanScale += result.scales[f] / window.size();
+    }
+  }
+  return result;
+}
+
+void Print(const char *name, bool step, const Result &r) {
+  char settle[16] = "-";
+  if (step) {
+    std::snprintf(settle, sizeof(settle), "%d", r.settleFrames);
+  }
+  std::printf("%-22s %7s %8.2f %8.2f %7.1f %8d %7.3f\n", name, settle,
+              r.meanMs, r.p95Ms, r.overPercent, r.resizes, r.meanScale);
+}
+
+Scenario Steps(const char *name, std::initializer_list<double> levels,
+               int framesPerLevel) {
+  Scenario s;
+  s.name = name;
+  for (double ms : levels) {
+    s.changeFrame = (int)s.fullMs.size();
+    s.fullMs.insert(s.fullMs.end(), framesPerLevel, ms);
+  }
+  s.step = s.changeFrame > 0;
+  return s;
+}
+
+void CheckRenderSize() {
+  DynamicResolutionSettings settings;
+  settings.minScale = 0.25f;
+  DynamicResolutionController controller(settings);
+  DynamicResolutionSize full = controller.RenderSize(1366, 767);
+  Expect(full.width == 1366 && full.height == 767,
+         "full scale renders the whole output, odd sizes included");
+
+  bool rounded = true, bounded = true;
+  for (int i = 0; i < 200; ++i) {
+    controller.Update(i < 100 ? 40.0 : 8.0);
+    DynamicResolutionSize size = controller.RenderSize(1366, 767);
+    if (controller.Scale() < 1.0f) {
+      rounded &= size.width % 8 == 0 && size.height % 8 == 0;
+    }
+    bounded &= size.width >= 8 && size.width <= 1366 && size.height >= 8 &&
+               size.height <= 767;
+  }
+  Expect(rounded, "scaled sizes are multiples of the granularity");
+  Expect(bounded, "render size stays within the output");
+  DynamicResolutionSize tiny = controller.RenderSize(5, 3);
+  Expect(tiny.width <= 5 && tiny.height <= 3 && tiny.width && tiny.height,
+         "outputs smaller than the granularity are not exceeded");
+
+  controller.Reset(0.5f);
+  float before = controller.Scale();
+  controller.Update(0.0);
+  controller.Update(-3.0);
+  controller.Update(std::nan(""));
+  controller.Update(INFINITY);
+  Expect(controller.Scale() == before, "invalid frame times are ignored");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double targetMs = 1000.0 / 60.0;
+  double overheadMs = 2.0;
+  int latency = 2;
+  const char *tracePath = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--target") && i + 1 < argc) {
+      targetMs = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--overhead") && i + 1 < argc) {
+      overheadMs = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--latency") && i + 1 < argc) {
+      latency = std::max(1, std::atoi(argv[++i])); // 1 = last frame
+    } else if (!std::strcmp(argv[i], "--trace") && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else {
+      std::printf("Usage: DynamicResolutionSimulator [--target MS] "
+                  "[--overhead MS] [--latency FRAMES] [--trace FILE]\n"
+                  "FILE holds one full-resolution frame time in ms per "
+                  "line.\n");
+      return 1;
+    }
+  }
+
+  CheckRenderSize();
+  std::printf("Render size checks: %s\n\n", g_failures ? "FAIL" : "ok");
+
+  DynamicResolutionSettings settings;
+  settings.targetMs = targetMs;
+  std::printf("Budget %.2f ms, overhead %.1f ms, %d frames of latency, "
+              "%ux%u output\n",
+              targetMs, overheadMs, latency, kOutputWidth, kOutputHeight);
+  std::printf("%-22s %7s %8s %8s %7s %8s %7s\n", "scenario", "settle",
+              "mean ms", "p95 ms", "over %", "resizes", "scale");
+
+  // Ray tracing cost at full resolution, before the overhead: the light
+  // load leaves full resolution enough headroom to clear the hysteresis
+  // band, the heavy one needs about half the pixels.
+  const double light = std::max(0.0, targetMs * 0.75 - overheadMs);
+  const double heavy = targetMs * 1.9;
+
+  Scenario lightLoad = Steps("light load", {light}, 600);
+  Result lightResult = Simulate(lightLoad, settings, overheadMs, latency);
+  Print(lightLoad.name, lightLoad.step, lightResult);
+  bool alwaysFull = true;
+  for (float s : lightResult.scales) {
+    alwaysFull &= s == settings.maxScale;
+  }
+  Expect(alwaysFull, "light load stays at full resolution");
+
+  Scenario stepUp = Steps("bounces up", {light, heavy}, 300);
+  Result stepUpResult = Simulate(stepUp, settings, overheadMs, latency);
+  Print(stepUp.name, stepUp.step, stepUpResult);
+  Expect(stepUpResult.settleFrames >= 0 && stepUpResult.settleFrames <= 60,
+         "a load increase settles within 60 frames");
+  Expect(stepUpResult.meanMs <= targetMs * 1.005 &&
+             stepUpResult.meanMs >= targetMs * (1.0 - settings.upBand),
+         "the settled frame time sits in the hysteresis band");
+
+  Scenario stepDown = Steps("bounces down", {heavy, light}, 300);
+  Result stepDownResult = Simulate(stepDown, settings, overheadMs, latency);
+  Print(stepDown.name, stepDown.step, stepDownResult);
+  Expect(stepDownResult.settleFrames <= 60 &&
+             stepDownResult.scales.back() == settings.maxScale,
+         "a load decrease returns to full resolution within 60 frames");
+
+  Scenario unreachable = Steps("out of reach", {targetMs * 8.0, light}, 300);
+  Result unreachableResult =
+      Simulate(unreachable, settings, overheadMs, latency);
+  Print(unreachable.name, unreachable.step, unreachableResult);
+  bool pinned = true;
+  for (int f = 100; f < 300; ++f) {
+    pinned &= unreachableResult.scales[f] == settings.minScale;
+  }
+  Expect(pinned, "an unreachable budget pins the minimum scale");
+  Expect(unreachableResult.settleFrames <= 60,
+         "recovery from the minimum does not wind up");
+
+  Scenario noisy = Steps("noisy", {heavy}, 1200);
+  noisy.changeFrame = 0;
+  noisy.noise = 0.2;
+  Result noisyResult = Simulate(noisy, settings, overheadMs, latency);
+  Print(noisy.name, noisy.step, noisyResult);
+  DynamicResolutionSettings noBand = settings;
+  noBand.upBand = noBand.downBand = 0.0f;
+  Result noBandResult = Simulate(noisy, noBand, overheadMs, latency);
+  Print("noisy, no band", false, noBandResult);
+  Expect(noisyResult.resizes * 2 < noBandResult.resizes,
+         "the hysteresis band at least halves resizes on noise");
+  Expect(noisyResult.overPercent < 5.0, "noise rarely overruns the budget");
+
+  Scenario spikes = Steps("spikes", {targetMs * 1.2}, 1200);
+  spikes.changeFrame = 0;
+  spikes.spikeEvery = 97;
+  spikes.spikeMs = targetMs * 3.0;
+  Result spikeResult = Simulate(spikes, settings, overheadMs, latency);
+  Print(spikes.name, spikes.step, spikeResult);
+  Expect(spikeResult.resizes == 0, "single slow frames do not resize");
+
+  Scenario sweep;
+  sweep.name = "sweep";
+  for (int f = 0; f < 1200; ++f) {
+    double phase = 0.5 - 0.5 * std::cos(f * 2.0 * 3.14159265358979 / 400.0);
+    sweep.fullMs.push_back(light + (heavy - light) * phase);
+  }
+  Result sweepResult = Simulate(sweep, settings, overheadMs, latency);
+  Print(sweep.name, sweep.step, sweepResult);
+  Expect(sweepResult.overPercent < 5.0,
+         "a slowly changing load stays within budget");
+
+  if (tracePath) {
+    std::ifstream file(tracePath);
+    Scenario trace;
+    trace.name = "trace";
+    double ms;
+    while (file >> ms) {
+      trace.fullMs.push_back(std::max(0.0, ms - overheadMs));
+    }
+    if (trace.fullMs.empty()) {
+      std::fprintf(stderr, "No frame times in %s\n", tracePath);
+      return 1;
+    }
+    Print(trace.name, false, Simulate(trace, settings, overheadMs, latency));
+  }
+  return g_failures ? 1 : 0;
+}
@@ -0,0 +1,178 @@
+// Runs the renderer's frame scheduling against SimulatedGpuQueue so CPU/GPU
+// overlap can be measured without a GPU.
+//
+// Every frame costs a fixed amount of CPU time (recording, TLAS upload) and
+// GPU time (TLAS build + DispatchRays + ImGui), optionally with random
+// jitter. Each scenario runs once with the pre-FramePacer scheme, which
+// waited for the TLAS build in the middle of the frame and again after
+// Present, and once per frames-in-flight setting through FramePacer. For
+// steady workloads the measured frame time is compared against the
+// analytic result: cpu + gpu with one frame in flight, max(cpu, gpu) with
+// two or more. A mismatch makes the tool exit with status 1.
+
+#include "FramePacer.h"
+#include "GpuQueue.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct Scenario {
+  const char *name;
+  double cpuMs;
+  double gpuMs;
+  double jitter; // +- fraction applied to both costs per frame
+};
+
+struct Rng {
+  uint32_t state;
+  double Next() {
+    state = state * 1664525u + 1013904223u;
+    return (double)(state >> 8) * (1.0 / 16777216.0);
+  }
+};
+
+struct Result {
+  double frameMs = 0.0; // frame start to frame start, second half of the run
+  double gpuUtilization = 0.0;
+  uint64_t stalls = 0;
+  double stallMs = 0.0;
+  uint32_t maxInFlight = 0;
+};
+
+// Per-frame costs, identical for every scheduling variant of a scenario.
+std::vector<double> FrameCosts(const Scenario &s, int frames, double base,
+                               uint32_t seed) {
+  Rng rng{seed};
+  std::vector<double> costs((size_t)frames);
+  for (double &c : costs) {
+    c = base * (1.0 + s.jitter * (rng.Next() * 2.0 - 1.0));
+  }
+  return costs;
+}
+
+// The scheme D3DRenderer used before frames in flight: submit the TLAS
+// build, wait for it, record and submit the main pass, wait again.
+Result RunSerial(const std::vector<double> &cpu,
+                 const std::vector<double> &gpu) {
+  SimulatedGpuQueue queue;
+  Result r;
+  double halfStart = 0.0, lastStart = 0.0;
+  size_t frames = cpu.size();
+  for (size_t f = 0; f < frames; ++f) {
+    if (f == frames / 2) {
+      halfStart = queue.CpuTime();
+    }
+    lastStart = queue.CpuTime();
+    queue.AdvanceCpu(cpu[f] * 0.25);
+    queue.Submit(gpu[f] * 0.1);
+    double waited = queue.Flush();
+    queue.AdvanceCpu(cpu[f] * 0.75);
+    queue.Submit(gpu[f] * 0.9);
+    waited += queue.Flush();
+    r.stalls += 2;
+    r.stallMs += waited;
+  }
+  r.frameMs = (lastStart - halfStart) / (double)(frames - 1 - frames / 2);
+  r.gpuUtilization = queue.GpuBusyMs() / queue.CpuTime();
+  r.maxInFlight = 1;
+  return r;
+}
+
+Result RunPaced(const std::vector<double> &cpu, const std::vector<double> &gpu,
+                uint32_t framesInFlight) {
+  SimulatedGpuQueue queue;
+  FramePacer pacer(queue, framesInFlight);
+  double halfStart = 0.0, lastStart = 0.0;
+  size_t frames = cpu.size();
+  for (size_t f = 0; f < frames; ++f) {
+    pacer.BeginFrame();
+    if (f == frames / 2) {
+      halfStart = queue.CpuTime();
+    }
+    lastStart = queue.CpuTime();
+    queue.AdvanceCpu(cpu[f]);
+    queue.Submit(gpu[f]);
+    pacer.EndFrame();
+  }
+  pacer.WaitIdle();
+
+  Result r;
+  r.frameMs = (lastStart - halfStart) / (double)(frames - 1 - frames / 2);
+  r.gpuUtilization = queue.GpuBusyMs() / queue.CpuTime();
+  r.stalls = pacer.Stats().stalls;
+  r.stallMs = pacer.Stats().stallMs;
+  r.maxInFlight = pacer.Stats().maxInFlight;
+  return r;
+}
+
+void Report(const char *mode, const Result &r, double expected, bool &ok) {
+  char check[16] = "-";
+  if (expected > 0.0) {
+    bool match = std::fabs(r.frameMs - expected) <= expected * 0.01;
+    std::snprintf(check, sizeof(check), "%s", match ? "ok" : "FAIL");
+    ok = ok && match;
+  }
+  std::printf("  %-18s %9.2f %8.1f %7.0f%% %8llu %9.1f %6u %9s\n", mode,
+              r.frameMs, 1000.0 / r.frameMs, r.gpuUtilization * 100.0,
+              (unsigned long long)r.stalls, r.stallMs, r.maxInFlight, check);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<Scenario> scenarios = {
+      {"CPU bound", 8.0, 5.0, 0.0},
+      {"GPU bound", 4.0, 10.0, 0.0},
+      {"balanced", 6.0, 6.0, 0.0},
+      {"balanced, 30% jitter", 6.0, 6.0, 0.3},
+  };
+  int frames = 600;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--cpu") && i + 2 < argc) {
+      double cpu = std::atof(argv[++i]);
+      double gpu = std::atof(argv[++i]);
+      scenarios = {{"custom", cpu, gpu, 0.0}};
+    } else if (!std::strcmp(argv[i], "--jitter") && i + 1 < argc) {
+      double jitter = std::atof(argv[++i]) / 100.0;
+      for (Scenario &s : scenarios) {
+        s.jitter = jitter;
+      }
+    } else if (!std::strcmp(argv[i], "--frames") && i + 1 < argc) {
+      frames = std::max(4, std::atoi(argv[++i]));
+    } else {
+      std::printf("Usage: FramePacingSimulator [--cpu CPU_MS GPU_MS] "
+                  "[--jitter PERCENT] [--frames N]\n");
+      return 1;
+    }
+  }
+
+  bool ok = true;
+  for (const Scenario &s : scenarios) {
+    std::vector<double> cpu = FrameCosts(s, frames, s.cpuMs, 17u);
+    std::vector<double> gpu = FrameCosts(s, frames, s.gpuMs, 91u);
+    bool steady = s.jitter == 0.0;
+
+    std::printf("%s: cpu %.1f ms, gpu %.1f ms per frame\n", s.name, s.cpuMs,
+                s.gpuMs);
+    std::printf("  %-18s %9s %8s %8s %8s %9s %6s %9s\n", "schedule",
+                "frame ms", "fps", "gpu busy", "waits", "wait ms", "queued",
+                "expected");
+    Report("serial (old)", RunSerial(cpu, gpu),
+           steady ? s.cpuMs + s.gpuMs : 0.0, ok);
+    for (uint32_t n = 1; n <= FramePacer::kMaxFramesInFlight; ++n) {
+      char mode[32];
+      std::snprintf(mode, sizeof(mode), "%u in flight", n);
+      double expected = n == 1 ? s.cpuMs + s.gpuMs : std::max(s.cpuMs, s.gpuMs);
+      Report(mode, RunPaced(cpu, gpu, n), steady ? expected : 0.0, ok);
+    }
+    std::printf("\n");
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,319 @@
+// Drives GpuProfiler, the bookkeeping behind the renderer's GPU timestamp
+// profiler, with a simulated GPU that writes timestamps into a readback
+// buffer frames after they were recorded, as D3D12GpuProfiler sees them.
+//
+// Checks tick-to-millisecond conversion at awkward frequencies and large
+// counter values, that every frame slot owns its own queries, that each
+// frame is resolved exactly once and only after its slot comes round, that
+// the rolling average is the exact mean of the window, that nested scopes
+// and the frame span come out right and that bad timestamps are dropped.
+// Any failure makes the tool exit with status 1. The table times the
+// per-frame CPU cost of the bookkeeping for 4 to 64 scopes.
+
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace {
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+bool Near(double a, double b, double tolerance = 1e-9) {
+  return std::fabs(a - b) <= tolerance * std::max(1.0, std::fabs(b));
+}
+
+void CheckConversion() {
+  Expect(GpuProfiler::TicksToMs(0, 10'000'000, 10'000'000) == 1000.0,
+         "one second of a 10 MHz counter is 1000 ms");
+  Expect(Near(GpuProfiler::TicksToMs(5, 5 + 19'200, 19'200'000), 1.0),
+         "19.2 MHz counter");
+  Expect(Near(GpuProfiler::TicksToMs(0, 1, 1'000'000'007), 1e-6, 1e-6),
+         "one tick of a prime-frequency counter");
+  // Near the top of the counter, where begin and end are not exactly
+  // representable as doubles but their difference is.
+  uint64_t top = UINT64_MAX - 1'000'000;
+  Expect(Near(GpuProfiler::TicksToMs(top, top + 123'457, 24'000'001),
+              123'457.0 * 1000.0 / 24'000'001.0),
+         "large counter values lose no precision");
+  // A long span at a high frequency, whose product with 1000 overflows.
+  uint64_t span = UINT64_MAX / 4;
+  Expect(Near(GpuProfiler::TicksToMs(0, span, 3'000'000'017),
+              (double)span / 3'000'000'017.0 * 1000.0),
+         "long spans do not overflow");
+  Expect(GpuProfiler::TicksToMs(10, 9, 1000) == 0.0 &&
+             GpuProfiler::TicksToMs(0, 10, 0) == 0.0,
+         "reversed timestamps and zero frequency read as 0");
+}
+
+void CheckRanges() {
+  const uint32_t slots = 3, maxScopes = 5;
+  GpuProfiler profiler(slots, maxScopes);
+  std::vector<int> owner(profiler.QueryCount(), -1);
+  bool inside = true, disjoint = true, ranges = true, spare = true;
+  for (uint32_t slot = 0; slot < slots; ++slot) {
+    profiler.BeginFrame(slot);
+    std::vector<uint32_t> queries;
+    for (uint32_t i = 0; i < maxScopes; ++i) {
+      GpuProfilerScope s = profiler.AddScope("scope");
+      queries.push_back(s.beginQuery);
+      queries.push_back(s.endQuery);
+    }
+    GpuProfilerScope extra = profiler.AddScope("overflow");
+    GpuQueryRange range = profiler.EndFrame();
+    ranges &= range.count == maxScopes * 2;
+    for (uint32_t q : queries) {
+      inside &= q >= range.first && q < range.first + range.count;
+      if (q >= owner.size()) {
+        inside = false;
+        continue;
+      }
+      disjoint &= owner[q] == -1;
+      owner[q] = (int)slot;
+    }
+    for (uint32_t q : {extra.beginQuery, extra.endQuery}) {
+      spare &= q < owner.size() && owner[q] == -1 &&
+               (q < range.first || q >= range.first + range.count);
+    }
+  }
+  Expect(inside, "scope queries lie in the frame's resolve range");
+  Expect(disjoint, "frame slots never share a query");
+  Expect(ranges, "the resolve range covers exactly the frame's scopes");
+  Expect(spare, "scopes past the limit use the unresolved spare pair");
+}
+
+// The scopes a frame records and how long each takes on the simulated GPU.
+struct SimScope {
+  const char *name;
+  uint32_t depth;
+};
+
+const SimScope kScopes[] = {
+    {"TLAS build", 0},          {"DispatchRays", 0}, {"Post-processing", 0},
+    {"Checkerboard resolve", 1}, {"Upscale", 1},      {"ImGui", 0},
+};
+constexpr uint32_t kScopeCount = (uint32_t)(sizeof(kScopes) / sizeof(kScopes[0]));
+constexpr uint32_t kParentScope = 2; // holds the two nested scopes
+
+uint64_t DurationTicks(uint64_t frame, uint32_t scope) {
+  uint64_t ticks = 1000 + (frame * 7919 + scope * 104729) % 50000;
+  return scope == kParentScope ? ticks + 100000 : ticks;
+}
+
+// Plays frames through a pipeline of framesInFlight slots. The GPU writes
+// a frame's timestamps into the readback buffer when it retires,
+// framesInFlight frames after recording; the CPU resolves a slot right
+// before reusing it, as the renderer does once FramePacer hands it out.
+void CheckPipeline(uint32_t framesInFlight) {
+  const uint64_t frequency = 24'000'000;
+  const uint32_t window = 16, frames = 100;
+  GpuProfiler profiler(framesInFlight, kScopeCount, window);
+  std::vector<uint64_t> readback(profiler.QueryCount(), 0);
+  struct InFlight {
+    uint64_t frame;
+    GpuProfilerScope scopes[kScopeCount];
+  };
+  std::deque<InFlight> gpu;
+  uint64_t clock = 1ull << 40;
+  bool latency = true, values = true, once = true;
+  std::vector<int> resolved(frames + 1, 0);
+  std::vector<std::vector<double>> history(kScopeCount);
+  std::vector<double> frameHistory;
+
+  for (uint64_t frame = 1; frame <= frames; ++frame) {
+    uint32_t slot = (uint32_t)((frame - 1) % framesInFlight);
+    // The GPU retires the oldest frame once framesInFlight are queued.
+    if (gpu.size() == framesInFlight) {
+      const InFlight &done = gpu.front();
+      uint64_t start = clock, child = clock;
+      for (uint32_t i = 0; i < kScopeCount; ++i) {
+        // Nested scopes run back to back from their parent's begin, which
+        // is long enough to hold them.
+        uint64_t d = DurationTicks(done.frame, i);
+        uint64_t &cursor = kScopes[i].depth == 0 ? clock : child;
+        readback[done.scopes[i].beginQuery] = cursor;
+        readback[done.scopes[i].endQuery] = cursor + d;
+        if (kScopes[i].depth == 0) {
+          child = cursor;
+        }
+        cursor += d;
+        history[i].push_back((double)d * 1000.0 / frequency);
+      }
+      frameHistory.push_back((double)(clock - start) * 1000.0 / frequency);
+      clock += 777;
+      gpu.pop_front();
+    }
+
+    if (profiler.Pending(slot)) {
+      GpuQueryRange range = profiler.PendingRange(slot);
+      uint64_t before = profiler.ResolvedFrame();
+      profiler.Resolve(slot, readback.data() + range.first, frequency);
+      uint64_t got = profiler.ResolvedFrame();
+      latency &= got == before + 1 && got + framesInFlight == frame;
+      if (got <= frames) {
+        ++resolved[got];
+      }
+      for (uint32_t i = 0; i < kScopeCount; ++i) {
+        const GpuScopeStats &stats = profiler.Scopes()[i];
+        values &= stats.lastFrame == got &&
+                  Near(stats.lastMs, (double)DurationTicks(got, i) * 1000.0 /
+                                         frequency);
+      }
+    }
+
+    profiler.BeginFrame(slot);
+    InFlight recorded{frame, {}};
+    // A parent scope is added before its nested ones, as in the renderer.
+    for (uint32_t i = 0; i < kScopeCount; ++i) {
+      recorded.scopes[i] = profiler.AddScope(kScopes[i].name, kScopes[i].depth);
+    }
+    profiler.EndFrame();
+    gpu.push_back(recorded);
+  }
+
+  for (uint64_t frame = 1; frame + framesInFlight <= frames; ++frame) {
+    once &= resolved[frame] == 1;
+  }
+  bool average = true, nesting = true;
+  for (uint32_t i = 0; i < kScopeCount; ++i) {
+    const GpuScopeStats &stats = profiler.Scopes()[i];
+    const std::vector<double> &h = history[i];
+    double sum = 0.0, peak = 0.0;
+    for (size_t j = h.size() - window; j < h.size(); ++j) {
+      sum += h[j];
+      peak = std::max(peak, h[j]);
+    }
+    average &= Near(stats.averageMs, sum / window) && stats.maxMs == peak;
+    nesting &= stats.name == kScopes[i].name && stats.depth == kScopes[i].depth;
+  }
+  double frameSum = 0.0;
+  for (size_t j = frameHistory.size() - window; j < frameHistory.size(); ++j) {
+    frameSum += frameHistory[j];
+  }
+  average &= Near(profiler.AverageFrameMs(), frameSum / window);
+  nesting &= Near(profiler.FrameMs(), frameHistory.back());
+
+  std::printf("%u in flight: resolved frame %llu on frame %u, frame %.3f ms "
+              "(avg %.3f)\n",
+              framesInFlight, (unsigned long long)profiler.ResolvedFrame(),
+              frames, profiler.FrameMs(), profiler.AverageFrameMs());
+  Expect(latency, "frames resolve in order, framesInFlight frames late");
+  Expect(values, "resolved scopes read their own frame's timestamps");
+  Expect(once, "every retired frame is resolved exactly once");
+  Expect(average, "rolling averages are the exact mean of the window");
+  Expect(nesting, "nested scopes keep their depth and stay inside the frame");
+}
+
+void CheckBadData() {
+  GpuProfiler profiler(2, 4);
+  profiler.BeginFrame(0);
+  profiler.AddScope("good");
+  profiler.AddScope("reversed");
+  GpuQueryRange range = profiler.EndFrame();
+  uint64_t ticks[4] = {100, 300, 500, 400};
+  Expect(range.first == 0 && range.count == 4, "two scopes resolve four queries");
+  profiler.Resolve(0, ticks, 1000);
+  const std::vector<GpuScopeStats> &scopes = profiler.Scopes();
+  Expect(scopes[0].lastFrame == 1 && Near(scopes[0].lastMs, 200.0),
+         "valid scope is measured");
+  Expect(scopes[1].lastFrame == 0, "a scope ending before it begins is dropped");
+  Expect(Near(profiler.FrameMs(), 200.0), "dropped scopes leave the frame span");
+  Expect(!profiler.Pending(0), "a resolved frame is no longer pending");
+
+  profiler.BeginFrame(1);
+  profiler.AddScope("good");
+  profiler.EndFrame();
+  profiler.Resolve(1, ticks, 0);
+  Expect(!profiler.Pending(1) && scopes[0].lastFrame == 1,
+         "zero frequency discards the frame");
+
+  profiler.BeginFrame(0);
+  profiler.AddScope("good");
+  profiler.EndFrame();
+  profiler.Discard(0);
+  Expect(!profiler.Pending(0) && profiler.ResolvedFrame() == 1,
+         "discarded frames are never resolved");
+
+  profiler.BeginFrame(1);
+  range = profiler.EndFrame();
+  Expect(range.count == 0 && !profiler.Pending(1),
+         "a frame without scopes resolves nothing");
+}
+
+void Measure(uint32_t scopes, double minSeconds) {
+  const uint32_t slots = 3;
+  GpuProfiler profiler(slots, scopes);
+  std::vector<uint64_t> readback(profiler.QueryCount());
+  for (size_t i = 0; i < readback.size(); ++i) {
+    readback[i] = i * 1000;
+  }
+  std::vector<std::string> names(scopes);
+  for (uint32_t i = 0; i < scopes; ++i) {
+    names[i] = "Scope " + std::to_string(i);
+  }
+  uint64_t frames = 0;
+  double seconds = 0.0;
+  auto start = std::chrono::steady_clock::now();
+  do {
+    for (int i = 0; i < 256; ++i, ++frames) {
+      uint32_t slot = (uint32_t)(frames % slots);
+      if (profiler.Pending(slot)) {
+        profiler.Resolve(slot,
+                         readback.data() + profiler.PendingRange(slot).first,
+                         10'000'000);
+      }
+      profiler.BeginFrame(slot);
+      for (uint32_t s = 0; s < scopes; ++s) {
+        profiler.AddScope(names[s].c_str());
+      }
+      profiler.EndFrame();
+    }
+    seconds = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  } while (seconds < minSeconds);
+  std::printf("%7u %12.2f %12.1f\n", scopes, seconds * 1e6 / frames,
+              seconds * 1e9 / ((double)frames * scopes));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double minSeconds = 0.25;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      minSeconds = std::atof(argv[++i]);
+    } else {
+      std::printf("Usage: GpuProfilerSimulator [--seconds S]\n");
+      return 1;
+    }
+  }
+
+  CheckConversion();
+  CheckRanges();
+  for (uint32_t framesInFlight = 1; framesInFlight <= 3; ++framesInFlight) {
+    CheckPipeline(framesInFlight);
+  }
+  CheckBadData();
+  std::printf("Profiler checks: %s\n\n", g_failures ? "FAIL" : "ok");
+
+  std::printf("%7s %12s %12s\n", "scopes", "us/frame", "ns/scope");
+  for (uint32_t scopes : {4u, 8u, 16u, 64u}) {
+    Measure(scopes, minSeconds);
+  }
+  return g_failures ? 1 : 0;
+}
@@ -0,0 +1,638 @@
+// Runs the CPU side of the renderer's frame headless, on NullDevice, so its
+// cost can be measured on machines without D3D12.
+//
+// Every frame does what D3DRenderer::Render() does apart from the D3D12
+// calls themselves: waits for its FramePacer slot, retires the upload ring
+// and command list pool, animates the scene and refits the instance BVH on
+// a job, moves the camera along a scripted path and writes ShaderParams
+// into the ring, picks the balls' sphere levels of detail, plans the TLAS
+// build and streams its instance descs on a job into list 0, records the
+// frame plan's barriers and passes into list 1, and submits both. The
+// table reports CPU milliseconds per frame (p50/p95/p99/max, warm-up frames
+// excluded) at full resolution, with the dynamic resolution upscale and
+// with checkerboard rendering on top.
+//
+// Checks that the camera moves along its own axes, that every frame plan
+// hands each pass its textures in the right states and leaves them at rest
+// with at most one batch per pass, that the static descs plus the streamed
+// balls equal MakeInstanceDesc over the whole scene with each ball on its
+// selected sphere level of detail, that the shader table passes each
+// instance its material, and that NullDevice saw no state mismatch or bad
+// instance desc while replaying the runs. Any failure makes the tool exit
+// with status 1.
+
+#include "CommandListPool.h"
+#include "CpuPathTracer.h"
+#include "DynamicResolution.h"
+#include "FrameLogic.h"
+#include "FramePacer.h"
+#include "InstanceAnimator.h"
+#include "InstanceBvh.h"
+#include "JobSystem.h"
+#include "MeshBvh.h"
+#include "MeshGenerator.h"
+#include "NullDevice.h"
+#include "SceneInstances.h"
+#include "SphereLod.h"
+#include "TlasUpdatePolicy.h"
+#include "UploadRing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Renderer constants this mirrors (D3DRenderer.h, d3d12.h).
+constexpr uint64_t kUploadRingSize = 4 << 20;
+constexpr uint64_t kConstantAlignment = 256;
+constexpr uint64_t kInstanceDescAlignment = 16;
+constexpr uint32_t kRecordingsPerFrame = 2; // TLAS, main
+constexpr SceneBlasAddresses kBlas = {0x10000, 0x20000};
+constexpr uint64_t kSphereLodBlas[kSphereLodCount] = {0x20000, 0x30000,
+                                                      0x40000, 0x50000};
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+bool Near(Float3 a, Float3 b) {
+  return Length(a - b) < 1e-4f;
+}
+
+// Registers the scene's bottom levels, built once, as the renderer does at
+// startup.
+void SetSceneMeshes(InstanceBvh &bvh) {
+  static const struct Meshes {
+    MeshBvh sphere, plane;
+    Meshes() {
+      std::vector<MeshVertex> vertices;
+      std::vector<uint32_t> indices;
+      GenerateSphere(vertices, indices, kSphereRadius, kSphereSlices,
+                     kSphereStacks);
+      sphere.Build(vertices, indices);
+      vertices.clear();
+      indices.clear();
+      GeneratePlane(vertices, indices, kPlaneSize, kPlaneSize);
+      plane.Build(vertices, indices);
+    }
+  } meshes;
+  bvh.SetMesh(SceneMesh::Sphere, &meshes.sphere);
+  bvh.SetMesh(SceneMesh::Plane, &meshes.plane);
+}
+
+// The camera path: a slow turn with a pitch sway, while strafing through
+// forward, right, back and left legs of three seconds each and holding
+// shift on every other lap.
+CameraInput ScriptedInput(int frame) {
+  CameraInput input;
+  input.yawDelta = 0.004f;
+  input.pitchDelta = 0.002f * std::sin(frame * 0.01f);
+  switch ((frame / 180) % 4) {
+  case 0:
+    input.forward = 1.0f;
+    break;
+  case 1:
+    input.right = 1.0f;
+    break;
+  case 2:
+    input.forward = -1.0f;
+    break;
+  default:
+    input.right = -1.0f;
+    break;
+  }
+  input.up = (frame / 90) % 2 ? 0.5f : -0.5f;
+  if ((frame / 720) % 2) {
+    input.speed *= 3.0f;
+  }
+  return input;
+}
+
+void CheckCamera() {
+  CameraState camera;
+  CameraInput input;
+  input.forward = 1.0f;
+  ApplyCameraInput(input, camera);
+  Expect(Near(camera.position, {0.0f, 5.0f, -9.9f}),
+         "moving forward at yaw 0 walks +z");
+
+  camera = {};
+  input = {};
+  input.yawDelta = 3.14159265f / 2.0f;
+  input.right = 1.0f;
+  ApplyCameraInput(input, camera);
+  Expect(Near(camera.position, {0.0f, 5.0f, -10.1f}),
+         "turning right by 90 degrees makes right -z");
+
+  camera = {};
+  camera.pitch = 0.4f;
+  input = {};
+  input.up = 1.0f;
+  input.speed = 2.0f;
+  ApplyCameraInput(input, camera);
+  Expect(Near(camera.position, {0.0f, 7.0f, -10.0f}),
+         "up moves along world up whatever the pitch");
+
+  FrameShading shading;
+  shading.checkerboard = true;
+  shading.checkerboardParity = 1;
+  shading.renderWidth = 640;
+  shading.renderHeight = 360;
+  ShaderParams cb = BuildShaderParams(camera, 16.0f / 9.0f, shading);
+  CpuCamera reference = CpuCamera::FromYawPitch(camera.position, camera.yaw,
+                                                camera.pitch, 16.0f / 9.0f);
+  Expect(!std::memcmp(&cb.viewInverse, &reference.viewInverse,
+                      sizeof(Float4x4)) &&
+             !std::memcmp(&cb.projInverse, &reference.projInverse,
+                          sizeof(Float4x4)),
+         "ShaderParams matrices are CpuCamera's");
+  Expect(Near({cb.viewInverse.m[3][0], cb.viewInverse.m[3][1],
+               cb.viewInverse.m[3][2]},
+              camera.position),
+         "the inverse view translates to the camera position");
+  Expect(cb.cameraPos.w == 1.0f && cb.lightPos.w == 1.0f &&
+             cb.checkerboard == 1 && cb.checkerboardParity == 1 &&
+             cb.renderWidth == 640 && cb.renderHeight == 360,
+         "ShaderParams carries the shading settings");
+}
+
+// Replays plan on its own state table and checks what each pass is handed.
+void CheckPlan(const FramePlanInputs &inputs, const FramePlan &plan) {
+  using State = FrameResourceState;
+  State states[kFrameResourceCount];
+  for (uint32_t r = 0; r < kFrameResourceCount; ++r) {
+    states[r] = FrameResourceRestState((FrameResource)r);
+  }
+  auto apply = [&](uint32_t first, uint32_t count) {
+    bool seen[kFrameResourceCount] = {};
+    for (uint32_t i = first; i < first + count; ++i) {
+      const FrameBarrier &barrier = plan.barriers[i];
+      uint32_t r = (uint32_t)barrier.resource;
+      Expect(states[r] == barrier.before, "barrier starts in current state");
+      Expect(barrier.before != barrier.after, "no no-op transitions");
+      Expect(!seen[r], "at most one transition per texture and batch");
+      seen[r] = true;
+      states[r] = barrier.after;
+    }
+  };
+  auto in = [&](FrameResource r) { return states[(uint32_t)r]; };
+
+  FrameResource target = inputs.resolvedIndex ? FrameResource::Resolved1
+                                              : FrameResource::Resolved0;
+  FrameResource history = inputs.resolvedIndex ? FrameResource::Resolved0
+                                               : FrameResource::Resolved1;
+  FrameResource presented = FrameResource::Output;
+  std::vector<FramePass> passes;
+  for (const FramePlanStep &step : plan.steps) {
+    apply(step.firstBarrier, step.barrierCount);
+    passes.push_back(step.pass);
+    switch (step.pass) {
+    case FramePass::DispatchRays:
+      Expect(in(FrameResource::Output) == State::UnorderedAccess,
+             "DispatchRays writes the output");
+      break;
+    case FramePass::CheckerboardResolve:
+      Expect(in(FrameResource::Output) == State::ShaderRead &&
+                 in(history) == State::ShaderRead &&
+                 in(target) == State::UnorderedAccess,
+             "resolve reads output and history, writes its target");
+      presented = target;
+      break;
+    case FramePass::Upscale:
+      Expect(in(presented) == State::ShaderRead &&
+                 in(FrameResource::Upscaled) == State::UnorderedAccess,
+             "upscale reads the newest image, writes m_upscaled");
+      Expect(plan.upscaleSource == presented, "upscale source");
+      presented = FrameResource::Upscaled;
+      break;
+    case FramePass::CopyToBackBuffer:
+      Expect(in(presented) == State::CopySource &&
+                 in(FrameResource::BackBuffer) == State::CopyDest,
+             "copy reads the newest image into the back buffer");
+      Expect(plan.copySource == presented, "copy source");
+      break;
+    case FramePass::ImGui:
+      Expect(in(FrameResource::BackBuffer) == State::RenderTarget,
+             "ImGui draws into the back buffer");
+      break;
+    }
+  }
+  apply(plan.firstFinalBarrier, plan.finalBarrierCount);
+  for (uint32_t r = 0; r < kFrameResourceCount; ++r) {
+    Expect(states[r] == FrameResourceRestState((FrameResource)r),
+           "every texture ends the frame at rest");
+  }
+
+  std::vector<FramePass> expected = {FramePass::DispatchRays};
+  if (inputs.checkerboard) {
+    expected.push_back(FramePass::CheckerboardResolve);
+  }
+  if (inputs.upscale) {
+    expected.push_back(FramePass::Upscale);
+  }
+  expected.push_back(FramePass::CopyToBackBuffer);
+  expected.push_back(FramePass::ImGui);
+  Expect(passes == expected, "passes in renderer order");
+}
+
+void CheckFramePlans() {
+  std::printf("%-24s %9s %8s %14s\n", "frame plan", "barriers", "batches",
+              "round trips");
+  FramePlan plan;
+  for (int mode = 0; mode < 8; ++mode) {
+    FramePlanInputs inputs;
+    inputs.checkerboard = (mode & 1) != 0;
+    inputs.upscale = (mode & 2) != 0;
+    inputs.resolvedIndex = (mode >> 2) & 1;
+    if (!inputs.checkerboard && inputs.resolvedIndex) {
+      continue;
+    }
+    BuildFramePlan(inputs, plan);
+    CheckPlan(inputs, plan);
+
+    // What sending every texture back to rest after each pass costs: the
+    // output's round trip plus the back buffer's three steps, and one batch
+    // before and after each compute pass.
+    uint32_t roundTrips = 5 + (inputs.checkerboard ? 6 : 0) +
+                          (inputs.upscale ? 4 : 0);
+    uint32_t roundTripBatches = 5 + (inputs.checkerboard ? 2 : 0) +
+                                (inputs.upscale ? 2 : 0);
+    uint32_t batches = plan.finalBarrierCount ? 1 : 0;
+    for (const FramePlanStep &step : plan.steps) {
+      batches += step.barrierCount ? 1 : 0;
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "%s%s%s",
+                  inputs.checkerboard ? "checkerboard" : "full",
+                  inputs.upscale ? "+upscale" : "",
+                  inputs.checkerboard ? (inputs.resolvedIndex ? " (1)" : " (0)")
+                                      : "");
+    std::printf("%-24s %9zu %8u %8u / %3u\n", name, plan.barriers.size(),
+                batches, roundTrips, roundTripBatches);
+    Expect(plan.barriers.size() <= roundTrips && batches <= roundTripBatches,
+           "the plan never records more than the round trips");
+  }
+  std::printf("\n");
+}
+
+void CheckInstanceDescs(JobSystem &jobs) {
+  InstanceAnimator balls(kSceneBallCount);
+  TlasUpdateTracker tracker;
+  InstanceBvh bvh;
+  SetSceneMeshes(bvh);
+  std::vector<SceneInstance> instances;
+  std::vector<GpuInstanceDesc> staticDescs;
+  std::vector<GpuInstanceDesc> descs(2 + kSceneBallCount);
+  SphereLodSelector lod;
+  std::vector<uint8_t> levels(kSceneBallCount, 0);
+  CameraState camera;
+  bool coarser = false;
+
+  // Shrinking viewports push the balls down the level chain.
+  const uint32_t viewportHeights[] = {1080, 240, 60, 16};
+  for (int frame = 0; frame < 4; ++frame) {
+    float time = frame * 0.37f;
+    BuildSceneInstances(time, 1.5f, instances);
+    bvh.Update(instances);
+    uint32_t staticCount = (uint32_t)instances.size() - balls.Count();
+    lod.Select(instances.data() + staticCount, balls.Count(),
+               MakeSphereLodView(camera.position, kCameraFovY,
+                                 viewportHeights[frame]),
+               levels.data());
+    tracker.Plan(instances, &bvh.WorldBounds(0));
+    UpdateStaticInstanceDescs(instances, tracker.DirtyInstances(),
+                              staticCount, kBlas, staticDescs);
+    WriteSceneInstanceDescs(staticDescs, balls, time, 1.5f, kSphereLodBlas,
+                            levels.data(), descs.data(), jobs);
+
+    bool match = descs.size() == instances.size();
+    for (size_t i = 0; match && i < instances.size(); ++i) {
+      uint64_t blas = i < staticCount
+                          ? kBlas[instances[i].mesh]
+                          : kSphereLodBlas[levels[i - staticCount]];
+      GpuInstanceDesc expected = MakeInstanceDesc(instances[i], blas);
+      match = !std::memcmp(&descs[i], &expected, sizeof(expected));
+    }
+    Expect(match, "static plus streamed descs equal MakeInstanceDesc on "
+                  "each ball's level of detail");
+    for (uint8_t level : levels) {
+      coarser |= level != 0;
+    }
+  }
+  Expect(coarser, "some balls were given a coarser level of detail");
+}
+
+void CheckShaderTable() {
+  uint8_t identifiers[4][ShaderTableBuilder::kIdentifierSize];
+  for (int i = 0; i < 4; ++i) {
+    std::memset(identifiers[i], 0x10 + i, sizeof(identifiers[i]));
+  }
+  std::vector<HitGroupRecord> records = {
+      MakeHitGroupRecord(SceneMesh::Plane, 7),
+      MakeHitGroupRecord(SceneMesh::Sphere, 3),
+      MakeHitGroupRecord(SceneMesh::Sphere, 9),
+      MakeHitGroupRecord(SceneMesh::Plane, 9),
+      MakeHitGroupRecord(SceneMesh::Sphere, 4)};
+  ShaderTableBuilder builder =
+      BuildSceneShaderTable(identifiers[0], identifiers[1], identifiers[2],
+                            identifiers[3], records);
+  ShaderTableBuilder::Layout layout = builder.ComputeLayout();
+  const ShaderTableRange &hitGroups = layout[ShaderTableKind::HitGroup];
+  Expect(layout[ShaderTableKind::RayGen].count == 1 &&
+             layout[ShaderTableKind::Miss].count == 1 &&
+             hitGroups.count == records.size(),
+         "one RayGen and Miss record, a hit group per instance");
+
+  std::vector<uint8_t> table(layout.TotalSize() +
+                             ShaderTableBuilder::kTableAlignment);
+  uint8_t *base = table.data();
+  base += (ShaderTableBuilder::kTableAlignment -
+           (uintptr_t)base % ShaderTableBuilder::kTableAlignment) %
+          ShaderTableBuilder::kTableAlignment;
+  builder.Write(base, layout);
+  bool match = true;
+  for (uint32_t id = 0; id < records.size(); ++id) {
+    const uint8_t *record = base + hitGroups.offset + id * hitGroups.stride;
+    uint8_t hitGroup = records[id].geometry == GEOMETRY_SPHERE ? 0x13 : 0x12;
+    match = match && record[0] == hitGroup &&
+            !std::memcmp(record + ShaderTableBuilder::kIdentifierSize,
+                         &records[id], sizeof(HitGroupRecord));
+  }
+  Expect(match, "hit group record id passes instance id's geometry and "
+                "material, with the sphere hit group for sphere geometry");
+}
+
+struct FrameConfig {
+  const char *name;
+  bool checkerboard;
+  float renderScale;
+};
+
+struct FrameRun {
+  std::vector<double> frameMs;
+  NullDeviceStats device;
+  uint64_t rebuilds = 0;
+  uint64_t refits = 0;
+  uint64_t uploadBytes = 0;
+  uint64_t pacerStalls = 0;
+  bool atRest = true;
+};
+
+// 256-byte blocks so the mapped stand-in meets the constant buffer
+// alignment the ring assumes of its buffer.
+struct alignas(256) UploadBlock {
+  uint8_t bytes[256];
+};
+
+FrameRun RunFrames(const FrameConfig &config, int frames,
+                   uint32_t framesInFlight, uint32_t width, uint32_t height,
+                   JobSystem &jobs) {
+  NullDevice device;
+  FramePacer pacer(device, framesInFlight);
+  uint32_t maxAllocators =
+      (FramePacer::kMaxFramesInFlight + 1) * kRecordingsPerFrame;
+  CommandListPool pool(device, device, maxAllocators, kRecordingsPerFrame);
+  UploadRing ring(kUploadRingSize);
+  std::vector<UploadBlock> upload(kUploadRingSize / sizeof(UploadBlock));
+  uint8_t *mapped = upload[0].bytes;
+  auto allocate = [&](uint64_t size, uint64_t alignment) {
+    uint64_t offset = ring.Allocate(size, alignment);
+    while (offset == UploadRing::kInvalidOffset) {
+      device.Wait(ring.OldestPendingFence());
+      ring.Retire(device.CompletedValue());
+      offset = ring.Allocate(size, alignment);
+    }
+    return mapped + offset;
+  };
+
+  DynamicResolutionController resolution;
+  resolution.Reset(config.renderScale);
+  DynamicResolutionSize render = resolution.RenderSize(width, height);
+
+  InstanceAnimator balls(kSceneBallCount);
+  TlasUpdateTracker tracker;
+  InstanceBvh bvh;
+  SetSceneMeshes(bvh);
+  std::vector<SceneInstance> instances;
+  std::vector<GpuInstanceDesc> staticDescs;
+  CameraState camera;
+  SphereLodSelector lod;
+  std::vector<uint8_t> levels;
+  std::vector<uint8_t> previousLevels;
+  FramePlan plan;
+  float animationTime = 0.0f;
+  const float animationSpeed = 1.0f;
+  uint32_t parity = 0;
+  uint32_t resolvedIndex = 0;
+
+  FrameRun run;
+  run.frameMs.reserve(frames);
+  for (int frame = 0; frame < frames; ++frame) {
+    auto start = std::chrono::steady_clock::now();
+
+    uint32_t slot = pacer.BeginFrame();
+    uint64_t completed = device.CompletedValue();
+    ring.Retire(completed);
+    pool.Retire(completed);
+    (void)slot;
+    animationTime += 0.016f * animationSpeed;
+    if (config.checkerboard) {
+      parity ^= 1;
+    }
+
+    JobCounter sceneReady;
+    jobs.Run(
+        [&]() {
+          BuildSceneInstances(animationTime, animationSpeed, instances);
+          bvh.Update(instances);
+        },
+        &sceneReady);
+
+    ApplyCameraInput(ScriptedInput(frame), camera);
+    FrameShading shading;
+    shading.animationTime = animationTime;
+    shading.checkerboard = config.checkerboard;
+    shading.checkerboardParity = parity;
+    shading.renderWidth = render.width;
+    shading.renderHeight = render.height;
+    ShaderParams cb =
+        BuildShaderParams(camera, (float)width / height, shading);
+    std::memcpy(allocate(sizeof(cb), kConstantAlignment), &cb, sizeof(cb));
+
+    JobCounter tlasRecorded;
+    jobs.Run(
+        [&]() {
+          CommandListPool::Recording recording = pool.Begin(0);
+          jobs.Wait(sceneReady);
+          uint32_t count = (uint32_t)instances.size();
+          uint32_t staticCount = count - balls.Count();
+          levels.resize(balls.Count(), 0);
+          previousLevels = levels;
+          lod.Select(instances.data() + staticCount, balls.Count(),
+                     MakeSphereLodView(camera.position, kCameraFovY, height),
+                     levels.data());
+          for (uint32_t i = 0; i < balls.Count(); ++i) {
+            if (levels[i] != previousLevels[i]) {
+              tracker.MarkDirty(staticCount + i);
+            }
+          }
+          TlasBuildAction action =
+              tracker.Plan(instances, &bvh.WorldBounds(0));
+          if (action != TlasBuildAction::None) {
+            UpdateStaticInstanceDescs(instances, tracker.DirtyInstances(),
+                                      staticCount, kBlas, staticDescs);
+            auto *descs = reinterpret_cast<GpuInstanceDesc *>(allocate(
+                (uint64_t)count * sizeof(GpuInstanceDesc),
+                kInstanceDescAlignment));
+            WriteSceneInstanceDescs(staticDescs, balls, animationTime,
+                                    animationSpeed, kSphereLodBlas,
+                                    levels.data(), descs, jobs);
+            device.BuildTlas(recording.list, descs, count,
+                             action == TlasBuildAction::Refit);
+          }
+          pool.End(recording);
+        },
+        &tlasRecorded);
+
+    CommandListPool::Recording main = pool.Begin(1);
+    FramePlanInputs inputs;
+    inputs.checkerboard = config.checkerboard;
+    inputs.resolvedIndex = resolvedIndex;
+    inputs.upscale = render.width != width || render.height != height;
+    BuildFramePlan(inputs, plan);
+    for (const FramePlanStep &step : plan.steps) {
+      if (step.barrierCount) {
+        device.ResourceBarriers(main.list, &plan.barriers[step.firstBarrier],
+                                step.barrierCount);
+      }
+      if (step.pass == FramePass::DispatchRays) {
+        jobs.Wait(tlasRecorded);
+      }
+      device.RecordPass(main.list, step.pass);
+    }
+    if (plan.finalBarrierCount) {
+      device.ResourceBarriers(main.list,
+                              &plan.barriers[plan.firstFinalBarrier],
+                              plan.finalBarrierCount);
+    }
+    if (config.checkerboard) {
+      resolvedIndex ^= 1;
+    }
+    pool.End(main);
+
+    pool.Submit();
+    pacer.EndFrame();
+    ring.FinishFrame(pacer.SlotFence(pacer.FrameSlot()));
+    pool.FinishFrame(pacer.SlotFence(pacer.FrameSlot()));
+
+    auto end = std::chrono::steady_clock::now();
+    run.frameMs.push_back(
+        std::chrono::duration<double, std::milli>(end - start).count());
+    for (uint32_t r = 0; r < kFrameResourceCount; ++r) {
+      run.atRest = run.atRest &&
+                   device.ResourceState((FrameResource)r) ==
+                       FrameResourceRestState((FrameResource)r);
+    }
+  }
+  pacer.WaitIdle();
+
+  run.device = device.Stats();
+  run.rebuilds = tracker.Stats().rebuildCount;
+  run.refits = tracker.Stats().refitCount;
+  run.uploadBytes = ring.Stats().bytesAllocated;
+  run.pacerStalls = pacer.Stats().stalls;
+  return run;
+}
+
+double Percentile(std::vector<double> sorted, double p) {
+  std::sort(sorted.begin(), sorted.end());
+  size_t rank = (size_t)std::ceil(p * (double)sorted.size());
+  return sorted[std::min(sorted.size() - 1, rank ? rank - 1 : 0)];
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int frames = 3000;
+  uint32_t framesInFlight = 2;
+  uint32_t width = 1920;
+  uint32_t height = 1080;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--frames") && i + 1 < argc) {
+      frames = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--frames-in-flight") && i + 1 < argc) {
+      framesInFlight = (uint32_t)std::clamp(
+          std::atoi(argv[++i]), 1, (int)FramePacer::kMaxFramesInFlight);
+    } else if (!std::strcmp(argv[i], "--width") && i + 1 < argc) {
+      width = (uint32_t)std::max(8, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--height") && i + 1 < argc) {
+      height = (uint32_t)std::max(8, std::atoi(argv[++i]));
+    } else {
+      std::printf("Usage: HeadlessFrameBenchmark [--frames N] "
+                  "[--frames-in-flight 1-3] [--width W] [--height H]\n");
+      return 1;
+    }
+  }
+
+  JobSystem jobs;
+  CheckCamera();
+  CheckFramePlans();
+  CheckInstanceDescs(jobs);
+  CheckShaderTable();
+  std::printf("Frame logic checks: %s\n\n", g_failures ? "FAIL" : "ok");
+
+  // The first frames build the TLAS and grow every pool and vector.
+  const int warmup = std::min(60, frames / 10);
+  const FrameConfig configs[] = {
+      {"full resolution", false, 1.0f},
+      {"upscale 0.75", false, 0.75f},
+      {"checkerboard+upscale", true, 0.75f},
+  };
+  std::printf("%d frames (%d warm-up) at %ux%u, %u in flight, %u job "
+              "threads\n",
+              frames, warmup, width, height, framesInFlight,
+              jobs.ThreadCount());
+  std::printf("%-22s %8s %8s %8s %8s %9s %7s %10s\n", "CPU ms per frame",
+              "p50", "p95", "p99", "max", "barriers", "refits", "upload KB");
+  for (const FrameConfig &config : configs) {
+    FrameRun run =
+        RunFrames(config, frames, framesInFlight, width, height, jobs);
+    std::vector<double> measured(run.frameMs.begin() + warmup,
+                                 run.frameMs.end());
+    std::printf("%-22s %8.4f %8.4f %8.4f %8.4f %9.1f %7llu %10.1f\n",
+                config.name, Percentile(measured, 0.50),
+                Percentile(measured, 0.95), Percentile(measured, 0.99),
+                *std::max_element(measured.begin(), measured.end()),
+                (double)run.device.barriers / frames,
+                (unsigned long long)run.refits,
+                run.uploadBytes / 1024.0 / frames);
+
+    Expect(run.device.stateMismatches == 0,
+           "NullDevice saw every barrier start in the tracked state");
+    Expect(run.device.badInstanceDescs == 0,
+           "NullDevice saw well-formed instance descs");
+    Expect(run.atRest, "textures rest between frames");
+    Expect(run.device.listsExecuted == 2ull * frames,
+           "two lists per frame");
+    Expect(run.device.passes ==
+               (uint64_t)frames * (3 + (config.checkerboard ? 1 : 0) +
+                                   (config.renderScale < 1.0f ? 1 : 0)),
+           "every pass recorded");
+    Expect(run.rebuilds >= 1 && run.device.tlasBuilds == run.rebuilds &&
+               run.device.tlasRefits == run.refits,
+           "the device built what the tracker planned");
+    Expect(run.pacerStalls == 0, "a GPU that never lags never stalls");
+  }
+  return g_failures ? 1 : 0;
+}
@@ -0,0 +1,343 @@
+// Measures the CPU two-level instance BVH used for picking and line-of-sight
+// queries as the animated scene grows from the renderer's 52 instances to
+// 100k and beyond.
+//
+// Each instance count is animated for a number of frames the same way the
+// renderer drives its TLAS: balls orbit the origin and bounce, every frame
+// calls InstanceBvh::Update(). The table shows the cost of a full rebuild,
+// the average per-frame update (mostly refits), how far refitting alone lets
+// the SAH cost drift, and the latency of single closest-hit and occlusion
+// queries. Small scenes are checked against a brute-force loop over every
+// instance, as is a chain of geometrically shrinking balls whose tree is
+// deeper than the traversal's inline stack. Any failure makes the tool exit
+// with status 1.
+
+#include "InstanceBvh.h"
+#include "MeshBvh.h"
+#include "MeshGenerator.h"
+#include "SceneInstances.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr float kRayTMin = 0.001f;
+constexpr float kRayTMax = 10000.0f;
+constexpr float kFrameSeconds = 0.016f;
+
+struct Rng {
+  uint32_t state;
+  float Next() {
+    state = state * 1664525u + 1013904223u;
+    return (float)(state >> 8) * (1.0f / 16777216.0f);
+  }
+};
+
+// The renderer's scene scaled up: same ball density (about 50 per 450 m^2),
+// so the floor grows with the count. Balls move at a constant linear speed
+// and alternate direction, which keeps neighbours crossing paths and makes
+// refitted boxes overlap more over time.
+float SceneRadius(size_t ballCount) {
+  return 12.0f * std::sqrt(std::max(1.0f, (float)ballCount / 50.0f));
+}
+
+void AnimateScene(size_t ballCount, float time,
+                  std::vector<SceneInstance> &instances) {
+  float radius = SceneRadius(ballCount);
+  instances.resize(ballCount + 2);
+
+  SceneInstance &floor = instances[0];
+  floor = {};
+  floor.transform.m[0][0] = radius / (kPlaneSize * 0.5f);
+  floor.transform.m[1][1] = 1.0f;
+  floor.transform.m[2][2] = radius / (kPlaneSize * 0.5f);
+  floor.instanceID = 0;
+  floor.mesh = SceneMesh::Plane;
+
+  SceneInstance &mirror = instances[1];
+  mirror = {};
+  mirror.transform.m[0][0] = mirror.transform.m[1][1] =
+      mirror.transform.m[2][2] = 1.5f;
+  mirror.transform.m[1][3] = 1.5f;
+  mirror.instanceID = 1;
+  mirror.mesh = SceneMesh::Sphere;
+
+  for (size_t i = 0; i < ballCount; ++i) {
+    float orbit =
+        std::max(3.0f, radius * std::sqrt(((float)i + 0.5f) / ballCount));
+    float speed = (i & 1) ? 2.0f : -2.0f; // metres per second
+    float angle = (float)i * 2.39996f + time * speed / orbit;
+    float bounce = std::fabs(std::sin(time * 2.0f + (float)i)) * 2.0f;
+    float scale = 0.3f + (float)(i % 3) * 0.1f;
+
+    SceneInstance &inst = instances[i + 2];
+    inst = {};
+    inst.transform.m[0][0] = scale;
+    inst.transform.m[0][3] = std::cos(angle) * orbit;
+    inst.transform.m[1][1] = scale;
+    inst.transform.m[1][3] = scale + bounce;
+    inst.transform.m[2][2] = scale;
+    inst.transform.m[2][3] = std::sin(angle) * orbit;
+    inst.instanceID = (uint32_t)(i + 2);
+    inst.mesh = SceneMesh::Sphere;
+  }
+}
+
+struct Query {
+  Ray pick;  // from a raised viewpoint into the scene
+  Ray sight; // between two points above the floor, tMax = 1
+};
+
+std::vector<Query> MakeQueries(size_t count, float radius) {
+  Rng rng{4242u};
+  std::vector<Query> queries(count);
+  for (Query &q : queries) {
+    auto scenePoint = [&](float height) {
+      return Float3{(rng.Next() * 2.0f - 1.0f) * radius,
+                    rng.Next() * height,
+                    (rng.Next() * 2.0f - 1.0f) * radius};
+    };
+    Float3 eye = scenePoint(1.0f) + Float3{0.0f, 5.0f, 0.0f};
+    Float3 target = scenePoint(2.0f);
+    q.pick = {eye, Normalize(target - eye), kRayTMin, kRayTMax};
+
+    Float3 from = scenePoint(3.0f);
+    Float3 to = from + Float3{(rng.Next() * 2.0f - 1.0f) * 20.0f,
+                              0.0f,
+                              (rng.Next() * 2.0f - 1.0f) * 20.0f};
+    q.sight = {from, to - from, kRayTMin, 1.0f};
+  }
+  return queries;
+}
+
+// Reference answer: every instance, no top-level tree.
+bool BruteForceIntersect(const InstanceBvh &scene,
+                         const std::vector<const MeshBvh *> &meshes,
+                         const Ray &ray, float &t) {
+  t = ray.tMax;
+  bool hit = false;
+  for (size_t i = 0; i < scene.InstanceCount(); ++i) {
+    const Float3x4 &worldToObject = scene.WorldToObject(i);
+    Ray objRay = {TransformPoint(worldToObject, ray.origin),
+                  TransformVector(worldToObject, ray.direction), ray.tMin, t};
+    if (meshes[i]->Intersect(objRay)) {
+      t = objRay.tMax;
+      hit = true;
+    }
+  }
+  return hit;
+}
+
+// Balls spaced so that every binned split can only peel off one of them:
+// along x, each 16.1 times closer to the origin than the last and as much
+// smaller, so with 16 bins only the farthest leaves the first bin; once x
+// runs out of float range the chain continues along y, then z. The range
+// stops short of the SAH areas overflowing and of denormal scales, and
+// the tree still comes out about as deep as the chain is long.
+void MakeChain(std::vector<SceneInstance> &instances) {
+  instances.clear();
+  for (int axis = 0; axis < 3; ++axis) {
+    for (float offset = 0x1p56f; offset >= 0x1p-126f; offset /= 16.1f) {
+      SceneInstance inst = {};
+      inst.transform.m[0][0] = inst.transform.m[1][1] =
+          inst.transform.m[2][2] = offset;
+      inst.transform.m[axis][3] = offset;
+      inst.instanceID = (uint32_t)instances.size();
+      inst.mesh = SceneMesh::Sphere;
+      instances.push_back(inst);
+    }
+  }
+}
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<size_t> counts = {kSceneBallCount, 1000, 10000, 100000};
+  int frames = 120;
+  size_t queryCount = 20000;
+  size_t validateLimit = 10000;
+  float threshold = 1.5f;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--balls") && i + 1 < argc) {
+      counts = {(size_t)std::max(1, std::atoi(argv[++i]))};
+    } else if (!std::strcmp(argv[i], "--frames") && i + 1 < argc) {
+      frames = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--queries") && i + 1 < argc) {
+      queryCount = (size_t)std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--threshold") && i + 1 < argc) {
+      threshold = (float)std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--validate") && i + 1 < argc) {
+      validateLimit = (size_t)std::max(0, std::atoi(argv[++i]));
+    } else {
+      std::printf("Usage: InstanceBvhBenchmark [--balls N] [--frames N] "
+                  "[--queries N] [--threshold R] [--validate N]\n");
+      return 1;
+    }
+  }
+
+  std::vector<MeshVertex> vertices;
+  std::vector<uint32_t> indices;
+  MeshBvh sphere, plane;
+  GenerateSphere(vertices, indices, kSphereRadius, kSphereSlices,
+                 kSphereStacks);
+  sphere.Build(vertices, indices);
+  vertices.clear();
+  indices.clear();
+  GeneratePlane(vertices, indices, kPlaneSize, kPlaneSize);
+  plane.Build(vertices, indices);
+
+  std::printf("%d frames of %.0f ms, rebuild when SAH > %.2fx build SAH\n\n",
+              frames, kFrameSeconds * 1000.0f, threshold);
+  std::printf("%9s %9s %9s %8s %9s %9s %8s %5s %8s %5s %7s\n", "instances",
+              "build ms", "update ms", "rebuilds", "refit ms", "SAH drift",
+              "pick us", "hit%", "sight us", "occ%", "checked");
+  bool failed = false;
+
+  for (size_t balls : counts) {
+    std::vector<SceneInstance> instances;
+    AnimateScene(balls, 0.0f, instances);
+
+    InstanceBvh scene;
+    scene.SetMesh(SceneMesh::Sphere, &sphere);
+    scene.SetMesh(SceneMesh::Plane, &plane);
+    scene.SetRebuildThreshold(threshold);
+    scene.Build(instances);
+    double buildMs = scene.Stats().buildMs;
+
+    // The renderer's policy: refit every frame, rebuild on degradation.
+    double updateSeconds = 0.0;
+    uint32_t rebuildsBefore = scene.Stats().rebuildCount;
+    for (int f = 1; f <= frames; ++f) {
+      AnimateScene(balls, f * kFrameSeconds, instances);
+      auto start = std::chrono::steady_clock::now();
+      scene.Update(instances);
+      updateSeconds += Seconds(start);
+    }
+    uint32_t rebuilds = scene.Stats().rebuildCount - rebuildsBefore;
+
+    // Refit only, from a fresh build, to show how far quality drifts.
+    InstanceBvh refitOnly;
+    refitOnly.SetMesh(SceneMesh::Sphere, &sphere);
+    refitOnly.SetMesh(SceneMesh::Plane, &plane);
+    AnimateScene(balls, 0.0f, instances);
+    refitOnly.Build(instances);
+    double refitMs = 0.0;
+    for (int f = 1; f <= frames; ++f) {
+      AnimateScene(balls, f * kFrameSeconds, instances);
+      refitOnly.Refit(instances);
+      refitMs += refitOnly.Stats().refitMs;
+    }
+    float drift = refitOnly.Stats().sahCost / refitOnly.Stats().buildSahCost;
+
+    // Queries run against the policy-maintained tree at the last frame.
+    AnimateScene(balls, frames * kFrameSeconds, instances);
+    scene.Update(instances);
+    std::vector<Query> queries =
+        MakeQueries(queryCount, SceneRadius(balls));
+
+    uint32_t picks = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const Query &q : queries) {
+      InstanceHit hit;
+      picks += scene.Intersect(q.pick, hit);
+    }
+    double pickUs = Seconds(start) * 1e6 / queries.size();
+
+    uint32_t blocked = 0;
+    start = std::chrono::steady_clock::now();
+    for (const Query &q : queries) {
+      blocked += scene.Occluded(q.sight);
+    }
+    double sightUs = Seconds(start) * 1e6 / queries.size();
+
+    const char *checked = "-";
+    if (instances.size() <= validateLimit) {
+      std::vector<const MeshBvh *> meshes(instances.size());
+      for (size_t i = 0; i < instances.size(); ++i) {
+        meshes[i] = instances[i].mesh == SceneMesh::Plane ? &plane : &sphere;
+      }
+      size_t mismatches = 0;
+      for (const Query &q : queries) {
+        InstanceHit hit;
+        float t;
+        bool expected = BruteForceIntersect(scene, meshes, q.pick, t);
+        bool got = scene.Intersect(q.pick, hit);
+        mismatches += got != expected || (got && hit.t != t);
+        expected = BruteForceIntersect(scene, meshes, q.sight, t);
+        mismatches += scene.Occluded(q.sight) != expected;
+      }
+      checked = mismatches ? "FAIL" : "ok";
+      failed |= mismatches != 0;
+      if (mismatches) {
+        std::fprintf(stderr, "%zu instances: %zu queries differ from brute "
+                     "force\n", instances.size(), mismatches);
+      }
+    }
+
+    std::printf("%9zu %9.3f %9.3f %8u %9.3f %8.2fx %8.2f %5.1f %8.2f %5.1f "
+                "%7s\n",
+                instances.size(), buildMs, updateSeconds * 1e3 / frames,
+                rebuilds, refitMs / frames, drift, pickUs,
+                100.0 * picks / queries.size(), sightUs,
+                100.0 * blocked / queries.size(), checked);
+  }
+
+  // A tree deeper than BvhTraversalStack::kInlineDepth: rays down the chain
+  // and across every ball must agree with brute force.
+  {
+    std::vector<SceneInstance> instances;
+    MakeChain(instances);
+    InstanceBvh chain;
+    chain.SetMesh(SceneMesh::Sphere, &sphere);
+    chain.SetMesh(SceneMesh::Plane, &plane);
+    chain.Build(instances);
+    std::vector<const MeshBvh *> meshes(instances.size(), &sphere);
+
+    // One ray per ball, across it from four of its sizes away; the
+    // direction scales with the ball so a hit is at t = 3.5. Balls at both
+    // ends of the float range are missed by both paths alike (SafeInverse
+    // nudges zero components to 1e-20), so only agreement is required.
+    size_t mismatches = 0, hits = 0;
+    std::vector<Ray> rays;
+    for (const SceneInstance &inst : instances) {
+      const Float3x4 &t = inst.transform;
+      Float3 center = {t.m[0][3], t.m[1][3], t.m[2][3]};
+      float size = t.m[0][0];
+      int axis = center.x != 0.0f ? 2 : center.y != 0.0f ? 0 : 1;
+      Float3 direction = {0.0f, 0.0f, 0.0f};
+      (&direction.x)[axis] = size;
+      rays.push_back({center - direction * 4.0f, direction, kRayTMin,
+                      kRayTMax});
+    }
+    for (const Ray &ray : rays) {
+      InstanceHit hit;
+      float t;
+      bool expected = BruteForceIntersect(chain, meshes, ray, t);
+      bool got = chain.Intersect(ray, hit);
+      mismatches += got != expected || (got && hit.t != t);
+      mismatches += chain.Occluded(ray) != expected;
+      hits += got;
+    }
+    uint32_t depth = chain.Tree().Stats().maxDepth;
+    bool ok = mismatches == 0 && hits > 0 &&
+              depth > BvhTraversalStack::kInlineDepth;
+    failed |= !ok;
+    std::printf("\nchain of %zu balls: tree depth %u, %zu of %zu rays hit, "
+                "%s\n",
+                instances.size(), depth, hits, rays.size(), ok ? "ok" : "FAIL");
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,276 @@
+// Measures ray/primitive intersection throughput of every SIMD level the CPU
+// supports, single-threaded so the numbers read as intersections per second
+// per core.
+//
+// Triangle kernels run brute force over the sphere CreateSphere emits for
+// the renderer (32x32 by default), once as one ray against blocks of eight
+// triangles and once as packets of eight rays against each triangle. The
+// sphere kernel tests camera rays against the 51 analytic spheres of the
+// animated scene. Each level's hits are checked against the scalar path.
+
+#include "MeshGenerator.h"
+#include "SceneInstances.h"
+#include "SimdIntersect.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr float kRayTMin = 0.001f;
+constexpr float kRayTMax = 10000.0f;
+
+struct Rng {
+  uint32_t state;
+  float Next() {
+    state = state * 1664525u + 1013904223u;
+    return (float)(state >> 8) * (1.0f / 16777216.0f);
+  }
+  Float3 InUnitSphere() {
+    for (;;) {
+      Float3 p = {Next() * 2.0f - 1.0f, Next() * 2.0f - 1.0f,
+                  Next() * 2.0f - 1.0f};
+      if (Dot(p, p) <= 1.0f) {
+        return p;
+      }
+    }
+  }
+};
+
+// Rays from a shell around the mesh aimed at points inside it, so most of
+// them hit and the closest-hit bookkeeping is exercised.
+std::vector<SimdRay> MakeMeshRays(size_t count, float radius) {
+  Rng rng{12345u};
+  std::vector<SimdRay> rays(count);
+  for (SimdRay &ray : rays) {
+    Float3 origin = Normalize(rng.InUnitSphere()) * (radius * 4.0f);
+    Float3 target = rng.InUnitSphere() * radius;
+    ray = {origin, kRayTMin, target - origin, kRayTMax};
+  }
+  return rays;
+}
+
+// Rays from the default camera position spread over the scene.
+std::vector<SimdRay> MakeSceneRays(size_t count) {
+  Rng rng{6789u};
+  Float3 eye = {0.0f, 5.0f, -10.0f};
+  std::vector<SimdRay> rays(count);
+  for (SimdRay &ray : rays) {
+    Float3 target = {rng.Next() * 24.0f - 12.0f, rng.Next() * 4.0f,
+                     rng.Next() * 24.0f - 12.0f};
+    ray = {eye, kRayTMin, Normalize(target - eye), kRayTMax};
+  }
+  return rays;
+}
+
+struct Result {
+  double seconds = 0.0;
+  uint64_t intersections = 0;
+  uint32_t hits = 0;
+  std::vector<uint32_t> closest; // hit primitive per ray, UINT32_MAX = miss
+};
+
+template <typename Fn> Result Measure(double minSeconds, Fn &&pass) {
+  Result result;
+  auto start = std::chrono::steady_clock::now();
+  do {
+    result = pass(result);
+    result.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  } while (result.seconds < minSeconds);
+  return result;
+}
+
+Result RunRayTriangles(const IntersectKernels &k,
+                       const std::vector<TriangleBlock8> &blocks,
+                       size_t triCount, const std::vector<SimdRay> &rays,
+                       double minSeconds) {
+  return Measure(minSeconds, [&](Result r) {
+    r.hits = 0;
+    r.closest.clear();
+    for (SimdRay ray : rays) {
+      uint32_t prim = UINT32_MAX;
+      for (const TriangleBlock8 &block : blocks) {
+        SimdHit hit;
+        int lane = k.rayTriangles8(ray, block, true, hit);
+        if (lane >= 0) {
+          ray.tMax = hit.t;
+          prim = block.primIndex[lane];
+        }
+      }
+      r.hits += prim != UINT32_MAX;
+      r.closest.push_back(prim);
+    }
+    r.intersections += rays.size() * triCount;
+    return r;
+  });
+}
+
+Result RunPacketTriangles(const IntersectKernels &k,
+                          const std::vector<PackedTriangle> &tris,
+                          const std::vector<SimdRay> &rays,
+                          double minSeconds) {
+  std::vector<RayPacket8> packets((rays.size() + kSimdWidth - 1) / kSimdWidth);
+  return Measure(minSeconds, [&](Result r) {
+    r.hits = 0;
+    r.closest.clear();
+    for (size_t p = 0; p < packets.size(); ++p) {
+      RayPacket8 &packet = packets[p];
+      HitPacket8 hits;
+      for (int lane = 0; lane < kSimdWidth; ++lane) {
+        size_t i = std::min(p * kSimdWidth + lane, rays.size() - 1);
+        SetRayPacketLane(packet, lane, rays[i]);
+        hits.u[lane] = hits.v[lane] = 0.0f;
+        hits.primIndex[lane] = UINT32_MAX;
+      }
+      for (size_t t = 0; t < tris.size(); ++t) {
+        k.packetTriangle(packet, tris[t], (uint32_t)t, true, hits);
+      }
+      for (int lane = 0; lane < kSimdWidth; ++lane) {
+        if (p * kSimdWidth + lane < rays.size()) {
+          r.hits += hits.primIndex[lane] != UINT32_MAX;
+          r.closest.push_back(hits.primIndex[lane]);
+        }
+      }
+    }
+    r.intersections += packets.size() * kSimdWidth * tris.size();
+    return r;
+  });
+}
+
+Result RunRaySpheres(const IntersectKernels &k,
+                     const std::vector<SphereBlock8> &blocks,
+                     size_t sphereCount, const std::vector<SimdRay> &rays,
+                     double minSeconds) {
+  return Measure(minSeconds, [&](Result r) {
+    r.hits = 0;
+    r.closest.clear();
+    for (SimdRay ray : rays) {
+      uint32_t instance = UINT32_MAX;
+      for (const SphereBlock8 &block : blocks) {
+        SimdHit hit;
+        int lane = k.raySpheres8(ray, block, hit);
+        if (lane >= 0) {
+          ray.tMax = hit.t;
+          instance = block.instanceIndex[lane];
+        }
+      }
+      r.hits += instance != UINT32_MAX;
+      r.closest.push_back(instance);
+    }
+    r.intersections += rays.size() * sphereCount;
+    return r;
+  });
+}
+
+// Rays whose closest hit differs from the scalar path. FMA and a different
+// evaluation order can flip exactly grazing hits, so a handful is expected.
+size_t CountDifferences(const Result &a, const Result &b) {
+  size_t count = 0;
+  for (size_t i = 0; i < a.closest.size(); ++i) {
+    count += a.closest[i] != b.closest[i];
+  }
+  return count;
+}
+
+void Report(const char *kernel, SimdLevel level, const Result &r,
+            const Result &scalar) {
+  double rate = r.intersections / r.seconds * 1e-6;
+  double scalarRate = scalar.intersections / scalar.seconds * 1e-6;
+  std::printf("%-22s %-7s %12.1f %8.2fx %8u %8zu\n", kernel,
+              SimdLevelName(level), rate, rate / scalarRate, r.hits,
+              CountDifferences(r, scalar));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int slices = kSphereSlices;
+  int stacks = kSphereStacks;
+  size_t rayCount = 4096;
+  double minSeconds = 0.25;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--slices") && i + 1 < argc) {
+      slices = std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--stacks") && i + 1 < argc) {
+      stacks = std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--rays") && i + 1 < argc) {
+      rayCount = (size_t)std::max(8, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      minSeconds = std::atof(argv[++i]);
+    } else {
+      std::printf("Usage: IntersectBenchmark [--slices N] [--stacks N] "
+                  "[--rays N] [--seconds S]\n");
+      return 1;
+    }
+  }
+
+  std::vector<MeshVertex> vertices;
+  std::vector<uint32_t> indices;
+  GenerateSphere(vertices, indices, kSphereRadius, slices, stacks);
+  size_t triCount = indices.size() / 3;
+
+  std::vector<TriangleBlock8> triBlocks;
+  BuildTriangleBlocks(vertices, indices, triBlocks);
+  std::vector<PackedTriangle> packedTris(triCount);
+  for (size_t t = 0; t < triCount; ++t) {
+    packedTris[t] = PackTriangle(vertices[indices[t * 3 + 0]].position,
+                                 vertices[indices[t * 3 + 1]].position,
+                                 vertices[indices[t * 3 + 2]].position);
+  }
+
+  std::vector<SceneInstance> instances;
+  BuildSceneInstances(0.0f, 1.0f, instances);
+  std::vector<SphereBlock8> sphereBlocks;
+  BuildSphereBlocks(instances, sphereBlocks);
+  size_t sphereCount = instances.size() - 1; // everything but the floor
+
+  std::vector<SimdRay> meshRays = MakeMeshRays(rayCount, kSphereRadius);
+  std::vector<SimdRay> sceneRays = MakeSceneRays(rayCount * 16);
+
+  std::printf("Sphere %dx%d: %zu triangles, %zu rays; scene: %zu spheres\n",
+              slices, stacks, triCount, rayCount, sphereCount);
+  std::printf("Detected: %s\n\n", SimdLevelName(DetectSimdLevel()));
+  std::printf("%-22s %-7s %12s %9s %8s %8s\n", "kernel", "level",
+              "Mint/s/core", "speedup", "hits", "differ");
+
+  const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::Sse41,
+                              SimdLevel::Avx2};
+  const IntersectKernels &scalar = *GetIntersectKernels(SimdLevel::Scalar);
+
+  Result base = RunRayTriangles(scalar, triBlocks, triCount, meshRays,
+                                minSeconds);
+  for (SimdLevel level : levels) {
+    if (const IntersectKernels *k = GetIntersectKernels(level)) {
+      Report("1 ray x 8 triangles", level,
+             RunRayTriangles(*k, triBlocks, triCount, meshRays, minSeconds),
+             base);
+    }
+  }
+
+  base = RunPacketTriangles(scalar, packedTris, meshRays, minSeconds);
+  for (SimdLevel level : levels) {
+    if (const IntersectKernels *k = GetIntersectKernels(level)) {
+      Report("8 rays x 1 triangle", level,
+             RunPacketTriangles(*k, packedTris, meshRays, minSeconds), base);
+    }
+  }
+
+  base = RunRaySpheres(scalar, sphereBlocks, sphereCount, sceneRays,
+                       minSeconds);
+  for (SimdLevel level : levels) {
+    if (const IntersectKernels *k = GetIntersectKernels(level)) {
+      Report("1 ray x 8 spheres", level,
+             RunRaySpheres(*k, sphereBlocks, sphereCount, sceneRays,
+                           minSeconds),
+             base);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,271 @@
+// Exercises JobSystem, the work-stealing scheduler the renderer fans its
+// CPU stages out on.
+//
+// Correctness checks come first: every ParallelFor index runs exactly once
+// (flat and nested), dependent jobs never start before the counter they
+// wait on drains, jobs submitted from a foreign thread run, and a bare
+// Chase-Lev deque hammered by one owner and several thieves hands out each
+// job exactly once. Any failure makes the tool exit with status 1.
+//
+// The scaling table then reports, for 1..N threads, empty-task throughput
+// (tasks per second, dominated by scheduling cost) and a compute-bound
+// ParallelFor with its speedup and parallel efficiency against one thread.
+
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void CheckParallelFor(JobSystem &jobs) {
+  for (uint32_t count : {0u, 1u, 7u, 1000u, 100003u}) {
+    for (uint32_t grain : {1u, 16u, 4096u}) {
+      std::vector<std::atomic<uint32_t>> hits(count);
+      jobs.ParallelFor(count, grain, [&](uint32_t begin, uint32_t end) {
+        Expect(end - begin <= grain, "ranges respect the grain");
+        for (uint32_t i = begin; i < end; ++i) {
+          hits[i].fetch_add(1, std::memory_order_relaxed);
+        }
+      });
+      bool once = true;
+      for (auto &hit : hits) {
+        once &= hit.load() == 1;
+      }
+      Expect(once, "ParallelFor visits every index exactly once");
+    }
+  }
+
+  // Nested fan-out from inside jobs must not deadlock.
+  std::atomic<uint64_t> sum{0};
+  jobs.ParallelFor(64, 1, [&](uint32_t outer, uint32_t) {
+    jobs.ParallelFor(1000, 50, [&](uint32_t begin, uint32_t end) {
+      uint64_t local = 0;
+      for (uint32_t i = begin; i < end; ++i) {
+        local += i + outer;
+      }
+      sum.fetch_add(local, std::memory_order_relaxed);
+    });
+  });
+  uint64_t expected = 0;
+  for (uint32_t outer = 0; outer < 64; ++outer) {
+    expected += 999 * 1000 / 2 + 1000ull * outer;
+  }
+  Expect(sum.load() == expected, "nested ParallelFor sums match");
+}
+
+void CheckDependencies(JobSystem &jobs) {
+  // Three stages of 200 jobs each; every job checks the previous stage has
+  // fully finished when it starts.
+  for (int round = 0; round < 50; ++round) {
+    JobCounter stage[3];
+    std::atomic<int> done[3] = {0, 0, 0};
+    std::atomic<bool> early{false};
+    for (int s = 0; s < 3; ++s) {
+      for (int j = 0; j < 200; ++j) {
+        jobs.Run(
+            [&, s]() {
+              if (s > 0 && done[s - 1].load() != 200) {
+                early = true;
+              }
+              done[s].fetch_add(1);
+            },
+            &stage[s], s > 0 ? &stage[s - 1] : nullptr);
+      }
+    }
+    jobs.Wait(stage[2]);
+    Expect(!early.load(), "dependent jobs start after their dependency");
+    Expect(done[2].load() == 200, "every dependent job ran");
+  }
+}
+
+void CheckForeignSubmit(JobSystem &jobs) {
+  JobCounter counter;
+  std::atomic<int> ran{0};
+  std::thread foreign([&]() {
+    for (int i = 0; i < 1000; ++i) {
+      jobs.Run([&]() { ran.fetch_add(1); }, &counter);
+    }
+    jobs.Wait(counter);
+  });
+  foreign.join();
+  Expect(ran.load() == 1000, "jobs from a non-worker thread all run");
+}
+
+void CheckDeque(unsigned thieves) {
+  constexpr int kJobs = 200000;
+  std::vector<Job> storage(kJobs);
+  std::vector<std::atomic<uint8_t>> taken(kJobs);
+  JobDeque deque(16); // small, to exercise growth under contention
+  std::atomic<bool> ownerDone{false};
+
+  auto take = [&](Job *job) {
+    taken[job - storage.data()].fetch_add(1, std::memory_order_relaxed);
+  };
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < thieves; ++t) {
+    threads.emplace_back([&]() {
+      while (!ownerDone.load() || !deque.Empty()) {
+        if (Job *job = deque.Steal()) {
+          take(job);
+        }
+      }
+    });
+  }
+  for (int i = 0; i < kJobs; ++i) {
+    deque.Push(&storage[i]);
+    if (i % 3 == 0) {
+      if (Job *job = deque.Pop()) {
+        take(job);
+      }
+    }
+  }
+  while (Job *job = deque.Pop()) {
+    take(job);
+  }
+  ownerDone = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  bool once = true;
+  for (auto &t : taken) {
+    once &= t.load() == 1;
+  }
+  Expect(once, "Chase-Lev deque hands out every job exactly once");
+}
+
+// Stand-in for per-item renderer work: a short dependent FP chain.
+float Work(uint32_t i) {
+  float x = (float)i * 1e-3f;
+  for (int k = 0; k < 64; ++k) {
+    x = x * 0.999f + std::sqrt(x + 1.0f) * 1e-3f;
+  }
+  return x;
+}
+
+struct ScalingResult {
+  double tasksPerSecond;
+  double forSeconds;
+  uint64_t stolen;
+};
+
+ScalingResult MeasureScaling(unsigned threads, bool pin, uint32_t tasks,
+                             uint32_t items) {
+  JobSystemSettings settings;
+  settings.threadCount = threads;
+  settings.pinThreads = pin;
+  JobSystem jobs(settings);
+
+  ScalingResult result = {};
+
+  // Empty tasks, spawned in batches from worker 0 and stolen by the rest.
+  std::atomic<uint32_t> counted{0};
+  auto start = std::chrono::steady_clock::now();
+  constexpr uint32_t kBatch = 1024;
+  for (uint32_t done = 0; done < tasks; done += kBatch) {
+    JobCounter counter;
+    for (uint32_t i = 0; i < kBatch; ++i) {
+      jobs.Run([&]() { counted.fetch_add(1, std::memory_order_relaxed); },
+               &counter);
+    }
+    jobs.Wait(counter);
+  }
+  result.tasksPerSecond = (double)counted.load() / Seconds(start);
+
+  // Compute-bound ParallelFor, best of three.
+  std::vector<float> out(items);
+  result.forSeconds = 1e30;
+  for (int rep = 0; rep < 3; ++rep) {
+    start = std::chrono::steady_clock::now();
+    jobs.ParallelFor(items, 1024, [&](uint32_t begin, uint32_t end) {
+      for (uint32_t i = begin; i < end; ++i) {
+        out[i] = Work(i);
+      }
+    });
+    result.forSeconds = std::min(result.forSeconds, Seconds(start));
+  }
+  result.stolen = jobs.Stats().stolen;
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  uint32_t tasks = 1 << 20;
+  uint32_t items = 1 << 19;
+  bool pin = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+      maxThreads = (unsigned)std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--tasks") && i + 1 < argc) {
+      tasks = (uint32_t)std::max(1024, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--items") && i + 1 < argc) {
+      items = (uint32_t)std::max(1024, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--pin")) {
+      pin = true;
+    } else {
+      std::printf("Usage: JobSystemBenchmark [--threads N] [--tasks N] "
+                  "[--items N] [--pin]\n");
+      return 1;
+    }
+  }
+
+  {
+    JobSystemSettings settings;
+    settings.threadCount = std::max(2u, maxThreads);
+    JobSystem jobs(settings);
+    CheckParallelFor(jobs);
+    CheckDependencies(jobs);
+    CheckForeignSubmit(jobs);
+  }
+  CheckDeque(std::max(2u, std::min(maxThreads, 8u) - 1));
+  std::printf("Scheduler checks: %s\n\n", g_failures ? "FAIL" : "ok");
+
+  std::printf("%u empty tasks, ParallelFor over %u items (grain 1024)%s\n\n",
+              tasks, items, pin ? ", pinned" : "");
+  std::printf("%7s %12s %10s %10s %9s %10s\n", "threads", "Mtasks/s",
+              "for ms", "speedup", "effic.", "stolen");
+  std::vector<unsigned> threadCounts;
+  for (unsigned threads = 1; threads < maxThreads;
+       threads = threads < 4 ? threads + 1 : threads * 2) {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(maxThreads);
+
+  double baseline = 0.0;
+  for (unsigned threads : threadCounts) {
+    ScalingResult r = MeasureScaling(threads, pin, tasks, items);
+    if (threads == 1) {
+      baseline = r.forSeconds;
+    }
+    double speedup = baseline / r.forSeconds;
+    std::printf("%7u %12.2f %10.2f %9.2fx %8.0f%% %10llu\n", threads,
+                r.tasksPerSecond * 1e-6, r.forSeconds * 1e3, speedup,
+                100.0 * speedup / threads, (unsigned long long)r.stolen);
+  }
+  return g_failures ? 1 : 0;
+}
@@ -0,0 +1,306 @@
+// Exercises MaterialRegistry, which packs the material table RayGen reads
+// instead of branching on InstanceID.
+//
+// Checks the MaterialData layout against the 32-byte structured buffer
+// stride the shader expects, checks that the registry dedupes identical
+// materials (including -0 against 0) and keeps distinct ones apart, and
+// checks that the scene's materials shade every instance exactly as the
+// old per-instance branches did: base colour, direct and emissive light,
+// and the mirror bounce. The scene's hit group records must give the floor
+// its flat up normal and every sphere the sphere rule, as the old
+// InstanceID() branch did, whatever order the instances come in. Any
+// failure makes the tool exit with status 1.
+// The throughput table registers up to 1M instances drawing on a growing
+// number of distinct materials.
+
+#include "MaterialRegistry.h"
+#include "SceneInstances.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct Rng {
+  uint32_t state;
+  uint32_t Next() {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+  }
+  float Uniform(float lo, float hi) {
+    return lo + (hi - lo) * (float)(Next() & 0xFFFF) / 65535.0f;
+  }
+};
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+MaterialData Make(float r, float g, float b, float reflectivity,
+                  float emissive, uint32_t pattern) {
+  MaterialData m = {};
+  m.albedo = {r, g, b};
+  m.reflectivity = reflectivity;
+  m.emissive = {r * emissive, g * emissive, b * emissive};
+  m.pattern = pattern;
+  return m;
+}
+
+void CheckRegistry() {
+  Expect(sizeof(MaterialData) == 32, "MaterialData is 32 bytes");
+  Expect(offsetof(MaterialData, reflectivity) == 12 &&
+             offsetof(MaterialData, emissive) == 16 &&
+             offsetof(MaterialData, pattern) == 28,
+         "MaterialData fields sit in two 16-byte rows");
+
+  MaterialRegistry registry;
+  MaterialData red = Make(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0);
+  Expect(registry.Add(red) == 0, "first material gets index 0");
+  Expect(registry.Add(red) == 0, "identical material is shared");
+  MaterialData negativeZero = red;
+  negativeZero.albedo.y = -0.0f;
+  negativeZero.reflectivity = -0.0f;
+  Expect(registry.Add(negativeZero) == 0, "-0 dedupes against 0");
+  Expect(registry.Add(Make(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1)) == 1,
+         "different pattern is a new material");
+  Expect(registry.Add(Make(1.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0)) == 2,
+         "different reflectivity is a new material");
+  Expect(registry.Add(Make(1.0f, 0.0f, 0.0f, 0.0f, 0.5f, 0)) == 3,
+         "different emissive is a new material");
+  Expect(registry.Count() == 4 && registry.SizeInBytes() == 128,
+         "table holds each distinct material once");
+  Expect(std::signbit(registry.Materials()[0].albedo.y) == false,
+         "stored materials are canonical");
+  registry.Clear();
+  Expect(registry.Count() == 0 && registry.Add(red) == 0,
+         "cleared registry starts over");
+}
+
+// The pre-material-table shading from RayTracing.hlsl, per instance ID.
+Float3 OldPastelColor(uint32_t instanceID) {
+  uint32_t h = instanceID * 0x9E3779B9u;
+  h = ((h >> 16) ^ h) * 0x45D9F3Bu;
+  h = ((h >> 16) ^ h) * 0x45D9F3Bu;
+  h = (h >> 16) ^ h;
+  float r = float(h & 0xFF) / 255.0f;
+  float g = float((h >> 8) & 0xFF) / 255.0f;
+  float b = float((h >> 16) & 0xFF) / 255.0f;
+  return Lerp({r, g, b}, {1.0f, 1.0f, 1.0f}, 0.5f);
+}
+
+struct Shading {
+  Float3 added;    // light added to finalColor, per unit throughput
+  float carried;   // throughput multiplier of the bounce, 0 if none
+};
+
+Float3 Lighting(Float3 hitPos, Float3 normal, Float3 baseColor,
+                Float3 lightPos) {
+  Float3 lightDir = Normalize(lightPos - hitPos);
+  float diff = std::fmax(Dot(normal, lightDir), 0.0f);
+  return baseColor * (diff * 0.8f + 0.2f);
+}
+
+Shading OldShade(uint32_t id, Float3 hitPos, Float3 normal, Float3 lightPos,
+                 float emissiveIntensity) {
+  Float3 baseColor;
+  if (id == 0) {
+    float sum = std::floor(hitPos.x * 0.5f) + std::floor(hitPos.y * 0.5f) +
+                std::floor(hitPos.z * 0.5f);
+    bool check = std::fmod(sum, 2.0f) == 0.0f;
+    baseColor = check ? Float3{0.9f, 0.9f, 0.9f} : Float3{0.5f, 0.5f, 0.5f};
+  } else if (id == 1) {
+    baseColor = {0.8f, 0.8f, 0.9f};
+  } else {
+    baseColor = OldPastelColor(id);
+  }
+  Float3 lit = Lighting(hitPos, normal, baseColor, lightPos);
+  if (id == 1) {
+    return {lit * 0.1f, 0.8f};
+  }
+  Float3 emissive = {0.0f, 0.0f, 0.0f};
+  if (id > 1) {
+    emissive = baseColor * (emissiveIntensity * 0.5f);
+  }
+  return {lit + emissive, 0.0f};
+}
+
+Shading NewShade(const MaterialData &m, Float3 hitPos, Float3 normal,
+                 Float3 lightPos, float emissiveIntensity) {
+  Float3 lit = Lighting(hitPos, normal, MaterialBaseColor(m, hitPos),
+                        lightPos);
+  Float3 emissive = {m.emissive.x, m.emissive.y, m.emissive.z};
+  return {lit * (1.0f - m.reflectivity) + emissive * emissiveIntensity,
+          m.reflectivity};
+}
+
+void CheckSceneShading(uint32_t instanceCount, uint32_t samples) {
+  MaterialRegistry registry;
+  std::vector<uint32_t> instanceMaterials;
+  BuildSceneMaterials(instanceCount, registry, instanceMaterials);
+  Expect(instanceMaterials.size() == instanceCount,
+         "every instance ID has a material");
+  Expect(instanceMaterials[0] != instanceMaterials[1] &&
+             registry.Materials()[instanceMaterials[0]].pattern ==
+                 MATERIAL_PATTERN_CHECKER,
+         "floor and mirror sphere get their own materials");
+  bool inRange = true;
+  for (uint32_t index : instanceMaterials) {
+    inRange &= index < registry.Count();
+  }
+  Expect(inRange, "material indices fit the table");
+
+  Rng rng = {0xC0FFEE};
+  float worst = 0.0f;
+  bool sameBounce = true;
+  for (uint32_t id = 0; id < instanceCount; ++id) {
+    const MaterialData &m = registry.Materials()[instanceMaterials[id]];
+    for (uint32_t s = 0; s < samples; ++s) {
+      Float3 hitPos = {rng.Uniform(-10, 10), rng.Uniform(0, 4),
+                       rng.Uniform(-10, 10)};
+      Float3 normal = Normalize({rng.Uniform(-1, 1), rng.Uniform(0.1f, 1),
+                                 rng.Uniform(-1, 1)});
+      Float3 lightPos = {rng.Uniform(-20, 20), rng.Uniform(1, 30),
+                         rng.Uniform(-20, 20)};
+      float intensity = rng.Uniform(0, 5);
+      Shading before = OldShade(id, hitPos, normal, lightPos, intensity);
+      Shading after = NewShade(m, hitPos, normal, lightPos, intensity);
+      Float3 d = before.added - after.added;
+      worst = std::max({worst, std::fabs(d.x), std::fabs(d.y),
+                        std::fabs(d.z)});
+      sameBounce &= before.carried == after.carried;
+    }
+  }
+  // 1/255 is one step of the R8G8B8A8 output; stay well under it.
+  Expect(worst < 1e-5f, "materials shade like the old instance branches");
+  Expect(sameBounce, "only the mirror sphere bounces, keeping 80%");
+  std::printf("%u instances -> %u materials, worst difference %.2g\n",
+              instanceCount, registry.Count(), worst);
+}
+
+void CheckHitGroupRecords() {
+  std::vector<SceneInstance> instances;
+  BuildSceneInstances(0.0f, 1.0f, instances);
+  MaterialRegistry registry;
+  std::vector<uint32_t> instanceMaterials;
+  BuildSceneMaterials((uint32_t)instances.size(), registry,
+                      instanceMaterials);
+  std::vector<HitGroupRecord> records;
+  BuildSceneHitGroupRecords(instances, instanceMaterials, records);
+  Expect(records.size() == instances.size(), "a record per instance ID");
+
+  bool geometry = true;
+  bool materials = true;
+  for (uint32_t id = 0; id < records.size(); ++id) {
+    const HitGroupRecord &r = records[id];
+    // The old ClosestHit: InstanceID() > 0 meant a sphere, else the floor.
+    bool sphere = id > 0;
+    geometry &= sphere ? r.geometry == GEOMETRY_SPHERE
+                       : r.geometry == GEOMETRY_FLAT &&
+                             r.flatNormal.x == 0.0f &&
+                             r.flatNormal.y == 1.0f &&
+                             r.flatNormal.z == 0.0f;
+    materials &= r.materialIndex == instanceMaterials[id];
+  }
+  Expect(geometry, "records give the floor a flat up normal and spheres the "
+                   "sphere rule");
+  Expect(materials, "records carry each instance's material");
+
+  std::vector<SceneInstance> reversed(instances.rbegin(), instances.rend());
+  std::vector<HitGroupRecord> reordered;
+  BuildSceneHitGroupRecords(reversed, instanceMaterials, reordered);
+  Expect(reordered.size() == records.size() &&
+             !std::memcmp(reordered.data(), records.data(),
+                          records.size() * sizeof(HitGroupRecord)),
+         "records follow instance IDs, not instance order");
+}
+
+void Measure(uint32_t instances, uint32_t distinct, double minSeconds) {
+  std::vector<MaterialData> palette(distinct);
+  Rng rng = {distinct};
+  for (MaterialData &m : palette) {
+    m = Make(rng.Uniform(0, 1), rng.Uniform(0, 1), rng.Uniform(0, 1),
+             rng.Next() % 4 == 0 ? 0.8f : 0.0f, rng.Uniform(0, 1),
+             rng.Next() % 2);
+  }
+  std::vector<uint32_t> picks(instances);
+  for (uint32_t &p : picks) {
+    p = rng.Next() % distinct;
+  }
+
+  MaterialRegistry registry;
+  std::vector<uint32_t> indices(instances);
+  uint32_t reps = 0;
+  double seconds = 0.0;
+  auto start = std::chrono::steady_clock::now();
+  do {
+    registry.Clear();
+    for (uint32_t i = 0; i < instances; ++i) {
+      indices[i] = registry.Add(palette[picks[i]]);
+    }
+    ++reps;
+    seconds = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  } while (seconds < minSeconds);
+
+  bool valid = true;
+  for (uint32_t i = 0; i < instances; ++i) {
+    valid &= std::memcmp(&registry.Materials()[indices[i]],
+                         &palette[picks[i]], sizeof(MaterialData)) == 0;
+  }
+  Expect(valid, "every instance maps back to its own material");
+
+  std::printf("%9u %9u %9u %10.1f %9.1f\n", instances, distinct,
+              registry.Count(), registry.SizeInBytes() / 1024.0,
+              seconds * 1e9 / ((double)reps * instances));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  uint32_t balls = kSceneBallCount;
+  uint32_t samples = 256;
+  double minSeconds = 0.25;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--balls") && i + 1 < argc) {
+      balls = (uint32_t)std::max(0, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--samples") && i + 1 < argc) {
+      samples = (uint32_t)std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      minSeconds = std::atof(argv[++i]);
+    } else {
+      std::printf("Usage: MaterialTableBenchmark [--balls N] [--samples N] "
+                  "[--seconds S]\n");
+      return 1;
+    }
+  }
+
+  CheckRegistry();
+  std::printf("Layout and dedupe checks: %s\n", g_failures ? "FAIL" : "ok");
+  int failures = g_failures;
+  CheckSceneShading(2 + balls, samples);
+  CheckHitGroupRecords();
+  std::printf("Scene shading check:      %s\n\n",
+              g_failures != failures ? "FAIL" : "ok");
+
+  std::printf("%9s %9s %9s %10s %9s\n", "instances", "palette", "table",
+              "table KB", "ns/add");
+  const uint32_t distinct[] = {1, 16, 1024, 65536};
+  for (uint32_t d : distinct) {
+    Measure(1000000, d, minSeconds);
+  }
+  Measure(52, 52, minSeconds);
+  return g_failures ? 1 : 0;
+}
@@ -0,0 +1,273 @@
+// Exercises MeshOptimizer, the welding, vertex cache and vertex fetch
+// passes the renderer runs over its meshes before upload, on the scene's
+// sphere and plane and on large tessellated spheres.
+//
+// Checks that welding closes the seam GenerateSphere leaves (every edge
+// then borders exactly two triangles, in opposite directions), that the
+// reordering passes keep the same triangles with the same winding, that
+// degenerate triangles are dropped, that vertices end up in first-use
+// order, that the cache pass never raises the ACMR and brings a shuffled
+// mesh back to a regular one's, and that PackIndices switches to 16-bit
+// indices exactly when every index fits. Any failure makes the tool exit
+// with status 1. The table reports vertex and index memory and the ACMR
+// before and after each mesh, with the time the optimizer took.
+
+#include "MeshOptimizer.h"
+#include "SceneInstances.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+struct Mesh {
+  std::vector<MeshVertex> vertices;
+  std::vector<uint32_t> indices;
+};
+
+Mesh MakeSphere(int slices, int stacks) {
+  Mesh mesh;
+  GenerateSphere(mesh.vertices, mesh.indices, kSphereRadius, slices, stacks);
+  return mesh;
+}
+
+// Same triangles in random order, as a mesh exported without any ordering
+// care would have them.
+Mesh Shuffled(Mesh mesh) {
+  uint32_t state = 777u;
+  size_t triangles = mesh.indices.size() / 3;
+  for (size_t t = triangles; t > 1; --t) {
+    state = state * 1664525u + 1013904223u;
+    size_t other = (size_t)(((uint64_t)state * t) >> 32);
+    for (int k = 0; k < 3; ++k) {
+      std::swap(mesh.indices[3 * (t - 1) + k], mesh.indices[3 * other + k]);
+    }
+  }
+  return mesh;
+}
+
+// Triangles as position triples rotated to start at their smallest corner
+// (which keeps the winding), sorted, so two orderings of one mesh compare
+// equal.
+std::vector<std::array<float, 9>> CanonicalTriangles(const Mesh &mesh) {
+  std::vector<std::array<float, 9>> triangles;
+  for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+    std::array<std::array<float, 3>, 3> corners;
+    for (int k = 0; k < 3; ++k) {
+      Float3 p = mesh.vertices[mesh.indices[t + k]].position;
+      corners[k] = {p.x, p.y, p.z};
+    }
+    int start = (int)(std::min_element(corners.begin(), corners.end()) -
+                      corners.begin());
+    std::array<float, 9> triangle;
+    for (int k = 0; k < 3; ++k) {
+      std::memcpy(&triangle[3 * k], corners[(start + k) % 3].data(),
+                  3 * sizeof(float));
+    }
+    triangles.push_back(triangle);
+  }
+  std::sort(triangles.begin(), triangles.end());
+  return triangles;
+}
+
+// Every directed edge used once and its reverse used once: closed, with
+// consistent winding.
+bool IsClosedManifold(const std::vector<uint32_t> &indices) {
+  std::map<std::pair<uint32_t, uint32_t>, int> edges;
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    for (int k = 0; k < 3; ++k) {
+      ++edges[{indices[t + k], indices[t + (k + 1) % 3]}];
+    }
+  }
+  for (const auto &[edge, uses] : edges) {
+    auto reverse = edges.find({edge.second, edge.first});
+    if (uses != 1 || reverse == edges.end() || reverse->second != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool InFirstUseOrder(const std::vector<uint32_t> &indices,
+                     size_t vertexCount) {
+  uint32_t nextNew = 0;
+  for (uint32_t index : indices) {
+    if (index > nextNew) {
+      return false;
+    }
+    nextNew += index == nextNew;
+  }
+  return nextNew == vertexCount;
+}
+
+void CheckWelding() {
+  const int slices = kSphereSlices, stacks = kSphereStacks;
+  Mesh sphere = MakeSphere(slices, stacks);
+  Expect(!IsClosedManifold(sphere.indices),
+         "the generated sphere has an open seam");
+  const MeshOptimizeSettings defaults;
+  size_t welded =
+      WeldVertices(sphere.vertices, sphere.indices,
+                   defaults.weldPositionEpsilon, defaults.weldNormalCos);
+  Expect(welded == (size_t)(stacks - 1),
+         "welding merges exactly the duplicated seam column");
+  Expect(IsClosedManifold(sphere.indices), "the welded sphere is closed");
+  Expect(RemoveDegenerateTriangles(sphere.indices) == 0,
+         "welding the sphere collapses no triangles");
+
+  // A zero epsilon still merges exact duplicates, nothing else.
+  Mesh plane;
+  GeneratePlane(plane.vertices, plane.indices, kPlaneSize, kPlaneSize);
+  GeneratePlane(plane.vertices, plane.indices, kPlaneSize, kPlaneSize);
+  size_t planeVertices = plane.vertices.size();
+  for (size_t i = plane.indices.size() / 2; i < plane.indices.size(); ++i) {
+    plane.indices[i] += (uint32_t)(planeVertices / 2);
+  }
+  Expect(WeldVertices(plane.vertices, plane.indices, 0.0f, 1.0f) == 4 &&
+             plane.vertices.size() == 4,
+         "exact duplicates weld with a zero epsilon");
+
+  // Normals past the angle threshold keep a hard edge.
+  Mesh crease;
+  crease.vertices = {{{0, 0, 0}, {0, 1, 0}, {1, 1, 1}},
+                     {{0, 0, 0}, {1, 0, 0}, {1, 1, 1}},
+                     {{1, 0, 0}, {0, 1, 0}, {1, 1, 1}},
+                     {{0, 0, 1}, {0, 1, 0}, {1, 1, 1}},
+                     {{0, 1, 0}, {1, 0, 0}, {1, 1, 1}},
+                     {{0, 0, 1}, {1, 0, 0}, {1, 1, 1}}};
+  crease.indices = {0, 3, 2, 1, 4, 5};
+  Expect(WeldVertices(crease.vertices, crease.indices, 1e-5f, 0.9999f) == 0,
+         "vertices with diverging normals are not welded");
+
+  // Welding two corners of a triangle together collapses it.
+  Mesh sliver;
+  sliver.vertices = {{{0, 0, 0}, {0, 1, 0}, {1, 1, 1}},
+                     {{1, 0, 0}, {0, 1, 0}, {1, 1, 1}},
+                     {{1, 0, 1e-6f}, {0, 1, 0}, {1, 1, 1}},
+                     {{0, 0, 1}, {0, 1, 0}, {1, 1, 1}}};
+  sliver.indices = {0, 1, 2, 0, 2, 3};
+  WeldVertices(sliver.vertices, sliver.indices, 1e-5f, 0.9999f);
+  Expect(RemoveDegenerateTriangles(sliver.indices) == 1 &&
+             sliver.indices.size() == 3,
+         "triangles collapsed by welding are removed");
+}
+
+void CheckReordering() {
+  for (int slices : {kSphereSlices, 96}) {
+    Mesh sphere = MakeSphere(slices, slices);
+    const MeshOptimizeSettings defaults;
+    WeldVertices(sphere.vertices, sphere.indices,
+                 defaults.weldPositionEpsilon, defaults.weldNormalCos);
+    std::vector<std::array<float, 9>> before = CanonicalTriangles(sphere);
+    float regularAcmr =
+        ComputeAcmr(sphere.indices, sphere.vertices.size(), 16);
+
+    Mesh optimized = sphere;
+    MeshOptimizeStats stats = OptimizeMesh(optimized.vertices,
+                                           optimized.indices);
+    Expect(CanonicalTriangles(optimized) == before,
+           "optimizing keeps the triangles and their winding");
+    Expect(IsClosedManifold(optimized.indices),
+           "the optimized sphere stays closed");
+    Expect(InFirstUseOrder(optimized.indices, optimized.vertices.size()),
+           "vertices are numbered in first-use order");
+    Expect(stats.acmrAfter <= stats.acmrBefore,
+           "the cache pass does not raise the ACMR");
+
+    Mesh shuffled = Shuffled(sphere);
+    MeshOptimizeStats shuffledStats =
+        OptimizeMesh(shuffled.vertices, shuffled.indices);
+    Expect(CanonicalTriangles(shuffled) == before,
+           "optimizing a shuffled mesh keeps its triangles");
+    Expect(shuffledStats.acmrBefore > 2.0f * regularAcmr &&
+               shuffledStats.acmrAfter <= regularAcmr,
+           "a shuffled mesh comes back to at most the regular mesh's ACMR");
+  }
+}
+
+void CheckPacking() {
+  Mesh sphere = MakeSphere(kSphereSlices, kSphereStacks);
+  PackedIndices packed = PackIndices(sphere.indices);
+  bool same = packed.sixteenBit && packed.Count() == sphere.indices.size() &&
+              packed.ByteSize() == sphere.indices.size() * 2;
+  for (size_t i = 0; same && i < sphere.indices.size(); ++i) {
+    same &= packed[i] == sphere.indices[i];
+  }
+  Expect(same, "a small mesh packs into 16-bit indices");
+
+  std::vector<uint32_t> edge = {0, 65535, 1};
+  Expect(PackIndices(edge).sixteenBit, "index 65535 still fits 16 bits");
+  edge.push_back(65536);
+  PackedIndices wide = PackIndices(edge);
+  Expect(!wide.sixteenBit && wide.ByteSize() == 16 && wide[3] == 65536,
+         "index 65536 needs 32 bits");
+}
+
+void Report(const char *name, Mesh mesh) {
+  auto start = std::chrono::steady_clock::now();
+  MeshOptimizeStats stats = OptimizeMesh(mesh.vertices, mesh.indices);
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  std::printf("%-22s %8zu %8zu %9zu %9.1f %9.1f %7.1f %7.1f %6.3f %6.3f "
+              "%8.2f\n",
+              name, stats.verticesBefore, stats.verticesAfter,
+              stats.trianglesAfter, stats.vertexBytesBefore / 1024.0,
+              stats.vertexBytesAfter / 1024.0,
+              stats.indexBytesBefore / 1024.0,
+              stats.indexBytesAfter / 1024.0, stats.acmrBefore,
+              stats.acmrAfter, ms);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int largeSlices = 1024;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--slices") && i + 1 < argc) {
+      largeSlices = std::max(8, std::atoi(argv[++i]));
+    } else {
+      std::printf("Usage: MeshOptimizeBenchmark [--slices N]\n");
+      return 1;
+    }
+  }
+
+  CheckWelding();
+  CheckReordering();
+  CheckPacking();
+  std::printf("Mesh optimizer checks: %s\n\n", g_failures ? "FAIL" : "ok");
+
+  std::printf("%-22s %8s %8s %9s %9s %9s %7s %7s %6s %6s %8s\n", "mesh",
+              "verts", "verts'", "tris", "vtx KB", "vtx KB'", "idx KB",
+              "idx KB'", "ACMR", "ACMR'", "ms");
+  Mesh plane;
+  GeneratePlane(plane.vertices, plane.indices, kPlaneSize, kPlaneSize);
+  Report("scene plane", plane);
+  Report("scene sphere 32x32", MakeSphere(kSphereSlices, kSphereStacks));
+  Report("sphere 255x256", MakeSphere(255, 256));
+  char name[64];
+  std::snprintf(name, sizeof(name), "sphere %dx%d", largeSlices, largeSlices);
+  Mesh large = MakeSphere(largeSlices, largeSlices);
+  Report(name, large);
+  std::snprintf(name, sizeof(name), "shuffled %dx%d", largeSlices,
+                largeSlices);
+  Report(name, Shuffled(std::move(large)));
+
+  return g_failures ? 1 : 0;
+}
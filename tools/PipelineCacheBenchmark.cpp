@@ -0,0 +1,427 @@
+// Checks PipelineCache, the on-disk store the renderer keeps compiled
+// shaders and driver pipeline blobs in, then measures what a cold and a warm
+// startup cost on the cache side.
+//
+// Key checks: a fixed input hashes to a pinned value (the key is part of
+// the on-disk format), and moving bytes between fields, reordering fields,
+// flipping one bytecode bit or changing the payload size or recursion depth
+// all change the key. Cache checks run in a scratch directory: blobs
+// survive a reopen byte for byte; a changed vendor, device or driver
+// version, a corrupt, truncated or wrong-version index, a damaged or
+// missing blob file and Invalidate() each drop what the rules say; stray
+// blob and temporary files are deleted on open; and Store() evicts the
+// least recently used entries past maxBytes. Any failure makes the tool exit
+// with status 1.
+//
+// The timing table then derives the renderer's keys from the shaders it
+// embeds (the DXR library dxc built, or the checked-in one) and reports a
+// cold start (miss, store, flush) against a warm one (open, load) per
+// pipeline, next to the cost of the key itself.
+
+#include "PipelineCache.h"
+#include "ShaderContainer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef RAYTRACING_SHADER_DIR
+#define RAYTRACING_SHADER_DIR "shaders"
+#endif
+#ifndef RAYTRACING_DXIL
+#define RAYTRACING_DXIL RAYTRACING_SHADER_DIR "/RayTracing.dxil"
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+const PipelineCacheDevice kDevice = {0x10de, 0x2684, 0x0020000f0c8e0001ull};
+
+std::vector<uint8_t> MakeBlob(uint32_t seed, size_t size) {
+  std::vector<uint8_t> blob(size);
+  uint32_t state = seed * 0x9E3779B9u + 1;
+  for (uint8_t &byte : blob) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    byte = (uint8_t)state;
+  }
+  return blob;
+}
+
+void WriteBytes(const fs::path &path, const std::vector<uint8_t> &bytes) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write((const char *)bytes.data(), (std::streamsize)bytes.size());
+}
+
+std::vector<uint8_t> ReadBytes(const fs::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(file),
+                              std::istreambuf_iterator<char>());
+}
+
+// Recomputes the index trailer after the test edits its body.
+void ResealIndex(std::vector<uint8_t> &index) {
+  uint64_t checksum = PipelineKey::Hash(index.data(), index.size() - 8);
+  std::memcpy(index.data() + index.size() - 8, &checksum, 8);
+}
+
+void CheckKeys() {
+  std::vector<uint8_t> bytecode = MakeBlob(1, 4096);
+  auto dxrKey = [&](const std::vector<uint8_t> &code, uint64_t payload,
+                    uint64_t recursion) {
+    return PipelineKey()
+        .AddBytes("library", code.data(), code.size())
+        .AddString("rootsig", "serialized root signature")
+        .AddU64("payload", payload)
+        .AddU64("recursion", recursion)
+        .Value();
+  };
+  uint64_t base = dxrKey(bytecode, 48, 2);
+
+  // Pinned: a different value here means every cache on disk goes stale.
+  uint64_t pinned = PipelineKey()
+                        .AddString("kind", "vs")
+                        .AddString("entry", "VSMain")
+                        .AddU64("flags", 0)
+                        .Value();
+  Expect(pinned == 0x3cb7715b769f9e47ull, "key derivation is stable");
+
+  Expect(PipelineKey().AddString("a", "bc").Value() !=
+             PipelineKey().AddString("ab", "c").Value(),
+         "field names and data do not run together");
+  Expect(PipelineKey().AddString("x", "ab").AddString("y", "").Value() !=
+             PipelineKey().AddString("x", "a").AddString("y", "b").Value(),
+         "bytes cannot move between fields");
+  Expect(PipelineKey().AddU64("a", 1).AddU64("b", 2).Value() !=
+             PipelineKey().AddU64("b", 2).AddU64("a", 1).Value(),
+         "field order matters");
+
+  std::vector<uint8_t> flipped = bytecode;
+  flipped[2048] ^= 0x10;
+  Expect(dxrKey(flipped, 48, 2) != base, "one bytecode bit changes the key");
+  Expect(dxrKey(bytecode, 52, 2) != base, "payload size changes the key");
+  Expect(dxrKey(bytecode, 48, 1) != base, "recursion depth changes the key");
+  Expect(dxrKey(bytecode, 48, 2) == base, "the same inputs give the same key");
+}
+
+void CheckRoundTrip(const fs::path &dir) {
+  std::vector<std::vector<uint8_t>> blobs;
+  {
+    PipelineCache cache(dir.string(), kDevice);
+    for (uint32_t i = 0; i < 8; ++i) {
+      blobs.push_back(MakeBlob(i, 1000 + 3000 * i));
+      cache.Store(100 + i, blobs.back().data(), blobs.back().size());
+    }
+    cache.Store(200, nullptr, 0); // seen-only marker
+    cache.Flush();
+  }
+  PipelineCache cache(dir.string(), kDevice);
+  Expect(cache.EntryCount() == 9 && !cache.Stats().indexDiscarded,
+         "entries survive a reopen");
+  bool same = true;
+  std::vector<uint8_t> blob;
+  for (uint32_t i = 0; i < 8; ++i) {
+    same &= cache.Load(100 + i, blob) && blob == blobs[i];
+  }
+  Expect(same, "reloaded blobs match byte for byte");
+  Expect(cache.Contains(200) && cache.Load(200, blob) && blob.empty(),
+         "empty marker entries survive a reopen");
+  Expect(!cache.Load(300, blob), "unknown keys miss");
+  Expect(cache.Stats().hits == 9 && cache.Stats().misses == 1,
+         "hits and misses are counted");
+}
+
+// Fills a fresh cache with four entries and flushes it.
+void Populate(const fs::path &dir) {
+  fs::remove_all(dir);
+  PipelineCache cache(dir.string(), kDevice);
+  for (uint32_t i = 0; i < 4; ++i) {
+    std::vector<uint8_t> blob = MakeBlob(i, 512);
+    cache.Store(i, blob.data(), blob.size());
+  }
+  cache.Flush();
+}
+
+size_t BlobFiles(const fs::path &dir) {
+  size_t count = 0;
+  for (const fs::directory_entry &file : fs::directory_iterator(dir)) {
+    count += file.path().filename() != "index.bin";
+  }
+  return count;
+}
+
+void CheckInvalidation(const fs::path &dir) {
+  fs::path index = dir / "index.bin";
+  std::vector<uint8_t> blob;
+
+  PipelineCacheDevice other[3] = {kDevice, kDevice, kDevice};
+  other[0].vendorId = 0x1002;
+  other[1].deviceId += 1;
+  other[2].driverVersion += 1;
+  for (const PipelineCacheDevice &device : other) {
+    Populate(dir);
+    PipelineCache cache(dir.string(), device);
+    Expect(cache.EntryCount() == 0 && cache.Stats().invalidated == 4,
+           "another adapter or driver drops every entry");
+    Expect(BlobFiles(dir) == 0, "dropped entries lose their blob files");
+  }
+
+  Populate(dir);
+  {
+    std::vector<uint8_t> bytes = ReadBytes(index);
+    bytes[40] ^= 1;
+    WriteBytes(index, bytes);
+    PipelineCache cache(dir.string(), kDevice);
+    Expect(cache.EntryCount() == 0 && cache.Stats().indexDiscarded,
+           "a corrupt index is discarded");
+  }
+
+  Populate(dir);
+  {
+    std::vector<uint8_t> bytes = ReadBytes(index);
+    bytes.resize(bytes.size() - 20);
+    WriteBytes(index, bytes);
+    PipelineCache cache(dir.string(), kDevice);
+    Expect(cache.EntryCount() == 0 && cache.Stats().indexDiscarded,
+           "a truncated index is discarded");
+  }
+
+  Populate(dir);
+  {
+    std::vector<uint8_t> bytes = ReadBytes(index);
+    bytes[4] = PipelineCache::kFormatVersion + 1;
+    ResealIndex(bytes);
+    WriteBytes(index, bytes);
+    PipelineCache cache(dir.string(), kDevice);
+    Expect(cache.EntryCount() == 0 && cache.Stats().indexDiscarded,
+           "an index from another format version is discarded");
+  }
+
+  Populate(dir);
+  {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", 1ull);
+    std::vector<uint8_t> bytes = ReadBytes(dir / name);
+    bytes[100] ^= 1;
+    WriteBytes(dir / name, bytes);
+    std::snprintf(name, sizeof(name), "%016llx.bin", 2ull);
+    fs::remove(dir / name);
+
+    PipelineCache cache(dir.string(), kDevice);
+    Expect(cache.EntryCount() == 4, "blob files are only checked on Load");
+    Expect(!cache.Load(1, blob) && !cache.Contains(1),
+           "a damaged blob misses and drops its entry");
+    Expect(!cache.Load(2, blob) && !cache.Contains(2),
+           "a missing blob misses and drops its entry");
+    Expect(cache.Load(3, blob), "intact neighbours still hit");
+    cache.Invalidate(3);
+    Expect(!cache.Contains(3), "Invalidate drops the entry");
+    Expect(cache.Stats().invalidated == 3, "invalidations are counted");
+    cache.Flush();
+  }
+  {
+    PipelineCache cache(dir.string(), kDevice);
+    Expect(cache.EntryCount() == 1 && cache.Contains(0),
+           "invalidations persist through Flush");
+  }
+
+  Populate(dir);
+  WriteBytes(dir / "00000000deadbeef.bin", MakeBlob(9, 64));
+  WriteBytes(dir / "index.bin.tmp", MakeBlob(9, 64));
+  WriteBytes(dir / "notes.txt", MakeBlob(9, 64));
+  {
+    PipelineCache cache(dir.string(), kDevice);
+    Expect(!fs::exists(dir / "00000000deadbeef.bin") &&
+               !fs::exists(dir / "index.bin.tmp"),
+           "stray blobs and temporaries are deleted on open");
+    Expect(fs::exists(dir / "notes.txt"), "other files are left alone");
+    Expect(cache.EntryCount() == 4, "stray files do not become entries");
+  }
+
+  // Unflushed stores leave blobs the old index does not know about.
+  Populate(dir);
+  {
+    PipelineCache cache(dir.string(), kDevice);
+    std::vector<uint8_t> extra = MakeBlob(7, 64);
+    cache.Store(7, extra.data(), extra.size());
+  }
+  {
+    PipelineCache cache(dir.string(), kDevice);
+    Expect(cache.EntryCount() == 4 && !cache.Contains(7),
+           "stores without Flush are forgotten");
+  }
+}
+
+void CheckEviction(const fs::path &dir) {
+  fs::remove_all(dir);
+  PipelineCache cache(dir.string(), kDevice, 4096);
+  std::vector<uint8_t> blob = MakeBlob(1, 1024);
+  for (uint64_t key = 0; key < 4; ++key) {
+    cache.Store(key, blob.data(), blob.size());
+  }
+  std::vector<uint8_t> loaded;
+  cache.Load(0, loaded); // 1 is now the least recently used
+  cache.Store(4, blob.data(), blob.size());
+  Expect(cache.Contains(0) && !cache.Contains(1) && cache.Contains(4),
+         "eviction drops the least recently used entry");
+  Expect(cache.TotalBytes() <= 4096 && cache.Stats().evicted == 1,
+         "the cache stays under maxBytes");
+  std::vector<uint8_t> huge = MakeBlob(2, 8192);
+  cache.Store(5, huge.data(), huge.size());
+  Expect(!cache.Contains(5) && cache.EntryCount() == 4,
+         "blobs larger than the cache are not stored");
+}
+
+struct StartupResult {
+  double keyUs;
+  double coldUs;
+  double warmUs;
+};
+
+// The renderer's pipelines: the DXR library, and the raster VS, PS and PSO.
+// Driver blobs are stood in for by random bytes of a plausible size.
+StartupResult MeasureStartup(const fs::path &dir,
+                             const std::string &libraryPath,
+                             const std::string &shaders, int reps) {
+  MappedFile library(libraryPath);
+  MappedFile source(shaders + "/shader.hlsl");
+  std::vector<uint8_t> vs = MakeBlob(11, 1200);
+  std::vector<uint8_t> ps = MakeBlob(12, 900);
+  std::vector<uint8_t> pso = MakeBlob(13, 24 * 1024);
+
+  auto keys = [&]() {
+    uint64_t k[4];
+    k[0] = PipelineKey()
+               .AddString("kind", "dxr")
+               .AddBytes("library", library.Data(), library.Size())
+               .AddU64("payload", 48)
+               .AddU64("recursion", 2)
+               .Value();
+    k[1] = PipelineKey()
+               .AddString("kind", "vs")
+               .AddBytes("source", source.Data(), source.Size())
+               .Value();
+    k[2] = PipelineKey()
+               .AddString("kind", "ps")
+               .AddBytes("source", source.Data(), source.Size())
+               .Value();
+    k[3] = PipelineKey()
+               .AddString("kind", "pso")
+               .AddBytes("vs", vs.data(), vs.size())
+               .AddBytes("ps", ps.data(), ps.size())
+               .Value();
+    return std::vector<uint64_t>(k, k + 4);
+  };
+
+  StartupResult result = {1e30, 1e30, 1e30};
+  for (int rep = 0; rep < reps; ++rep) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint64_t> k = keys();
+    result.keyUs = std::min(result.keyUs, Seconds(start) * 1e6);
+
+    fs::remove_all(dir);
+    start = std::chrono::steady_clock::now();
+    {
+      PipelineCache cache(dir.string(), kDevice);
+      std::vector<uint8_t> blob;
+      k = keys();
+      Expect(!cache.Load(k[0], blob) && !cache.Load(k[1], blob),
+             "a cold cache misses");
+      cache.Store(k[0], nullptr, 0);
+      cache.Store(k[1], vs.data(), vs.size());
+      cache.Store(k[2], ps.data(), ps.size());
+      cache.Store(k[3], pso.data(), pso.size());
+      cache.Flush();
+    }
+    result.coldUs = std::min(result.coldUs, Seconds(start) * 1e6);
+
+    start = std::chrono::steady_clock::now();
+    {
+      PipelineCache cache(dir.string(), kDevice);
+      std::vector<uint8_t> blob;
+      k = keys();
+      bool hit = cache.Contains(k[0]);
+      hit &= cache.Load(k[1], blob) && blob == vs;
+      hit &= cache.Load(k[2], blob) && blob == ps;
+      hit &= cache.Load(k[3], blob) && blob == pso;
+      Expect(hit, "a warm cache hits every pipeline");
+      cache.Flush();
+    }
+    result.warmUs = std::min(result.warmUs, Seconds(start) * 1e6);
+  }
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  fs::path dir = fs::temp_directory_path() / "PipelineCacheBenchmark";
+  std::string shaders = RAYTRACING_SHADER_DIR;
+  std::string library = RAYTRACING_DXIL;
+  int reps = 50;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--dir") && i + 1 < argc) {
+      dir = argv[++i];
+    } else if (!std::strcmp(argv[i], "--shaders") && i + 1 < argc) {
+      shaders = argv[++i];
+    } else if (!std::strcmp(argv[i], "--library") && i + 1 < argc) {
+      library = argv[++i];
+    } else if (!std::strcmp(argv[i], "--reps") && i + 1 < argc) {
+      reps = std::max(1, std::atoi(argv[++i]));
+    } else {
+      std::printf("Usage: PipelineCacheBenchmark [--dir scratch] "
+                  "[--shaders dir] [--library path.dxil] [--reps N]\n");
+      return 1;
+    }
+  }
+
+  StartupResult startup;
+  try {
+    CheckKeys();
+    fs::remove_all(dir);
+    CheckRoundTrip(dir);
+    CheckInvalidation(dir);
+    CheckEviction(dir);
+    std::printf("Pipeline cache checks: %s\n\n", g_failures ? "FAIL" : "ok");
+    startup = MeasureStartup(dir, library, shaders, reps);
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "FAIL: %s\n", e.what());
+    fs::remove_all(dir);
+    return 1;
+  }
+  fs::remove_all(dir);
+
+  std::printf("Cache side of startup, 4 pipelines, best of %d:\n", reps);
+  std::printf("%-26s %10s\n", "", "us");
+  std::printf("%-26s %10.1f\n", "derive keys", startup.keyUs);
+  std::printf("%-26s %10.1f\n", "cold (miss, store, flush)", startup.coldUs);
+  std::printf("%-26s %10.1f\n", "warm (open, load)", startup.warmUs);
+  std::printf("\nDriver compile time is what a warm start saves on top; the "
+              "renderer shows it in its panel.\n");
+  return g_failures ? 1 : 0;
+}
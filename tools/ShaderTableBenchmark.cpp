@@ -0,0 +1,383 @@
+// Exercises ShaderTableBuilder, the layout engine behind the renderer's
+// shader binding table.
+//
+// A scripted check compares the renderer's own table (one raygen, one miss
+// and a hit group record per instance with a 4-byte material argument)
+// against hand-computed offsets. A randomized run then builds thousands of
+// records with mixed argument sizes and ray type counts and checks every
+// table against the D3D12 rules (64-byte table starts, 32-byte strides that
+// fit the widest record, no overlap), checks that no table order gives a
+// smaller buffer, and reads every record back out of the written bytes,
+// padding included. Any failure makes the tool exit with status 1. The
+// throughput table measures building, laying out and writing the table for
+// growing instance counts.
+
+#include "ShaderTable.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+using Kind = ShaderTableKind;
+
+struct Rng {
+  uint32_t state;
+  uint32_t Next() {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+  }
+};
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+template <typename Fn> bool Throws(Fn &&fn) {
+  try {
+    fn();
+  } catch (const std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+// Identifier i is 32 copies of the byte 0x10 + i, so records are easy to
+// recognise in the written bytes.
+std::vector<uint8_t> MakeIdentifier(uint32_t i) {
+  return std::vector<uint8_t>(ShaderTableBuilder::kIdentifierSize,
+                              (uint8_t)(0x10 + i));
+}
+
+// A destination buffer with guard bytes behind it.
+struct Output {
+  std::vector<uint8_t> bytes;
+  uint8_t *data;
+  size_t size;
+
+  explicit Output(uint64_t size) : size((size_t)size) {
+    bytes.assign(this->size + 2 * ShaderTableBuilder::kTableAlignment, 0xCD);
+    uintptr_t base = (uintptr_t)bytes.data();
+    uintptr_t aligned = (base + 63) & ~(uintptr_t)63;
+    data = bytes.data() + (aligned - base);
+  }
+  bool GuardIntact() const {
+    for (size_t b = 0; b < ShaderTableBuilder::kTableAlignment; ++b) {
+      if (data[size + b] != 0xCD) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+void CheckScripted() {
+  ShaderTableBuilder sbt(1);
+  std::vector<uint8_t> rayGen = MakeIdentifier(0);
+  std::vector<uint8_t> miss = MakeIdentifier(1);
+  std::vector<uint8_t> hitGroup = MakeIdentifier(2);
+  uint32_t rayGenId = sbt.AddIdentifier(rayGen.data());
+  uint32_t missId = sbt.AddIdentifier(miss.data());
+  uint32_t hitGroupId = sbt.AddIdentifier(hitGroup.data());
+
+  Expect(sbt.AddRecord(Kind::RayGen, rayGenId) == 0, "first raygen record");
+  Expect(sbt.AddRecord(Kind::Miss, missId) == 0, "first miss record");
+  bool indices = true;
+  for (uint32_t i = 0; i < 52; ++i) {
+    indices &= sbt.AddInstance(&hitGroupId, &i, sizeof(i)) == i;
+  }
+  Expect(indices, "one hit group record per instance");
+
+  // Hit groups: 52 x 64 bytes (32 + 4 rounded up), no tail padding, so they
+  // go first. Raygen and miss are one 32-byte record each, 64-aligned.
+  ShaderTableBuilder::Layout layout = sbt.ComputeLayout();
+  Expect(layout[Kind::HitGroup].offset == 0 &&
+             layout[Kind::HitGroup].stride == 64 &&
+             layout[Kind::HitGroup].size == 52 * 64,
+         "hit group table layout");
+  Expect(layout[Kind::RayGen].offset == 3328 &&
+             layout[Kind::RayGen].stride == 32 &&
+             layout[Kind::RayGen].size == 32,
+         "raygen table layout");
+  Expect(layout[Kind::Miss].offset == 3392 && layout[Kind::Miss].size == 32,
+         "miss table layout");
+  Expect(layout[Kind::Callable].count == 0 &&
+             layout[Kind::Callable].size == 0,
+         "no callable table");
+  Expect(layout.TotalSize() == 3424, "total size");
+  Expect(layout.paddingBytes == 3424 - (32 + 32 + 52 * 36),
+         "padding accounted");
+
+  Output out(layout.TotalSize());
+  sbt.Write(out.data, layout);
+  uint32_t arg = 0;
+  std::memcpy(&arg, out.data + 17 * 64 + 32, sizeof(arg));
+  Expect(arg == 17, "instance 17's argument follows its identifier");
+  Expect(out.data[17 * 64] == 0x12 && out.data[3328] == 0x10 &&
+             out.data[3392] == 0x11,
+         "identifiers written at their table offsets");
+  Expect(out.GuardIntact(), "nothing written past the end");
+
+  // Two ray types: instances step by two records, each pair sharing args.
+  ShaderTableBuilder twoRays(2);
+  uint32_t groups[2] = {twoRays.AddIdentifier(hitGroup.data()),
+                        twoRays.AddIdentifier(miss.data())};
+  Expect(twoRays.AddInstance(groups) == 0 &&
+             twoRays.AddInstance(groups) == 2 &&
+             twoRays.RecordCount(Kind::HitGroup) == 4,
+         "instance contribution steps by the ray type count");
+
+  ShaderTableBuilder errors(1);
+  uint32_t id = errors.AddIdentifier(rayGen.data());
+  std::vector<uint8_t> wide(ShaderTableBuilder::kMaxRecordStride);
+  Expect(Throws([&] { ShaderTableBuilder zero(0); }),
+         "zero ray types rejected");
+  Expect(Throws([&] { errors.AddRecord(Kind::Miss, id + 1); }),
+         "unknown identifier rejected");
+  Expect(Throws([&] { errors.AddRecord(Kind::Miss, id, wide.data(), 6); }),
+         "partial 32-bit argument rejected");
+  Expect(Throws([&] { errors.AddIdentifier(nullptr); }),
+         "null identifier rejected");
+  errors.AddRecord(Kind::Callable, id, wide.data(),
+                   ShaderTableBuilder::kMaxRecordStride -
+                       ShaderTableBuilder::kIdentifierSize);
+  Expect(!Throws([&] { errors.ComputeLayout(); }),
+         "4096-byte record accepted");
+  errors.AddRecord(Kind::Callable, id, wide.data(),
+                   ShaderTableBuilder::kMaxRecordStride);
+  Expect(Throws([&] { errors.ComputeLayout(); }),
+         "record over 4096 bytes rejected");
+}
+
+// Smallest total size over every order of the non-empty tables.
+uint64_t BestTotalSize(const ShaderTableBuilder::Layout &layout) {
+  std::vector<uint32_t> order;
+  for (uint32_t k = 0; k < kShaderTableKindCount; ++k) {
+    if (layout.tables[k].count) {
+      order.push_back(k);
+    }
+  }
+  uint64_t best = UINT64_MAX;
+  do {
+    uint64_t offset = 0;
+    for (uint32_t k : order) {
+      offset = (offset + 63) & ~63ull;
+      offset += layout.tables[k].size;
+    }
+    best = std::min(best, offset);
+  } while (std::next_permutation(order.begin(), order.end()));
+  return best;
+}
+
+struct Expected {
+  uint32_t identifier;
+  std::vector<uint8_t> args;
+};
+
+void CheckRandomized(uint32_t rounds, uint32_t maxInstances) {
+  Rng rng = {0x5B7};
+  bool rules = true, tight = true, contents = true, guard = true;
+  for (uint32_t round = 0; round < rounds; ++round) {
+    uint32_t rayTypes = 1 + rng.Next() % 3;
+    ShaderTableBuilder sbt(rayTypes);
+    uint32_t identifierCount = 2 + rng.Next() % 6;
+    for (uint32_t i = 0; i < identifierCount; ++i) {
+      sbt.AddIdentifier(MakeIdentifier(i).data());
+    }
+
+    std::vector<Expected> expected[kShaderTableKindCount];
+    auto randomArgs = [&]() {
+      // Mostly small root constants, sometimes several descriptors' worth.
+      uint32_t words = rng.Next() % 4 == 0 ? rng.Next() % 64 : rng.Next() % 5;
+      std::vector<uint8_t> args(words * 4);
+      for (uint8_t &b : args) {
+        b = (uint8_t)rng.Next();
+      }
+      return args;
+    };
+    for (uint32_t k = 0; k < kShaderTableKindCount; ++k) {
+      if (k == (uint32_t)Kind::HitGroup) {
+        continue;
+      }
+      uint32_t count = rng.Next() % 4;
+      for (uint32_t i = 0; i < count; ++i) {
+        Expected e = {rng.Next() % identifierCount, randomArgs()};
+        sbt.AddRecord((Kind)k, e.identifier, e.args.data(),
+                      (uint32_t)e.args.size());
+        expected[k].push_back(std::move(e));
+      }
+    }
+    uint32_t instances = rng.Next() % (maxInstances + 1);
+    std::vector<uint32_t> groups(rayTypes);
+    for (uint32_t i = 0; i < instances; ++i) {
+      for (uint32_t &g : groups) {
+        g = rng.Next() % identifierCount;
+      }
+      std::vector<uint8_t> args = randomArgs();
+      uint32_t base = sbt.AddInstance(groups.data(), args.data(),
+                                      (uint32_t)args.size());
+      rules &= base == i * rayTypes;
+      for (uint32_t g : groups) {
+        expected[(uint32_t)Kind::HitGroup].push_back({g, args});
+      }
+    }
+
+    ShaderTableBuilder::Layout layout = sbt.ComputeLayout();
+    uint64_t end = 0;
+    for (uint32_t k = 0; k < kShaderTableKindCount; ++k) {
+      const ShaderTableRange &range = layout.tables[k];
+      rules &= range.count == expected[k].size();
+      if (!range.count) {
+        rules &= range.size == 0;
+        continue;
+      }
+      size_t widest = 0;
+      for (const Expected &e : expected[k]) {
+        widest = std::max(widest, e.args.size());
+      }
+      rules &= range.offset % ShaderTableBuilder::kTableAlignment == 0;
+      rules &= range.stride % ShaderTableBuilder::kRecordAlignment == 0;
+      rules &= range.stride >= 32 + widest && range.stride < 64 + widest;
+      rules &= range.size == (uint64_t)range.stride * range.count;
+      for (uint32_t j = 0; j < kShaderTableKindCount; ++j) {
+        const ShaderTableRange &other = layout.tables[j];
+        if (j != k && other.count) {
+          rules &= range.offset + range.size <= other.offset ||
+                   other.offset + other.size <= range.offset;
+        }
+      }
+      end = std::max(end, range.offset + range.size);
+    }
+    rules &= layout.TotalSize() == end;
+    tight &= layout.TotalSize() == BestTotalSize(layout);
+
+    Output out(layout.TotalSize());
+    std::memset(out.data, 0xAB, out.size);
+    sbt.Write(out.data, layout);
+    std::vector<bool> covered(out.size, false);
+    for (uint32_t k = 0; k < kShaderTableKindCount; ++k) {
+      const ShaderTableRange &range = layout.tables[k];
+      for (uint32_t r = 0; r < range.count; ++r) {
+        const Expected &e = expected[k][r];
+        const uint8_t *record = out.data + range.offset + r * range.stride;
+        std::vector<uint8_t> id = MakeIdentifier(e.identifier);
+        contents &= std::memcmp(record, id.data(), id.size()) == 0;
+        contents &= e.args.empty() ||
+                    std::memcmp(record + 32, e.args.data(), e.args.size()) == 0;
+        for (size_t b = 32 + e.args.size(); b < range.stride; ++b) {
+          contents &= record[b] == 0;
+        }
+        std::fill(covered.begin() + (range.offset + r * range.stride),
+                  covered.begin() + (range.offset + (r + 1) * range.stride),
+                  true);
+      }
+    }
+    for (size_t b = 0; b < out.size; ++b) {
+      contents &= covered[b] || out.data[b] == 0; // gaps between tables
+    }
+    guard &= out.GuardIntact();
+  }
+  Expect(rules, "every table follows the alignment and stride rules");
+  Expect(tight, "no table order gives a smaller buffer");
+  Expect(contents, "written records and padding read back exactly");
+  Expect(guard, "nothing written past the end");
+}
+
+void Measure(uint32_t instances, uint32_t rayTypes, uint32_t argsSize,
+             double minSeconds) {
+  std::vector<uint8_t> identifier = MakeIdentifier(0);
+  std::vector<uint32_t> args(argsSize / 4);
+  std::vector<uint32_t> groups(rayTypes, 2);
+  std::vector<uint8_t> buffer;
+  ShaderTableBuilder sbt(rayTypes);
+  for (uint32_t i = 0; i < 3; ++i) {
+    sbt.AddIdentifier(identifier.data());
+  }
+
+  double buildSeconds = 0, writeSeconds = 0;
+  uint64_t totalSize = 0, padding = 0;
+  uint32_t reps = 0;
+  auto start = std::chrono::steady_clock::now();
+  do {
+    auto t0 = std::chrono::steady_clock::now();
+    sbt.ClearRecords();
+    sbt.AddRecord(ShaderTableKind::RayGen, 0);
+    sbt.AddRecord(ShaderTableKind::Miss, 1);
+    for (uint32_t i = 0; i < instances; ++i) {
+      if (!args.empty()) {
+        args[0] = i;
+      }
+      sbt.AddInstance(groups.data(), args.data(), argsSize);
+    }
+    ShaderTableBuilder::Layout layout = sbt.ComputeLayout();
+    auto t1 = std::chrono::steady_clock::now();
+    buffer.resize((size_t)layout.TotalSize());
+    sbt.Write(buffer.data(), layout);
+    auto t2 = std::chrono::steady_clock::now();
+    buildSeconds += std::chrono::duration<double>(t1 - t0).count();
+    writeSeconds += std::chrono::duration<double>(t2 - t1).count();
+    totalSize = layout.TotalSize();
+    padding = layout.paddingBytes;
+    ++reps;
+  } while (std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+               .count() < minSeconds);
+
+  uint64_t records = (uint64_t)instances * rayTypes + 2;
+  std::printf("%9u %4u %5u %10.1f %9.2f %9.2f %10.2f %7.1f%%\n", instances,
+              rayTypes, argsSize, totalSize / 1024.0,
+              buildSeconds * 1e9 / reps / records,
+              writeSeconds * 1e9 / reps / records,
+              totalSize * reps / writeSeconds / (1u << 30),
+              100.0 * padding / (double)totalSize);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  uint32_t rounds = 200;
+  uint32_t maxInstances = 4000;
+  double minSeconds = 0.25;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--rounds") && i + 1 < argc) {
+      rounds = (uint32_t)std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--instances") && i + 1 < argc) {
+      maxInstances = (uint32_t)std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      minSeconds = std::atof(argv[++i]);
+    } else {
+      std::printf("Usage: ShaderTableBenchmark [--rounds N] [--instances N] "
+                  "[--seconds S]\n");
+      return 1;
+    }
+  }
+
+  CheckScripted();
+  std::printf("Scripted renderer layout: %s\n", g_failures ? "FAIL" : "ok");
+  int failures = g_failures;
+  CheckRandomized(rounds, maxInstances);
+  std::printf("Randomized layout check:  %s\n\n",
+              g_failures != failures ? "FAIL" : "ok");
+
+  std::printf("%9s %4s %5s %10s %9s %9s %10s %8s\n", "instances", "rays",
+              "args", "size KB", "ns/build", "ns/write", "write GB/s",
+              "padding");
+  const uint32_t counts[] = {52, 1000, 10000, 100000, 1000000};
+  for (uint32_t count : counts) {
+    Measure(count, 1, 4, minSeconds);
+  }
+  Measure(100000, 2, 4, minSeconds);
+  Measure(100000, 1, 32, minSeconds);
+  return g_failures ? 1 : 0;
+}
@@ -0,0 +1,408 @@
+// Exercises IntersectRaySphere from shaders/RayTracingHlslCompat.h, the
+// routine the SphereIntersection shader runs for the procedural sphere
+// BLAS, compiled here from the same source as C++.
+//
+// Rays are aimed at the scene sphere from 2 to 100000 radii away, with
+// impact parameters spread across the disc and packed against its edge,
+// and compared with a double-precision reference. Checks that every ray
+// that clearly hits or clearly misses is classified correctly, that hit
+// points lie on the sphere to within a few float steps of the ray origin's
+// precision at every range, that the normal the shader reports is accurate
+// at the scene's scale, and that tMin, tMax and origins inside the sphere
+// pick the right root. Any failure makes the tool exit with status 1.
+//
+// The tables report the error of the textbook quadratic next to the robust
+// one, how far the 32x32 tessellated sphere the triangle path traces is from
+// the exact surface, the BLAS input sizes of both paths and the routine's
+// throughput.
+
+#include "MeshBvh.h"
+#include "MeshOptimizer.h"
+#include "SceneInstances.h"
+
+#include "../shaders/RayTracingHlslCompat.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+struct Rng {
+  uint32_t state;
+  float Next() { // [0, 1)
+    state = state * 1664525u + 1013904223u;
+    return (float)(state >> 8) * (1.0f / 16777216.0f);
+  }
+};
+
+struct Double3 {
+  double x, y, z;
+};
+
+double Dot(Double3 a, Double3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+// Exact nearest root in [tMin, tMax] for the float ray as given, or -1.
+double ReferenceT(Float3 origin, Float3 direction, double radius, double tMin,
+                  double tMax) {
+  Double3 o = {origin.x, origin.y, origin.z};
+  Double3 d = {direction.x, direction.y, direction.z};
+  double a = Dot(d, d);
+  double b = Dot(o, d);
+  // Closest approach, as the float routine does; in double this is exact
+  // enough for every range tested.
+  double s = b / a;
+  Double3 l = {o.x - s * d.x, o.y - s * d.y, o.z - s * d.z};
+  double disc = a * (radius * radius - Dot(l, l));
+  if (disc < 0.0) {
+    return -1.0;
+  }
+  double root = std::sqrt(disc);
+  double t0 = (-b - root) / a, t1 = (-b + root) / a;
+  if (t0 >= tMin && t0 <= tMax) {
+    return t0;
+  }
+  if (t1 >= tMin && t1 <= tMax) {
+    return t1;
+  }
+  return -1.0;
+}
+
+// The textbook form: b^2 - ac and (-b -+ sqrt) / a.
+float NaiveIntersect(Float3 o, Float3 d, float radius, float tMin,
+                     float tMax) {
+  float a = Dot(d, d);
+  float b = Dot(o, d);
+  float c = Dot(o, o) - radius * radius;
+  float disc = b * b - a * c;
+  if (disc < 0.0f) {
+    return RAY_SPHERE_MISS;
+  }
+  float root = std::sqrt(disc);
+  float t0 = (-b - root) / a, t1 = (-b + root) / a;
+  if (t0 >= tMin && t0 <= tMax) {
+    return t0;
+  }
+  if (t1 >= tMin && t1 <= tMax) {
+    return t1;
+  }
+  return RAY_SPHERE_MISS;
+}
+
+struct RaySample {
+  Float3 origin;
+  Float3 direction;
+  float impact; // closest approach to the center, in radii
+};
+
+// Rays from distance * radius away in a random direction, aimed past the
+// center at an impact parameter drawn from [lo, hi) radii. Directions are
+// unit length apart from rounding, as RayGen's are.
+std::vector<RaySample> MakeRays(float distance, float lo, float hi,
+                                size_t count, uint32_t seed) {
+  Rng rng{seed};
+  std::vector<RaySample> rays(count);
+  for (RaySample &ray : rays) {
+    float z = rng.Next() * 2.0f - 1.0f;
+    float phi = rng.Next() * 6.2831853f;
+    float rxy = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    Float3 toward = {rxy * std::cos(phi), rxy * std::sin(phi), z};
+    // A unit vector perpendicular to toward for the offset.
+    Float3 side = Normalize(Cross(
+        toward, std::fabs(toward.y) < 0.9f ? Float3{0, 1, 0}
+                                           : Float3{1, 0, 0}));
+    float angle = rng.Next() * 6.2831853f;
+    Float3 up = Cross(toward, side);
+    Float3 offsetDir = side * std::cos(angle) + up * std::sin(angle);
+    ray.impact = lo + (hi - lo) * rng.Next();
+    Float3 target = offsetDir * (ray.impact * kSphereRadius);
+    ray.origin = toward * (distance * kSphereRadius);
+    ray.direction = Normalize(target - ray.origin);
+    // The rounded direction decides the real impact parameter.
+    Double3 o = {ray.origin.x, ray.origin.y, ray.origin.z};
+    Double3 d = {ray.direction.x, ray.direction.y, ray.direction.z};
+    double s = Dot(o, d) / Dot(d, d);
+    Double3 l = {o.x - s * d.x, o.y - s * d.y, o.z - s * d.z};
+    ray.impact = (float)(std::sqrt(Dot(l, l)) / kSphereRadius);
+  }
+  return rays;
+}
+
+// Errors are in radii. A float origin distance * radius away is only
+// known to about FLT_EPSILON * distance radii, so the bounds below scale
+// with the range, and rays whose closest approach is that close to the
+// silhouette could go either way and are not judged.
+struct Accuracy {
+  size_t wrong = 0;          // hit/miss disagrees with the reference
+  double maxTError = 0;      // |t - tRef|, over rays both call hits
+  double maxSurfaceError = 0; // | |hit point| - radius |
+};
+
+double Resolution(float distance) {
+  return FLT_EPSILON * (distance + 1.0);
+}
+
+template <typename Intersect>
+Accuracy Measure(const std::vector<RaySample> &rays, float distance,
+                 Intersect intersect) {
+  Accuracy result;
+  const Float3 center = {0, 0, 0};
+  const double band = 4.0 * Resolution(distance);
+  for (const RaySample &ray : rays) {
+    if (std::fabs(ray.impact - 1.0) < band) {
+      continue;
+    }
+    float t = intersect(ray.origin, ray.direction, center);
+    double ref = ReferenceT(ray.origin, ray.direction, kSphereRadius, 0.0,
+                            1e30);
+    if ((t >= 0.0f) != (ref >= 0.0)) {
+      ++result.wrong;
+      continue;
+    }
+    if (ref >= 0.0) {
+      Double3 p = {ray.origin.x + (double)t * ray.direction.x,
+                   ray.origin.y + (double)t * ray.direction.y,
+                   ray.origin.z + (double)t * ray.direction.z};
+      result.maxTError = std::max(
+          result.maxTError, std::fabs((double)t - ref) / kSphereRadius);
+      result.maxSurfaceError =
+          std::max(result.maxSurfaceError,
+                   std::fabs(std::sqrt(Dot(p, p)) - kSphereRadius) /
+                       kSphereRadius);
+    }
+  }
+  return result;
+}
+
+float Robust(Float3 o, Float3 d, Float3 c) {
+  return IntersectRaySphere(o, d, c, SCENE_SPHERE_RADIUS, 0.0f, 1e30f);
+}
+
+float Naive(Float3 o, Float3 d, Float3) {
+  return NaiveIntersect(o, d, SCENE_SPHERE_RADIUS, 0.0f, 1e30f);
+}
+
+// Worst hit point distance from the surface, in units of Resolution().
+constexpr double kSurfaceBound = 8.0;
+
+const float kDistances[] = {2.0f, 20.0f, 200.0f, 2000.0f, 20000.0f,
+                            100000.0f};
+
+void CheckAccuracy(size_t rayCount) {
+  std::printf("%-11s %7s %6s %6s %9s %9s %9s %9s %9s %6s\n", "distance",
+              "rays", "wrong", "naive", "t err", "naive", "surface",
+              "naive", "normal", "bound");
+  for (float distance : kDistances) {
+    for (int grazing = 0; grazing < 2; ++grazing) {
+      // Everything across 1.2 radii, or only a thin shell around the edge
+      // just wider than the band Measure leaves unjudged.
+      float edge = 0.01f + 16.0f * (float)Resolution(distance);
+      std::vector<RaySample> rays =
+          grazing ? MakeRays(distance, 1.0f - edge, 1.0f + edge, rayCount, 7u)
+                  : MakeRays(distance, 0.0f, 1.2f, rayCount, 3u);
+      Accuracy robust = Measure(rays, distance, Robust);
+      Accuracy naive = Measure(rays, distance, Naive);
+
+      // Normal as SphereIntersection computes it, against the exact one.
+      // Its length is 1 plus the surface error, which Measure bounds.
+      double maxNormalError = 0.0;
+      for (const RaySample &ray : rays) {
+        float t = Robust(ray.origin, ray.direction, {0, 0, 0});
+        double ref = ReferenceT(ray.origin, ray.direction, kSphereRadius,
+                                0.0, 1e30);
+        if (t < 0.0f || ref < 0.0) {
+          continue;
+        }
+        Float3 n = (ray.origin + ray.direction * t) * (1.0f / kSphereRadius);
+        Double3 exact = {ray.origin.x + ref * ray.direction.x,
+                         ray.origin.y + ref * ray.direction.y,
+                         ray.origin.z + ref * ray.direction.z};
+        double len = std::sqrt(Dot(exact, exact));
+        Double3 nn = {n.x, n.y, n.z};
+        double cosAngle = Dot(nn, exact) / (len * std::sqrt(Dot(nn, nn)));
+        maxNormalError = std::max(
+            maxNormalError, std::acos(std::min(1.0, std::max(-1.0, cosAngle))));
+      }
+
+      char label[32];
+      std::snprintf(label, sizeof(label), "%g%s", distance,
+                    grazing ? " edge" : "");
+      // Worst surface error as a multiple of the origin's resolution.
+      double bound = robust.maxSurfaceError / Resolution(distance);
+      std::printf("%-11s %7zu %6zu %6zu %9.1e %9.1e %9.1e %9.1e %9.1e %6.1f\n",
+                  label, rays.size(), robust.wrong, naive.wrong,
+                  robust.maxTError, naive.maxTError, robust.maxSurfaceError,
+                  naive.maxSurfaceError, maxNormalError, bound);
+
+      Expect(robust.wrong == 0,
+             "every clear hit and clear miss is classified correctly");
+      Expect(bound <= kSurfaceBound,
+             "hit points lie on the sphere to the origin's precision");
+      if (distance <= 20.0f && !grazing) {
+        Expect(maxNormalError < 1e-4,
+               "normals are within 1e-4 rad at the scene's distances");
+      }
+    }
+  }
+  std::printf("\n");
+}
+
+void CheckRoots() {
+  const Float3 center = {0, 0, 0};
+  const float r = SCENE_SPHERE_RADIUS;
+  Float3 origin = {0, 0, -2};
+  Float3 direction = {0, 0, 1};
+  Expect(IntersectRaySphere(origin, direction, center, r, 0.0f, 100.0f) ==
+             1.5f,
+         "a head-on ray hits the front at 1.5");
+  Expect(IntersectRaySphere(origin, direction, center, r, 1.6f, 100.0f) ==
+             2.5f,
+         "tMin past the front hit selects the back hit");
+  Expect(IntersectRaySphere(origin, direction, center, r, 0.0f, 1.4f) ==
+             RAY_SPHERE_MISS,
+         "tMax short of the sphere misses");
+  Expect(IntersectRaySphere(origin, direction, center, r, 2.6f, 100.0f) ==
+             RAY_SPHERE_MISS,
+         "tMin past both hits misses");
+  Expect(IntersectRaySphere(origin, {0, 0, -1}, center, r, 0.0f, 100.0f) ==
+             RAY_SPHERE_MISS,
+         "a sphere behind the ray is missed");
+  Expect(IntersectRaySphere(center, {0, 1, 0}, center, r, 0.0f, 100.0f) ==
+             r,
+         "from the center the exit is one radius away");
+  Expect(IntersectRaySphere(origin, {0, 0, 4}, center, r, 0.0f, 100.0f) ==
+             0.375f,
+         "unnormalized directions scale t");
+  Expect(IntersectRaySphere({3, 4, -7}, direction, {3, 4, 5}, r, 0.0f,
+                            100.0f) == 11.5f,
+         "the center is honoured");
+  Expect(IntersectRaySphere({r, 0, -2}, direction, center, r, 0.0f,
+                            100.0f) == 2.0f,
+         "an exactly tangent ray touches at the tangent point");
+  Expect(IntersectRaySphere({r * 1.0001f, 0, -2}, direction, center, r, 0.0f,
+                            100.0f) == RAY_SPHERE_MISS,
+         "a ray just outside the silhouette misses");
+
+  // The shader only reports hits on the outside of the sphere, like the
+  // triangle path with back faces culled.
+  float t = IntersectRaySphere({0.1f, 0.2f, 0}, direction, center, r, 0.0f,
+                               100.0f);
+  Float3 normal = (Float3{0.1f, 0.2f, 0} + direction * t) * (1.0f / r);
+  Expect(t > 0.0f && Dot(normal, direction) > 0.0f,
+         "a ray from inside finds the exit, which faces away");
+}
+
+// The scene's tessellated sphere, as the triangle BLAS holds it, against
+// the exact surface.
+void CompareTessellation(size_t rayCount) {
+  std::vector<MeshVertex> vertices;
+  std::vector<uint32_t> indices;
+  GenerateSphere(vertices, indices, kSphereRadius, kSphereSlices,
+                 kSphereStacks);
+  OptimizeMesh(vertices, indices);
+  MeshBvh mesh;
+  mesh.Build(vertices, indices);
+
+  std::vector<RaySample> rays = MakeRays(20.0f, 0.0f, 1.05f, rayCount, 11u);
+  size_t disagree = 0, hits = 0;
+  double maxTError = 0.0, maxNormalError = 0.0, maxDisagreeDepth = 0.0;
+  for (const RaySample &sample : rays) {
+    Ray ray = {sample.origin, sample.direction, 0.0f, 1e30f};
+    bool meshHit = mesh.Intersect(ray);
+    float t = Robust(sample.origin, sample.direction, {0, 0, 0});
+    if (meshHit != (t >= 0.0f)) {
+      ++disagree;
+      maxDisagreeDepth =
+          std::max(maxDisagreeDepth, std::fabs(1.0 - sample.impact));
+      continue;
+    }
+    if (!meshHit) {
+      continue;
+    }
+    ++hits;
+    maxTError = std::max(maxTError, (double)std::fabs(ray.tMax - t));
+    // ClosestHit's normal: the normalized hit point on the triangle.
+    Float3 meshNormal = Normalize(sample.origin + sample.direction * ray.tMax);
+    Float3 exactNormal = Normalize(sample.origin + sample.direction * t);
+    maxNormalError =
+        std::max(maxNormalError,
+                 (double)std::acos(std::min(1.0f, Dot(meshNormal,
+                                                      exactNormal))));
+  }
+
+  std::printf("Tessellated %dx%d sphere vs exact, %zu rays from 20 radii:\n",
+              kSphereSlices, kSphereStacks, rays.size());
+  std::printf("  hit/miss disagreements  %zu (%.2f%%, all within %.1e "
+              "radii of the silhouette)\n",
+              disagree, 100.0 * disagree / rays.size(), maxDisagreeDepth);
+  std::printf("  max depth error         %.2e radii\n",
+              maxTError / kSphereRadius);
+  std::printf("  max normal error        %.2e rad\n\n", maxNormalError);
+  Expect(hits > rays.size() / 2, "most rays hit the tessellated sphere");
+
+  PackedIndices packed = PackIndices(indices);
+  size_t triangleBytes = vertices.size() * sizeof(Float3) + packed.ByteSize();
+  std::printf("BLAS input: %zu triangles, %zu B of positions and indices; "
+              "procedural: 1 AABB, %zu B\n\n",
+              indices.size() / 3, triangleBytes, 6 * sizeof(float));
+}
+
+void Throughput(size_t rayCount) {
+  std::vector<RaySample> rays = MakeRays(20.0f, 0.0f, 1.2f, rayCount, 5u);
+  auto time = [&](const char *name, auto intersect) {
+    volatile float sink = 0.0f;
+    float sum = 0.0f;
+    const int repeats = 8;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+      for (const RaySample &ray : rays) {
+        sum += intersect(ray.origin, ray.direction, Float3{0, 0, 0});
+      }
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    sink = sum;
+    (void)sink;
+    std::printf("%-22s %8.1f Mrays/s\n", name,
+                repeats * rays.size() / seconds * 1e-6);
+  };
+  time("IntersectRaySphere", Robust);
+  time("textbook quadratic", Naive);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t rayCount = 200000;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--rays") && i + 1 < argc) {
+      rayCount = (size_t)std::max(1000, std::atoi(argv[++i]));
+    } else {
+      std::printf("Usage: SphereIntersectBenchmark [--rays N]\n");
+      return 1;
+    }
+  }
+
+  CheckRoots();
+  CheckAccuracy(rayCount);
+  CompareTessellation(rayCount);
+  Throughput(rayCount);
+  std::printf("\nSphere intersection checks: %s\n",
+              g_failures ? "FAIL" : "ok");
+  return g_failures ? 1 : 0;
+}
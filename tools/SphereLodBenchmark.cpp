@@ -0,0 +1,389 @@
+// Exercises SphereLodSelector, which picks each ball's sphere level of
+// detail from its projected size, and measures what the level chain saves.
+//
+// Checks that every level's mesh, as the renderer builds it, stays within
+// the error SphereLodError claims for it, that the SSE2 Select agrees with
+// SelectOne for every instance, that the selected level never shows more
+// than errorPixels of silhouette error while the next coarser one would,
+// that levels only coarsen as a ball moves away and only refine as it
+// comes back, that a ball jittering around a switch distance keeps its
+// level, and that a camera inside a ball selects the finest level. Any
+// failure makes the tool exit with status 1. The tables report each
+// level's triangles, BLAS input size and ray cost, the levels a field of
+// balls spread over distance ends up on against tracing them all at the
+// finest level, and the cost of selection per instance.
+
+#include "MeshBvh.h"
+#include "MeshOptimizer.h"
+#include "SceneInstances.h"
+#include "SphereLod.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+struct Rng {
+  uint32_t state;
+  float Next() { // [0, 1)
+    state = state * 1664525u + 1013904223u;
+    return (float)(state >> 8) * (1.0f / 16777216.0f);
+  }
+};
+
+constexpr uint32_t kViewportHeight = 1080;
+
+// A ball of the given uniform scale at position, turned about y so the
+// selector has to measure the scale rather than read a diagonal.
+SceneInstance MakeBall(Float3 position, float scale, float angle) {
+  float c = std::cos(angle) * scale, s = std::sin(angle) * scale;
+  SceneInstance instance = {};
+  instance.transform = {{{c, 0.0f, s, position.x},
+                         {0.0f, scale, 0.0f, position.y},
+                         {-s, 0.0f, c, position.z}}};
+  instance.mesh = SceneMesh::Sphere;
+  return instance;
+}
+
+// Projected radius in pixels, in double: focal * r / sqrt(d^2 - r^2).
+double ProjectedPixels(const SceneInstance &instance, const SphereLodView &view,
+                       float scale) {
+  const Float3x4 &t = instance.transform;
+  double dx = (double)t.m[0][3] - view.cameraPosition.x;
+  double dy = (double)t.m[1][3] - view.cameraPosition.y;
+  double dz = (double)t.m[2][3] - view.cameraPosition.z;
+  double r = (double)kSphereRadius * scale;
+  double depth = dx * dx + dy * dy + dz * dz - r * r;
+  return depth > 0.0 ? view.focalPixels * r / std::sqrt(depth) : 1e30;
+}
+
+// Distance from the origin to the nearest point of triangle abc.
+double NearestDistance(Float3 a, Float3 b, Float3 c) {
+  Float3 n = Normalize(Cross(b - a, c - a));
+  float planeDistance = Dot(n, a);
+  Float3 foot = n * planeDistance;
+  Float3 v0 = b - a, v1 = c - a, v2 = foot - a;
+  float d00 = Dot(v0, v0), d01 = Dot(v0, v1), d11 = Dot(v1, v1);
+  float d20 = Dot(v2, v0), d21 = Dot(v2, v1);
+  float denominator = d00 * d11 - d01 * d01;
+  float v = (d11 * d20 - d01 * d21) / denominator;
+  float w = (d00 * d21 - d01 * d20) / denominator;
+  if (v >= 0.0f && w >= 0.0f && v + w <= 1.0f) {
+    return std::fabs(planeDistance);
+  }
+  double nearest = 1e30;
+  const Float3 edges[3][2] = {{a, b}, {b, c}, {c, a}};
+  for (const auto &edge : edges) {
+    Float3 e = edge[1] - edge[0];
+    float s = std::clamp(-Dot(edge[0], e) / Dot(e, e), 0.0f, 1.0f);
+    nearest = std::min(nearest, (double)Length(edge[0] + e * s));
+  }
+  return nearest;
+}
+
+struct LevelMesh {
+  std::vector<MeshVertex> vertices;
+  std::vector<uint32_t> indices;
+  size_t Triangles() const { return indices.size() / 3; }
+  // Positions and indices as the BLAS build reads them.
+  size_t BlasInputBytes() const {
+    return vertices.size() * sizeof(Float3) + PackIndices(indices).ByteSize();
+  }
+};
+
+void CheckLevels(std::vector<LevelMesh> &meshes, size_t rayCount) {
+  std::printf("level  slices x stacks  triangles  BLAS input B  max error "
+              "(bound)        Mrays/s\n");
+  // Rays from 20 radii aimed across the silhouette, as at a distant ball.
+  Rng rng = {17u};
+  std::vector<Ray> rays(rayCount);
+  for (Ray &ray : rays) {
+    float u = rng.Next() * 2.0f - 1.0f, v = rng.Next() * 2.0f - 1.0f;
+    Float3 origin = {0.0f, 0.0f, -20.0f * kSphereRadius};
+    Float3 target = {u * 1.2f * kSphereRadius, v * 1.2f * kSphereRadius, 0};
+    ray = {origin, Normalize(target - origin), 0.0f, 1e30f};
+  }
+
+  meshes.resize(kSphereLodCount);
+  for (uint32_t level = 0; level < kSphereLodCount; ++level) {
+    const SphereLodLevel &lod = kSphereLodLevels[level];
+    LevelMesh &mesh = meshes[level];
+    GenerateSphere(mesh.vertices, mesh.indices, kSphereRadius, lod.slices,
+                   lod.stacks);
+    OptimizeMesh(mesh.vertices, mesh.indices);
+
+    double maxError = 0.0;
+    for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+      double distance = NearestDistance(
+          mesh.vertices[mesh.indices[i]].position,
+          mesh.vertices[mesh.indices[i + 1]].position,
+          mesh.vertices[mesh.indices[i + 2]].position);
+      maxError = std::max(maxError, 1.0 - distance / kSphereRadius);
+    }
+    float bound = SphereLodError(lod);
+    Expect(maxError <= bound * (1.0 + 1e-4),
+           "SphereLodError bounds the level's facet error");
+
+    MeshBvh bvh;
+    bvh.Build(mesh.vertices, mesh.indices);
+    size_t hits = 0;
+    const int repeats = 4;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+      for (Ray ray : rays) {
+        hits += bvh.Intersect(ray) ? 1 : 0;
+      }
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    Expect(hits > 0, "rays hit the level's mesh");
+
+    std::printf("%5u  %6d x %-6d  %9zu  %12zu  %.5f (%.5f)  %9.1f\n", level,
+                lod.slices, lod.stacks, mesh.Triangles(),
+                mesh.BlasInputBytes(), maxError, bound,
+                repeats * rays.size() / seconds * 1e-6);
+  }
+  std::printf("\n");
+}
+
+std::vector<SceneInstance> MakeField(size_t count, float maxDistance,
+                                     std::vector<float> &scales,
+                                     uint32_t seed) {
+  Rng rng = {seed};
+  std::vector<SceneInstance> instances(count);
+  scales.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    // Uniform in distance, so every level sees plenty of balls.
+    float distance = 1.0f + rng.Next() * maxDistance;
+    float z = rng.Next() * 2.0f - 1.0f, phi = rng.Next() * 6.2831853f;
+    float ring = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    Float3 direction = {ring * std::cos(phi), z, ring * std::sin(phi)};
+    scales[i] = 0.5f + rng.Next() * 1.5f;
+    instances[i] = MakeBall(direction * distance, scales[i], rng.Next() * 6.3f);
+  }
+  return instances;
+}
+
+void CheckSelection(const SphereLodSelector &lod) {
+  SphereLodView view = MakeSphereLodView({0.0f, 0.0f, 0.0f}, kCameraFovY,
+                                         kViewportHeight);
+  std::vector<float> scales;
+  // Not a multiple of four, so Select's scalar tail runs too.
+  std::vector<SceneInstance> instances = MakeField(10003, 400.0f, scales, 3u);
+  size_t count = instances.size();
+
+  // From every starting level, SIMD and scalar agree.
+  bool agree = true;
+  for (uint8_t start = 0; start < kSphereLodCount; ++start) {
+    std::vector<uint8_t> levels(count, start);
+    lod.Select(instances.data(), count, view, levels.data());
+    for (size_t i = 0; i < count; ++i) {
+      agree &= levels[i] == lod.SelectOne(instances[i], view, start);
+    }
+  }
+  Expect(agree, "Select equals SelectOne for every instance");
+
+  // Starting from the coarsest level, each ball lands on the coarsest level
+  // whose error stays within errorPixels.
+  const double tolerance = 1e-4;
+  float errorPixels = lod.Settings().errorPixels;
+  std::vector<uint8_t> levels(count, kSphereLodCount - 1);
+  lod.Select(instances.data(), count, view, levels.data());
+  bool withinError = true, coarsest = true;
+  for (size_t i = 0; i < count; ++i) {
+    double pixels = ProjectedPixels(instances[i], view, scales[i]);
+    uint32_t level = levels[i];
+    if (level > 0) {
+      withinError &= pixels * SphereLodError(kSphereLodLevels[level]) <=
+                     errorPixels * (1.0 + tolerance);
+    }
+    if (level + 1 < kSphereLodCount) {
+      coarsest &= pixels * SphereLodError(kSphereLodLevels[level + 1]) >
+                  errorPixels * (1.0 - tolerance);
+    }
+  }
+  Expect(withinError, "selected levels show at most errorPixels of error");
+  Expect(coarsest, "the next coarser level would show more");
+
+  // The camera inside a ball, or at its center, keeps the finest level.
+  uint8_t inside[2] = {kSphereLodCount - 1, kSphereLodCount - 1};
+  SceneInstance around[2] = {MakeBall({0.1f, 0.0f, 0.0f}, 1.0f, 0.0f),
+                             MakeBall({0.0f, 0.0f, 0.0f}, 2.0f, 1.0f)};
+  lod.Select(around, 2, view, inside);
+  Expect(inside[0] == 0 && inside[1] == 0,
+         "a camera inside a ball selects the finest level");
+}
+
+// A ball flying out to 1000 units and back, then jittering around each
+// switch distance.
+void CheckHysteresis(const SphereLodSelector &lod) {
+  SphereLodView view = MakeSphereLodView({0.0f, 0.0f, 0.0f}, kCameraFovY,
+                                         kViewportHeight);
+  uint8_t level = 0;
+  bool outward = true, inward = true;
+  float switchOut[kSphereLodCount] = {}, switchIn[kSphereLodCount] = {};
+  for (float d = 1.0f; d < 1000.0f; d *= 1.001f) {
+    SceneInstance ball = MakeBall({0.0f, 0.0f, d}, 1.0f, 0.0f);
+    uint8_t next = lod.SelectOne(ball, view, level);
+    outward &= next >= level;
+    if (next != level) {
+      switchOut[next] = d;
+    }
+    level = next;
+  }
+  Expect(level == kSphereLodCount - 1, "far balls reach the coarsest level");
+  for (float d = 1000.0f; d > 1.0f; d /= 1.001f) {
+    SceneInstance ball = MakeBall({0.0f, 0.0f, d}, 1.0f, 0.0f);
+    uint8_t next = lod.SelectOne(ball, view, level);
+    inward &= next <= level;
+    if (next != level) {
+      switchIn[level] = d;
+    }
+    level = next;
+  }
+  Expect(level == 0, "near balls return to the finest level");
+  Expect(outward && inward, "levels follow distance monotonically");
+
+  std::printf("level  switch pixels  coarsens at  refines at\n");
+  bool band = true, steady = true;
+  float hysteresis = lod.Settings().hysteresis;
+  for (uint32_t l = 1; l < kSphereLodCount; ++l) {
+    std::printf("%5u  %13.2f  %11.2f  %10.2f\n", l, lod.SwitchPixels(l),
+                switchOut[l], switchIn[l]);
+    // Coarsening waits until the projected radius is the band below the
+    // switch, that is the distance is 1 / (1 - hysteresis) further.
+    float ratio = switchOut[l] / switchIn[l];
+    band &= std::fabs(ratio * (1.0f - hysteresis) - 1.0f) < 0.01f;
+
+    // Jitter a few percent around both switch distances, well inside the
+    // band, from either side.
+    for (float center : {switchOut[l], switchIn[l]}) {
+      for (uint8_t start : {(uint8_t)(l - 1), (uint8_t)l}) {
+        uint8_t current = start;
+        int flips = 0;
+        for (int frame = 0; frame < 64; ++frame) {
+          float d = center * (1.0f + 0.03f * std::sin(frame * 0.7f));
+          SceneInstance ball = MakeBall({0.0f, d, 0.0f}, 1.0f, 0.0f);
+          uint8_t next = lod.SelectOne(ball, view, current);
+          flips += frame > 0 && next != current;
+          current = next;
+        }
+        steady &= flips == 0;
+      }
+    }
+  }
+  std::printf("\n");
+  Expect(band, "levels coarsen and refine the hysteresis band apart");
+  Expect(steady, "a ball jittering around a switch distance keeps its level");
+}
+
+void ReportField(const SphereLodSelector &lod,
+                 const std::vector<LevelMesh> &meshes) {
+  SphereLodView view = MakeSphereLodView({0.0f, 0.0f, 0.0f}, kCameraFovY,
+                                         kViewportHeight);
+  std::printf("%zu balls from 1 unit to max distance, %u px viewport\n",
+              (size_t)10000, kViewportHeight);
+  std::printf("max distance    level 0    level 1    level 2    level 3  "
+              "triangles  vs finest\n");
+  for (float maxDistance : {25.0f, 100.0f, 400.0f}) {
+    std::vector<float> scales;
+    std::vector<SceneInstance> instances =
+        MakeField(10000, maxDistance, scales, 9u);
+    std::vector<uint8_t> levels(instances.size(), 0);
+    lod.Select(instances.data(), instances.size(), view, levels.data());
+    size_t perLevel[kSphereLodCount] = {};
+    size_t triangles = 0;
+    for (uint8_t level : levels) {
+      ++perLevel[level];
+      triangles += meshes[level].Triangles();
+    }
+    std::printf("%12.0f %10zu %10zu %10zu %10zu %10zu %9.2fx\n", maxDistance,
+                perLevel[0], perLevel[1], perLevel[2], perLevel[3], triangles,
+                (double)(instances.size() * meshes[0].Triangles()) /
+                    triangles);
+  }
+  size_t chainBytes = 0;
+  for (const LevelMesh &mesh : meshes) {
+    chainBytes += mesh.BlasInputBytes();
+  }
+  std::printf("BLAS input for the whole chain: %zu B (finest alone %zu B)\n\n",
+              chainBytes, meshes[0].BlasInputBytes());
+}
+
+void Throughput(const SphereLodSelector &lod) {
+  SphereLodView view = MakeSphereLodView({0.0f, 0.0f, 0.0f}, kCameraFovY,
+                                         kViewportHeight);
+  std::printf("instances  Select ns/inst  SelectOne ns/inst  speedup\n");
+  for (size_t count : {(size_t)1000, (size_t)100000, (size_t)1000000}) {
+    std::vector<float> scales;
+    std::vector<SceneInstance> instances =
+        MakeField(count, 400.0f, scales, 21u);
+    std::vector<uint8_t> levels(count, 0);
+    const int repeats = (int)std::max<size_t>(4, 4000000 / count);
+    auto time = [&](auto select) {
+      auto start = std::chrono::steady_clock::now();
+      for (int r = 0; r < repeats; ++r) {
+        select();
+      }
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           start)
+                 .count() *
+             1e9 / ((double)repeats * count);
+    };
+    double simd = time(
+        [&]() { lod.Select(instances.data(), count, view, levels.data()); });
+    double scalar = time([&]() {
+      for (size_t i = 0; i < count; ++i) {
+        levels[i] = lod.SelectOne(instances[i], view, levels[i]);
+      }
+    });
+    std::printf("%9zu  %14.2f  %17.2f  %6.2fx\n", count, simd, scalar,
+                scalar / simd);
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t rayCount = 100000;
+  SphereLodSettings settings;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--rays") && i + 1 < argc) {
+      rayCount = (size_t)std::max(1000, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--error-pixels") && i + 1 < argc) {
+      settings.errorPixels = std::max(0.01f, (float)std::atof(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--hysteresis") && i + 1 < argc) {
+      settings.hysteresis =
+          std::clamp((float)std::atof(argv[++i]), 0.05f, 0.5f);
+    } else {
+      std::printf("Usage: SphereLodBenchmark [--rays N] [--error-pixels P] "
+                  "[--hysteresis H]\n");
+      return 1;
+    }
+  }
+
+  SphereLodSelector lod(settings);
+  std::vector<LevelMesh> meshes;
+  CheckLevels(meshes, rayCount);
+  CheckSelection(lod);
+  CheckHysteresis(lod);
+  ReportField(lod, meshes);
+  Throughput(lod);
+  std::printf("\nSphere LOD checks: %s\n", g_failures ? "FAIL" : "ok");
+  return g_failures ? 1 : 0;
+}
@@ -0,0 +1,226 @@
+// Runs the renderer's TLAS rebuild-vs-refit policy without a device.
+//
+// The scene is the renderer's ball field scaled to larger instance counts,
+// driven through TlasUpdateTracker::Plan() once per frame under several
+// motion patterns: every ball moving (the renderer's animation), a static
+// scene, a tenth of the balls moving, and a scene that gains a ball every
+// 30 frames. For each pattern the table shows how many frames rebuilt,
+// refit or skipped the build, the cost of planning, the estimated SAH drift
+// and how much instance desc data per frame the renderer streams into its
+// upload ring. The policy's guarantees (count changes rebuild, static
+// scenes never build, refits stay under the SAH ratio) are checked and a
+// violation makes the tool exit with status 1.
+
+#include "SceneInstances.h"
+#include "TlasUpdatePolicy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr float kFrameSeconds = 0.016f;
+constexpr size_t kInstanceDescSize = 64; // D3D12_RAYTRACING_INSTANCE_DESC
+
+enum class Motion { All, Static, Tenth, Spawn };
+
+struct Pattern {
+  const char *name;
+  Motion motion;
+};
+
+float SceneRadius(size_t ballCount) {
+  return 12.0f * std::sqrt(std::max(1.0f, (float)ballCount / 50.0f));
+}
+
+// Same layout as InstanceBvhBenchmark: constant ball density, alternating
+// orbit directions. Balls that do not move keep their time-zero transform.
+void AnimateScene(size_t ballCount, float time, Motion motion,
+                  std::vector<SceneInstance> &instances) {
+  float radius = SceneRadius(ballCount);
+  instances.resize(ballCount + 2);
+
+  SceneInstance &floor = instances[0];
+  floor = {};
+  floor.transform.m[0][0] = radius / (kPlaneSize * 0.5f);
+  floor.transform.m[1][1] = 1.0f;
+  floor.transform.m[2][2] = radius / (kPlaneSize * 0.5f);
+  floor.instanceID = 0;
+  floor.mesh = SceneMesh::Plane;
+
+  SceneInstance &mirror = instances[1];
+  mirror = {};
+  mirror.transform.m[0][0] = mirror.transform.m[1][1] =
+      mirror.transform.m[2][2] = 1.5f;
+  mirror.transform.m[1][3] = 1.5f;
+  mirror.instanceID = 1;
+  mirror.mesh = SceneMesh::Sphere;
+
+  for (size_t i = 0; i < ballCount; ++i) {
+    bool moving = motion == Motion::All || motion == Motion::Spawn ||
+                  (motion == Motion::Tenth && i % 10 == 0);
+    float t = moving ? time : 0.0f;
+    float orbit =
+        std::max(3.0f, radius * std::sqrt(((float)i + 0.5f) / ballCount));
+    float speed = (i & 1) ? 2.0f : -2.0f; // metres per second
+    float angle = (float)i * 2.39996f + t * speed / orbit;
+    float bounce = std::fabs(std::sin(t * 2.0f + (float)i)) * 2.0f;
+    float scale = 0.3f + (float)(i % 3) * 0.1f;
+
+    SceneInstance &inst = instances[i + 2];
+    inst = {};
+    inst.transform.m[0][0] = scale;
+    inst.transform.m[0][3] = std::cos(angle) * orbit;
+    inst.transform.m[1][1] = scale;
+    inst.transform.m[1][3] = scale + bounce;
+    inst.transform.m[2][2] = scale;
+    inst.transform.m[2][3] = std::sin(angle) * orbit;
+    inst.instanceID = (uint32_t)(i + 2);
+    inst.mesh = SceneMesh::Sphere;
+  }
+}
+
+void WorldBounds(const std::vector<SceneInstance> &instances,
+                 std::vector<Aabb> &bounds) {
+  const Aabb sphere = {{-kSphereRadius, -kSphereRadius, -kSphereRadius},
+                       {kSphereRadius, kSphereRadius, kSphereRadius}};
+  const Aabb plane = {{-kPlaneSize * 0.5f, 0.0f, -kPlaneSize * 0.5f},
+                      {kPlaneSize * 0.5f, 0.0f, kPlaneSize * 0.5f}};
+  bounds.resize(instances.size());
+  for (size_t i = 0; i < instances.size(); ++i) {
+    bounds[i] = TransformAabb(instances[i].transform,
+                              instances[i].mesh == SceneMesh::Plane ? plane
+                                                                    : sphere);
+  }
+}
+
+struct Result {
+  uint32_t rebuilds = 0;
+  uint32_t refits = 0;
+  uint32_t skips = 0;
+  double planUs = 0.0;        // per frame
+  double dirty = 0.0;         // per frame
+  double uploadKb = 0.0;      // per frame, instance descs copied to the ring
+  float maxRefitRatio = 0.0f;
+  bool ok = true;
+};
+
+Result Run(size_t balls, int frames, Motion motion,
+           const TlasUpdateSettings &settings) {
+  TlasUpdateTracker tracker(settings);
+  std::vector<SceneInstance> instances;
+  std::vector<Aabb> bounds;
+  uint64_t uploadBytes = 0, dirty = 0;
+  double planSeconds = 0.0;
+  Result r;
+
+  for (int f = 0; f < frames; ++f) {
+    size_t count = balls;
+    if (motion == Motion::Spawn) {
+      count += f / 30;
+    }
+    AnimateScene(count, f * kFrameSeconds, motion, instances);
+    WorldBounds(instances, bounds);
+
+    bool countChanged = f == 0 || (motion == Motion::Spawn && f % 30 == 0);
+
+    auto start = std::chrono::steady_clock::now();
+    TlasBuildAction action = tracker.Plan(instances, bounds.data());
+    planSeconds += std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    dirty += tracker.Stats().dirtyCount;
+
+    switch (action) {
+    case TlasBuildAction::None:
+      ++r.skips;
+      break;
+    case TlasBuildAction::Refit:
+      ++r.refits;
+      r.maxRefitRatio = std::max(r.maxRefitRatio, tracker.Stats().sahRatio);
+      break;
+    case TlasBuildAction::Rebuild:
+      ++r.rebuilds;
+      break;
+    }
+
+    if (countChanged && action != TlasBuildAction::Rebuild) {
+      std::fprintf(stderr, "frame %d: instance count changed but the plan "
+                   "was %s\n", f, TlasBuildActionName(action));
+      r.ok = false;
+    }
+    if (motion == Motion::Static && f > 0 && action != TlasBuildAction::None) {
+      std::fprintf(stderr, "frame %d: static scene planned %s\n", f,
+                   TlasBuildActionName(action));
+      r.ok = false;
+    }
+
+    if (action != TlasBuildAction::None) {
+      uploadBytes += instances.size() * kInstanceDescSize;
+    }
+  }
+
+  if (r.maxRefitRatio > settings.rebuildSahRatio) {
+    std::fprintf(stderr, "refit SAH ratio %.3f exceeds %.3f\n",
+                 r.maxRefitRatio, settings.rebuildSahRatio);
+    r.ok = false;
+  }
+  r.planUs = planSeconds * 1e6 / frames;
+  r.dirty = (double)dirty / frames;
+  r.uploadKb = uploadBytes / 1024.0 / frames;
+  return r;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<size_t> counts = {kSceneBallCount, 1000, 10000, 100000};
+  int frames = 240;
+  TlasUpdateSettings settings;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--balls") && i + 1 < argc) {
+      counts = {(size_t)std::max(1, std::atoi(argv[++i]))};
+    } else if (!std::strcmp(argv[i], "--frames") && i + 1 < argc) {
+      frames = std::max(2, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--ratio") && i + 1 < argc) {
+      settings.rebuildSahRatio = (float)std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--max-refits") && i + 1 < argc) {
+      settings.maxRefits = (uint32_t)std::max(0, std::atoi(argv[++i]));
+    } else {
+      std::printf("Usage: TlasUpdateBenchmark [--balls N] [--frames N] "
+                  "[--ratio R] [--max-refits N]\n");
+      return 1;
+    }
+  }
+
+  const Pattern patterns[] = {
+      {"all moving", Motion::All},
+      {"static", Motion::Static},
+      {"10% moving", Motion::Tenth},
+      {"+1 ball / 30 frames", Motion::Spawn},
+  };
+
+  std::printf("%d frames, rebuild when SAH > %.2fx or after %u refits\n\n",
+              frames, settings.rebuildSahRatio, settings.maxRefits);
+  std::printf("%9s %-20s %8s %6s %6s %8s %9s %9s %10s %6s\n", "instances",
+              "motion", "rebuilds", "refits", "skips", "plan us", "dirty",
+              "max SAH", "upload KB", "check");
+
+  bool ok = true;
+  for (size_t balls : counts) {
+    for (const Pattern &p : patterns) {
+      Result r = Run(balls, frames, p.motion, settings);
+      std::printf("%9zu %-20s %8u %6u %6u %8.1f %9.1f %8.2fx %10.1f %6s\n",
+                  balls + 2, p.name, r.rebuilds, r.refits, r.skips, r.planUs,
+                  r.dirty, r.maxRefitRatio, r.uploadKb, r.ok ? "ok" : "FAIL");
+      ok = ok && r.ok;
+    }
+  }
+  return ok ? 0 : 1;
+}
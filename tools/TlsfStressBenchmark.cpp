@@ -0,0 +1,370 @@
+// Exercises TlsfAllocator, the sub-allocator that places the renderer's
+// resources in large ID3D12Heap blocks.
+//
+// A scripted sequence checks alignment padding and coalescing against
+// hand-computed offsets. A randomized run then churns a heap with the
+// renderer's allocation shapes (acceleration structures at 256 bytes,
+// buffers and textures at 64 KB) and checks after every operation that
+// allocations are aligned, in bounds and disjoint, that the byte accounting
+// matches, and that the drained heap is a single free block again. Any
+// failure makes the tool exit with status 1. The throughput table compares
+// allocate/free pairs against a first-fit free list as the number of live
+// allocations grows.
+
+#include "TlsfAllocator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+struct Rng {
+  uint32_t state;
+  uint32_t Next() {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+  }
+};
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+constexpr uint64_t KB = 1024;
+constexpr uint64_t MB = 1024 * 1024;
+
+void CheckScripted() {
+  TlsfAllocator heap(1 * MB, 256);
+
+  TlsfAllocator::Allocation a = heap.Allocate(1000, 256);
+  Expect(a.Valid() && a.offset == 0 && a.size == 1024,
+         "small allocation rounded to the granularity at offset 0");
+
+  // The 64 KB rule leaves the space between a and the aligned offset free.
+  TlsfAllocator::Allocation b = heap.Allocate(64 * KB, 64 * KB);
+  Expect(b.Valid() && b.offset == 64 * KB, "64 KB aligned allocation");
+  Expect(heap.Stats().freeBlockCount == 2, "alignment padding stays free");
+
+  TlsfAllocator::Allocation c = heap.Allocate(60 * KB, 256);
+  Expect(c.Valid() && c.offset < b.offset,
+         "alignment padding is reused by a later allocation");
+
+  Expect(!heap.Allocate(2 * MB, 256).Valid(), "oversized allocation fails");
+
+  heap.Free(a.handle);
+  heap.Free(c.handle);
+  TlsfStats stats = heap.Stats();
+  // a and c merge with the rest of the padding; the tail is untouched.
+  Expect(stats.freeBlockCount == 2 && stats.largestFreeBlock == 896 * KB &&
+             stats.freeBytes == 960 * KB,
+         "freed neighbours merge");
+  heap.Free(b.handle);
+  stats = heap.Stats();
+  Expect(stats.freeBlockCount == 1 && stats.largestFreeBlock == 1 * MB &&
+             stats.fragmentation == 0.0f && heap.Empty(),
+         "empty heap is one free block");
+
+  TlsfAllocator::Allocation all = heap.Allocate(1 * MB, 64 * KB);
+  Expect(all.Valid() && all.offset == 0, "empty heap fits its capacity");
+  Expect(!heap.Allocate(256, 256).Valid(), "full heap refuses allocations");
+  heap.Free(all.handle);
+
+  bool threw = false;
+  try {
+    heap.Free(all.handle);
+  } catch (const std::exception &) {
+    threw = true;
+  }
+  Expect(threw, "double free is rejected");
+}
+
+struct Shape {
+  uint64_t minSize;
+  uint64_t maxSize;
+  uint64_t alignment;
+};
+
+// Roughly the renderer's mix: many small acceleration structures, buffers,
+// and the occasional large texture.
+const Shape kShapes[] = {
+    {256, 512 * KB, 256},        // BLAS/TLAS results and scratch
+    {64 * KB, 4 * MB, 64 * KB},  // vertex/index/shader table buffers
+    {1 * MB, 16 * MB, 64 * KB},  // render targets
+};
+
+uint64_t RandomSize(Rng &rng, const Shape &shape) {
+  // Log-uniform, so small sizes are as common as large ones per octave.
+  double t = (rng.Next() & 0xffff) / 65535.0;
+  double size = shape.minSize * std::pow((double)shape.maxSize / shape.minSize,
+                                         t);
+  return (uint64_t)size;
+}
+
+struct Live {
+  uint64_t offset;
+  uint64_t size;
+  uint32_t handle;
+};
+
+struct StressResult {
+  float meanFragmentation = 0.0f;
+  float peakFragmentation = 0.0f;
+  uint64_t failedAllocations = 0;
+  uint64_t fragmentationFailures = 0; // enough bytes free, not in one piece
+};
+
+StressResult CheckRandomized(uint64_t capacity, int ops, double targetFill) {
+  TlsfAllocator heap(capacity, 256);
+  Rng rng{2024u};
+  std::vector<Live> live;
+  std::map<uint64_t, uint64_t> ranges; // offset -> end of every live block
+  uint64_t liveBytes = 0;
+  StressResult result;
+  double fragmentationSum = 0.0;
+  int samples = 0;
+
+  for (int op = 0; op < ops; ++op) {
+    // Below the target fill allocations dominate, above it frees do.
+    uint32_t allocatePercent =
+        (double)liveBytes / capacity < targetFill ? 70 : 30;
+    bool allocate = live.empty() || rng.Next() % 100 < allocatePercent;
+    if (allocate) {
+      uint32_t pick = rng.Next() % 100;
+      const Shape &shape = kShapes[pick < 70 ? 0 : pick < 95 ? 1 : 2];
+      uint64_t size = RandomSize(rng, shape);
+      TlsfAllocator::Allocation a = heap.Allocate(size, shape.alignment);
+      if (!a.Valid()) {
+        ++result.failedAllocations;
+        result.fragmentationFailures +=
+            capacity - heap.UsedBytes() >= size + shape.alignment;
+        continue;
+      }
+      bool fits = a.offset % shape.alignment == 0 && a.size >= size &&
+                  a.offset + a.size <= capacity;
+      auto next = ranges.lower_bound(a.offset);
+      bool overlaps = (next != ranges.end() && next->first < a.offset + a.size);
+      if (next != ranges.begin()) {
+        overlaps |= std::prev(next)->second > a.offset;
+      }
+      Expect(fits, "randomized allocation is aligned and in bounds");
+      Expect(!overlaps, "randomized allocation overlaps a live one");
+      if (!fits || overlaps) {
+        return result;
+      }
+      ranges.emplace(a.offset, a.offset + a.size);
+      live.push_back({a.offset, a.size, a.handle});
+      liveBytes += a.size;
+    } else {
+      size_t i = rng.Next() % live.size();
+      heap.Free(live[i].handle);
+      ranges.erase(live[i].offset);
+      liveBytes -= live[i].size;
+      live[i] = live.back();
+      live.pop_back();
+    }
+
+    if (heap.UsedBytes() != liveBytes) {
+      Expect(false, "used bytes match the live allocations");
+      return result;
+    }
+    if ((op & 1023) == 0) {
+      float fragmentation = heap.Stats().fragmentation;
+      result.peakFragmentation =
+          std::max(result.peakFragmentation, fragmentation);
+      fragmentationSum += fragmentation;
+      ++samples;
+    }
+  }
+
+  while (!live.empty()) {
+    heap.Free(live.back().handle);
+    live.pop_back();
+  }
+  TlsfStats stats = heap.Stats();
+  Expect(stats.freeBlockCount == 1 && stats.largestFreeBlock == capacity &&
+             stats.usedBytes == 0,
+         "drained heap coalesces into one block");
+  result.meanFragmentation = (float)(fragmentationSum / std::max(samples, 1));
+  return result;
+}
+
+// Reference point: address-ordered free list searched first fit, merging
+// neighbours on free. Allocation cost grows with the number of free ranges.
+class FirstFitAllocator {
+public:
+  explicit FirstFitAllocator(uint64_t capacity) { m_free[0] = capacity; }
+
+  uint64_t Allocate(uint64_t size, uint64_t alignment) {
+    size = (size + 255) & ~255ull;
+    for (auto it = m_free.begin(); it != m_free.end(); ++it) {
+      uint64_t start = it->first, end = it->first + it->second;
+      uint64_t aligned = (start + alignment - 1) & ~(alignment - 1);
+      if (aligned + size > end) {
+        continue;
+      }
+      m_free.erase(it);
+      if (aligned > start) {
+        m_free[start] = aligned - start;
+      }
+      if (aligned + size < end) {
+        m_free[aligned + size] = end - aligned - size;
+      }
+      m_sizes[aligned] = size;
+      return aligned;
+    }
+    return UINT64_MAX;
+  }
+
+  void Free(uint64_t offset) {
+    auto used = m_sizes.find(offset);
+    uint64_t size = used->second;
+    m_sizes.erase(used);
+    auto next = m_free.lower_bound(offset);
+    if (next != m_free.end() && next->first == offset + size) {
+      size += next->second;
+      next = m_free.erase(next);
+    }
+    if (next != m_free.begin()) {
+      auto prev = std::prev(next);
+      if (prev->first + prev->second == offset) {
+        prev->second += size;
+        return;
+      }
+    }
+    m_free[offset] = size;
+  }
+
+private:
+  std::map<uint64_t, uint64_t> m_free;  // offset -> size
+  std::map<uint64_t, uint64_t> m_sizes; // live offset -> size
+};
+
+struct Op {
+  uint64_t size;
+  uint64_t alignment;
+  uint32_t victim; // live slot freed before the allocation
+};
+
+// Churns `live` allocations: each step frees a random one and allocates a
+// replacement, so the free space stays split into about `live` pieces.
+template <typename Alloc, typename Free>
+double MeasurePairs(size_t live, const std::vector<Op> &ops,
+                    const Alloc &allocate, const Free &free) {
+  std::vector<uint64_t> slots(live);
+  for (size_t i = 0; i < live; ++i) {
+    slots[i] = allocate(ops[i].size, ops[i].alignment);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = live; i < ops.size(); ++i) {
+    uint64_t &slot = slots[ops[i].victim % live];
+    free(slot);
+    slot = allocate(ops[i].size, ops[i].alignment);
+  }
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  for (uint64_t slot : slots) {
+    free(slot);
+  }
+  return seconds * 1e9 / (ops.size() - live);
+}
+
+void Measure(size_t live, int pairs) {
+  // Small allocations only, so every size fits and both allocators do the
+  // same work; capacity leaves room for the alignment padding.
+  uint64_t capacity = live * 160 * KB;
+  Rng rng{31u};
+  std::vector<Op> ops(live + pairs);
+  for (Op &op : ops) {
+    bool buffer = rng.Next() % 4 == 0;
+    op.alignment = buffer ? 64 * KB : 256;
+    op.size = buffer ? 64 * KB : 256 + rng.Next() % (64 * KB);
+    op.victim = rng.Next();
+  }
+
+  TlsfAllocator tlsf(capacity, 256);
+  double tlsfNs = MeasurePairs(
+      live, ops,
+      [&](uint64_t size, uint64_t alignment) {
+        TlsfAllocator::Allocation a = tlsf.Allocate(size, alignment);
+        Expect(a.Valid(), "throughput run ran out of heap space");
+        return (uint64_t)a.handle;
+      },
+      [&](uint64_t handle) { tlsf.Free((uint32_t)handle); });
+
+  FirstFitAllocator firstFit(capacity);
+  double firstFitNs = MeasurePairs(
+      live, ops,
+      [&](uint64_t size, uint64_t alignment) {
+        uint64_t offset = firstFit.Allocate(size, alignment);
+        Expect(offset != UINT64_MAX, "first-fit run ran out of heap space");
+        return offset;
+      },
+      [&](uint64_t offset) { firstFit.Free(offset); });
+
+  std::printf("%8zu %10.0f %10.1f %12.1f %8.1fx\n", live,
+              capacity / (double)MB, tlsfNs, firstFitNs, firstFitNs / tlsfNs);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  uint64_t capacity = 256 * MB;
+  int ops = 1000000;
+  double fill = 0.8;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--heap") && i + 1 < argc) {
+      capacity = (uint64_t)std::max(16, std::atoi(argv[++i])) * MB;
+    } else if (!std::strcmp(argv[i], "--ops") && i + 1 < argc) {
+      ops = std::max(1000, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--fill") && i + 1 < argc) {
+      fill = std::min(0.99, std::max(0.1, std::atof(argv[++i])));
+    } else {
+      std::printf("Usage: TlsfStressBenchmark [--heap MB] [--ops N] "
+                  "[--fill 0..1]\n");
+      return 1;
+    }
+  }
+
+  CheckScripted();
+  std::printf("Scripted alignment/coalescing: %s\n",
+              g_failures ? "FAIL" : "ok");
+
+  int failures = g_failures;
+  auto start = std::chrono::steady_clock::now();
+  StressResult stress = CheckRandomized(capacity, ops, fill);
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  std::printf("Randomized stress check:       %s\n",
+              g_failures != failures ? "FAIL" : "ok");
+  std::printf("  %d ops on a %.0f MB heap at %.0f%% target fill in %.2f s\n"
+              "  fragmentation %.1f%% mean, %.1f%% peak; %llu failed "
+              "allocations (%llu with enough free bytes)\n\n",
+              ops, capacity / (double)MB, fill * 100.0, seconds,
+              stress.meanFragmentation * 100.0f,
+              stress.peakFragmentation * 100.0f,
+              (unsigned long long)stress.failedAllocations,
+              (unsigned long long)stress.fragmentationFailures);
+
+  std::printf("Free + allocate pair cost, ns\n");
+  std::printf("%8s %10s %10s %12s %9s\n", "live", "heap MB", "TLSF",
+              "first fit", "speedup");
+  for (size_t live : {64, 1024, 16384}) {
+    Measure(live, live >= 16384 ? 20000 : 200000);
+  }
+  return g_failures ? 1 : 0;
+}
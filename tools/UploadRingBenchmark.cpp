@@ -0,0 +1,245 @@
+// Exercises UploadRing, the offset allocator behind the renderer's
+// persistently mapped upload buffer.
+//
+// First a scripted sequence checks wraparound and fence retirement against
+// hand-computed offsets, then a randomized run with several frames in
+// flight checks that no allocation ever overlaps one whose frame has not
+// retired, that every offset honours its alignment and that a drained ring
+// always fits a full-size allocation. Any failure makes the tool exit with
+// status 1. The throughput table measures allocations per second for the
+// renderer's two patterns (256-byte constant buffers and 16-byte aligned
+// instance desc arrays) and a mix of random sizes, with and without copying
+// the data into the ring.
+
+#include "UploadRing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+namespace {
+
+struct Rng {
+  uint32_t state;
+  uint32_t Next() {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+  }
+};
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+void CheckScripted() {
+  UploadRing ring(1024);
+
+  // Frame 1 fills the front half, frame 2 the next quarter.
+  Expect(ring.Allocate(500, 256) == 0, "first allocation at offset 0");
+  ring.FinishFrame(1);
+  Expect(ring.Allocate(200, 256) == 512, "second allocation aligned to 256");
+  ring.FinishFrame(2);
+
+  // 312 bytes remain at the end, 0 at the front: too small for 400.
+  Expect(ring.Allocate(400, 16) == UploadRing::kInvalidOffset,
+         "allocation fails while the wrapped region is still live");
+  Expect(ring.Allocate(300, 16) == 720, "tail of the buffer still usable");
+  ring.FinishFrame(3);
+
+  // Once frame 1 retires the front half is free and the ring wraps.
+  ring.Retire(1);
+  Expect(ring.Allocate(400, 16) == 0, "allocation wraps to offset 0");
+  Expect(ring.Stats().wraps == 1, "wrap counted");
+  Expect(ring.Allocate(200, 16) == UploadRing::kInvalidOffset,
+         "wrapped head stops at frame 2's region");
+  ring.FinishFrame(4);
+
+  // Fence 4 completing implies frames 2 and 3 completed too.
+  ring.Retire(4);
+  Expect(ring.Used() == 0, "everything retired once fence 4 completed");
+  Expect(!ring.HasPendingFrames(), "no pending frames left");
+
+  // A drained ring skips to the start for free instead of padding.
+  uint64_t padding = ring.Stats().paddingBytes;
+  Expect(ring.Allocate(1000, 16) == 0, "drained ring fits almost all of it");
+  Expect(ring.Stats().paddingBytes == padding,
+         "skipping to the start of a drained ring is not padding");
+  Expect(ring.Allocate(32, 16) == UploadRing::kInvalidOffset,
+         "ring is full");
+  Expect(ring.Allocate(2048, 16) == UploadRing::kInvalidOffset,
+         "oversized allocation fails");
+}
+
+struct Live {
+  uint64_t offset;
+  uint64_t size;
+  uint64_t fence;
+};
+
+void CheckRandomized(uint64_t capacity, int frames, uint32_t framesInFlight) {
+  UploadRing ring(capacity);
+  Rng rng{99u};
+  std::deque<Live> live;
+  uint64_t completed = 0;
+
+  for (int f = 1; f <= frames; ++f) {
+    // The GPU finishes frames up to framesInFlight behind the CPU.
+    if ((uint64_t)f > framesInFlight) {
+      completed = f - framesInFlight;
+      ring.Retire(completed);
+      while (!live.empty() && live.front().fence <= completed) {
+        live.pop_front();
+      }
+    }
+
+    int count = 1 + rng.Next() % 12;
+    for (int a = 0; a < count; ++a) {
+      uint64_t alignment = 1ull << (rng.Next() % 9); // 1 .. 256
+      uint64_t size = rng.Next() % (capacity / 16) + (rng.Next() & 1);
+      uint64_t offset = ring.Allocate(size, alignment);
+      if (offset == UploadRing::kInvalidOffset) {
+        continue;
+      }
+      bool fits = offset % alignment == 0 && offset + size <= capacity;
+      bool overlaps = false;
+      for (const Live &l : live) {
+        overlaps |= size && l.size && offset < l.offset + l.size &&
+                    l.offset < offset + size;
+      }
+      Expect(fits, "randomized allocation is aligned and in bounds");
+      Expect(!overlaps, "randomized allocation overlaps a live one");
+      if (!fits || overlaps) {
+        return;
+      }
+      live.push_back({offset, size, (uint64_t)f});
+    }
+    ring.FinishFrame(f);
+  }
+
+  ring.Retire(frames);
+  Expect(ring.Used() == 0, "randomized ring drains completely");
+  Expect(ring.Allocate(capacity, 256) == 0, "drained ring fits its capacity");
+  Expect(ring.Stats().wraps > 0, "randomized run wrapped at least once");
+}
+
+struct Pattern {
+  const char *name;
+  uint64_t minSize;
+  uint64_t maxSize;
+  uint64_t alignment;
+};
+
+void Measure(const Pattern &p, uint64_t capacity, uint32_t framesInFlight,
+             bool copy, double minSeconds) {
+  UploadRing ring(capacity);
+  std::vector<uint8_t> buffer(capacity);
+  std::vector<uint8_t> source(p.maxSize, 0x5a);
+  Rng rng{7u};
+  // Sizes are drawn up front so the timed loop only allocates.
+  std::vector<uint64_t> sizes(4096);
+  for (uint64_t &s : sizes) {
+    s = p.minSize + (p.maxSize > p.minSize
+                         ? rng.Next() % (p.maxSize - p.minSize + 1)
+                         : 0);
+  }
+
+  // Frames hold a fixed budget so the ring always has room, wrap padding
+  // included: the point is the cost of Allocate itself, not of waiting.
+  uint64_t frameBudget = capacity / (framesInFlight + 2);
+  uint64_t allocations = 0, bytes = 0, fence = 0;
+  size_t next = 0;
+  auto start = std::chrono::steady_clock::now();
+  double seconds = 0.0;
+  do {
+    for (int frame = 0; frame < 64; ++frame) {
+      uint64_t used = 0;
+      for (;;) {
+        uint64_t size = sizes[next];
+        if (used + size + p.alignment > frameBudget) {
+          break;
+        }
+        next = (next + 1) & (sizes.size() - 1);
+        uint64_t offset = ring.Allocate(size, p.alignment);
+        if (offset == UploadRing::kInvalidOffset) {
+          Expect(false, "throughput run ran out of ring space");
+          return;
+        }
+        if (copy) {
+          std::memcpy(buffer.data() + offset, source.data(), size);
+        }
+        used += size + p.alignment;
+        bytes += size;
+        ++allocations;
+      }
+      ring.FinishFrame(++fence);
+      if (fence > framesInFlight) {
+        ring.Retire(fence - framesInFlight);
+      }
+    }
+    seconds = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  } while (seconds < minSeconds);
+
+  const UploadRingStats &stats = ring.Stats();
+  std::printf("%-26s %-5s %10.1f %10.2f %8.2f %8.1f%%\n", p.name,
+              copy ? "yes" : "no", allocations / seconds * 1e-6,
+              bytes / seconds / (1u << 30), seconds * 1e9 / allocations,
+              100.0 * stats.paddingBytes /
+                  (double)(stats.bytesAllocated + stats.paddingBytes));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  uint64_t capacity = 4 << 20; // the renderer's ring
+  uint32_t framesInFlight = 2;
+  double minSeconds = 0.25;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--capacity") && i + 1 < argc) {
+      capacity = (uint64_t)std::max(64, std::atoi(argv[++i])) * 1024;
+    } else if (!std::strcmp(argv[i], "--frames-in-flight") && i + 1 < argc) {
+      framesInFlight = (uint32_t)std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      minSeconds = std::atof(argv[++i]);
+    } else {
+      std::printf("Usage: UploadRingBenchmark [--capacity KB] "
+                  "[--frames-in-flight N] [--seconds S]\n");
+      return 1;
+    }
+  }
+
+  CheckScripted();
+  std::printf("Scripted wraparound/retirement: %s\n",
+              g_failures ? "FAIL" : "ok");
+  int failures = g_failures;
+  CheckRandomized(64 * 1024, 20000, framesInFlight);
+  std::printf("Randomized overlap check:       %s\n\n",
+              g_failures != failures ? "FAIL" : "ok");
+
+  const Pattern patterns[] = {
+      {"constants (256 B @ 256)", 256, 256, 256},
+      {"instance descs (52 @ 16)", 52 * 64, 52 * 64, 16},
+      {"mixed 16..4096 B @ 16", 16, 4096, 16},
+  };
+
+  std::printf("%.0f KB ring, %u frames in flight\n\n", capacity / 1024.0,
+              framesInFlight);
+  std::printf("%-26s %-5s %10s %10s %8s %9s\n", "pattern", "copy",
+              "Malloc/s", "GB/s", "ns/alloc", "padding");
+  for (const Pattern &p : patterns) {
+    Measure(p, capacity, framesInFlight, false, minSeconds);
+    Measure(p, capacity, framesInFlight, true, minSeconds);
+  }
+  return g_failures ? 1 : 0;
+}
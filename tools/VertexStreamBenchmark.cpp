@@ -0,0 +1,342 @@
+// Exercises VertexStreams, the split position/attribute layout the renderer
+// uploads, and its octahedral normal and SNORM16 position codecs.
+//
+// Checks that octahedral normals come back within kOctahedralMaxError of
+// the input over random directions and the awkward ones (axes, the folded
+// diagonals, signed zeros, the z = 0 seam), that decoded normals are unit
+// length, that SNORM16 positions come back within half a quantization step,
+// and that the four-wide batch codecs produce the same bits as the scalar
+// functions for every count and for MeshVertex-strided input. Any failure
+// makes the tool exit with status 1. The table lists each stream's bytes
+// per vertex and times the codecs, scalar and batched, in vertices per
+// microsecond.
+
+#include "MeshGenerator.h"
+#include "SceneInstances.h"
+#include "VertexStreams.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+int g_failures = 0;
+
+void Expect(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+  }
+}
+
+struct Rng {
+  uint32_t state;
+  float Next() {
+    state = state * 1664525u + 1013904223u;
+    return (float)(state >> 8) * (1.0f / 16777216.0f);
+  }
+  uint32_t NextU32() {
+    state = state * 1664525u + 1013904223u;
+    return state;
+  }
+  Float3 OnUnitSphere() {
+    for (;;) {
+      Float3 p = {Next() * 2.0f - 1.0f, Next() * 2.0f - 1.0f,
+                  Next() * 2.0f - 1.0f};
+      float d = Dot(p, p);
+      if (d > 1e-4f && d <= 1.0f) {
+        return Normalize(p);
+      }
+    }
+  }
+};
+
+// Angle between two unit vectors, accurate near zero where acos is not.
+double AngleBetween(Float3 a, Float3 b) {
+  double dx = (double)a.x - b.x, dy = (double)a.y - b.y,
+         dz = (double)a.z - b.z;
+  return 2.0 * std::asin(std::min(1.0, std::sqrt(dx * dx + dy * dy + dz * dz) *
+                                           0.5));
+}
+
+std::vector<Float3> MakeNormals(size_t count) {
+  Rng rng{2024u};
+  std::vector<Float3> normals;
+  const float s = std::sqrt(0.5f), t = 1.0f / std::sqrt(3.0f);
+  for (float a : {-1.0f, 1.0f}) {
+    normals.push_back({a, 0.0f, 0.0f});
+    normals.push_back({0.0f, a, 0.0f});
+    normals.push_back({0.0f, 0.0f, a});
+    normals.push_back({-0.0f, -0.0f, a});
+    normals.push_back({a * s, s, 0.0f});
+    normals.push_back({a * s, -s, -0.0f});
+    normals.push_back({a * s, 0.0f, -s});
+    normals.push_back({0.0f, a * s, -s});
+    for (float b : {-1.0f, 1.0f}) {
+      normals.push_back({a * t, b * t, -t});
+      normals.push_back({a * t, b * t, t});
+    }
+  }
+  // Just either side of the seam the lower hemisphere folds along.
+  for (int i = 0; i < 64; ++i) {
+    Float3 n = rng.OnUnitSphere();
+    normals.push_back(Normalize({n.x, n.y, 1e-7f}));
+    normals.push_back(Normalize({n.x, n.y, -1e-7f}));
+  }
+  while (normals.size() < count) {
+    normals.push_back(rng.OnUnitSphere());
+  }
+  return normals;
+}
+
+bool SameBits(const void *a, const void *b, size_t bytes) {
+  return !std::memcmp(a, b, bytes);
+}
+
+void CheckOctahedral(const std::vector<Float3> &normals, double &maxAngle) {
+  maxAngle = 0.0;
+  double maxLengthError = 0.0;
+  for (Float3 n : normals) {
+    Float3 d = DecodeOctahedral(EncodeOctahedral(n));
+    maxAngle = std::max(maxAngle, AngleBetween(n, d));
+    maxLengthError = std::max(maxLengthError, std::fabs(Length(d) - 1.0));
+  }
+  Expect(maxAngle <= kOctahedralMaxError,
+         "octahedral normals come back within kOctahedralMaxError");
+  Expect(maxLengthError < 1e-6, "decoded normals are unit length");
+
+  Float3 zero = DecodeOctahedral(EncodeOctahedral({0.0f, 0.0f, 0.0f}));
+  Expect(zero.x == 0.0f && zero.y == 0.0f && zero.z == 1.0f,
+         "a zero vector decodes as +z");
+
+  // Codes no encoder emits (-32768) still decode to unit vectors.
+  Float3 corner = DecodeOctahedral(0x80008000u);
+  Expect(std::fabs(Length(corner) - 1.0f) < 1e-6f && corner.z == -1.0f,
+         "the -32768 corner decodes as -z");
+}
+
+void CheckBatchMatchesScalar(const std::vector<Float3> &normals) {
+  bool encodeSame = true, decodeSame = true;
+  for (size_t count : {size_t(0), size_t(1), size_t(3), size_t(4), size_t(7),
+                       size_t(64), normals.size()}) {
+    std::vector<uint32_t> batch(count), scalar(count);
+    EncodeOctahedralNormals(normals.data(), sizeof(Float3), count,
+                            batch.data());
+    for (size_t i = 0; i < count; ++i) {
+      scalar[i] = EncodeOctahedral(normals[i]);
+    }
+    encodeSame &= SameBits(batch.data(), scalar.data(), count * 4);
+
+    std::vector<Float3> decoded(count), reference(count);
+    DecodeOctahedralNormals(batch.data(), count, decoded.data());
+    for (size_t i = 0; i < count; ++i) {
+      reference[i] = DecodeOctahedral(batch[i]);
+    }
+    decodeSame &= SameBits(decoded.data(), reference.data(),
+                           count * sizeof(Float3));
+  }
+  Expect(encodeSame, "batch octahedral encode matches the scalar bits");
+  Expect(decodeSame, "batch octahedral decode matches the scalar bits");
+
+  // Arbitrary codes, including ones the encoder never produces.
+  Rng rng{99u};
+  std::vector<uint32_t> codes(4099);
+  for (uint32_t &code : codes) {
+    code = rng.NextU32();
+  }
+  std::vector<Float3> decoded(codes.size());
+  DecodeOctahedralNormals(codes.data(), codes.size(), decoded.data());
+  bool same = true;
+  for (size_t i = 0; i < codes.size(); ++i) {
+    Float3 reference = DecodeOctahedral(codes[i]);
+    same &= SameBits(&decoded[i], &reference, sizeof(Float3));
+  }
+  Expect(same, "batch octahedral decode matches on arbitrary codes");
+}
+
+void CheckSnorm16(const std::vector<MeshVertex> &vertices) {
+  const Float3 *positions = &vertices[0].position;
+  size_t count = vertices.size();
+  float scale = Snorm16Scale(positions, sizeof(MeshVertex), count);
+
+  std::vector<int16_t> batch(count * 4), scalar(count * 4);
+  EncodePositionsSnorm16(positions, sizeof(MeshVertex), count, scale,
+                         batch.data());
+  for (size_t i = 0; i < count; ++i) {
+    // One vertex at a time takes the scalar tail.
+    EncodePositionsSnorm16(&vertices[i].position, sizeof(MeshVertex), 1, scale,
+                           &scalar[4 * i]);
+  }
+  Expect(batch == scalar, "batch SNORM16 encode matches the scalar bits");
+
+  bool wZero = true;
+  for (size_t i = 0; i < count; ++i) {
+    wZero &= batch[4 * i + 3] == 0;
+  }
+  Expect(wZero, "SNORM16 positions carry w = 0");
+
+  std::vector<Float3> decoded(count);
+  DecodePositionsSnorm16(batch.data(), count, scale, decoded.data());
+  // Half a step, plus the float rounding of scaling in and out.
+  float bound = Snorm16MaxError(scale) + scale * 1e-6f;
+  bool within = true, decodeSame = true;
+  for (size_t i = 0; i < count; ++i) {
+    Float3 p = vertices[i].position, d = decoded[i];
+    within &= std::fabs(p.x - d.x) <= bound && std::fabs(p.y - d.y) <= bound &&
+              std::fabs(p.z - d.z) <= bound;
+    Float3 reference;
+    DecodePositionsSnorm16(&batch[4 * i], 1, scale, &reference);
+    decodeSame &= SameBits(&reference, &d, sizeof(Float3));
+  }
+  Expect(within, "SNORM16 positions come back within half a step");
+  Expect(decodeSame, "batch SNORM16 decode matches the scalar bits");
+}
+
+void CheckStreams(const std::vector<MeshVertex> &vertices) {
+  VertexStreams streams;
+  BuildVertexStreams(vertices, streams);
+  bool positions = streams.positions.size() == vertices.size() &&
+                   streams.attributes.size() == vertices.size();
+  bool normals = positions;
+  for (size_t i = 0; positions && i < vertices.size(); ++i) {
+    positions &= SameBits(&streams.positions[i], &vertices[i].position,
+                          sizeof(Float3));
+    normals &= AngleBetween(DecodeOctahedral(streams.attributes[i].normal),
+                            vertices[i].normal) <= kOctahedralMaxError;
+  }
+  Expect(positions, "the position stream is the vertices' positions");
+  Expect(normals, "the attribute stream holds the vertices' normals");
+}
+
+// Vertices per microsecond for fn over count vertices.
+template <typename Fn> double Rate(size_t count, double minSeconds, Fn fn) {
+  size_t runs = 0;
+  auto start = std::chrono::steady_clock::now();
+  double seconds = 0.0;
+  do {
+    fn();
+    ++runs;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            start)
+                  .count();
+  } while (seconds < minSeconds);
+  return (double)(runs * count) / (seconds * 1e6);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t count = 1 << 20;
+  double minSeconds = 0.25;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--vertices") && i + 1 < argc) {
+      count = (size_t)std::max(16, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      minSeconds = std::atof(argv[++i]);
+    } else {
+      std::printf("Usage: VertexStreamBenchmark [--vertices N] [--seconds S]\n");
+      return 1;
+    }
+  }
+
+  std::vector<MeshVertex> vertices;
+  std::vector<uint32_t> indices;
+  GenerateSphere(vertices, indices, kSphereRadius, kSphereSlices,
+                 kSphereStacks);
+  GeneratePlane(vertices, indices, kPlaneSize, kPlaneSize);
+
+  std::vector<Float3> normals = MakeNormals(count);
+  double maxAngle = 0.0;
+  CheckOctahedral(normals, maxAngle);
+  CheckBatchMatchesScalar(normals);
+  CheckSnorm16(vertices);
+  CheckStreams(vertices);
+  std::printf("Vertex stream checks: %s\n", g_failures ? "FAIL" : "ok");
+  std::printf("octahedral max error %.3g rad (%.5f deg), bound %.3g rad\n\n",
+              maxAngle, maxAngle * 180.0 / 3.14159265358979,
+              (double)kOctahedralMaxError);
+
+  std::printf("%-28s %6s %14s\n", "stream", "bytes", "per 64B line");
+  struct Layout {
+    const char *name;
+    size_t bytes;
+  } layouts[] = {{"MeshVertex (interleaved)", sizeof(MeshVertex)},
+                 {"position float3", sizeof(Float3)},
+                 {"position SNORM16x4", 4 * sizeof(int16_t)},
+                 {"attributes (oct normal)", sizeof(VertexAttributes)}};
+  for (const Layout &layout : layouts) {
+    std::printf("%-28s %6zu %14.1f\n", layout.name, layout.bytes,
+                64.0 / (double)layout.bytes);
+  }
+
+  std::vector<uint32_t> codes(count);
+  std::vector<Float3> decoded(count);
+  std::vector<int16_t> snorm(count * 4);
+  float scale = Snorm16Scale(normals.data(), sizeof(Float3), count);
+  volatile uint32_t sink = 0;
+
+  std::printf("\n%-28s %10s %10s\n", "codec (vertices/us)", "scalar",
+              "batch");
+  std::printf(
+      "%-28s %10.1f %10.1f\n", "octahedral encode",
+      Rate(count, minSeconds,
+           [&] {
+             for (size_t i = 0; i < count; ++i) {
+               codes[i] = EncodeOctahedral(normals[i]);
+             }
+             sink = sink + codes[count / 2];
+           }),
+      Rate(count, minSeconds, [&] {
+        EncodeOctahedralNormals(normals.data(), sizeof(Float3), count,
+                                codes.data());
+        sink = sink + codes[count / 2];
+      }));
+  std::printf(
+      "%-28s %10.1f %10.1f\n", "octahedral decode",
+      Rate(count, minSeconds,
+           [&] {
+             for (size_t i = 0; i < count; ++i) {
+               decoded[i] = DecodeOctahedral(codes[i]);
+             }
+             sink = sink + (uint32_t)decoded[count / 2].x;
+           }),
+      Rate(count, minSeconds, [&] {
+        DecodeOctahedralNormals(codes.data(), count, decoded.data());
+        sink = sink + (uint32_t)decoded[count / 2].x;
+      }));
+  std::printf(
+      "%-28s %10.1f %10.1f\n", "SNORM16 position encode",
+      Rate(count, minSeconds,
+           [&] {
+             for (size_t i = 0; i < count; ++i) {
+               EncodePositionsSnorm16(&normals[i], sizeof(Float3), 1, scale,
+                                      &snorm[4 * i]);
+             }
+             sink = sink + (uint32_t)snorm[count];
+           }),
+      Rate(count, minSeconds, [&] {
+        EncodePositionsSnorm16(normals.data(), sizeof(Float3), count, scale,
+                               snorm.data());
+        sink = sink + (uint32_t)snorm[count];
+      }));
+  std::printf(
+      "%-28s %10.1f %10.1f\n", "SNORM16 position decode",
+      Rate(count, minSeconds,
+           [&] {
+             for (size_t i = 0; i < count; ++i) {
+               DecodePositionsSnorm16(&snorm[4 * i], 1, scale, &decoded[i]);
+             }
+             sink = sink + (uint32_t)decoded[count / 2].x;
+           }),
+      Rate(count, minSeconds, [&] {
+        DecodePositionsSnorm16(snorm.data(), count, scale, decoded.data());
+        sink = sink + (uint32_t)decoded[count / 2].x;
+      }));
+
+  return g_failures ? 1 : 0;
+}